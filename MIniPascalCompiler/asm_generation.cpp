@@ -0,0 +1,1201 @@
+#include "asm_generation.h"
+#include "ast.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static const char* const intArgRegisters[] = { "%edi", "%esi", "%edx", "%ecx", "%r8d", "%r9d" };
+static const unsigned INT_ARG_REGISTERS = 6;
+
+static const unsigned REAL_ARG_REGISTERS = 8;
+
+// By PhysicalRegister
+static const char* const registerNames32[] = { "%ebx", "%r12d", "%r13d", "%r14d", "%r15d", "%r10d", "%r11d" };
+static const char* const registerNames64[] = { "%rbx", "%r12", "%r13", "%r14", "%r15", "%r10", "%r11" };
+static const char* const xmmNames[] = { "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15" };
+
+// Where System V puts one parameter: a register, or memory at `offset` in
+// the argument area.
+struct ArgumentSlot {
+    bool inMemory;
+    bool real;
+    unsigned reg;
+    uint32_t offset;
+};
+
+static std::vector<ArgumentSlot> classifyArguments(const SemanticInfo& info, const SubprogramInfo& subprogram,
+                                                   uint32_t& memoryBytes) {
+    std::vector<ArgumentSlot> slots;
+    unsigned intRegs = 0;
+    unsigned realRegs = 0;
+    memoryBytes = 0;
+    for (uint32_t i = 0; i < subprogram.paramCount; ++i) {
+        const VariableInfo& param = info.variables[subprogram.firstParam + i];
+        ArgumentSlot slot = { false, param.type.baseType == DataType::REAL, 0, 0 };
+        if (param.type.baseType == DataType::ARRAY) slot.inMemory = true;
+        else if (slot.real && realRegs < REAL_ARG_REGISTERS) slot.reg = realRegs++;
+        else if (!slot.real && intRegs < INT_ARG_REGISTERS) slot.reg = intRegs++;
+        else slot.inMemory = true;
+
+        if (slot.inMemory) {
+            slot.offset = memoryBytes;
+            memoryBytes += 8 * param.cells;
+        }
+        slots.push_back(slot);
+    }
+    return slots;
+}
+
+static const char* conditionCode(OpKind op) {
+    switch (op) {
+    case OP_EQ: return "e";
+    case OP_NEQ: return "ne";
+    case OP_LT: return "l";
+    case OP_LE: return "le";
+    case OP_GT: return "g";
+    default: return "ge";
+    }
+}
+
+static OpKind negated(OpKind op) {
+    switch (op) {
+    case OP_EQ: return OP_NEQ;
+    case OP_NEQ: return OP_EQ;
+    case OP_LT: return OP_GE;
+    case OP_LE: return OP_GT;
+    case OP_GT: return OP_LE;
+    default: return OP_LT;
+    }
+}
+
+// movsd between registers merges into the destination's upper half and
+// waits on its last writer; movapd does not
+static const char* realMove(const std::string& source, const std::string& destination) {
+    return source[0] == '%' && destination[0] == '%' ? "    movapd " : "    movsd ";
+}
+
+static bool isRelational(OpKind op) {
+    return op >= OP_EQ && op <= OP_GE;
+}
+
+AsmGenerator::AsmGenerator(const std::string& outputFilename)
+    : ast(nullptr), info(nullptr), current(nullptr), frameBytes(0), pushed(0), labelCount(0), allocate(true),
+      nextLoad(0), nextStore(0), position(0), vectorize(true), vectorized(0) {
+    outFile.open(outputFilename);
+    if (!outFile.is_open()) {
+        std::cerr << "Error: Could not open output file: " << outputFilename << std::endl;
+        exit(1);
+    }
+}
+
+void AsmGenerator::generate(const AstArena& tree, NodeId root, const SemanticInfo& semanticInfo) {
+    if (!root) return;
+
+    ast = &tree;
+    info = &semanticInfo;
+    stats = RegisterAllocationStats();
+    if (allocate) findSharedGlobals(tree, semanticInfo, sharedGlobals);
+    vectorLoops.clear();
+    vectorLoopOf.clear();
+    vectorized = 0;
+    if (vectorize) findVectorLoops(tree, root, semanticInfo, vectorLoops);
+    for (size_t i = 0; i < vectorLoops.size(); ++i) vectorLoopOf[vectorLoops[i].loop] = i;
+    outFile << "# Generated from program " << tree.nodeName(root) << "\n";
+    outFile << "    .text\n";
+
+    emitEntryPoint();
+    emitMain(ast->child(root, 2));
+    for (const SubprogramInfo& subprogram : info->subprograms) {
+        if (subprogram.isReachable) emitSubprogram(subprogram);
+    }
+    emitRuntime();
+    emitData();
+
+    outFile.close();
+}
+
+void AsmGenerator::emitLabel(int label) {
+    outFile << ".L" << label << ":\n";
+}
+
+void AsmGenerator::emitEntryPoint() {
+    outFile << "    .globl _start\n"
+            << "_start:\n"
+            << "    call pascal_main\n";
+
+    for (const VariableInfo& variable : info->variables) {
+        if (variable.storage != Storage::GLOBAL || variable.type.baseType == DataType::ARRAY || variable.isTemporary)
+            continue;
+
+        const char* name = nameOf(variable.name);
+        outFile << "    leaq s_" << name << "(%rip), %rdi\n"
+                << "    movl $" << std::strlen(name) + 3 << ", %esi\n"
+                << "    call rt_write\n";
+        if (variable.type.baseType == DataType::REAL) {
+            outFile << "    movsd v_" << name << "(%rip), %xmm0\n"
+                    << "    call rt_print_real\n";
+        }
+        else {
+            outFile << "    movl v_" << name << "(%rip), %edi\n"
+                    << "    call " << (variable.type.baseType == DataType::BOOLEAN ? "rt_print_bool" : "rt_print_int") << "\n";
+        }
+        outFile << "    leaq rt_newline(%rip), %rdi\n"
+                << "    movl $1, %esi\n"
+                << "    call rt_write\n";
+    }
+
+    outFile << "    call rt_flush\n"
+            << "    movl $60, %eax\n"
+            << "    xorl %edi, %edi\n"
+            << "    syscall\n\n";
+}
+
+void AsmGenerator::emitMain(NodeId body) {
+    current = nullptr;
+    frameBytes = 0;
+    pushed = 0;
+    outFile << "pascal_main:\n";
+    emitPrologue(body);
+    visitStatement(body);
+    emitEpilogue();
+}
+
+// Allocates registers for the routine, then sets up its frame: variable
+// cells first, below them the callee-saved registers it uses.
+void AsmGenerator::emitPrologue(NodeId body) {
+    if (allocate) {
+        allocateRegisters(*ast, *info, body, allocation, stats);
+    }
+    else {
+        allocation.intervals.clear();
+        allocation.location.assign(info->variables.size(), NO_REGISTER);
+        allocation.calleeSaved = 0;
+    }
+    byEnd.clear();
+    for (uint32_t i = 0; i < allocation.intervals.size(); ++i) {
+        if (allocation.intervals[i].reg != NO_REGISTER) byEnd.push_back(i);
+    }
+    std::stable_sort(byEnd.begin(), byEnd.end(), [this](uint32_t a, uint32_t b) {
+        return allocation.intervals[a].end < allocation.intervals[b].end;
+    });
+    nextLoad = 0;
+    nextStore = 0;
+
+    outFile << "    pushq %rbp\n"
+            << "    movq %rsp, %rbp\n";
+    uint32_t total = frameBytes + ((allocation.calleeSaved * 8 + 15) & ~15u);
+    if (total) outFile << "    subq $" << total << ", %rsp\n";
+    for (uint32_t i = 0; i < allocation.calleeSaved; ++i) {
+        outFile << "    movq " << registerNames64[i] << ", " << -static_cast<int32_t>(frameBytes + 8 * (i + 1)) << "(%rbp)\n";
+    }
+}
+
+void AsmGenerator::emitEpilogue() {
+    for (uint32_t i = 0; i < allocation.calleeSaved; ++i) {
+        outFile << "    movq " << -static_cast<int32_t>(frameBytes + 8 * (i + 1)) << "(%rbp), " << registerNames64[i] << "\n";
+    }
+    outFile << "    leave\n"
+            << "    ret\n\n";
+}
+
+// A register-allocated variable is loaded from its home when its interval
+// starts and, if it is a global it wrote, stored back when it ends.
+void AsmGenerator::enterStatement(NodeId node) {
+    if (allocation.intervals.empty()) return;
+
+    position = allocation.statementStart[node];
+    while (nextLoad < allocation.intervals.size() && allocation.intervals[nextLoad].start <= position) {
+        const LiveInterval& interval = allocation.intervals[nextLoad++];
+        if (interval.reg == NO_REGISTER || !interval.needsLoad) continue;
+        const VariableInfo& variable = info->variables[interval.variable];
+        outFile << (interval.real ? "    movsd " : "    movl ") << home(variable) << ", " << cell(variable) << "\n";
+        ++stats.loads;
+    }
+}
+
+void AsmGenerator::leaveStatement(NodeId node) {
+    if (byEnd.empty()) return;
+
+    uint32_t end = allocation.statementEnd[node];
+    while (nextStore < byEnd.size() && allocation.intervals[byEnd[nextStore]].end == end) {
+        const LiveInterval& interval = allocation.intervals[byEnd[nextStore++]];
+        const VariableInfo& variable = info->variables[interval.variable];
+        if (variable.storage != Storage::GLOBAL || !interval.written) continue;
+        outFile << (interval.real ? "    movsd " : "    movl ") << cell(variable) << ", " << home(variable) << "\n";
+        ++stats.stores;
+    }
+}
+
+// Subprograms see globals in memory: registers holding globals they use are
+// written back before a call and reloaded after it.
+void AsmGenerator::syncSharedGlobals(bool reload) {
+    for (const LiveInterval& interval : allocation.intervals) {
+        if (interval.reg == NO_REGISTER || interval.start > position || interval.end < position) continue;
+        if (!sharedGlobals[interval.variable] || (!reload && !interval.written)) continue;
+
+        const VariableInfo& variable = info->variables[interval.variable];
+        const char* move = interval.real ? "    movsd " : "    movl ";
+        if (reload) {
+            outFile << move << home(variable) << ", " << cell(variable) << "\n";
+            ++stats.loads;
+        }
+        else {
+            outFile << move << cell(variable) << ", " << home(variable) << "\n";
+            ++stats.stores;
+        }
+    }
+}
+
+void AsmGenerator::emitSubprogram(const SubprogramInfo& subprogram) {
+    current = &subprogram;
+    frameBytes = (subprogram.frameCells * 8 + 15) & ~15u;
+    pushed = 0;
+
+    NodeId body = ast->child(subprogram.node, 2);
+    outFile << "p_" << nameOf(subprogram.name) << ":\n";
+    emitPrologue(body);
+
+    // Register arguments first: copying the memory ones uses rdi, rsi, rcx
+    uint32_t memoryBytes;
+    std::vector<ArgumentSlot> slots = classifyArguments(*info, subprogram, memoryBytes);
+    for (uint32_t i = 0; i < subprogram.paramCount; ++i) {
+        if (slots[i].inMemory) continue;
+        const VariableInfo& param = info->variables[subprogram.firstParam + i];
+        if (slots[i].real) outFile << "    movsd %xmm" << slots[i].reg << ", " << home(param) << "\n";
+        else outFile << "    movl " << intArgRegisters[slots[i].reg] << ", " << home(param) << "\n";
+    }
+    for (uint32_t i = 0; i < subprogram.paramCount; ++i) {
+        if (!slots[i].inMemory) continue;
+        const VariableInfo& param = info->variables[subprogram.firstParam + i];
+        if (param.type.baseType == DataType::ARRAY) {
+            outFile << "    leaq " << 16 + slots[i].offset << "(%rbp), %rsi\n"
+                    << "    leaq " << home(param) << ", %rdi\n"
+                    << "    movl $" << param.cells << ", %ecx\n"
+                    << "    rep movsq\n";
+        }
+        else {
+            outFile << "    movq " << 16 + slots[i].offset << "(%rbp), %rax\n"
+                    << "    movq %rax, " << home(param) << "\n";
+        }
+    }
+
+    // The result and the locals start out zero, as in the interpreters
+    uint32_t locals = subprogram.frameCells - subprogram.paramCells;
+    int32_t first = static_cast<int32_t>(subprogram.paramCells * 8) - static_cast<int32_t>(frameBytes);
+    if (locals > 8) {
+        outFile << "    leaq " << first << "(%rbp), %rdi\n"
+                << "    xorl %eax, %eax\n"
+                << "    movl $" << locals << ", %ecx\n"
+                << "    rep stosq\n";
+    }
+    else {
+        for (uint32_t i = 0; i < locals; ++i) outFile << "    movq $0, " << first + 8 * static_cast<int32_t>(i) << "(%rbp)\n";
+    }
+
+    visitStatement(body);
+
+    if (subprogram.isFunction) {
+        int32_t result = static_cast<int32_t>(subprogram.resultSlot * 8) - static_cast<int32_t>(frameBytes);
+        if (subprogram.returnType == DataType::REAL) outFile << "    movsd " << result << "(%rbp), %xmm0\n";
+        else outFile << "    movl " << result << "(%rbp), %eax\n";
+    }
+    emitEpilogue();
+}
+
+// Output is collected in a buffer and written with one write(2) at exit.
+void AsmGenerator::emitRuntime() {
+    outFile << R"(rt_write:
+    movq rt_used(%rip), %rax
+    leaq (%rax,%rsi), %rdx
+    cmpq $4096, %rdx
+    jbe 1f
+    pushq %rdi
+    pushq %rsi
+    subq $8, %rsp
+    call rt_flush
+    addq $8, %rsp
+    popq %rsi
+    popq %rdi
+    xorl %eax, %eax
+1:  leaq rt_buffer(%rip), %rdx
+    addq %rax, %rdx
+    addq %rsi, %rax
+    movq %rax, rt_used(%rip)
+    movq %rsi, %rcx
+    movq %rdi, %rsi
+    movq %rdx, %rdi
+    rep movsb
+    ret
+
+rt_flush:
+    movq rt_used(%rip), %rdx
+    testq %rdx, %rdx
+    jz 1f
+    movl $1, %eax
+    movl $1, %edi
+    leaq rt_buffer(%rip), %rsi
+    syscall
+    movq $0, rt_used(%rip)
+1:  ret
+
+rt_print_u64:
+    subq $40, %rsp
+    movq %rdi, %rax
+    leaq 32(%rsp), %rdi
+    movq %rdi, %r8
+    movl $10, %ecx
+1:  xorl %edx, %edx
+    divq %rcx
+    addb $48, %dl
+    decq %rdi
+    movb %dl, (%rdi)
+    testq %rax, %rax
+    jnz 1b
+    movq %r8, %rsi
+    subq %rdi, %rsi
+    call rt_write
+    addq $40, %rsp
+    ret
+
+rt_print_int:
+    subq $8, %rsp
+    movslq %edi, %rdi
+    testq %rdi, %rdi
+    jns 1f
+    negq %rdi
+    movq %rdi, (%rsp)
+    leaq rt_minus(%rip), %rdi
+    movl $1, %esi
+    call rt_write
+    movq (%rsp), %rdi
+1:  call rt_print_u64
+    addq $8, %rsp
+    ret
+
+rt_print_bool:
+    testl %edi, %edi
+    jz 1f
+    leaq rt_true(%rip), %rdi
+    movl $4, %esi
+    jmp rt_write
+1:  leaq rt_false(%rip), %rdi
+    movl $5, %esi
+    jmp rt_write
+
+# Six decimals below 1e12, otherwise d.dddddde+N
+rt_print_real:
+    subq $40, %rsp
+    ucomisd %xmm0, %xmm0
+    jp 5f
+    movq %xmm0, %rax
+    btrq $63, %rax
+    jnc 1f
+    movq %rax, 24(%rsp)
+    leaq rt_minus(%rip), %rdi
+    movl $1, %esi
+    call rt_write
+    movq 24(%rsp), %rax
+1:  movq %rax, %xmm0
+    ucomisd rt_big(%rip), %xmm0
+    jae 3f
+    mulsd rt_million(%rip), %xmm0
+    cvtsd2si %xmm0, %rax
+    xorl %edx, %edx
+    movl $1000000, %ecx
+    divq %rcx
+    movq %rdx, 24(%rsp)
+    movq %rax, %rdi
+    call rt_print_u64
+    leaq rt_dot(%rip), %rdi
+    movl $1, %esi
+    call rt_write
+    movq 24(%rsp), %rax
+    leaq 16(%rsp), %rdi
+    movl $6, %r8d
+    movl $10, %ecx
+2:  xorl %edx, %edx
+    divq %rcx
+    addb $48, %dl
+    decq %rdi
+    movb %dl, (%rdi)
+    decl %r8d
+    jnz 2b
+    leaq 10(%rsp), %rdi
+    movl $6, %esi
+    call rt_write
+    addq $40, %rsp
+    ret
+3:  ucomisd rt_infinity(%rip), %xmm0
+    je 6f
+    xorl %eax, %eax
+    movsd rt_ten(%rip), %xmm1
+4:  divsd %xmm1, %xmm0
+    incq %rax
+    ucomisd %xmm1, %xmm0
+    jae 4b
+    movq %rax, 24(%rsp)
+    call rt_print_real
+    leaq rt_exponent(%rip), %rdi
+    movl $2, %esi
+    call rt_write
+    movq 24(%rsp), %rdi
+    call rt_print_u64
+    addq $40, %rsp
+    ret
+5:  leaq rt_nan(%rip), %rdi
+    movl $3, %esi
+    call rt_write
+    addq $40, %rsp
+    ret
+6:  leaq rt_inf(%rip), %rdi
+    movl $3, %esi
+    call rt_write
+    addq $40, %rsp
+    ret
+
+rt_division_by_zero:
+    leaq rt_message_division(%rip), %rsi
+    movl $(rt_message_index - rt_message_division), %edx
+    jmp rt_fail
+rt_index_error:
+    leaq rt_message_index(%rip), %rsi
+    movl $(rt_message_end - rt_message_index), %edx
+rt_fail:
+    movl $1, %eax
+    movl $2, %edi
+    syscall
+    movl $60, %eax
+    movl $1, %edi
+    syscall
+
+    .section .rodata
+rt_minus: .ascii "-"
+rt_dot: .ascii "."
+rt_newline: .ascii "\n"
+rt_true: .ascii "true"
+rt_false: .ascii "false"
+rt_exponent: .ascii "e+"
+rt_nan: .ascii "nan"
+rt_inf: .ascii "inf"
+rt_message_division: .ascii "Runtime error: division by zero\n"
+rt_message_index: .ascii "Runtime error: array index out of range\n"
+rt_message_end:
+    .balign 8
+rt_big: .double 1e12
+rt_million: .double 1e6
+rt_ten: .double 10.0
+rt_infinity: .quad 0x7ff0000000000000
+)";
+}
+
+void AsmGenerator::emitData() {
+    for (size_t i = 0; i < realConstants.size(); ++i) {
+        uint64_t bits;
+        std::memcpy(&bits, &realConstants[i], sizeof bits);
+        outFile << ".LC" << i << ": .quad 0x" << std::hex << bits << std::dec << "\n";
+    }
+    for (const VariableInfo& variable : info->variables) {
+        if (variable.storage == Storage::GLOBAL && variable.type.baseType != DataType::ARRAY && !variable.isTemporary)
+            outFile << "s_" << nameOf(variable.name) << ": .ascii \"" << nameOf(variable.name) << " = \"\n";
+    }
+
+    outFile << "\n    .bss\n"
+            << "    .balign 16\n"
+            << "rt_buffer: .zero 4096\n"
+            << "rt_used: .zero 8\n";
+    for (const VariableInfo& variable : info->variables) {
+        if (variable.storage == Storage::GLOBAL && !variable.isUnused)
+            outFile << "v_" << nameOf(variable.name) << ": .zero " << 8 * variable.cells << "\n";
+    }
+}
+
+std::string AsmGenerator::cell(const VariableInfo& variable) const {
+    uint32_t index = static_cast<uint32_t>(&variable - info->variables.data());
+    if (!allocation.location.empty() && allocation.inRegister(index)) {
+        uint8_t reg = allocation.location[index];
+        return reg >= REG_XMM8 ? xmmNames[reg - REG_XMM8] : registerNames32[reg];
+    }
+    return home(variable);
+}
+
+std::string AsmGenerator::home(const VariableInfo& variable) const {
+    if (variable.storage == Storage::GLOBAL) return std::string("v_") + nameOf(variable.name) + "(%rip)";
+    return std::to_string(static_cast<int32_t>(variable.slot * 8) - static_cast<int32_t>(frameBytes)) + "(%rbp)";
+}
+
+void AsmGenerator::arrayAddress(const VariableInfo& variable, const char* reg) {
+    outFile << "    leaq " << home(variable) << ", " << reg << "\n";
+}
+
+// Evaluates the index into rax, checks it against the bounds and returns
+// the element's memory operand; global arrays also use rdx.
+std::string AsmGenerator::element(NodeId access) {
+    const VariableInfo& array = info->variable(access);
+    visitExpression(ast->child(access, 0));
+    if (array.type.arrayStart != 0) outFile << "    subl $" << array.type.arrayStart << ", %eax\n";
+    if (!info->boundsProven[access]) {
+        outFile << "    cmpl $" << array.cells << ", %eax\n"
+                << "    jae rt_index_error\n";
+    }
+    if (array.storage == Storage::GLOBAL) {
+        arrayAddress(array, "%rdx");
+        return "(%rdx,%rax,8)";
+    }
+    return std::to_string(static_cast<int32_t>(array.slot * 8) - static_cast<int32_t>(frameBytes)) + "(%rbp,%rax,8)";
+}
+
+// Literals and scalar variables can be used in place as instruction operands.
+bool AsmGenerator::simpleOperand(NodeId node, std::string& operand) {
+    const ASTNode& n = ast->node(node);
+    switch (n.type) {
+    case NODE_INT_NUM:
+        operand = "$" + std::to_string(n.intVal);
+        return true;
+    case NODE_BOOLEAN:
+        operand = n.boolVal ? "$1" : "$0";
+        return true;
+    case NODE_REAL_NUM:
+        operand = realConstant(n.realVal);
+        return true;
+    case NODE_VARIABLE:
+        if (info->ref(node).kind != RefKind::VARIABLE || info->variable(node).type.baseType == DataType::ARRAY)
+            return false;
+        operand = cell(info->variable(node));
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::string AsmGenerator::realConstant(double value) {
+    realConstants.push_back(value);
+    return ".LC" + std::to_string(realConstants.size() - 1) + "(%rip)";
+}
+
+void AsmGenerator::pushInt() {
+    outFile << "    pushq %rax\n";
+    pushed += 8;
+}
+
+void AsmGenerator::popInt(const char* reg) {
+    outFile << "    popq " << reg << "\n";
+    pushed -= 8;
+}
+
+void AsmGenerator::pushReal() {
+    outFile << "    subq $8, %rsp\n"
+            << "    movsd %xmm0, (%rsp)\n";
+    pushed += 8;
+}
+
+void AsmGenerator::popReal(const char* reg) {
+    outFile << "    movsd (%rsp), " << reg << "\n"
+            << "    addq $8, %rsp\n";
+    pushed -= 8;
+}
+
+void AsmGenerator::visitStatement(NodeId node) {
+    if (!node) return;
+
+    enterStatement(node);
+    switch (ast->node(node).type) {
+    case NODE_COMPOUND_STMT:
+        for (NodeId stmt = ast->firstChild(node); stmt; stmt = ast->nextSibling(stmt)) {
+            visitStatement(stmt);
+        }
+        break;
+    case NODE_ASSIGNMENT:
+        visitAssignment(node);
+        break;
+    case NODE_IF: {
+        int elseLabel = newLabel();
+        branch(ast->child(node, 0), false, elseLabel);
+        visitStatement(ast->child(node, 1));
+        NodeId elseStmt = ast->child(node, 2);
+        if (elseStmt) {
+            int endLabel = newLabel();
+            outFile << "    jmp .L" << endLabel << "\n";
+            emitLabel(elseLabel);
+            visitStatement(elseStmt);
+            emitLabel(endLabel);
+        }
+        else {
+            emitLabel(elseLabel);
+        }
+        break;
+    }
+    case NODE_WHILE: {
+        auto vector = vectorLoopOf.find(node);
+        if (vector != vectorLoopOf.end()) emitVectorLoop(vectorLoops[vector->second]);
+
+        // Condition at the bottom: one conditional jump per iteration
+        int bodyLabel = newLabel();
+        int conditionLabel = newLabel();
+        outFile << "    jmp .L" << conditionLabel << "\n";
+        emitLabel(bodyLabel);
+        visitStatement(ast->child(node, 1));
+        emitLabel(conditionLabel);
+        if (!allocation.intervals.empty()) position = allocation.statementStart[node];
+        branch(ast->child(node, 0), true, bodyLabel);
+        break;
+    }
+    case NODE_PROCEDURE_CALL:
+    case NODE_FUNCTION_CALL:
+        visitCall(node, info->ref(node).index);
+        break;
+    default:
+        break;
+    }
+    leaveStatement(node);
+}
+
+void AsmGenerator::visitAssignment(NodeId node) {
+    NodeId target = ast->child(node, 0);
+    NodeId value = ast->child(node, 1);
+    bool real = info->typeOf(value) == DataType::REAL;
+    std::string operand;
+
+    if (ast->node(target).type == NODE_ARRAY_ACCESS) {
+        if (simpleOperand(value, operand)) {
+            std::string destination = element(target);
+            if (real) {
+                outFile << realMove(operand, "%xmm1") << operand << ", %xmm1\n"
+                        << "    movsd %xmm1, " << destination << "\n";
+            }
+            else if (operand[0] == '$') {
+                outFile << "    movl " << operand << ", " << destination << "\n";
+            }
+            else {
+                outFile << "    movl " << operand << ", %ecx\n"
+                        << "    movl %ecx, " << destination << "\n";
+            }
+            return;
+        }
+        // Index first, as the interpreters do; it waits on the stack
+        element(target);
+        pushInt();
+        visitExpression(value);
+        popInt("%rcx");
+        const VariableInfo& array = info->variable(target);
+        std::string destination;
+        if (array.storage == Storage::GLOBAL) {
+            arrayAddress(array, "%rdx");
+            destination = "(%rdx,%rcx,8)";
+        }
+        else {
+            destination = std::to_string(static_cast<int32_t>(array.slot * 8) - static_cast<int32_t>(frameBytes)) +
+                          "(%rbp,%rcx,8)";
+        }
+        if (real) outFile << "    movsd %xmm0, " << destination << "\n";
+        else outFile << "    movl %eax, " << destination << "\n";
+        return;
+    }
+
+    std::string destination;
+    if (info->ref(target).kind == RefKind::RESULT) {
+        destination = std::to_string(static_cast<int32_t>(info->subprogram(target).resultSlot * 8) -
+                                     static_cast<int32_t>(frameBytes)) + "(%rbp)";
+    }
+    else {
+        const VariableInfo& variable = info->variable(target);
+        if (variable.type.baseType == DataType::ARRAY) {
+            arrayAddress(info->variable(value), "%rsi");
+            arrayAddress(variable, "%rdi");
+            outFile << "    movl $" << variable.cells << ", %ecx\n"
+                    << "    rep movsq\n";
+            return;
+        }
+        destination = cell(variable);
+
+        // v := v + k and v := v - k update the variable in place
+        const ASTNode& op = ast->node(value);
+        if (!real && op.type == NODE_BINARY_OP && (op.op == OP_ADD || op.op == OP_SUB)) {
+            NodeId left = ast->child(value, 0);
+            NodeId right = ast->child(value, 1);
+            if (ast->node(left).type == NODE_VARIABLE && info->ref(left).kind == RefKind::VARIABLE &&
+                info->ref(left).index == info->ref(target).index && ast->node(right).type == NODE_INT_NUM) {
+                outFile << "    " << (op.op == OP_ADD ? "addl $" : "subl $") << ast->node(right).intVal
+                        << ", " << destination << "\n";
+                return;
+            }
+        }
+    }
+
+    if (!real && simpleOperand(value, operand) && operand[0] == '$') {
+        outFile << "    movl " << operand << ", " << destination << "\n";
+        return;
+    }
+    visitExpression(value);
+    if (real) outFile << realMove("%xmm0", destination) << "%xmm0, " << destination << "\n";
+    else outFile << "    movl %eax, " << destination << "\n";
+}
+
+// Arguments are evaluated left to right into a block below the stack
+// pointer: memory arguments at the bottom where the callee expects them,
+// register arguments above, loaded into their registers just before the call.
+void AsmGenerator::visitCall(NodeId node, uint32_t index) {
+    const SubprogramInfo& subprogram = info->subprograms[index];
+    uint32_t memoryBytes;
+    std::vector<ArgumentSlot> slots = classifyArguments(*info, subprogram, memoryBytes);
+
+    uint32_t registerArgs = 0;
+    for (const ArgumentSlot& slot : slots) {
+        if (!slot.inMemory) ++registerArgs;
+    }
+    uint32_t block = memoryBytes + 8 * registerArgs;
+    if ((pushed + block) % 16) block += 8;
+
+    if (block) outFile << "    subq $" << block << ", %rsp\n";
+    pushed += block;
+
+    uint32_t i = 0;
+    uint32_t spill = memoryBytes;
+    std::vector<uint32_t> spills(slots.size());
+    for (NodeId arg = ast->firstChild(node); arg; arg = ast->nextSibling(arg), ++i) {
+        const VariableInfo& param = info->variables[subprogram.firstParam + i];
+        if (param.type.baseType == DataType::ARRAY) {
+            arrayAddress(info->variable(arg), "%rsi");
+            outFile << "    leaq " << slots[i].offset << "(%rsp), %rdi\n"
+                    << "    movl $" << param.cells << ", %ecx\n"
+                    << "    rep movsq\n";
+            continue;
+        }
+
+        visitExpression(arg);
+        uint32_t offset = slots[i].inMemory ? slots[i].offset : spill;
+        if (!slots[i].inMemory) {
+            spills[i] = spill;
+            spill += 8;
+        }
+        if (slots[i].real) outFile << "    movsd %xmm0, " << offset << "(%rsp)\n";
+        else outFile << "    movl %eax, " << offset << "(%rsp)\n";
+    }
+
+    for (i = 0; i < slots.size(); ++i) {
+        if (slots[i].inMemory) continue;
+        if (slots[i].real) outFile << "    movsd " << spills[i] << "(%rsp), %xmm" << slots[i].reg << "\n";
+        else outFile << "    movl " << spills[i] << "(%rsp), " << intArgRegisters[slots[i].reg] << "\n";
+    }
+
+    syncSharedGlobals(false);
+    outFile << "    call p_" << nameOf(subprogram.name) << "\n";
+    if (block) outFile << "    addq $" << block << ", %rsp\n";
+    pushed -= block;
+    syncSharedGlobals(true);
+}
+
+// Leaves an integer or boolean in eax, a real in xmm0.
+void AsmGenerator::visitExpression(NodeId node) {
+    const ASTNode& n = ast->node(node);
+    bool real = info->typeOf(node) == DataType::REAL;
+    switch (n.type) {
+    case NODE_INT_NUM:
+    case NODE_BOOLEAN:
+    case NODE_REAL_NUM: {
+        std::string operand;
+        simpleOperand(node, operand);
+        if (real) outFile << "    movsd " << operand << ", %xmm0\n";
+        else outFile << "    movl " << operand << ", %eax\n";
+        break;
+    }
+    case NODE_VARIABLE:
+        if (info->ref(node).kind == RefKind::CALL) {
+            visitCall(node, info->ref(node).index);
+            break;
+        }
+        if (real) outFile << realMove(cell(info->variable(node)), "%xmm0") << cell(info->variable(node)) << ", %xmm0\n";
+        else outFile << "    movl " << cell(info->variable(node)) << ", %eax\n";
+        break;
+    case NODE_ARRAY_ACCESS: {
+        std::string source = element(node);
+        if (real) outFile << "    movsd " << source << ", %xmm0\n";
+        else outFile << "    movl " << source << ", %eax\n";
+        break;
+    }
+    case NODE_FUNCTION_CALL:
+        visitCall(node, info->ref(node).index);
+        break;
+    case NODE_UNARY_OP:
+        visitExpression(ast->child(node, 0));
+        if (n.op == OP_NOT) {
+            outFile << "    xorl $1, %eax\n";
+        }
+        else if (real) {
+            outFile << "    movq %xmm0, %rax\n"
+                    << "    btcq $63, %rax\n"
+                    << "    movq %rax, %xmm0\n";
+        }
+        else {
+            outFile << "    negl %eax\n";
+        }
+        break;
+    case NODE_BINARY_OP:
+        if (real || info->typeOf(ast->child(node, 0)) == DataType::REAL) visitRealBinaryOp(node);
+        else visitBinaryOp(node);
+        break;
+    default:
+        break;
+    }
+}
+
+void AsmGenerator::visitRealExpression(NodeId node) {
+    visitExpression(node);
+    if (info->typeOf(node) == DataType::INTEGER) outFile << "    cvtsi2sdl %eax, %xmm0\n";
+}
+
+void AsmGenerator::visitBinaryOp(NodeId node) {
+    const ASTNode& n = ast->node(node);
+    NodeId left = ast->child(node, 0);
+    NodeId right = ast->child(node, 1);
+
+    if (n.op == OP_AND || n.op == OP_OR) {
+        int falseLabel = newLabel();
+        int endLabel = newLabel();
+        branch(node, false, falseLabel);
+        outFile << "    movl $1, %eax\n"
+                << "    jmp .L" << endLabel << "\n";
+        emitLabel(falseLabel);
+        outFile << "    xorl %eax, %eax\n";
+        emitLabel(endLabel);
+        return;
+    }
+
+    visitExpression(left);
+    std::string operand;
+    if (!simpleOperand(right, operand)) {
+        pushInt();
+        visitExpression(right);
+        outFile << "    movl %eax, %ecx\n";
+        popInt("%rax");
+        operand = "%ecx";
+    }
+
+    switch (n.op) {
+    case OP_ADD:
+        outFile << "    addl " << operand << ", %eax\n";
+        break;
+    case OP_SUB:
+        outFile << "    subl " << operand << ", %eax\n";
+        break;
+    case OP_MUL:
+        if (operand[0] == '$') outFile << "    imull " << operand << ", %eax, %eax\n";
+        else outFile << "    imull " << operand << ", %eax\n";
+        break;
+    case OP_DIV: {
+        // Divisor zero is an error, -1 negates so INT_MIN div -1 wraps
+        bool plain = operand[0] == '$' && operand != "$0" && operand != "$-1";
+        if (operand != "%ecx") outFile << "    movl " << operand << ", %ecx\n";
+        if (plain) {
+            outFile << "    cltd\n"
+                    << "    idivl %ecx\n";
+            break;
+        }
+        int negate = newLabel();
+        int done = newLabel();
+        outFile << "    testl %ecx, %ecx\n"
+                << "    jz rt_division_by_zero\n"
+                << "    cmpl $-1, %ecx\n"
+                << "    je .L" << negate << "\n"
+                << "    cltd\n"
+                << "    idivl %ecx\n"
+                << "    jmp .L" << done << "\n";
+        emitLabel(negate);
+        outFile << "    negl %eax\n";
+        emitLabel(done);
+        break;
+    }
+    default:
+        if (isRelational(n.op)) {
+            outFile << "    cmpl " << operand << ", %eax\n"
+                    << "    set" << conditionCode(n.op) << " %al\n"
+                    << "    movzbl %al, %eax\n";
+        }
+        break;
+    }
+}
+
+// Real arithmetic, and comparisons of reals (which leave a boolean in eax).
+void AsmGenerator::visitRealBinaryOp(NodeId node) {
+    const ASTNode& n = ast->node(node);
+    NodeId left = ast->child(node, 0);
+    NodeId right = ast->child(node, 1);
+
+    visitRealExpression(left);
+    std::string operand;
+    if (info->typeOf(right) != DataType::REAL || !simpleOperand(right, operand)) {
+        pushReal();
+        visitRealExpression(right);
+        outFile << "    movapd %xmm0, %xmm1\n";
+        popReal("%xmm0");
+        operand = "%xmm1";
+    }
+
+    switch (n.op) {
+    case OP_ADD: outFile << "    addsd " << operand << ", %xmm0\n"; break;
+    case OP_SUB: outFile << "    subsd " << operand << ", %xmm0\n"; break;
+    case OP_MUL: outFile << "    mulsd " << operand << ", %xmm0\n"; break;
+    case OP_DIVIDE: outFile << "    divsd " << operand << ", %xmm0\n"; break;
+    case OP_EQ:
+        outFile << "    ucomisd " << operand << ", %xmm0\n"
+                << "    sete %al\n"
+                << "    setnp %cl\n"
+                << "    andb %cl, %al\n"
+                << "    movzbl %al, %eax\n";
+        break;
+    case OP_NEQ:
+        outFile << "    ucomisd " << operand << ", %xmm0\n"
+                << "    setne %al\n"
+                << "    setp %cl\n"
+                << "    orb %cl, %al\n"
+                << "    movzbl %al, %eax\n";
+        break;
+    case OP_GT:
+    case OP_GE:
+        outFile << "    ucomisd " << operand << ", %xmm0\n"
+                << "    set" << (n.op == OP_GT ? "a" : "ae") << " %al\n"
+                << "    movzbl %al, %eax\n";
+        break;
+    case OP_LT:
+    case OP_LE:
+        // a < b is b > a: unordered operands compare false
+        if (operand != "%xmm1") outFile << realMove(operand, "%xmm1") << operand << ", %xmm1\n";
+        outFile << "    ucomisd %xmm0, %xmm1\n"
+                << "    set" << (n.op == OP_LT ? "a" : "ae") << " %al\n"
+                << "    movzbl %al, %eax\n";
+        break;
+    default:
+        break;
+    }
+}
+
+// Jumps to `label` when the condition evaluates to `when`. Comparisons jump
+// on the flags directly; and / or become jump chains.
+void AsmGenerator::branch(NodeId condition, bool when, int label) {
+    const ASTNode& n = ast->node(condition);
+    if (n.type == NODE_UNARY_OP && n.op == OP_NOT) {
+        branch(ast->child(condition, 0), !when, label);
+        return;
+    }
+    if (n.type == NODE_BOOLEAN) {
+        if (n.boolVal == when) outFile << "    jmp .L" << label << "\n";
+        return;
+    }
+    if (n.type == NODE_BINARY_OP) {
+        NodeId left = ast->child(condition, 0);
+        NodeId right = ast->child(condition, 1);
+        if (n.op == OP_AND || n.op == OP_OR) {
+            if ((n.op == OP_AND) != when) {
+                branch(left, when, label);
+                branch(right, when, label);
+            }
+            else {
+                int skip = newLabel();
+                branch(left, !when, skip);
+                branch(right, when, label);
+                emitLabel(skip);
+            }
+            return;
+        }
+
+        bool real = info->typeOf(left) == DataType::REAL;
+        if (isRelational(n.op) && !real) {
+            // A variable in a register is compared in place
+            std::string operand;
+            std::string leftOperand;
+            if (simpleOperand(left, leftOperand) && leftOperand[0] == '%' && simpleOperand(right, operand)) {
+                outFile << "    cmpl " << operand << ", " << leftOperand << "\n"
+                        << "    j" << conditionCode(when ? n.op : negated(n.op)) << " .L" << label << "\n";
+                return;
+            }
+            visitExpression(left);
+            if (!simpleOperand(right, operand)) {
+                pushInt();
+                visitExpression(right);
+                outFile << "    movl %eax, %ecx\n";
+                popInt("%rax");
+                operand = "%ecx";
+            }
+            outFile << "    cmpl " << operand << ", %eax\n"
+                    << "    j" << conditionCode(when ? n.op : negated(n.op)) << " .L" << label << "\n";
+            return;
+        }
+        if (real && n.op != OP_EQ && n.op != OP_NEQ) {
+            // Taken-when-false uses jb / jbe, which unordered operands also take
+            visitRealExpression(left);
+            std::string operand;
+            if (!simpleOperand(right, operand)) {
+                pushReal();
+                visitRealExpression(right);
+                outFile << "    movapd %xmm0, %xmm1\n";
+                popReal("%xmm0");
+                operand = "%xmm1";
+            }
+            bool strict = n.op == OP_GT || n.op == OP_LT;
+            if (n.op == OP_LT || n.op == OP_LE) {
+                if (operand != "%xmm1") outFile << realMove(operand, "%xmm1") << operand << ", %xmm1\n";
+                outFile << "    ucomisd %xmm0, %xmm1\n";
+            }
+            else {
+                outFile << "    ucomisd " << operand << ", %xmm0\n";
+            }
+            const char* jump = when ? (strict ? "ja" : "jae") : (strict ? "jbe" : "jb");
+            outFile << "    " << jump << " .L" << label << "\n";
+            return;
+        }
+    }
+
+    visitExpression(condition);
+    outFile << "    testl %eax, %eax\n"
+            << "    " << (when ? "jnz" : "jz") << " .L" << label << "\n";
+}
+
+static bool fitsImmediate(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static const char* quadMove(int64_t value) {
+    return fitsImmediate(value) ? "    movq $" : "    movabsq $";
+}
+
+// Byte offset from the array's base to the element lane 0 uses, as a
+// multiple of the counter in rcx.
+int64_t AsmGenerator::vectorDisplacement(NodeId access, const VectorLoop& loop) const {
+    const VariableInfo& array = info->variable(access);
+    int64_t offset = 0;
+    counterOffset(*ast, *info, ast->child(access, 0), loop.counter, offset);
+    int64_t displacement = -(array.type.arrayStart - offset) * 8;
+    if (array.storage != Storage::GLOBAL) displacement += static_cast<int64_t>(array.slot * 8) - frameBytes;
+    return displacement;
+}
+
+bool AsmGenerator::vectorAddressable(NodeId node, const VectorLoop& loop) const {
+    if (ast->node(node).type == NODE_ARRAY_ACCESS) return fitsImmediate(vectorDisplacement(node, loop));
+    for (NodeId child = ast->firstChild(node); child; child = ast->nextSibling(child)) {
+        if (!vectorAddressable(child, loop)) return false;
+    }
+    return true;
+}
+
+// Global arrays also use rsi.
+std::string AsmGenerator::vectorElement(NodeId access, const VectorLoop& loop) {
+    const VariableInfo& array = info->variable(access);
+    std::string displacement = std::to_string(vectorDisplacement(access, loop));
+    if (array.storage == Storage::GLOBAL) {
+        arrayAddress(array, "%rsi");
+        return displacement + "(%rsi,%rcx,8)";
+    }
+    return displacement + "(%rbp,%rcx,8)";
+}
+
+// Leaves both lanes in xmm`reg`, using xmm`reg`+1 as scratch. Integers go
+// in the low half of each 64-bit lane, like the cells they come from.
+void AsmGenerator::vectorExpression(NodeId node, const VectorLoop& loop, unsigned reg) {
+    const ASTNode& n = ast->node(node);
+    bool real = loop.elementType == DataType::REAL;
+    std::string target = "%xmm" + std::to_string(reg);
+    std::string scratch = "%xmm" + std::to_string(reg + 1);
+    switch (n.type) {
+    case NODE_INT_NUM:
+        outFile << "    movl $" << n.intVal << ", %eax\n"
+                << "    movd %eax, " << target << "\n"
+                << "    pshufd $0x44, " << target << ", " << target << "\n";
+        break;
+    case NODE_REAL_NUM:
+        outFile << "    movsd " << realConstant(n.realVal) << ", " << target << "\n"
+                << "    unpcklpd " << target << ", " << target << "\n";
+        break;
+    case NODE_VARIABLE:
+        if (info->ref(node).index == loop.counter) {
+            // counter, counter + 1
+            outFile << "    movd %ecx, " << target << "\n"
+                    << "    pshufd $0x44, " << target << ", " << target << "\n"
+                    << "    movl $1, %eax\n"
+                    << "    movd %eax, " << scratch << "\n"
+                    << "    pslldq $8, " << scratch << "\n"
+                    << "    paddd " << scratch << ", " << target << "\n";
+        }
+        else if (real) {
+            std::string source = cell(info->variable(node));
+            outFile << realMove(source, target) << source << ", " << target << "\n"
+                    << "    unpcklpd " << target << ", " << target << "\n";
+        }
+        else {
+            outFile << "    movd " << cell(info->variable(node)) << ", " << target << "\n"
+                    << "    pshufd $0x44, " << target << ", " << target << "\n";
+        }
+        break;
+    case NODE_ARRAY_ACCESS: {
+        std::string source = vectorElement(node, loop);
+        outFile << (real ? "    movupd " : "    movdqu ") << source << ", " << target << "\n";
+        break;
+    }
+    case NODE_UNARY_OP:
+        vectorExpression(ast->child(node, 0), loop, reg);
+        if (real) {
+            outFile << "    pcmpeqd " << scratch << ", " << scratch << "\n"
+                    << "    psllq $63, " << scratch << "\n"
+                    << "    xorpd " << scratch << ", " << target << "\n";
+        }
+        else {
+            outFile << "    pxor " << scratch << ", " << scratch << "\n"
+                    << "    psubd " << target << ", " << scratch << "\n"
+                    << "    movdqa " << scratch << ", " << target << "\n";
+        }
+        break;
+    case NODE_BINARY_OP: {
+        vectorExpression(ast->child(node, 0), loop, reg);
+        vectorExpression(ast->child(node, 1), loop, reg + 1);
+        const char* instruction = "";
+        switch (n.op) {
+        case OP_ADD: instruction = real ? "addpd" : "paddd"; break;
+        case OP_SUB: instruction = real ? "subpd" : "psubd"; break;
+        // pmuludq multiplies the low halves: the low 32 bits are the product
+        case OP_MUL: instruction = real ? "mulpd" : "pmuludq"; break;
+        default: instruction = "divpd"; break;
+        }
+        outFile << "    " << instruction << " " << scratch << ", " << target << "\n";
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Runs two iterations at a time while both have every access in bounds,
+// counting in rcx, then stores the counter for the loop that follows.
+void AsmGenerator::emitVectorLoop(const VectorLoop& loop) {
+    for (NodeId store : loop.stores) {
+        if (!vectorAddressable(store, loop)) return;
+    }
+    ++vectorized;
+
+    int skip = newLabel();
+    int body = newLabel();
+    int condition = newLabel();
+    const VariableInfo& counter = info->variables[loop.counter];
+    outFile << "    movslq " << cell(counter) << ", %rcx\n"
+            << quadMove(loop.lowest) << loop.lowest << ", %rdx\n"
+            << "    cmpq %rdx, %rcx\n"
+            << "    jl .L" << skip << "\n";
+    if (ast->node(loop.bound).type == NODE_INT_NUM) outFile << "    movq $" << ast->node(loop.bound).intVal << ", %rdx\n";
+    else outFile << "    movslq " << cell(info->variable(loop.bound)) << ", %rdx\n";
+    if (!loop.inclusive) outFile << "    decq %rdx\n";
+    outFile << quadMove(loop.highest) << loop.highest << ", %rsi\n"
+            << "    cmpq %rsi, %rdx\n"
+            << "    cmovgq %rsi, %rdx\n"
+            << "    decq %rdx\n"
+            << "    jmp .L" << condition << "\n";
+
+    emitLabel(body);
+    for (NodeId store : loop.stores) {
+        vectorExpression(ast->child(store, 1), loop, 0);
+        std::string destination = vectorElement(ast->child(store, 0), loop);
+        outFile << (loop.elementType == DataType::REAL ? "    movupd %xmm0, " : "    movdqu %xmm0, ") << destination << "\n";
+    }
+    outFile << "    addq $2, %rcx\n";
+    emitLabel(condition);
+    outFile << "    cmpq %rdx, %rcx\n"
+            << "    jle .L" << body << "\n"
+            << "    movl %ecx, " << cell(counter) << "\n";
+    emitLabel(skip);
+}
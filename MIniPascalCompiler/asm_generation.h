@@ -0,0 +1,107 @@
+#ifndef ASM_GENERATOR_H
+#define ASM_GENERATOR_H
+
+#include "ast.h"
+#include "ast_arena.h"
+#include "register_allocation.h"
+#include "semantic_info.h"
+#include "vectorization.h"
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+// Emits x86-64 GNU assembler for Linux from the analyzed AST. The output is
+// a complete program: `as prog.s -o prog.o && ld prog.o -o prog` is all it
+// takes, with no C or C++ runtime. On exit the program prints its scalar
+// globals as "name = value", like --run.
+//
+// Subprograms follow the System V AMD64 calling convention: integer and
+// boolean arguments in rdi, rsi, rdx, rcx, r8, r9, reals in xmm0-xmm7, the
+// rest and every array (by value) in memory on the stack; results in eax
+// or xmm0. Expressions evaluate into eax or xmm0 with SSE2 scalar double
+// arithmetic, spilling to the machine stack. Variables have a home in
+// memory, globals in .bss and everything else in the rbp frame, one 8-byte
+// cell each; scalars the register allocator picks live in rbx, r10-r15 or
+// xmm8-xmm15 instead, loaded from and stored to their home at the ends of
+// their live interval. Loops vectorization.h accepts first run two elements
+// at a time in xmm0-xmm7 with packed SSE2 instructions; an integer element
+// is the low half of its cell, and the high half is never read.
+class AsmGenerator {
+public:
+    AsmGenerator(const std::string& outputFilename);
+
+    void setRegisterAllocation(bool enabled) { allocate = enabled; }
+    void setVectorization(bool enabled) { vectorize = enabled; }
+    void generate(const AstArena& tree, NodeId root, const SemanticInfo& semanticInfo);
+
+    const RegisterAllocationStats& allocationStats() const { return stats; }
+    uint32_t vectorizedLoops() const { return vectorized; }
+
+private:
+    std::ofstream outFile;
+    const AstArena* ast;
+    const SemanticInfo* info;
+    const SubprogramInfo* current;  // null in the main program
+    uint32_t frameBytes;
+    uint32_t pushed;                // bytes pushed below the frame
+    int labelCount;
+    std::vector<double> realConstants;
+
+    bool allocate;
+    RegisterAllocation allocation;
+    RegisterAllocationStats stats;
+    std::vector<bool> sharedGlobals;
+    std::vector<uint32_t> byEnd;    // allocated intervals in order of end position
+    size_t nextLoad;
+    size_t nextStore;
+    uint32_t position;              // start of the statement being emitted
+
+    bool vectorize;
+    std::vector<VectorLoop> vectorLoops;
+    std::unordered_map<NodeId, size_t> vectorLoopOf;   // by while node
+    uint32_t vectorized;
+
+    void emitMain(NodeId body);
+    void emitSubprogram(const SubprogramInfo& subprogram);
+    void emitEntryPoint();
+    void emitPrologue(NodeId body);
+    void emitEpilogue();
+    void enterStatement(NodeId node);
+    void leaveStatement(NodeId node);
+    void syncSharedGlobals(bool reload);
+    void emitRuntime();
+    void emitData();
+
+    void visitStatement(NodeId node);
+    void visitAssignment(NodeId node);
+    void visitExpression(NodeId node);
+    void visitRealExpression(NodeId node);
+    void visitBinaryOp(NodeId node);
+    void visitRealBinaryOp(NodeId node);
+    void visitCall(NodeId node, uint32_t index);
+    void branch(NodeId condition, bool when, int label);
+
+    void emitVectorLoop(const VectorLoop& loop);
+    void vectorExpression(NodeId node, const VectorLoop& loop, unsigned reg);
+    bool vectorAddressable(NodeId node, const VectorLoop& loop) const;
+    int64_t vectorDisplacement(NodeId access, const VectorLoop& loop) const;
+    std::string vectorElement(NodeId access, const VectorLoop& loop);
+
+    std::string cell(const VariableInfo& variable) const;
+    std::string home(const VariableInfo& variable) const;
+    std::string element(NodeId access);
+    void arrayAddress(const VariableInfo& variable, const char* reg);
+    bool simpleOperand(NodeId node, std::string& operand);
+    std::string realConstant(double value);
+
+    void pushInt();
+    void popInt(const char* reg);
+    void pushReal();
+    void popReal(const char* reg);
+    int newLabel() { return labelCount++; }
+    void emitLabel(int label);
+};
+
+#endif // ASM_GENERATOR_H
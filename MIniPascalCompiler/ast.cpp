@@ -1,229 +1,309 @@
 #include "ast.h"
+#include "ast_arena.h"
 #include <iostream>
 #include <iomanip>
-#include <memory>
-
-ASTNode* createProgramNode(const std::string& name, ASTNode* decls, ASTNode* subprogs, ASTNode* compound) {
-    ASTNode* node = new ASTNode(NODE_PROGRAM);
-    node->name = name;
-    if (decls) node->children.push_back(decls);
-    if (subprogs) node->children.push_back(subprogs);
-    if (compound) node->children.push_back(compound);
-    return node;
+
+// Both per thread: a worker that installs no arena builds in its own
+// default rather than in another thread's tree
+static thread_local AstArena defaultArena;
+static thread_local AstArena* currentArena = nullptr;
+
+static AstArena& activeArena() {
+    return currentArena ? *currentArena : defaultArena;
 }
 
-ASTNode* createDeclarationsNode(ASTNode* prev, ASTNode* ids, ASTNode* type) {
-    ASTNode* node = new ASTNode(NODE_DECLARATIONS);
-    if (prev) node->children.push_back(prev);
-    if (ids) node->children.push_back(ids);
-    if (type) node->children.push_back(type);
-    return node;
+AstArena* getAstArena() {
+    return &activeArena();
 }
 
-ASTNode* createTypeNode(const std::string& type_name) {
-    ASTNode* node = new ASTNode(NODE_TYPE);
-    node->name = type_name;
-    return node;
+void setAstArena(AstArena* arena) {
+    currentArena = arena;
+}
+
+static NodeId newNode(NodeType type) {
+    return activeArena().addNode(type);
 }
 
-ASTNode* createArrayTypeNode(int start, int end, ASTNode* base_type) {
-    ASTNode* node = new ASTNode(NODE_ARRAY_TYPE);
-    node->int_val = start;
-    node->real_val = end;
-    if (base_type) node->children.push_back(base_type);
+static NodeId newNamedNode(NodeType type, NameId name) {
+    AstArena& nodes = activeArena();
+    NodeId id = nodes.addNode(type);
+    nodes.node(id).name = name;
+    return id;
+}
+
+static void addChild(NodeId parent, NodeId child) {
+    activeArena().appendChild(parent, child);
+}
+
+NodeId createProgramNode(NameId name, NodeId decls, NodeId subprogs, NodeId compound) {
+    NodeId node = newNamedNode(NODE_PROGRAM, name);
+    addChild(node, decls ? decls : createDeclarationsNode());
+    addChild(node, subprogs ? subprogs : createSubprogramDeclarationsNode());
+    addChild(node, compound ? compound : createCompoundStatementNode(NULL_NODE));
     return node;
 }
 
-ASTNode* createSubprogramDeclarationsNode(ASTNode* prev, ASTNode* subprog) {
-    ASTNode* node = new ASTNode(NODE_SUBPROGRAM_DECLS);
-    if (prev) node->children.push_back(prev);
-    if (subprog) node->children.push_back(subprog);
+NodeId createDeclarationsNode() {
+    return newNode(NODE_DECLARATIONS);
+}
+
+NodeId appendDeclarationsNode(NodeId prev, NodeId ids, NodeId type) {
+    if (!prev) prev = createDeclarationsNode();
+
+    NodeId decl = newNode(NODE_VAR_DECL);
+    addChild(decl, ids);
+    addChild(decl, type);
+    addChild(prev, decl);
+    return prev;
+}
+
+NodeId createTypeNode(DataType type) {
+    NodeId node = newNode(NODE_TYPE);
+    activeArena().node(node).dataType = type;
     return node;
 }
 
-ASTNode* createSubprogramNode(ASTNode* head, ASTNode* body) {
-    ASTNode* node = new ASTNode(NODE_SUBPROGRAM);
-    if (head) node->children.push_back(head);
-    if (body) node->children.push_back(body);
+NodeId createArrayTypeNode(int start, int end, NodeId base_type) {
+    NodeId node = newNode(NODE_ARRAY_TYPE);
+    activeArena().node(node).range.start = start;
+    activeArena().node(node).range.end = end;
+    addChild(node, base_type);
     return node;
 }
 
-ASTNode* createFunctionHeadNode(const std::string& name, ASTNode* params, ASTNode* return_type) {
-    ASTNode* node = new ASTNode(NODE_FUNCTION_HEAD);
-    node->name = name;
-    if (params) node->children.push_back(params);
-    if (return_type) node->children.push_back(return_type);
+NodeId createSubprogramDeclarationsNode() {
+    return newNode(NODE_SUBPROGRAM_DECLS);
+}
+
+NodeId appendSubprogramDeclarationsNode(NodeId prev, NodeId subprog) {
+    if (!prev) prev = createSubprogramDeclarationsNode();
+
+    addChild(prev, subprog);
+    return prev;
+}
+
+NodeId createSubprogramNode(NodeId head, NodeId decls, NodeId body) {
+    NodeId node = newNode(NODE_SUBPROGRAM);
+    addChild(node, head);
+    addChild(node, decls ? decls : createDeclarationsNode());
+    addChild(node, body ? body : createCompoundStatementNode(NULL_NODE));
     return node;
 }
 
-ASTNode* createProcedureHeadNode(const std::string& name, ASTNode* params) {
-    ASTNode* node = new ASTNode(NODE_PROCEDURE_HEAD);
-    node->name = name;
-    if (params) node->children.push_back(params);
+NodeId createFunctionHeadNode(NameId name, NodeId params, NodeId return_type) {
+    NodeId node = newNamedNode(NODE_FUNCTION_HEAD, name);
+    addChild(node, params ? params : newNode(NODE_PARAMETER_LIST));
+    addChild(node, return_type);
     return node;
 }
 
-ASTNode* createParameterListNode(ASTNode* ids, ASTNode* type) {
-    ASTNode* node = new ASTNode(NODE_PARAMETER_LIST);
-    if (ids) node->children.push_back(ids);
-    if (type) node->children.push_back(type);
+NodeId createProcedureHeadNode(NameId name, NodeId params) {
+    NodeId node = newNamedNode(NODE_PROCEDURE_HEAD, name);
+    addChild(node, params ? params : newNode(NODE_PARAMETER_LIST));
     return node;
 }
 
-ASTNode* appendParameterListNode(ASTNode* prev, ASTNode* ids, ASTNode* type) {
+NodeId createParameterListNode(NodeId ids, NodeId type) {
+    return appendParameterListNode(newNode(NODE_PARAMETER_LIST), ids, type);
+}
+
+NodeId appendParameterListNode(NodeId prev, NodeId ids, NodeId type) {
     if (!prev) return createParameterListNode(ids, type);
 
-    ASTNode* new_node = createParameterListNode(ids, type);
-    prev->children.push_back(new_node);
+    NodeId param = newNode(NODE_PARAMETER);
+    addChild(param, ids);
+    addChild(param, type);
+    addChild(prev, param);
     return prev;
 }
 
-ASTNode* createIdentifierListNode(const std::string& id) {
-    ASTNode* node = new ASTNode(NODE_IDENTIFIER_LIST);
-    node->name = id;
-    return node;
+NodeId createIdentifierListNode(NameId id) {
+    return appendIdentifierListNode(newNode(NODE_IDENTIFIER_LIST), id);
 }
 
-ASTNode* appendIdentifierListNode(ASTNode* prev, const std::string& id) {
+NodeId appendIdentifierListNode(NodeId prev, NameId id) {
     if (!prev) return createIdentifierListNode(id);
 
-    ASTNode* new_node = createIdentifierListNode(id);
-    prev->children.push_back(new_node);
+    addChild(prev, newNamedNode(NODE_IDENTIFIER, id));
     return prev;
 }
 
-ASTNode* createCompoundStatementNode(ASTNode* stmts) {
-    ASTNode* node = new ASTNode(NODE_COMPOUND_STMT);
-    if (stmts) node->children.push_back(stmts);
+// The statement list built while parsing becomes the compound statement
+// itself, so no wrapper node is left behind.
+NodeId createCompoundStatementNode(NodeId stmts) {
+    if (stmts && activeArena().node(stmts).type == NODE_STATEMENT_LIST) {
+        activeArena().node(stmts).type = NODE_COMPOUND_STMT;
+        return stmts;
+    }
+
+    NodeId node = newNode(NODE_COMPOUND_STMT);
+    addChild(node, stmts);
     return node;
 }
 
-ASTNode* createAssignmentNode(ASTNode* var, ASTNode* expr) {
-    ASTNode* node = new ASTNode(NODE_ASSIGNMENT);
-    node->left = var;
-    node->right = expr;
+NodeId createStatementListNode(NodeId stmt) {
+    NodeId node = newNode(NODE_STATEMENT_LIST);
+    addChild(node, stmt);
     return node;
 }
 
-ASTNode* createIfNode(ASTNode* cond, ASTNode* then_stmt, ASTNode* else_stmt) {
-    ASTNode* node = new ASTNode(NODE_IF);
-    node->left = cond;
-    node->right = then_stmt;
-    if (else_stmt) {
-        ASTNode* else_node = new ASTNode(NODE_IF);
-        else_node->right = else_stmt;
-        node->children.push_back(else_node);
-    }
-    return node;
+NodeId appendStatementNode(NodeId prev, NodeId stmt) {
+    if (!prev) return createStatementListNode(stmt);
+
+    addChild(prev, stmt);
+    return prev;
 }
 
-ASTNode* createWhileNode(ASTNode* cond, ASTNode* body) {
-    ASTNode* node = new ASTNode(NODE_WHILE);
-    node->left = cond;
-    node->right = body;
+NodeId createAssignmentNode(NodeId var, NodeId expr) {
+    NodeId node = newNode(NODE_ASSIGNMENT);
+    addChild(node, var);
+    addChild(node, expr);
     return node;
 }
 
-ASTNode* createProcedureCallNode(const std::string& name, ASTNode* params) {
-    ASTNode* node = new ASTNode(NODE_PROCEDURE_CALL);
-    node->name = name;
-    if (params) node->children.push_back(params);
+NodeId createIfNode(NodeId cond, NodeId then_stmt, NodeId else_stmt) {
+    NodeId node = newNode(NODE_IF);
+    addChild(node, cond);
+    addChild(node, then_stmt ? then_stmt : createCompoundStatementNode(NULL_NODE));
+    addChild(node, else_stmt);
     return node;
 }
 
-ASTNode* createFunctionCallNode(const std::string& name, ASTNode* params) {
-    ASTNode* node = new ASTNode(NODE_FUNCTION_CALL);
-    node->name = name;
-    if (params) node->children.push_back(params);
+NodeId createWhileNode(NodeId cond, NodeId body) {
+    NodeId node = newNode(NODE_WHILE);
+    addChild(node, cond);
+    addChild(node, body ? body : createCompoundStatementNode(NULL_NODE));
     return node;
 }
 
-ASTNode* createVariableNode(const std::string& name, ASTNode* index) {
-    ASTNode* node = new ASTNode(NODE_VARIABLE);
-    node->name = name;
-    if (index) node->children.push_back(index);
+// Calls take over the expression list node that collected their arguments.
+static NodeId createCallNode(NodeType type, NameId name, NodeId params) {
+    if (params && activeArena().node(params).type == NODE_EXPRESSION_LIST) {
+        ASTNode& node = activeArena().node(params);
+        node.type = type;
+        node.name = name;
+        return params;
+    }
+
+    NodeId node = newNamedNode(type, name);
+    addChild(node, params);
     return node;
 }
 
-ASTNode* createArrayAccessNode(const std::string& name, ASTNode* index) {
-    ASTNode* node = new ASTNode(NODE_ARRAY_ACCESS);
-    node->name = name;
-    if (index) node->children.push_back(index);
+NodeId createProcedureCallNode(NameId name, NodeId params) {
+    return createCallNode(NODE_PROCEDURE_CALL, name, params);
+}
+
+NodeId createFunctionCallNode(NameId name, NodeId params) {
+    return createCallNode(NODE_FUNCTION_CALL, name, params);
+}
+
+NodeId createVariableNode(NameId name) {
+    return newNamedNode(NODE_VARIABLE, name);
+}
+
+NodeId createArrayAccessNode(NameId name, NodeId index) {
+    NodeId node = newNamedNode(NODE_ARRAY_ACCESS, name);
+    addChild(node, index);
     return node;
 }
 
-ASTNode* createExpressionListNode(ASTNode* expr) {
-    ASTNode* node = new ASTNode(NODE_EXPRESSION_LIST);
-    if (expr) node->children.push_back(expr);
+NodeId createExpressionListNode(NodeId expr) {
+    NodeId node = newNode(NODE_EXPRESSION_LIST);
+    addChild(node, expr);
     return node;
 }
 
-ASTNode* appendExpressionListNode(ASTNode* prev, ASTNode* expr) {
+NodeId appendExpressionListNode(NodeId prev, NodeId expr) {
     if (!prev) return createExpressionListNode(expr);
 
-    if (expr) prev->children.push_back(expr);
+    addChild(prev, expr);
     return prev;
 }
 
-ASTNode* createIntNumNode(int val) {
-    ASTNode* node = new ASTNode(NODE_INT_NUM);
-    node->int_val = val;
+NodeId createIntNumNode(int val) {
+    NodeId node = newNode(NODE_INT_NUM);
+    activeArena().node(node).intVal = val;
     return node;
 }
 
-ASTNode* createRealNumNode(double val) {
-    ASTNode* node = new ASTNode(NODE_REAL_NUM);
-    node->real_val = val;
+NodeId createRealNumNode(double val) {
+    NodeId node = newNode(NODE_REAL_NUM);
+    activeArena().node(node).realVal = val;
     return node;
 }
 
-ASTNode* createBooleanNode(bool val) {
-    ASTNode* node = new ASTNode(NODE_BOOLEAN);
-    node->bool_val = val;
+NodeId createBooleanNode(bool val) {
+    NodeId node = newNode(NODE_BOOLEAN);
+    activeArena().node(node).boolVal = val;
     return node;
 }
 
-ASTNode* createBinaryOpNode(ASTNode* left, ASTNode* right, const std::string& op) {
-    ASTNode* node = new ASTNode(NODE_BINARY_OP);
-    node->left = left;
-    node->right = right;
-    node->op = op;
+NodeId createBinaryOpNode(NodeId left, NodeId right, OpKind op) {
+    NodeId node = newNode(NODE_BINARY_OP);
+    activeArena().node(node).op = op;
+    addChild(node, left);
+    addChild(node, right);
     return node;
 }
 
-ASTNode* createUnaryOpNode(ASTNode* expr, const std::string& op) {
-    ASTNode* node = new ASTNode(NODE_UNARY_OP);
-    node->left = expr;
-    node->op = op;
+NodeId createUnaryOpNode(NodeId expr, OpKind op) {
+    NodeId node = newNode(NODE_UNARY_OP);
+    activeArena().node(node).op = op;
+    addChild(node, expr);
     return node;
 }
 
-ASTNode* appendStatementNode(ASTNode* prev, ASTNode* stmt) {
-    if (!prev) return stmt;
-
-    ASTNode* node = new ASTNode(NODE_STATEMENT_LIST);
-    node->children.push_back(prev);
-    node->children.push_back(stmt);
+NodeId locateNode(NodeId node, uint32_t line, uint32_t column) {
+    if (!node) return node;
+    ASTNode& located = activeArena().node(node);
+    located.line = line;
+    located.column = static_cast<uint16_t>(column < 0xFFFF ? column : 0xFFFF);
     return node;
 }
 
-void printAST(ASTNode* node, int indent) {
-    if (!node) return;
+const char* opSpelling(OpKind op) {
+    switch (op) {
+    case OP_ADD: return "+";
+    case OP_SUB: return "-";
+    case OP_MUL: return "*";
+    case OP_DIVIDE: return "/";
+    case OP_DIV: return "div";
+    case OP_EQ: return "=";
+    case OP_NEQ: return "<>";
+    case OP_LT: return "<";
+    case OP_LE: return "<=";
+    case OP_GT: return ">";
+    case OP_GE: return ">=";
+    case OP_AND: return "and";
+    case OP_OR: return "or";
+    case OP_NEG: return "-";
+    case OP_NOT: return "not";
+    default: return "?";
+    }
+}
 
+void printAST(const AstArena& ast, NodeId id, int indent) {
+    if (!id) return;
+
+    const ASTNode& node = ast.node(id);
     std::cout << std::setw(indent) << "";
 
-    switch (node->type) {
+    switch (node.type) {
     case NODE_PROGRAM:
-        std::cout << "Program: " << node->name << std::endl;
+        std::cout << "Program: " << ast.nodeName(id) << std::endl;
         break;
     case NODE_DECLARATIONS:
         std::cout << "Declarations" << std::endl;
         break;
+    case NODE_VAR_DECL:
+        std::cout << "Variable Declaration" << std::endl;
+        break;
     case NODE_TYPE:
-        std::cout << "Type: " << node->name << std::endl;
+        std::cout << "Type: " << TypeInfo(node.dataType).toString() << std::endl;
         break;
     case NODE_ARRAY_TYPE:
-        std::cout << "Array[" << node->int_val << ".." << node->real_val << "]" << std::endl;
+        std::cout << "Array[" << node.range.start << ".." << node.range.end << "]" << std::endl;
         break;
     case NODE_SUBPROGRAM_DECLS:
         std::cout << "Subprogram Declarations" << std::endl;
@@ -232,20 +312,29 @@ void printAST(ASTNode* node, int indent) {
         std::cout << "Subprogram" << std::endl;
         break;
     case NODE_FUNCTION_HEAD:
-        std::cout << "Function: " << node->name << std::endl;
+        std::cout << "Function: " << ast.nodeName(id) << std::endl;
         break;
     case NODE_PROCEDURE_HEAD:
-        std::cout << "Procedure: " << node->name << std::endl;
+        std::cout << "Procedure: " << ast.nodeName(id) << std::endl;
         break;
     case NODE_PARAMETER_LIST:
         std::cout << "Parameter List" << std::endl;
         break;
+    case NODE_PARAMETER:
+        std::cout << "Parameter" << std::endl;
+        break;
     case NODE_IDENTIFIER_LIST:
-        std::cout << "Identifier: " << node->name << std::endl;
+        std::cout << "Identifier List" << std::endl;
+        break;
+    case NODE_IDENTIFIER:
+        std::cout << "Identifier: " << ast.nodeName(id) << std::endl;
         break;
     case NODE_COMPOUND_STMT:
         std::cout << "Compound Statement" << std::endl;
         break;
+    case NODE_STATEMENT_LIST:
+        std::cout << "Statement List" << std::endl;
+        break;
     case NODE_ASSIGNMENT:
         std::cout << "Assignment" << std::endl;
         break;
@@ -256,47 +345,45 @@ void printAST(ASTNode* node, int indent) {
         std::cout << "While Loop" << std::endl;
         break;
     case NODE_PROCEDURE_CALL:
-        std::cout << "Procedure Call: " << node->name << std::endl;
+        std::cout << "Procedure Call: " << ast.nodeName(id) << std::endl;
         break;
     case NODE_FUNCTION_CALL:
-        std::cout << "Function Call: " << node->name << std::endl;
+        std::cout << "Function Call: " << ast.nodeName(id) << std::endl;
         break;
     case NODE_VARIABLE:
-        std::cout << "Variable: " << node->name << std::endl;
+        std::cout << "Variable: " << ast.nodeName(id) << std::endl;
         break;
     case NODE_ARRAY_ACCESS:
-        std::cout << "Array Access: " << node->name << "[]" << std::endl;
+        std::cout << "Array Access: " << ast.nodeName(id) << "[]" << std::endl;
         break;
     case NODE_EXPRESSION_LIST:
         std::cout << "Expression List" << std::endl;
         break;
     case NODE_INT_NUM:
-        std::cout << "Integer: " << node->int_val << std::endl;
+        std::cout << "Integer: " << node.intVal << std::endl;
         break;
     case NODE_REAL_NUM:
-        std::cout << "Real: " << node->real_val << std::endl;
+        std::cout << "Real: " << node.realVal << std::endl;
         break;
     case NODE_BOOLEAN:
-        std::cout << "Boolean: " << (node->bool_val ? "true" : "false") << std::endl;
+        std::cout << "Boolean: " << (node.boolVal ? "true" : "false") << std::endl;
         break;
     case NODE_BINARY_OP:
-        std::cout << "Binary Op: " << node->op << std::endl;
+        std::cout << "Binary Op: " << opSpelling(node.op) << std::endl;
         break;
     case NODE_UNARY_OP:
-        std::cout << "Unary Op: " << node->op << std::endl;
+        std::cout << "Unary Op: " << opSpelling(node.op) << std::endl;
         break;
     default:
         std::cout << "Unknown node type" << std::endl;
     }
 
-    if (node->left) printAST(node->left, indent + 4);
-    if (node->right) printAST(node->right, indent + 4);
-    for (ASTNode* child : node->children) {
-        printAST(child, indent + 4);
+    for (NodeId child = node.firstChild; child; child = ast.nextSibling(child)) {
+        printAST(ast, child, indent + 4);
     }
 }
 
-void freeAST(ASTNode* node) {
+void freeAST(NodeId node) {
     if (!node) return;
-    delete node; // Destructor will handle children recursively
-}
\ No newline at end of file
+    activeArena().release();
+}
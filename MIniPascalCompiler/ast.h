@@ -1,12 +1,14 @@
 #ifndef AST_H
 #define AST_H
 
-#include <string>
-#include <vector>
+#include <cstdint>
+#include "semantic_types.h"
+#include "string_interner.h"
 
-enum NodeType {
+enum NodeType : uint8_t {
     NODE_PROGRAM,
     NODE_DECLARATIONS,
+    NODE_VAR_DECL,
     NODE_TYPE,
     NODE_ARRAY_TYPE,
     NODE_SUBPROGRAM_DECLS,
@@ -14,7 +16,9 @@ enum NodeType {
     NODE_FUNCTION_HEAD,
     NODE_PROCEDURE_HEAD,
     NODE_PARAMETER_LIST,
+    NODE_PARAMETER,
     NODE_IDENTIFIER_LIST,
+    NODE_IDENTIFIER,
     NODE_COMPOUND_STMT,
     NODE_STATEMENT_LIST,
     NODE_ASSIGNMENT,
@@ -32,51 +36,131 @@ enum NodeType {
     NODE_UNARY_OP
 };
 
+enum OpKind : uint8_t {
+    OP_NONE,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIVIDE,
+    OP_DIV,
+    OP_EQ,
+    OP_NEQ,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_AND,
+    OP_OR,
+    OP_NEG,
+    OP_NOT
+};
+
+// Nodes live in one contiguous array owned by an AstArena and refer to each
+// other by 32-bit index. Index 0 is reserved so NULL_NODE can mean "absent".
+typedef uint32_t NodeId;
+const NodeId NULL_NODE = 0;
+
+// Children are kept as a singly linked sibling chain, so appending is O(1)
+// and every node type is walked the same way. Child layout per node type:
+//
+//   PROGRAM (name)          declarations, subprogram_decls, compound_stmt
+//   DECLARATIONS            var_decl*
+//   VAR_DECL                identifier_list, type | array_type
+//   ARRAY_TYPE (range)      type
+//   SUBPROGRAM_DECLS        subprogram*
+//   SUBPROGRAM              function_head | procedure_head, declarations, compound_stmt
+//   FUNCTION_HEAD (name)    parameter_list, type
+//   PROCEDURE_HEAD (name)   parameter_list
+//   PARAMETER_LIST          parameter*
+//   PARAMETER               identifier_list, type | array_type
+//   IDENTIFIER_LIST         identifier*
+//   COMPOUND_STMT           statement*
+//   ASSIGNMENT              variable | array_access, expression
+//   IF                      condition, then_stmt [, else_stmt]
+//   WHILE                   condition, body
+//   PROCEDURE_CALL (name)   argument*
+//   FUNCTION_CALL (name)    argument*
+//   ARRAY_ACCESS (name)     index
+//   BINARY_OP (op)          lhs, rhs
+//   UNARY_OP (op)           operand
+//
+// STATEMENT_LIST and EXPRESSION_LIST only exist while parsing; they are
+// turned into the COMPOUND_STMT or call node that owns them.
+//
+// The parsers record where each statement, expression, declared name and
+// subprogram starts (a binary operation at its operator), for diagnostics.
+// Lines and columns count from 1; 0 means the node has no position, as
+// for nodes the optimizer makes.
 struct ASTNode {
     NodeType type;
-    std::string name;
-    int int_val;
-    double real_val;
-    bool bool_val;
-    std::string op;
-    ASTNode* left;
-    ASTNode* right;
-    std::vector<ASTNode*> children;
-
-    ASTNode(NodeType t) : type(t), left(nullptr), right(nullptr) {}
+    OpKind op;
+    uint16_t column;    // saturates at 65535
+    NodeId firstChild;
+    NodeId lastChild;
+    NodeId nextSibling;
+    uint32_t line;
+    union {
+        int32_t intVal;
+        double realVal;
+        bool boolVal;
+        NameId name;        // interned identifier
+        DataType dataType;  // NODE_TYPE
+        struct {
+            int32_t start;
+            int32_t end;
+        } range;            // NODE_ARRAY_TYPE
+    };
 };
 
+class AstArena;
+
+// Arena that create*Node functions allocate from. Each thread has a default
+// arena, used unless the caller installs its own before parsing; the setting
+// is per thread, so files can be parsed side by side into their own arenas.
+AstArena* getAstArena();
+void setAstArena(AstArena* arena);
+
 // Function declarations for creating AST nodes
-ASTNode* createProgramNode(const char* name, ASTNode* decls, ASTNode* subprogs, ASTNode* compound);
-ASTNode* createDeclarationsNode(ASTNode* prev, ASTNode* ids, ASTNode* type);
-ASTNode* createTypeNode(const char* type_name);
-ASTNode* createArrayTypeNode(int start, int end, ASTNode* base_type);
-ASTNode* createSubprogramDeclarationsNode(ASTNode* prev, ASTNode* subprog);
-ASTNode* createSubprogramNode(ASTNode* head, ASTNode* body);
-ASTNode* createFunctionHeadNode(const char* name, ASTNode* params, ASTNode* return_type);
-ASTNode* createProcedureHeadNode(const char* name, ASTNode* params);
-ASTNode* createParameterListNode(ASTNode* ids, ASTNode* type);
-ASTNode* appendParameterListNode(ASTNode* prev, ASTNode* ids, ASTNode* type);
-ASTNode* createIdentifierListNode(const char* id);
-ASTNode* appendIdentifierListNode(ASTNode* prev, const char* id);
-ASTNode* createCompoundStatementNode(ASTNode* stmts);
-ASTNode* createAssignmentNode(ASTNode* var, ASTNode* expr);
-ASTNode* createIfNode(ASTNode* cond, ASTNode* then_stmt, ASTNode* else_stmt);
-ASTNode* createWhileNode(ASTNode* cond, ASTNode* body);
-ASTNode* createProcedureCallNode(const char* name, ASTNode* params);
-ASTNode* createFunctionCallNode(const char* name, ASTNode* params);
-ASTNode* createVariableNode(const char* name, ASTNode* index);
-ASTNode* createArrayAccessNode(const char* name, ASTNode* index);
-ASTNode* createExpressionListNode(ASTNode* expr);
-ASTNode* appendExpressionListNode(ASTNode* prev, ASTNode* expr);
-ASTNode* createIntNumNode(int val);
-ASTNode* createRealNumNode(double val);
-ASTNode* createBooleanNode(bool val);
-ASTNode* createBinaryOpNode(ASTNode* left, ASTNode* right, const char* op);
-ASTNode* createUnaryOpNode(ASTNode* expr, const char* op);
-ASTNode* appendStatementNode(ASTNode* prev, ASTNode* stmt);
+NodeId createProgramNode(NameId name, NodeId decls, NodeId subprogs, NodeId compound);
+NodeId createDeclarationsNode();
+NodeId appendDeclarationsNode(NodeId prev, NodeId ids, NodeId type);
+NodeId createTypeNode(DataType type);
+NodeId createArrayTypeNode(int start, int end, NodeId base_type);
+NodeId createSubprogramDeclarationsNode();
+NodeId appendSubprogramDeclarationsNode(NodeId prev, NodeId subprog);
+NodeId createSubprogramNode(NodeId head, NodeId decls, NodeId body);
+NodeId createFunctionHeadNode(NameId name, NodeId params, NodeId return_type);
+NodeId createProcedureHeadNode(NameId name, NodeId params);
+NodeId createParameterListNode(NodeId ids, NodeId type);
+NodeId appendParameterListNode(NodeId prev, NodeId ids, NodeId type);
+NodeId createIdentifierListNode(NameId id);
+NodeId appendIdentifierListNode(NodeId prev, NameId id);
+NodeId createCompoundStatementNode(NodeId stmts);
+NodeId createStatementListNode(NodeId stmt);
+NodeId appendStatementNode(NodeId prev, NodeId stmt);
+NodeId createAssignmentNode(NodeId var, NodeId expr);
+NodeId createIfNode(NodeId cond, NodeId then_stmt, NodeId else_stmt);
+NodeId createWhileNode(NodeId cond, NodeId body);
+NodeId createProcedureCallNode(NameId name, NodeId params);
+NodeId createFunctionCallNode(NameId name, NodeId params);
+NodeId createVariableNode(NameId name);
+NodeId createArrayAccessNode(NameId name, NodeId index);
+NodeId createExpressionListNode(NodeId expr);
+NodeId appendExpressionListNode(NodeId prev, NodeId expr);
+NodeId createIntNumNode(int val);
+NodeId createRealNumNode(double val);
+NodeId createBooleanNode(bool val);
+NodeId createBinaryOpNode(NodeId left, NodeId right, OpKind op);
+NodeId createUnaryOpNode(NodeId expr, OpKind op);
+
+// Records that `node`, in the current arena, starts at line:column.
+// Returns `node`.
+NodeId locateNode(NodeId node, uint32_t line, uint32_t column);
+
+const char* opSpelling(OpKind op);
 
-void printAST(ASTNode* node, int indent = 0);
-void freeAST(ASTNode* node);
+void printAST(const AstArena& ast, NodeId node, int indent = 0);
+// Releases every node owned by the current arena, not just the given subtree.
+void freeAST(NodeId node);
 
-#endif // AST_H
\ No newline at end of file
+#endif // AST_H
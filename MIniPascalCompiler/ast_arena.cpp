@@ -0,0 +1,83 @@
+#include "ast_arena.h"
+#include <cstring>
+
+AstArena::AstArena() : base(nullptr), count(0) {
+    release();
+}
+
+NodeId AstArena::addNode(NodeType type) {
+    if (base != nodes.data()) nodes.assign(base, base + count);
+
+    ASTNode node;
+    std::memset(&node, 0, sizeof(node));
+    node.type = type;
+    nodes.push_back(node);
+    base = nodes.data();
+    count = nodes.size();
+    return static_cast<NodeId>(count - 1);
+}
+
+void AstArena::appendChild(NodeId parent, NodeId child) {
+    if (parent == NULL_NODE || child == NULL_NODE) return;
+
+    ASTNode& p = base[parent];
+    if (p.lastChild != NULL_NODE)
+        base[p.lastChild].nextSibling = child;
+    else
+        p.firstChild = child;
+    p.lastChild = child;
+}
+
+void AstArena::adoptChildren(NodeId parent, NodeId from) {
+    if (parent == NULL_NODE || from == NULL_NODE) return;
+
+    ASTNode& src = base[from];
+    ASTNode& dst = base[parent];
+    if (src.firstChild == NULL_NODE) return;
+
+    if (dst.lastChild != NULL_NODE)
+        base[dst.lastChild].nextSibling = src.firstChild;
+    else
+        dst.firstChild = src.firstChild;
+    dst.lastChild = src.lastChild;
+
+    src.firstChild = src.lastChild = NULL_NODE;
+}
+
+unsigned AstArena::childCount(NodeId id) const {
+    unsigned count = 0;
+    for (NodeId c = base[id].firstChild; c != NULL_NODE; c = base[c].nextSibling) {
+        ++count;
+    }
+    return count;
+}
+
+NodeId AstArena::child(NodeId id, unsigned index) const {
+    NodeId c = base[id].firstChild;
+    while (c != NULL_NODE && index > 0) {
+        c = base[c].nextSibling;
+        --index;
+    }
+    return c;
+}
+
+void AstArena::release() {
+    std::vector<ASTNode>().swap(nodes);
+    base = nullptr;
+    count = 0;
+
+    // Slot 0 backs NULL_NODE.
+    addNode(NODE_PROGRAM);
+}
+
+void AstArena::assign(const AstArena& other) {
+    nodes.assign(other.base, other.base + other.count);
+    base = nodes.data();
+    count = nodes.size();
+}
+
+void AstArena::adopt(ASTNode* external, size_t size) {
+    std::vector<ASTNode>().swap(nodes);
+    base = external;
+    count = size;
+}
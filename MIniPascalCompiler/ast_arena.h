@@ -0,0 +1,54 @@
+#ifndef AST_ARENA_H
+#define AST_ARENA_H
+
+#include <cstddef>
+#include <vector>
+#include "ast.h"
+
+// Owns every AST node created during a parse. Nodes are stored contiguously
+// and addressed by NodeId, and are handed back all at once by release().
+// An arena can also work on nodes it does not own, such as a mapped tree
+// file (ast_file.h), until a node is added to it.
+class AstArena {
+public:
+    AstArena();
+
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+
+    NodeId addNode(NodeType type);
+    ASTNode& node(NodeId id) { return base[id]; }
+    const ASTNode& node(NodeId id) const { return base[id]; }
+
+    void appendChild(NodeId parent, NodeId child);
+    void adoptChildren(NodeId parent, NodeId from);
+    NodeId firstChild(NodeId id) const { return base[id].firstChild; }
+    NodeId nextSibling(NodeId id) const { return base[id].nextSibling; }
+    unsigned childCount(NodeId id) const;
+    NodeId child(NodeId id, unsigned index) const;
+
+    const char* nodeName(NodeId id) const { return nameOf(base[id].name); }
+
+    void release();
+
+    // Replaces the nodes with a copy of `other`'s, under the same NodeIds.
+    void assign(const AstArena& other);
+
+    // Works on the `size` nodes at `external`, slot 0 included, in place.
+    // They are only copied into the arena's own storage when a node is
+    // added; until then the memory has to stay valid, and writable if the
+    // tree is going to be edited.
+    void adopt(ASTNode* external, size_t size);
+
+    const ASTNode* data() const { return base; }
+    size_t nodeCount() const { return count - 1; }
+    size_t bytesUsed() const { return count * sizeof(ASTNode); }
+    size_t bytesReserved() const { return nodes.capacity() * sizeof(ASTNode); }
+
+private:
+    std::vector<ASTNode> nodes;
+    ASTNode* base;      // nodes.data(), or adopted memory
+    size_t count;
+};
+
+#endif // AST_ARENA_H
@@ -0,0 +1,331 @@
+#include "ast_file.h"
+#include <cstring>
+#include <fstream>
+
+static const char FILE_MAGIC[8] = { 'M', 'P', 'A', 'S', 'T', 'R', 'E', 'E' };
+static const uint32_t ORDER_MARK = 0x01020304u;
+
+enum Section {
+    SECTION_NODES,
+    SECTION_NAME_LENGTHS,
+    SECTION_NAME_TEXT,
+    SECTION_VARIABLES,
+    SECTION_SUBPROGRAMS,
+    SECTION_REF_KINDS,
+    SECTION_REF_INDICES,
+    SECTION_TYPES,
+    SECTION_BOUNDS,
+    SECTION_COUNT
+};
+
+struct FileSection {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t nodeSize;          // sizeof(ASTNode) of the writer
+    uint32_t root;
+    uint32_t nodeCount;         // slot 0 included
+    uint32_t nameCount;         // NO_NAME excluded
+    uint32_t variableCount;
+    uint32_t subprogramCount;
+    uint32_t globalCells;
+    uint32_t reserved;
+    uint64_t fileSize;
+    FileSection sections[SECTION_COUNT];
+};
+
+// VariableInfo and SubprogramInfo with every field at a fixed width, so the
+// file does not depend on how the compiler lays out the structs.
+struct FileVariable {
+    uint32_t name;
+    uint8_t baseType;
+    uint8_t elementType;
+    uint8_t storage;
+    uint8_t flags;              // FLAG_PARAMETER | FLAG_TEMPORARY | FLAG_UNUSED
+    int32_t arrayStart;
+    int32_t arrayEnd;
+    uint32_t slot;
+    uint32_t cells;
+    uint32_t owner;
+};
+
+struct FileSubprogram {
+    uint32_t name;
+    uint32_t node;
+    uint8_t isFunction;
+    uint8_t returnType;
+    uint8_t isReachable;
+    uint8_t reserved;
+    uint32_t firstParam;
+    uint32_t paramCount;
+    uint32_t paramCells;
+    uint32_t resultSlot;
+    uint32_t frameCells;
+};
+
+enum { FLAG_PARAMETER = 1, FLAG_TEMPORARY = 2, FLAG_UNUSED = 4 };
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~static_cast<uint64_t>(7);
+}
+
+// Starts a section at the next 8-byte boundary of `image`.
+static char* openSection(std::string& image, FileSection& section, uint64_t size) {
+    section.offset = align8(image.size());
+    section.size = size;
+    image.resize(static_cast<size_t>(section.offset + size), '\0');
+    return &image[static_cast<size_t>(section.offset)];
+}
+
+bool writeAstFile(const char* path, const AstArena& arena, NodeId root, const SemanticInfo& info,
+                  const StringInterner& names, std::string& error) {
+    size_t count = arena.nodeCount() + 1;
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = AST_FILE_VERSION;
+    header.byteOrder = ORDER_MARK;
+    header.nodeSize = sizeof(ASTNode);
+    header.root = root;
+    header.nodeCount = static_cast<uint32_t>(count);
+    header.nameCount = static_cast<uint32_t>(names.size());
+    header.variableCount = static_cast<uint32_t>(info.variables.size());
+    header.subprogramCount = static_cast<uint32_t>(info.subprograms.size());
+    header.globalCells = info.globalCells;
+
+    std::string image(sizeof(header), '\0');
+    std::memcpy(openSection(image, header.sections[SECTION_NODES], count * sizeof(ASTNode)), arena.data(),
+                count * sizeof(ASTNode));
+
+    size_t textBytes = 0;
+    for (NameId id = 1; id <= names.size(); ++id) textBytes += names.length(id);
+    char* lengths = openSection(image, header.sections[SECTION_NAME_LENGTHS], names.size() * sizeof(uint32_t));
+    for (NameId id = 1; id <= names.size(); ++id) {
+        uint32_t length = names.length(id);
+        std::memcpy(lengths + (id - 1) * sizeof(uint32_t), &length, sizeof(length));
+    }
+    char* text = openSection(image, header.sections[SECTION_NAME_TEXT], textBytes);
+    for (NameId id = 1; id <= names.size(); ++id) {
+        std::memcpy(text, names.spelling(id), names.length(id));
+        text += names.length(id);
+    }
+
+    char* variables = openSection(image, header.sections[SECTION_VARIABLES], info.variables.size() * sizeof(FileVariable));
+    for (const VariableInfo& variable : info.variables) {
+        FileVariable record;
+        std::memset(&record, 0, sizeof(record));
+        record.name = variable.name;
+        record.baseType = static_cast<uint8_t>(variable.type.baseType);
+        record.elementType = static_cast<uint8_t>(variable.type.elementType);
+        record.storage = static_cast<uint8_t>(variable.storage);
+        record.flags = (variable.isParameter ? FLAG_PARAMETER : 0) | (variable.isTemporary ? FLAG_TEMPORARY : 0) |
+                       (variable.isUnused ? FLAG_UNUSED : 0);
+        record.arrayStart = variable.type.arrayStart;
+        record.arrayEnd = variable.type.arrayEnd;
+        record.slot = variable.slot;
+        record.cells = variable.cells;
+        record.owner = variable.owner;
+        std::memcpy(variables, &record, sizeof(record));
+        variables += sizeof(record);
+    }
+
+    char* subprograms = openSection(image, header.sections[SECTION_SUBPROGRAMS],
+                                    info.subprograms.size() * sizeof(FileSubprogram));
+    for (const SubprogramInfo& subprogram : info.subprograms) {
+        FileSubprogram record;
+        std::memset(&record, 0, sizeof(record));
+        record.name = subprogram.name;
+        record.node = subprogram.node;
+        record.isFunction = subprogram.isFunction;
+        record.returnType = static_cast<uint8_t>(subprogram.returnType);
+        record.isReachable = subprogram.isReachable;
+        record.firstParam = subprogram.firstParam;
+        record.paramCount = subprogram.paramCount;
+        record.paramCells = subprogram.paramCells;
+        record.resultSlot = subprogram.resultSlot;
+        record.frameCells = subprogram.frameCells;
+        std::memcpy(subprograms, &record, sizeof(record));
+        subprograms += sizeof(record);
+    }
+
+    // Passes that add nodes grow the side tables lazily; missing entries
+    // are the defaults
+    char* kinds = openSection(image, header.sections[SECTION_REF_KINDS], count);
+    char* indices = openSection(image, header.sections[SECTION_REF_INDICES], count * sizeof(uint32_t));
+    char* types = openSection(image, header.sections[SECTION_TYPES], count);
+    char* bounds = openSection(image, header.sections[SECTION_BOUNDS], count);
+    for (size_t id = 0; id < count; ++id) {
+        if (id < info.refs.size()) {
+            kinds[id] = static_cast<char>(info.refs[id].kind);
+            std::memcpy(indices + id * sizeof(uint32_t), &info.refs[id].index, sizeof(uint32_t));
+        }
+        types[id] = static_cast<char>(id < info.exprTypes.size() ? info.exprTypes[id] : DataType::UNKNOWN);
+        bounds[id] = id < info.boundsProven.size() && info.boundsProven[id];
+    }
+
+    image.resize(static_cast<size_t>(align8(image.size())), '\0');
+    header.fileSize = image.size();
+    std::memcpy(&image[0], &header, sizeof(header));
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(image.data(), static_cast<std::streamsize>(image.size()));
+    out.close();
+    if (out.fail()) {
+        error = std::string("cannot write ") + path;
+        return false;
+    }
+    return true;
+}
+
+static bool hasName(NodeType type) {
+    switch (type) {
+    case NODE_PROGRAM:
+    case NODE_FUNCTION_HEAD:
+    case NODE_PROCEDURE_HEAD:
+    case NODE_IDENTIFIER:
+    case NODE_PROCEDURE_CALL:
+    case NODE_FUNCTION_CALL:
+    case NODE_VARIABLE:
+    case NODE_ARRAY_ACCESS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool fail(std::string& error, const char* path, const char* reason) {
+    error = std::string(path) + ": " + reason;
+    return false;
+}
+
+bool loadAstFile(const char* path, MappedFile& image, AstArena& arena, StringInterner& names, SemanticInfo& info,
+                 NodeId& root, std::string& error) {
+    if (!image.open(path, true)) return fail(error, path, "cannot open file");
+    char* bytes = image.writableData();
+
+    FileHeader header;
+    if (image.size() < sizeof(header) || !bytes) return fail(error, path, "not a tree file");
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) return fail(error, path, "not a tree file");
+    if (header.version != AST_FILE_VERSION) return fail(error, path, "written by another version of the compiler");
+    if (header.byteOrder != ORDER_MARK || header.nodeSize != sizeof(ASTNode)) {
+        return fail(error, path, "written for another kind of machine");
+    }
+    if (header.fileSize != image.size()) return fail(error, path, "truncated");
+
+    // Every section inside the file, aligned, and as long as its counts say
+    size_t count = header.nodeCount;
+    const uint64_t expected[SECTION_COUNT] = {
+        count * sizeof(ASTNode), header.nameCount * sizeof(uint32_t), header.sections[SECTION_NAME_TEXT].size,
+        header.variableCount * sizeof(FileVariable), header.subprogramCount * sizeof(FileSubprogram), count,
+        count * sizeof(uint32_t), count, count
+    };
+    for (int i = 0; i < SECTION_COUNT; ++i) {
+        const FileSection& section = header.sections[i];
+        if (section.size != expected[i] || section.offset % 8 != 0 || section.offset < sizeof(header) ||
+            section.offset > image.size() || section.size > image.size() - section.offset) {
+            return fail(error, path, "corrupt section table");
+        }
+    }
+    if (count == 0 || header.root == NULL_NODE || header.root >= count) return fail(error, path, "corrupt header");
+    auto section = [&](Section which) { return bytes + header.sections[which].offset; };
+
+    // The nodes are used where they are; they are only checked, so a bad
+    // file cannot send a walk outside the array
+    ASTNode* nodes = reinterpret_cast<ASTNode*>(section(SECTION_NODES));
+    for (size_t id = 1; id < count; ++id) {
+        const ASTNode& node = nodes[id];
+        if (node.type > NODE_UNARY_OP || node.op > OP_NOT || node.firstChild >= count || node.lastChild >= count ||
+            node.nextSibling >= count || (hasName(node.type) && node.name > header.nameCount)) {
+            return fail(error, path, "corrupt node");
+        }
+    }
+
+    // Names go into the empty interner in the writer's order, so they come
+    // out under the same ids
+    const char* lengths = section(SECTION_NAME_LENGTHS);
+    const char* text = section(SECTION_NAME_TEXT);
+    uint64_t textLeft = header.sections[SECTION_NAME_TEXT].size;
+    for (NameId id = 1; id <= header.nameCount; ++id) {
+        uint32_t length;
+        std::memcpy(&length, lengths + (id - 1) * sizeof(uint32_t), sizeof(length));
+        if (length > textLeft || names.intern(text, length) != id) return fail(error, path, "corrupt name table");
+        text += length;
+        textLeft -= length;
+    }
+
+    info.variables.resize(header.variableCount);
+    const char* variables = section(SECTION_VARIABLES);
+    for (VariableInfo& variable : info.variables) {
+        FileVariable record;
+        std::memcpy(&record, variables, sizeof(record));
+        variables += sizeof(record);
+        if (record.name > header.nameCount || record.baseType > static_cast<uint8_t>(DataType::UNKNOWN) ||
+            record.elementType > static_cast<uint8_t>(DataType::UNKNOWN)) {
+            return fail(error, path, "corrupt variable table");
+        }
+        variable.name = record.name;
+        variable.type = TypeInfo(static_cast<DataType>(record.baseType), record.arrayStart, record.arrayEnd,
+                                 static_cast<DataType>(record.elementType));
+        variable.storage = static_cast<Storage>(record.storage);
+        variable.slot = record.slot;
+        variable.cells = record.cells;
+        variable.owner = record.owner;
+        variable.isParameter = (record.flags & FLAG_PARAMETER) != 0;
+        variable.isTemporary = (record.flags & FLAG_TEMPORARY) != 0;
+        variable.isUnused = (record.flags & FLAG_UNUSED) != 0;
+    }
+
+    info.subprograms.resize(header.subprogramCount);
+    const char* subprograms = section(SECTION_SUBPROGRAMS);
+    for (SubprogramInfo& subprogram : info.subprograms) {
+        FileSubprogram record;
+        std::memcpy(&record, subprograms, sizeof(record));
+        subprograms += sizeof(record);
+        if (record.name > header.nameCount || record.node >= count ||
+            record.returnType > static_cast<uint8_t>(DataType::UNKNOWN) ||
+            static_cast<uint64_t>(record.firstParam) + record.paramCount > header.variableCount) {
+            return fail(error, path, "corrupt subprogram table");
+        }
+        subprogram.name = record.name;
+        subprogram.node = record.node;
+        subprogram.isFunction = record.isFunction != 0;
+        subprogram.returnType = static_cast<DataType>(record.returnType);
+        subprogram.isReachable = record.isReachable != 0;
+        subprogram.firstParam = record.firstParam;
+        subprogram.paramCount = record.paramCount;
+        subprogram.paramCells = record.paramCells;
+        subprogram.resultSlot = record.resultSlot;
+        subprogram.frameCells = record.frameCells;
+    }
+    info.globalCells = header.globalCells;
+
+    const char* kinds = section(SECTION_REF_KINDS);
+    const char* indices = section(SECTION_REF_INDICES);
+    const char* types = section(SECTION_TYPES);
+    const char* bounds = section(SECTION_BOUNDS);
+    info.refs.resize(count);
+    info.exprTypes.resize(count);
+    info.boundsProven.assign(count, false);
+    for (size_t id = 0; id < count; ++id) {
+        NodeRef& ref = info.refs[id];
+        ref.kind = static_cast<RefKind>(kinds[id]);
+        std::memcpy(&ref.index, indices + id * sizeof(uint32_t), sizeof(uint32_t));
+        size_t limit = ref.kind == RefKind::VARIABLE ? info.variables.size() : info.subprograms.size();
+        if (ref.kind > RefKind::RESULT || (ref.kind != RefKind::NONE && ref.index >= limit) ||
+            static_cast<uint8_t>(types[id]) > static_cast<uint8_t>(DataType::UNKNOWN)) {
+            return fail(error, path, "corrupt side tables");
+        }
+        info.exprTypes[id] = static_cast<DataType>(types[id]);
+        if (bounds[id]) info.boundsProven[id] = true;
+    }
+
+    arena.adopt(nodes, count);
+    root = header.root;
+    return true;
+}
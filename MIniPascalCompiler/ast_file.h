@@ -0,0 +1,49 @@
+#ifndef AST_FILE_H
+#define AST_FILE_H
+
+#include "ast.h"
+#include "ast_arena.h"
+#include "mapped_file.h"
+#include "semantic_info.h"
+#include "string_interner.h"
+#include <cstdint>
+#include <string>
+
+// Binary image of an analyzed tree, so a later stage, say an optimizer or
+// backend in another process, can pick it up without parsing and checking
+// the source again. One file holds the interned names, the node array and
+// the SemanticInfo side tables, each section 8-byte aligned after a fixed
+// header:
+//
+//   header      magic "MPASTREE", version, byte order, sizeof(ASTNode),
+//               root, counts, then offset and size of every section
+//   nodes       the arena's ASTNodes as they are in memory, slot 0 included
+//   names       uint32 length per name, then the spellings back to back
+//   variables   VariableInfo, resolved TypeInfo included, as fixed records
+//   subprograms SubprogramInfo as fixed records
+//   refs        per node: RefKind bytes, then uint32 indices
+//   types       per node: the DataType of each expression, one byte each
+//   bounds      per node: 1 where the array index is proven in range
+//
+// The node array is used in place: the reader points an arena at the
+// mapped section, and only a node added to the tree copies it out. Bump
+// AST_FILE_VERSION whenever ASTNode, NodeType, OpKind or a record changes;
+// a file from another version, or another byte order, is refused.
+const uint32_t AST_FILE_VERSION = 2;
+
+// Writes the tree under `root` with its resolution. `info` must be the
+// result of analyze() with resolution on, kept in step with the arena by
+// any pass that ran since. False with `error` set if the file cannot be
+// written.
+bool writeAstFile(const char* path, const AstArena& arena, NodeId root, const SemanticInfo& info,
+                  const StringInterner& names, std::string& error);
+
+// Maps the tree file at `path` into `image`, copy-on-write, and points
+// `arena` at its nodes; `image` has to stay open for as long as the arena
+// uses them. `names` must be empty: its NameIds come out the same as the
+// writer's. False with `error` set if the file is not a valid tree file of
+// this version.
+bool loadAstFile(const char* path, MappedFile& image, AstArena& arena, StringInterner& names, SemanticInfo& info,
+                 NodeId& root, std::string& error);
+
+#endif // AST_FILE_H
@@ -0,0 +1,201 @@
+#include "ast_rewrite.h"
+
+#include <string>
+
+uint32_t subtreeSize(const AstArena& ast, NodeId node) {
+    uint32_t size = 1;
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        size += subtreeSize(ast, child);
+    }
+    return size;
+}
+
+bool isLiteral(const AstArena& ast, NodeId node) {
+    NodeType type = ast.node(node).type;
+    return type == NODE_INT_NUM || type == NODE_REAL_NUM || type == NODE_BOOLEAN;
+}
+
+Value literalValue(const AstArena& ast, NodeId node) {
+    const ASTNode& n = ast.node(node);
+    Value value{};
+    if (n.type == NODE_REAL_NUM) value.r = n.realVal;
+    else if (n.type == NODE_BOOLEAN) value.i = n.boolVal ? 1 : 0;
+    else value.i = n.intVal;
+    return value;
+}
+
+uint32_t replaceWithLiteral(AstArena& ast, SemanticInfo& info, NodeId node, DataType type, Value value) {
+    uint32_t removed = subtreeSize(ast, node) - 1;
+    ASTNode& n = ast.node(node);
+    n.op = OP_NONE;
+    n.firstChild = n.lastChild = NULL_NODE;
+    switch (type) {
+    case DataType::REAL:
+        n.type = NODE_REAL_NUM;
+        n.realVal = value.r;
+        break;
+    case DataType::BOOLEAN:
+        n.type = NODE_BOOLEAN;
+        n.realVal = 0.0;
+        n.boolVal = value.i != 0;
+        break;
+    default:
+        n.type = NODE_INT_NUM;
+        n.realVal = 0.0;
+        n.intVal = value.i;
+        break;
+    }
+    info.refs[node] = NodeRef{ RefKind::NONE, 0 };
+    info.exprTypes[node] = type;
+    return removed;
+}
+
+uint32_t replaceWithDescendant(AstArena& ast, SemanticInfo& info, NodeId node, NodeId descendant) {
+    uint32_t removed = subtreeSize(ast, node) - subtreeSize(ast, descendant);
+    NodeId next = ast.node(node).nextSibling;
+    ast.node(node) = ast.node(descendant);
+    ast.node(node).nextSibling = next;
+    info.refs[node] = info.refs[descendant];
+    info.exprTypes[node] = info.exprTypes[descendant];
+    return removed;
+}
+
+uint32_t replaceWithEmpty(AstArena& ast, SemanticInfo& info, NodeId statement) {
+    uint32_t removed = subtreeSize(ast, statement) - 1;
+    ASTNode& n = ast.node(statement);
+    n.type = NODE_COMPOUND_STMT;
+    n.op = OP_NONE;
+    n.firstChild = n.lastChild = NULL_NODE;
+    info.refs[statement] = NodeRef{ RefKind::NONE, 0 };
+    info.exprTypes[statement] = DataType::UNKNOWN;
+    return removed;
+}
+
+NodeId newNode(AstArena& ast, SemanticInfo& info, NodeType type) {
+    NodeId node = ast.addNode(type);
+    if (info.refs.size() <= node) {
+        info.refs.resize(node + 1, NodeRef{ RefKind::NONE, 0 });
+        info.exprTypes.resize(node + 1, DataType::UNKNOWN);
+        info.boundsProven.resize(node + 1, false);
+    }
+    return node;
+}
+
+NodeId newVariable(AstArena& ast, SemanticInfo& info, uint32_t variable) {
+    NodeId node = newNode(ast, info, NODE_VARIABLE);
+    ast.node(node).name = info.variables[variable].name;
+    info.refs[node] = NodeRef{ RefKind::VARIABLE, variable };
+    info.exprTypes[node] = info.variables[variable].type.baseType;
+    return node;
+}
+
+NodeId newIntLiteral(AstArena& ast, SemanticInfo& info, int32_t value) {
+    NodeId node = newNode(ast, info, NODE_INT_NUM);
+    ast.node(node).intVal = value;
+    info.exprTypes[node] = DataType::INTEGER;
+    return node;
+}
+
+NodeId newBinary(AstArena& ast, SemanticInfo& info, OpKind op, NodeId left, NodeId right, DataType type) {
+    NodeId node = newNode(ast, info, NODE_BINARY_OP);
+    ast.node(node).op = op;
+    ast.appendChild(node, left);
+    ast.appendChild(node, right);
+    info.exprTypes[node] = type;
+    return node;
+}
+
+NodeId newAssignment(AstArena& ast, SemanticInfo& info, uint32_t variable, NodeId value) {
+    NodeId target = newVariable(ast, info, variable);
+    NodeId node = newNode(ast, info, NODE_ASSIGNMENT);
+    ast.appendChild(node, target);
+    ast.appendChild(node, value);
+    return node;
+}
+
+NodeId newLiteral(AstArena& ast, SemanticInfo& info, DataType type, Value value) {
+    NodeId node = newNode(ast, info, NODE_INT_NUM);
+    replaceWithLiteral(ast, info, node, type, value);
+    return node;
+}
+
+uint32_t addTemporary(SemanticInfo& info, uint32_t owner, DataType type, const char* purpose) {
+    return addTemporary(info, owner, TypeInfo(type), purpose);
+}
+
+uint32_t addTemporary(SemanticInfo& info, uint32_t owner, const TypeInfo& type, const char* purpose) {
+    uint32_t index = static_cast<uint32_t>(info.variables.size());
+    std::string name = std::to_string(index) + "_" + purpose;
+
+    VariableInfo variable;
+    variable.name = globalInterner().intern(name.c_str(), name.size());
+    variable.type = type;
+    variable.cells = type.baseType == DataType::ARRAY ? static_cast<uint32_t>(type.arrayEnd - type.arrayStart + 1) : 1;
+    variable.owner = owner;
+    variable.isParameter = false;
+    variable.isTemporary = true;
+    if (owner == NO_SUBPROGRAM) {
+        variable.storage = Storage::GLOBAL;
+        variable.slot = info.globalCells;
+        info.globalCells += variable.cells;
+    }
+    else {
+        variable.storage = Storage::FRAME;
+        variable.slot = info.subprograms[owner].frameCells;
+        info.subprograms[owner].frameCells += variable.cells;
+    }
+    info.variables.push_back(variable);
+    return index;
+}
+
+NodeId replaceWithVariable(AstArena& ast, SemanticInfo& info, NodeId node, uint32_t variable) {
+    NodeId moved = newNode(ast, info, NODE_VARIABLE);
+    ast.node(moved) = ast.node(node);
+    ast.node(moved).nextSibling = NULL_NODE;
+    info.refs[moved] = info.refs[node];
+    info.exprTypes[moved] = info.exprTypes[node];
+    info.boundsProven[moved] = info.boundsProven[node];
+
+    ASTNode& n = ast.node(node);
+    n.type = NODE_VARIABLE;
+    n.op = OP_NONE;
+    n.firstChild = n.lastChild = NULL_NODE;
+    n.name = info.variables[variable].name;
+    info.refs[node] = NodeRef{ RefKind::VARIABLE, variable };
+    info.exprTypes[node] = info.variables[variable].type.baseType;
+    info.boundsProven[node] = false;
+    return moved;
+}
+
+NodeId prependStatements(AstArena& ast, SemanticInfo& info, NodeId statement, const std::vector<NodeId>& before) {
+    NodeId moved = newNode(ast, info, NODE_COMPOUND_STMT);
+    ast.node(moved) = ast.node(statement);
+    ast.node(moved).nextSibling = NULL_NODE;
+    info.refs[moved] = info.refs[statement];
+    info.exprTypes[moved] = info.exprTypes[statement];
+
+    ASTNode& n = ast.node(statement);
+    n.type = NODE_COMPOUND_STMT;
+    n.op = OP_NONE;
+    n.firstChild = n.lastChild = NULL_NODE;
+    info.refs[statement] = NodeRef{ RefKind::NONE, 0 };
+    info.exprTypes[statement] = DataType::UNKNOWN;
+    for (NodeId node : before) ast.appendChild(statement, node);
+    ast.appendChild(statement, moved);
+    return moved;
+}
+
+NodeId detachStatement(AstArena& ast, SemanticInfo& info, NodeId statement) {
+    NodeId moved = newNode(ast, info, NODE_COMPOUND_STMT);
+    ast.node(moved) = ast.node(statement);
+    ast.node(moved).nextSibling = NULL_NODE;
+    info.refs[moved] = info.refs[statement];
+    replaceWithEmpty(ast, info, statement);
+    return moved;
+}
+
+void insertAfter(AstArena& ast, NodeId parent, NodeId after, NodeId statement) {
+    ast.node(statement).nextSibling = ast.node(after).nextSibling;
+    ast.node(after).nextSibling = statement;
+    if (ast.node(parent).lastChild == after) ast.node(parent).lastChild = statement;
+}
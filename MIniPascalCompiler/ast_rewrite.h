@@ -0,0 +1,60 @@
+#ifndef AST_REWRITE_H
+#define AST_REWRITE_H
+
+#include <cstdint>
+#include <vector>
+#include "ast.h"
+#include "ast_arena.h"
+#include "bytecode.h"
+#include "semantic_info.h"
+
+// In-place edits for the optimization passes. Each keeps SemanticInfo's
+// per-node tables in step and returns how many nodes it cut off.
+
+uint32_t subtreeSize(const AstArena& ast, NodeId node);
+
+bool isLiteral(const AstArena& ast, NodeId node);
+
+// The value of an INT_NUM, REAL_NUM or BOOLEAN node, as the interpreters
+// hold it.
+Value literalValue(const AstArena& ast, NodeId node);
+
+// Turns an expression into a literal of `type` (INTEGER, REAL or BOOLEAN).
+uint32_t replaceWithLiteral(AstArena& ast, SemanticInfo& info, NodeId node, DataType type, Value value);
+
+// Puts one of the node's descendants in its place.
+uint32_t replaceWithDescendant(AstArena& ast, SemanticInfo& info, NodeId node, NodeId descendant);
+
+// Turns a statement into an empty compound statement.
+uint32_t replaceWithEmpty(AstArena& ast, SemanticInfo& info, NodeId statement);
+
+// New nodes get room in every per-node table of `info`.
+NodeId newNode(AstArena& ast, SemanticInfo& info, NodeType type);
+NodeId newVariable(AstArena& ast, SemanticInfo& info, uint32_t variable);
+NodeId newIntLiteral(AstArena& ast, SemanticInfo& info, int32_t value);
+NodeId newBinary(AstArena& ast, SemanticInfo& info, OpKind op, NodeId left, NodeId right, DataType type);
+NodeId newAssignment(AstArena& ast, SemanticInfo& info, uint32_t variable, NodeId value);
+NodeId newLiteral(AstArena& ast, SemanticInfo& info, DataType type, Value value);
+
+// A scalar for a pass to keep values in: a frame cell of subprogram
+// `owner`, or a global when owner is NO_SUBPROGRAM. Its name starts with a
+// digit so it cannot clash with a Pascal identifier.
+uint32_t addTemporary(SemanticInfo& info, uint32_t owner, DataType type, const char* purpose);
+uint32_t addTemporary(SemanticInfo& info, uint32_t owner, const TypeInfo& type, const char* purpose);
+
+// Moves the node's contents to a new node and returns it; the old node
+// becomes a reference to `variable` in the same place.
+NodeId replaceWithVariable(AstArena& ast, SemanticInfo& info, NodeId node, uint32_t variable);
+
+// Turns the statement into a compound statement that runs `before` and
+// then the statement itself, now under a new NodeId which is returned.
+NodeId prependStatements(AstArena& ast, SemanticInfo& info, NodeId statement, const std::vector<NodeId>& before);
+
+// Moves a statement's contents to a new node, which is returned, leaving an
+// empty compound statement in its place.
+NodeId detachStatement(AstArena& ast, SemanticInfo& info, NodeId statement);
+
+// Links `statement` in after `after`, a child of `parent`.
+void insertAfter(AstArena& ast, NodeId parent, NodeId after, NodeId statement);
+
+#endif // AST_REWRITE_H
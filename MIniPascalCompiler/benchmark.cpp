@@ -0,0 +1,2520 @@
+#include "benchmark.h"
+#include "asm_generation.h"
+#include "ast_file.h"
+#include "ast_rewrite.h"
+#include "code_generation.h"
+#include "compilation.h"
+#include "compile_cache.h"
+#include "compile_session.h"
+#include "error_handler.h"
+#include "ir.h"
+#include "ir_interpreter.h"
+#include "ast.h"
+#include "ast_arena.h"
+#include "lexer.h"
+#include "mapped_file.h"
+#include "minipascal.tab.h"
+#include "optimizer.h"
+#include "output_buffer.h"
+#include "parser.h"
+#include "semantic_analyzer.h"
+#include "semantic_info.h"
+#include "register_vm.h"
+#include "stack_vm.h"
+#include "string_interner.h"
+#include "symbol_table.h"
+#include "thread_pool.h"
+#include "tree_walker.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#define popen _popen
+#define pclose _pclose
+#else
+#include <sys/resource.h>
+#endif
+
+size_t peakResidentSetKB() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize / 1024;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+double nowMs() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Identifier-heavy program: a few hundred long variable names cycled
+// through simple assignments, the shape of our generated sources.
+static const int SYNTHETIC_VARIABLES = 256;
+
+// With `errorEvery` > 0, every errorEvery-th statement is replaced by one
+// of a few common syntax errors.
+static void writeSyntheticProgram(FILE* out, int statements, bool comments = false, int errorEvery = 0) {
+    fprintf(out, "program Bench;\n");
+    for (int v = 0; v < SYNTHETIC_VARIABLES; v += 16) {
+        fprintf(out, "var ");
+        for (int k = v; k < v + 16; ++k) {
+            fprintf(out, "%saccumulated_value_%d", k == v ? "" : ", ", k);
+        }
+        fprintf(out, ": integer;\n");
+    }
+    fprintf(out, "begin\n");
+    for (int i = 0; i < statements; ++i) {
+        int a = i % SYNTHETIC_VARIABLES;
+        int b = (i * 7 + 3) % SYNTHETIC_VARIABLES;
+        if (comments && i % 4 == 0) {
+            fprintf(out, "        { step %d: fold accumulated_value_%d into accumulated_value_%d }\n", i, b, a);
+        }
+        if (errorEvery > 0 && i % errorEvery == errorEvery - 1) {
+            switch ((i / errorEvery) % 4) {
+            case 0: fprintf(out, "    accumulated_value_%d := ;\n", a); break;
+            case 1: fprintf(out, "    accumulated_value_%d %d;\n", a, i); break;
+            case 2: fprintf(out, "    accumulated_value_%d := (accumulated_value_%d + 1;\n", a, b); break;
+            default: fprintf(out, "    accumulated_value_%d := %d $ + 2;\n", a, i); break;     // a stray character
+            }
+            continue;
+        }
+        switch (i % 3) {
+        case 0: fprintf(out, "    accumulated_value_%d := %d;\n", a, i); break;
+        case 1: fprintf(out, "    accumulated_value_%d := accumulated_value_%d + %d * (accumulated_value_%d - 1);\n", a, b, i, a); break;
+        default: fprintf(out, "    accumulated_value_%d := accumulated_value_%d div 2;\n", a, b); break;
+        }
+    }
+    fprintf(out, "    accumulated_value_0 := 0\nend.\n");
+}
+
+int runParseBenchmark(int statements) {
+    FILE* source = tmpfile();
+    if (!source) {
+        std::cerr << "Error: Cannot create temporary file" << std::endl;
+        return 1;
+    }
+    writeSyntheticProgram(source, statements);
+    rewind(source);
+
+    size_t rssBefore = peakResidentSetKB();
+    ErrorHandler errors;
+    ParseContext context = { nullptr, nullptr, &errors, NULL_NODE };
+    context.scanner = flexScannerOpen(source, &context);
+
+    double start = nowMs();
+    int result = context.scanner ? yyparse(context) : 1;
+    double parsed = nowMs();
+    flexScannerClose(context.scanner);
+    fclose(source);
+    NodeId root = context.root;
+
+    AstArena* arena = getAstArena();
+    bool analyzed = false;
+    double analyzeStart = nowMs();
+    if (result == 0) {
+        SemanticAnalyzer analyzer;
+        analyzed = analyzer.analyze(*arena, root);
+    }
+    double analyzeEnd = nowMs();
+
+    size_t nodes = arena->nodeCount();
+    size_t bytesUsed = arena->bytesUsed();
+    size_t bytesReserved = arena->bytesReserved();
+    size_t rssPeak = peakResidentSetKB();
+
+    double freeStart = nowMs();
+    freeAST(root);
+    double freed = nowMs();
+
+    if (result != 0) {
+        std::cerr << "Error: Parsing failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "statements:      " << statements << "\n"
+              << "parse time:      " << (parsed - start) << " ms\n"
+              << "analysis time:   " << (analyzeEnd - analyzeStart) << " ms" << (analyzed ? "" : " (errors)") << "\n"
+              << "free time:       " << (freed - freeStart) << " ms\n"
+              << "AST nodes:       " << nodes << " (" << sizeof(ASTNode) << " bytes each)\n"
+              << "arena used:      " << bytesUsed / 1024 << " KB (" << bytesReserved / 1024 << " KB reserved)\n"
+              << "interned names:  " << globalInterner().size() << "\n"
+              << "peak RSS:        " << rssPeak << " KB (" << rssBefore << " KB before parse)" << std::endl;
+    return 0;
+}
+
+static std::string syntheticSource(int statements, bool comments, int errorEvery = 0) {
+    std::string text;
+    FILE* out = tmpfile();
+    if (!out) {
+        std::cerr << "Error: Cannot create temporary file" << std::endl;
+        return text;
+    }
+    writeSyntheticProgram(out, statements, comments, errorEvery);
+    text.resize(static_cast<size_t>(ftell(out)));
+    rewind(out);
+    text.resize(fread(&text[0], 1, text.size(), out));
+    fclose(out);
+    return text;
+}
+
+// Source for the lexer benchmarks: the mapped file, or a synthetic program
+// with comments held in `generated`.
+static bool loadLexerSource(const char* path, MappedFile& mapped, std::string& generated,
+                            const char*& source, size_t& size) {
+    if (path) {
+        if (!mapped.open(path)) {
+            std::cerr << "Error: Cannot open file " << path << std::endl;
+            return false;
+        }
+        source = mapped.data();
+        size = mapped.size();
+        return true;
+    }
+
+    generated = syntheticSource(200000, true);
+    if (generated.empty()) return false;
+    source = generated.data();
+    size = generated.size();
+    return true;
+}
+
+// flex reads through stdio, so it gets the same bytes as a stream.
+static FILE* openFlexOn(const char* source, size_t size, ParseContext& context) {
+    FILE* input = tmpfile();
+    if (!input) {
+        std::cerr << "Error: Cannot create temporary file" << std::endl;
+        return nullptr;
+    }
+    fwrite(source, 1, size, input);
+    rewind(input);
+    context.scanner = flexScannerOpen(input, &context);
+    if (!context.scanner) {
+        std::cerr << "Error: Cannot create the flex scanner" << std::endl;
+        fclose(input);
+        return nullptr;
+    }
+    return input;
+}
+
+static double lexWithLexer(const char* source, size_t size, ScanKernel kernel, size_t& tokens) {
+    double start = nowMs();
+    Lexer lexer(source, size, kernel);
+    size_t count = 0;
+    for (Token token = lexer.next(); token.kind != 0; token = lexer.next()) {
+        ++count;
+    }
+    tokens = count;
+    return nowMs() - start;
+}
+
+static double lexWithYylex(ParseContext& context, size_t& tokens) {
+    double start = nowMs();
+    size_t count = 0;
+    YYSTYPE value;
+    YYLTYPE location;
+    while (yylex(&value, &location, context) != 0) {
+        ++count;
+    }
+    tokens = count;
+    return nowMs() - start;
+}
+
+static const ScanKernel ALL_KERNELS[] = { ScanKernel::SCALAR, ScanKernel::SSE2, ScanKernel::AVX2 };
+
+int runLexerBenchmark(const char* path, int iterations) {
+    MappedFile mapped;
+    std::string generated;
+    const char* source;
+    size_t size;
+    if (!loadLexerSource(path, mapped, generated, source, size)) return 1;
+    if (iterations < 1) iterations = 1;
+
+    double kernelMs[3] = { 0, 0, 0 };
+    size_t kernelTokens[3] = { 0, 0, 0 };
+    double adapterMs = 0, flexMs = 0;
+    size_t adapterTokens = 0, flexTokens = 0;
+
+    for (int i = 0; i < iterations; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            kernelMs[k] += lexWithLexer(source, size, ALL_KERNELS[k], kernelTokens[k]);
+        }
+
+        ErrorHandler errors;
+        Lexer lexer(source, size);
+        ParseContext adapter = { nullptr, &lexer, &errors, NULL_NODE };
+        adapterMs += lexWithYylex(adapter, adapterTokens);
+
+        ParseContext flex = { nullptr, nullptr, &errors, NULL_NODE };
+        FILE* input = openFlexOn(source, size, flex);
+        if (!input) return 1;
+        flexMs += lexWithYylex(flex, flexTokens);
+        flexScannerClose(flex.scanner);
+        fclose(input);
+    }
+
+    double megabytes = static_cast<double>(size) * iterations / (1024.0 * 1024.0);
+    std::cout << "source:          " << (path ? path : "synthetic") << " (" << size / 1024 << " KB x " << iterations << ")\n";
+    for (int k = 0; k < 3; ++k) {
+        ScanKernel used = scanKernels(ALL_KERNELS[k]).kind;
+        std::string label = std::string("lexer/") + scanKernelName(ALL_KERNELS[k]) + ":";
+        label.resize(17, ' ');
+        std::cout << label << kernelMs[k] << " ms, " << megabytes * 1000.0 / kernelMs[k] << " MB/s, "
+                  << kernelTokens[k] << " tokens" << (used != ALL_KERNELS[k] ? " (unsupported, fell back)" : "") << "\n";
+    }
+    std::cout << "lexer via yylex: " << adapterMs << " ms, " << megabytes * 1000.0 / adapterMs << " MB/s, " << adapterTokens << " tokens ("
+              << scanKernelName(bestScanKernel()) << ")\n"
+              << "flex:            " << flexMs << " ms, " << megabytes * 1000.0 / flexMs << " MB/s, " << flexTokens << " tokens" << std::endl;
+
+    for (int k = 0; k < 3; ++k) {
+        if (kernelTokens[k] != flexTokens) {
+            std::cerr << "Error: Lexers disagree on the token count" << std::endl;
+            return 1;
+        }
+    }
+    if (adapterTokens != flexTokens) {
+        std::cerr << "Error: Lexers disagree on the token count" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+static std::vector<Token> tokenize(const char* source, size_t size, ScanKernel kernel) {
+    std::vector<Token> tokens;
+    Lexer lexer(source, size, kernel);
+    for (;;) {
+        Token token = lexer.next();
+        tokens.push_back(token);
+        if (token.kind == 0) break;
+    }
+    return tokens;
+}
+
+static bool sameToken(const Token& a, const Token& b) {
+    if (a.kind != b.kind || a.text != b.text || a.length != b.length || a.line != b.line || a.column != b.column)
+        return false;
+    if (a.kind == INT_NUM) return a.intVal == b.intVal;
+    if (a.kind == REAL_NUM) return a.realVal == b.realVal;
+    return true;
+}
+
+// Compares every kernel against the scalar one; returns the number of inputs
+// on which they disagree and describes the first difference.
+static int compareKernels(const char* source, size_t size, const char* what) {
+    std::vector<Token> reference = tokenize(source, size, ScanKernel::SCALAR);
+    int failures = 0;
+    for (ScanKernel kernel : ALL_KERNELS) {
+        if (kernel == ScanKernel::SCALAR) continue;
+        std::vector<Token> tokens = tokenize(source, size, kernel);
+        size_t n = tokens.size() < reference.size() ? tokens.size() : reference.size();
+        size_t i = 0;
+        while (i < n && sameToken(tokens[i], reference[i])) ++i;
+        if (i == n && tokens.size() == reference.size()) continue;
+
+        if (i == n) --i;
+        std::cerr << what << ": " << scanKernelName(kernel) << " differs from scalar at token " << i
+                  << " (line " << reference[i].line << ", column " << reference[i].column << ")" << std::endl;
+        ++failures;
+    }
+    return failures;
+}
+
+// Token kind, value and line as the parser would see them through yylex().
+struct ParserToken {
+    int kind;
+    int line;
+    YYSTYPE value;
+};
+
+static std::vector<ParserToken> drainYylex(ParseContext& context) {
+    std::vector<ParserToken> tokens;
+    for (;;) {
+        ParserToken token;
+        YYLTYPE location;
+        token.kind = yylex(&token.value, &location, context);
+        token.line = location.first_line;
+        tokens.push_back(token);
+        if (token.kind == 0) break;
+    }
+    return tokens;
+}
+
+static bool sameParserToken(const ParserToken& a, const ParserToken& b) {
+    if (a.kind != b.kind || a.line != b.line) return false;
+    if (a.kind == ID) return a.value.name_id == b.value.name_id;
+    if (a.kind == INT_NUM) return a.value.int_val == b.value.int_val;
+    if (a.kind == REAL_NUM) return a.value.real_val == b.value.real_val;
+    return true;
+}
+
+// flex has the last word on what the token stream should be. It reports
+// invalid characters through yyerror, so only well-formed input is used.
+// Returns 1 and describes the first difference if the lexers disagree.
+static int compareWithFlex(const char* source, size_t size, const char* what, size_t& tokens) {
+    ErrorHandler errors;
+    ParseContext flex = { nullptr, nullptr, &errors, NULL_NODE };
+    FILE* input = openFlexOn(source, size, flex);
+    if (!input) return 1;
+    std::vector<ParserToken> expected = drainYylex(flex);
+    flexScannerClose(flex.scanner);
+    fclose(input);
+    tokens = expected.size() - 1;
+
+    Lexer lexer(source, size);
+    ParseContext adapter = { nullptr, &lexer, &errors, NULL_NODE };
+    std::vector<ParserToken> actual = drainYylex(adapter);
+
+    size_t n = expected.size() < actual.size() ? expected.size() : actual.size();
+    size_t i = 0;
+    while (i < n && sameParserToken(expected[i], actual[i])) ++i;
+    if (i == n && expected.size() == actual.size()) return 0;
+    if (i == n) --i;
+    std::cerr << what << ": flex and the hand-written lexer differ at token " << i
+              << " (flex line " << expected[i].line << ", kind " << expected[i].kind
+              << "; lexer line " << actual[i].line << ", kind " << actual[i].kind << ")" << std::endl;
+    return 1;
+}
+
+struct NumberCase {
+    const char* source;
+    const char* tokens;     // integers by value, anything else as written
+};
+
+static const NumberCase numberCases[] = {
+    { "0123", "0 123" },
+    { "0123..5", "123 .. 5" },
+    { "array [0123..0456]", "array [ 123 .. 0 456 ]" },
+    { "007..8", "7 .. 8" },
+    { "0..05", "0 .. 0 5" },
+    { "1..9", "1 .. 9" },
+    { "10 .. 020", "10 .. 0 20" },
+};
+
+int runLexerDifferentialTest(const char* path) {
+    MappedFile mapped;
+    std::string generated;
+    const char* source;
+    size_t size;
+    if (!loadLexerSource(path, mapped, generated, source, size)) return 1;
+
+    int failures = compareKernels(source, size, path ? path : "synthetic");
+
+    size_t sourceTokens = 0;
+    failures += compareWithFlex(source, size, path ? path : "synthetic", sourceTokens);
+
+    // Numbers where flex's longest match decides, with what its rules give
+    for (const NumberCase& number : numberCases) {
+        size_t tokens = 0;
+        failures += compareWithFlex(number.source, std::strlen(number.source), number.source, tokens);
+        std::string spelled;
+        Lexer lexer(number.source, std::strlen(number.source));
+        for (Token token = lexer.next(); token.kind != 0; token = lexer.next()) {
+            if (!spelled.empty()) spelled += ' ';
+            spelled += token.kind == INT_NUM ? std::to_string(token.intVal) : std::string(token.text, token.length);
+        }
+        if (spelled != number.tokens) {
+            std::cerr << number.source << ": lexed as \"" << spelled << "\", expected \"" << number.tokens << "\""
+                      << std::endl;
+            ++failures;
+        }
+    }
+
+    // Random inputs built from the bytes the kernels care about, with lengths
+    // straddling the 16- and 32-byte block boundaries.
+    static const char alphabet[] = "    \t\r\n\n{{}}}//abcXYZ_09..:=<>+-;\xC3\x80";
+    const size_t alphabetSize = sizeof(alphabet) - 1;
+    uint32_t seed = 12345;
+    std::string fuzz;
+    int fuzzCases = 20000;
+    for (int c = 0; c < fuzzCases; ++c) {
+        seed = seed * 1103515245u + 12345u;
+        size_t length = (seed >> 16) % 130;
+        fuzz.clear();
+        for (size_t k = 0; k < length; ++k) {
+            seed = seed * 1103515245u + 12345u;
+            fuzz += alphabet[(seed >> 16) % alphabetSize];
+        }
+        std::string label = "fuzz case " + std::to_string(c);
+        failures += compareKernels(fuzz.data(), fuzz.size(), label.c_str());
+    }
+
+    std::cout << "kernels:         scalar, sse2, " << scanKernelName(scanKernels(ScanKernel::AVX2).kind) << "\n"
+              << "source tokens:   " << sourceTokens << "\n"
+              << "number cases:    " << sizeof numberCases / sizeof numberCases[0] << "\n"
+              << "fuzz cases:      " << fuzzCases << "\n"
+              << "mismatches:      " << failures << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+static bool sameNode(const ASTNode& a, const ASTNode& b) {
+    if (a.type != b.type || a.op != b.op || a.line != b.line || a.column != b.column) return false;
+    switch (a.type) {
+    case NODE_PROGRAM:
+    case NODE_FUNCTION_HEAD:
+    case NODE_PROCEDURE_HEAD:
+    case NODE_IDENTIFIER:
+    case NODE_PROCEDURE_CALL:
+    case NODE_FUNCTION_CALL:
+    case NODE_VARIABLE:
+    case NODE_ARRAY_ACCESS:
+        return a.name == b.name;
+    case NODE_INT_NUM:
+        return a.intVal == b.intVal;
+    case NODE_REAL_NUM:
+        return a.realVal == b.realVal;
+    case NODE_BOOLEAN:
+        return a.boolVal == b.boolVal;
+    case NODE_TYPE:
+        return a.dataType == b.dataType;
+    case NODE_ARRAY_TYPE:
+        return a.range.start == b.range.start && a.range.end == b.range.end;
+    default:
+        return true;
+    }
+}
+
+// Structural equality of two trees, possibly in different arenas.
+static bool sameTree(const AstArena& left, NodeId leftRoot, const AstArena& right, NodeId rightRoot) {
+    std::vector<std::pair<NodeId, NodeId>> pending;
+    pending.push_back({ leftRoot, rightRoot });
+    while (!pending.empty()) {
+        NodeId a = pending.back().first;
+        NodeId b = pending.back().second;
+        pending.pop_back();
+
+        if ((a == NULL_NODE) != (b == NULL_NODE)) return false;
+        if (a == NULL_NODE) continue;
+        if (!sameNode(left.node(a), right.node(b))) return false;
+
+        NodeId ca = left.firstChild(a);
+        NodeId cb = right.firstChild(b);
+        while (ca != NULL_NODE && cb != NULL_NODE) {
+            pending.push_back({ ca, cb });
+            ca = left.nextSibling(ca);
+            cb = right.nextSibling(cb);
+        }
+        if (ca != cb) return false;
+    }
+    return true;
+}
+
+static size_t treeDepth(const AstArena& ast, NodeId rootId) {
+    std::vector<std::pair<NodeId, size_t>> pending;
+    size_t deepest = 0;
+    if (rootId != NULL_NODE) pending.push_back({ rootId, 1 });
+    while (!pending.empty()) {
+        NodeId id = pending.back().first;
+        size_t depth = pending.back().second;
+        pending.pop_back();
+        if (depth > deepest) deepest = depth;
+        for (NodeId child = ast.firstChild(id); child != NULL_NODE; child = ast.nextSibling(child)) {
+            pending.push_back({ child, depth + 1 });
+        }
+    }
+    return deepest;
+}
+
+int runParserComparisonBenchmark(int statements) {
+    std::string source = syntheticSource(statements, false);
+    if (source.empty()) return 1;
+    double megabytes = static_cast<double>(source.size()) / (1024.0 * 1024.0);
+
+    // Both parsers read tokens from the hand-written lexer so only the
+    // parsing itself differs.
+    AstArena bisonArena;
+    setAstArena(&bisonArena);
+    Lexer bisonLexer(source.data(), source.size());
+    ErrorHandler errors;
+    ParseContext context = { nullptr, &bisonLexer, &errors, NULL_NODE };
+    double bisonStart = nowMs();
+    int bisonResult = yyparse(context);
+    double bisonMs = nowMs() - bisonStart;
+    NodeId bisonRoot = context.root;
+
+    AstArena descentArena;
+    setAstArena(&descentArena);
+    Lexer descentLexer(source.data(), source.size());
+    double descentStart = nowMs();
+    Parser parser(descentLexer, errors);
+    NodeId descentRoot = parser.parseProgram();
+    double descentMs = nowMs() - descentStart;
+    setAstArena(nullptr);
+
+    if (bisonResult != 0 || parser.errorCount() != 0) {
+        errors.print_errors();
+        std::cerr << "Error: Parsing failed" << std::endl;
+        return 1;
+    }
+    bool identical = sameTree(bisonArena, bisonRoot, descentArena, descentRoot);
+
+    std::cout << "statements:      " << statements << " (" << source.size() / 1024 << " KB)\n"
+              << "bison:           " << bisonMs << " ms, " << megabytes * 1000.0 / bisonMs << " MB/s, "
+              << bisonArena.nodeCount() << " nodes, depth " << treeDepth(bisonArena, bisonRoot) << "\n"
+              << "recursive:       " << descentMs << " ms, " << megabytes * 1000.0 / descentMs << " MB/s, "
+              << descentArena.nodeCount() << " nodes, depth " << treeDepth(descentArena, descentRoot) << "\n"
+              << "same AST:        " << (identical ? "yes" : "NO") << std::endl;
+    return identical ? 0 : 1;
+}
+
+int runErrorRecoveryBenchmark(int statements, int errorEvery) {
+    // Recovery resumes after the next statement, so back-to-back mistakes
+    // would merge into one error
+    if (errorEvery < 2) errorEvery = 2;
+    std::string source = syntheticSource(statements, false, errorEvery);
+    if (source.empty()) return 1;
+    double megabytes = static_cast<double>(source.size()) / (1024.0 * 1024.0);
+    int planted = statements / errorEvery;
+
+    std::cout << "statements:      " << statements << " (" << source.size() / 1024 << " KB), "
+              << planted << " with a mistake\n";
+
+    // Uncapped runs find every error; capped runs show how soon a parser
+    // gives up at the default limit. Each planted mistake is one error.
+    int status = 0;
+    for (int capped = 0; capped < 2; ++capped) {
+        ErrorHandler bisonErrors;
+        ErrorHandler descentErrors;
+        if (!capped) {
+            bisonErrors.set_max_errors(static_cast<size_t>(-1));
+            descentErrors.set_max_errors(static_cast<size_t>(-1));
+        }
+
+        AstArena bisonArena;
+        setAstArena(&bisonArena);
+        Lexer bisonLexer(source.data(), source.size());
+        ParseContext context = { nullptr, &bisonLexer, &bisonErrors, NULL_NODE };
+        double bisonStart = nowMs();
+        yyparse(context);
+        double bisonMs = nowMs() - bisonStart;
+
+        AstArena descentArena;
+        setAstArena(&descentArena);
+        Lexer descentLexer(source.data(), source.size());
+        double descentStart = nowMs();
+        Parser parser(descentLexer, descentErrors);
+        parser.parseProgram();
+        double descentMs = nowMs() - descentStart;
+        setAstArena(nullptr);
+
+        std::string bisonLabel = capped ? "bison, capped:" : "bison:";
+        std::string descentLabel = capped ? "recursive, capped:" : "recursive:";
+        bisonLabel.resize(20, ' ');
+        descentLabel.resize(20, ' ');
+        size_t expected = capped ? std::min(static_cast<size_t>(planted), ErrorHandler().max_error_count())
+                                 : static_cast<size_t>(planted);
+        std::cout << bisonLabel << bisonMs << " ms, " << bisonErrors.error_count() << " errors";
+        if (!capped) std::cout << ", " << megabytes * 1000.0 / bisonMs << " MB/s";
+        if (bisonErrors.error_count() != expected) std::cout << ", WRONG COUNT";
+        std::cout << "\n" << descentLabel << descentMs << " ms, " << descentErrors.error_count() << " errors";
+        if (!capped) std::cout << ", " << megabytes * 1000.0 / descentMs << " MB/s";
+        if (descentErrors.error_count() != expected) std::cout << ", WRONG COUNT";
+        std::cout << "\n";
+        if (bisonErrors.error_count() != expected || descentErrors.error_count() != expected) status = 1;
+    }
+    std::cout << std::flush;
+    return status;
+}
+
+// The scope-per-map layout SymbolTable used before the flat table, kept here
+// only as the comparison point for the symbol table benchmark.
+class MapStackSymbolTable {
+public:
+    void enterScope() { scopes.push_back(std::unordered_map<NameId, Symbol>()); }
+    void exitScope() { scopes.pop_back(); }
+    bool addSymbol(const Symbol& symbol) { return scopes.back().emplace(symbol.name, symbol).second; }
+    Symbol* findSymbol(NameId name) {
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+            auto found = it->find(name);
+            if (found != it->end()) return &found->second;
+        }
+        return nullptr;
+    }
+
+private:
+    std::vector<std::unordered_map<NameId, Symbol>> scopes;
+};
+
+template <typename Table>
+static double deepNestingRun(Table& table, const std::vector<NameId>& names, int depth, int lookups, size_t& found) {
+    const int perScope = 4;
+    double start = nowMs();
+    for (int d = 0; d < depth; ++d) {
+        table.enterScope();
+        for (int k = 0; k < perScope; ++k) {
+            Symbol symbol;
+            symbol.name = names[(d * perScope + k) % names.size()];
+            table.addSymbol(symbol);
+        }
+    }
+    // Look up names declared at every level of the nest.
+    size_t declared = static_cast<size_t>(depth) * perScope;
+    if (declared > names.size()) declared = names.size();
+    for (int i = 0; i < lookups; ++i) {
+        if (table.findSymbol(names[(i * 13) % declared]))
+            ++found;
+    }
+    for (int d = 0; d < depth; ++d) {
+        table.exitScope();
+    }
+    return nowMs() - start;
+}
+
+template <typename Table>
+static double manySubprogramsRun(Table& table, const std::vector<NameId>& names, int subprograms, size_t& found) {
+    const int locals = 8;
+    const int lookupsPerBody = 64;
+    double start = nowMs();
+    table.enterScope();
+    for (int g = 0; g < 32; ++g) {
+        Symbol global;
+        global.name = names[g];
+        table.addSymbol(global);
+    }
+    for (int s = 0; s < subprograms; ++s) {
+        table.enterScope();
+        for (int k = 0; k < locals; ++k) {
+            Symbol local;
+            local.name = names[32 + (s + k) % (names.size() - 32)];
+            table.addSymbol(local);
+        }
+        for (int i = 0; i < lookupsPerBody; ++i) {
+            if (table.findSymbol(names[(s + i * 5) % names.size()]))
+                ++found;
+        }
+        table.exitScope();
+    }
+    table.exitScope();
+    return nowMs() - start;
+}
+
+struct FlatTableAdapter {
+    SymbolTable table;
+    void enterScope() { table.enterScope(); }
+    void exitScope() { table.exitScope(); }
+    bool addSymbol(const Symbol& symbol) { return table.addSymbol(symbol); }
+    Symbol* findSymbol(NameId name) { return table.findSymbol(name); }
+};
+
+int runSymbolTableBenchmark(int depth, int subprograms) {
+    std::vector<NameId> names;
+    for (int i = 0; i < 4096; ++i) {
+        names.push_back(globalInterner().intern(("symbol_name_" + std::to_string(i)).c_str()));
+    }
+    const int lookups = 2000000;
+
+    size_t foundFlat = 0, foundMaps = 0;
+    FlatTableAdapter flat;
+    MapStackSymbolTable maps;
+
+    double flatDeep = deepNestingRun(flat, names, depth, lookups, foundFlat);
+    double mapsDeep = deepNestingRun(maps, names, depth, lookups, foundMaps);
+    std::cout << "deep nesting (" << depth << " scopes, " << lookups << " lookups):\n"
+              << "    flat table:     " << flatDeep << " ms (" << foundFlat << " hits)\n"
+              << "    map per scope:  " << mapsDeep << " ms (" << foundMaps << " hits)\n";
+
+    foundFlat = foundMaps = 0;
+    double flatMany = manySubprogramsRun(flat, names, subprograms, foundFlat);
+    double mapsMany = manySubprogramsRun(maps, names, subprograms, foundMaps);
+    std::cout << "many subprograms (" << subprograms << " bodies):\n"
+              << "    flat table:     " << flatMany << " ms (" << foundFlat << " hits)\n"
+              << "    map per scope:  " << mapsMany << " ms (" << foundMaps << " hits)" << std::endl;
+    return 0;
+}
+
+// Programs for the execution backends. Each leaves a known value in `check`.
+struct BenchProgram {
+    const char* name;
+    const char* source;
+    int32_t expected;
+};
+
+static const BenchProgram benchPrograms[] = {
+    { "factorial",
+      "program Factorial;\n"
+      "var counter, factorial, round, check: integer;\n"
+      "begin\n"
+      "    round := 0;\n"
+      "    check := 0;\n"
+      "    while round < 200000 do\n"
+      "    begin\n"
+      "        counter := 12;\n"
+      "        factorial := 1;\n"
+      "        while counter > 0 do\n"
+      "        begin\n"
+      "            factorial := factorial * counter;\n"
+      "            counter := counter - 1\n"
+      "        end;\n"
+      "        check := check + factorial div 479001600;\n"
+      "        round := round + 1\n"
+      "    end\n"
+      "end.\n",
+      200000 },
+    { "sieve",
+      "program Sieve;\n"
+      "var flags: array [2..100000] of boolean;\n"
+      "var i, j, round, check: integer;\n"
+      "begin\n"
+      "    round := 0;\n"
+      "    while round < 20 do\n"
+      "    begin\n"
+      "        i := 2;\n"
+      "        while i <= 100000 do\n"
+      "        begin\n"
+      "            flags[i] := true;\n"
+      "            i := i + 1\n"
+      "        end;\n"
+      "        check := 0;\n"
+      "        i := 2;\n"
+      "        while i <= 100000 do\n"
+      "        begin\n"
+      "            if flags[i] then\n"
+      "            begin\n"
+      "                check := check + 1;\n"
+      "                j := i + i;\n"
+      "                while j <= 100000 do\n"
+      "                begin\n"
+      "                    flags[j] := false;\n"
+      "                    j := j + i\n"
+      "                end\n"
+      "            end;\n"
+      "            i := i + 1\n"
+      "        end;\n"
+      "        round := round + 1\n"
+      "    end\n"
+      "end.\n",
+      9592 },
+    { "nested-sums",
+      "program NestedSums;\n"
+      "var grid: array [0..249999] of integer;\n"
+      "var rowSum: array [0..499] of integer;\n"
+      "var colSum: array [0..499] of integer;\n"
+      "var i, j, check: integer;\n"
+      "begin\n"
+      "    i := 0;\n"
+      "    while i < 500 do\n"
+      "    begin\n"
+      "        j := 0;\n"
+      "        while j < 500 do\n"
+      "        begin\n"
+      "            grid[i * 500 + j] := i + j;\n"
+      "            j := j + 1\n"
+      "        end;\n"
+      "        i := i + 1\n"
+      "    end;\n"
+      "    check := 0;\n"
+      "    i := 0;\n"
+      "    while i < 500 do\n"
+      "    begin\n"
+      "        j := 0;\n"
+      "        while j < 500 do\n"
+      "        begin\n"
+      "            rowSum[i] := rowSum[i] + grid[i * 500 + j];\n"
+      "            colSum[j] := colSum[j] + grid[i * 500 + j];\n"
+      "            j := j + 1\n"
+      "        end;\n"
+      "        check := check + rowSum[i] - colSum[i] div 2;\n"
+      "        i := i + 1\n"
+      "    end\n"
+      "end.\n",
+      93500250 },
+    { "fib",
+      "program Fib;\n"
+      "var check: integer;\n"
+      "function fib(n: integer): integer;\n"
+      "begin\n"
+      "    if n < 2 then fib := n\n"
+      "    else fib := fib(n - 1) + fib(n - 2)\n"
+      "end;\n"
+      "begin\n"
+      "    check := fib(27)\n"
+      "end.\n",
+      196418 },
+    { "harmonic",
+      "program Harmonic;\n"
+      "var sum, x: real;\n"
+      "var i: integer;\n"
+      "var check: boolean;\n"
+      "begin\n"
+      "    sum := 0.0;\n"
+      "    x := 1.0;\n"
+      "    i := 0;\n"
+      "    while i < 1000000 do\n"
+      "    begin\n"
+      "        sum := sum + 1.0 / x;\n"
+      "        x := x + 1.0;\n"
+      "        i := i + 1\n"
+      "    end;\n"
+      "    check := (sum > 14.39) and (sum < 14.40)\n"
+      "end.\n",
+      1 },
+    // and/or as values, where the right operand can trap or call and so
+    // only runs when the left one does not decide
+    { "short-circuit",
+      "program ShortCircuit;\n"
+      "var a, k, check: integer;\n"
+      "var c, d: boolean;\n"
+      "var z: array [1..4] of integer;\n"
+      "function bump(v: integer): integer;\n"
+      "begin\n"
+      "    k := k + 1;\n"
+      "    bump := v\n"
+      "end;\n"
+      "begin\n"
+      "    a := 0;\n"
+      "    k := 0;\n"
+      "    check := 0;\n"
+      "    z[1] := 5;\n"
+      "    c := (a > 1) or (z[a + 1] = 6);\n"
+      "    d := (a < 1) and (z[a + 1] = 5);\n"
+      "    if c then check := check + 1;\n"
+      "    if d then check := check + 2;\n"
+      "    c := (a < 1) or (bump(1) = 1);\n"
+      "    d := (a > 1) and (bump(1) = 1);\n"
+      "    if c then check := check + 4;\n"
+      "    if d then check := check + 8;\n"
+      "    c := (a > 1) or (bump(2) = 2);\n"
+      "    d := (a < 1) and (bump(3) = 4);\n"
+      "    if c then check := check + 16;\n"
+      "    if d then check := check + 32;\n"
+      "    check := check + k * 100\n"
+      "end.\n",
+      222 },
+};
+
+// Parses and analyzes `source` into `arena`. Returns NULL_NODE on errors.
+static NodeId compileBenchProgram(const BenchProgram& program, AstArena& arena, SemanticInfo& info) {
+    std::string source = program.source;
+    setAstArena(&arena);
+    Lexer lexer(source.data(), source.size());
+    ErrorHandler errors;
+    Parser parser(lexer, errors);
+    NodeId programRoot = parser.parseProgram();
+    setAstArena(nullptr);
+    if (parser.errorCount() != 0) {
+        errors.print_errors();
+        std::cerr << "Error: " << program.name << ": parsing failed" << std::endl;
+        return NULL_NODE;
+    }
+
+    SemanticAnalyzer analyzer;
+    if (!analyzer.analyze(arena, programRoot, &info)) {
+        std::cerr << "Error: " << program.name << ": semantic analysis failed" << std::endl;
+        return NULL_NODE;
+    }
+    return programRoot;
+}
+
+static int32_t checkValue(const SemanticInfo& info, const Value* globals) {
+    NameId check = globalInterner().intern("check");
+    for (const VariableInfo& variable : info.variables) {
+        if (variable.storage == Storage::GLOBAL && variable.name == check) return globals[variable.slot].i;
+    }
+    return -1;
+}
+
+// Runs an engine `rounds` times and keeps the best time.
+template <typename Engine>
+static bool timeEngine(Engine& engine, int rounds, double& best) {
+    for (int round = 0; round < rounds; ++round) {
+        double start = nowMs();
+        if (!engine.run()) return false;
+        double elapsed = nowMs() - start;
+        if (round == 0 || elapsed < best) best = elapsed;
+    }
+    return true;
+}
+
+template <typename Engine>
+static bool reportEngine(const char* label, Engine& engine, int rounds, const BenchProgram& bench,
+                         const SemanticInfo& info, double baselineMs) {
+    double best = 0.0;
+    if (!timeEngine(engine, rounds, best)) {
+        std::cerr << "Error: " << bench.name << ": " << label << ": runtime error: " << engine.error() << std::endl;
+        return false;
+    }
+    int32_t result = checkValue(info, engine.globals());
+    std::cout << "  " << label << best << " ms, " << engine.dispatchCount() << " dispatches, "
+              << engine.dispatchCount() / (best * 1000.0) << " M/s";
+    if (baselineMs > 0.0) std::cout << ", " << baselineMs / best << "x";
+    std::cout << (result == bench.expected ? "" : ", WRONG RESULT") << std::endl;
+    return result == bench.expected;
+}
+
+int runVMBenchmark(int rounds) {
+    if (rounds < 1) rounds = 1;
+    int status = 0;
+    for (const BenchProgram& bench : benchPrograms) {
+        AstArena arena;
+        SemanticInfo info;
+        NodeId programRoot = compileBenchProgram(bench, arena, info);
+        if (!programRoot) return 1;
+
+        BytecodeProgram stackProgram;
+        compileBytecode(arena, programRoot, info, stackProgram);
+        RegisterProgram registerProgram;
+        compileRegisterBytecode(arena, programRoot, info, registerProgram);
+
+        std::cout << bench.name << " (stack code " << stackProgram.code.size() << " bytes, register code "
+                  << registerProgram.code.size() * 4 << " bytes):" << std::endl;
+
+        TreeWalker walker(arena, programRoot, info);
+        double treeMs = 0.0;
+        if (!timeEngine(walker, 1, treeMs)) {
+            std::cerr << "Error: " << bench.name << ": tree walker: runtime error: " << walker.error() << std::endl;
+            return 1;
+        }
+        if (!reportEngine("tree walker:   ", walker, 1, bench, info, 0.0)) status = 1;
+
+        StackVM stackVM(stackProgram);
+        if (!reportEngine("stack vm:      ", stackVM, rounds, bench, info, treeMs)) status = 1;
+
+        RegisterVM registerVM(registerProgram);
+        if (!reportEngine("register vm:   ", registerVM, rounds, bench, info, treeMs)) status = 1;
+
+        IrModule ir;
+        buildIr(arena, programRoot, info, ir);
+        if (!verifyIr(ir, std::cerr)) {
+            std::cerr << "Error: " << bench.name << ": IR verification failed" << std::endl;
+            status = 1;
+            continue;
+        }
+        IrInterpreter irInterpreter(ir);
+        if (!reportEngine("ir interpreter:", irInterpreter, 1, bench, info, treeMs)) status = 1;
+    }
+    return status;
+}
+
+// Programs where an optimizer that treats an expression as its value would
+// skip a call's side effect or a trap. Each runs the same with --optimize;
+// the recursive functions keep their calls through inlining.
+static const BenchProgram optimizerCases[] = {
+    { "impure-calls",
+      "program Impure;\n"
+      "var g, k: integer;\n"
+      "var c, d: boolean;\n"
+      "function f(v: integer): integer;\n"
+      "begin\n"
+      "    g := g + 1;\n"
+      "    if v > 100 then f := f(v - 1) else f := v\n"
+      "end;\n"
+      "function sq(v: integer): integer;\n"
+      "begin\n"
+      "    if v > 100 then sq := sq(v - 1) else sq := v * v\n"
+      "end;\n"
+      "begin\n"
+      "    k := 1;\n"
+      "    c := (f(1) = 6) or ((k div 1) = 1);\n"
+      "    d := (f(2) = 6) or (sq(2) = 4);\n"
+      "    if (f(3) > 0) or true then k := k + 1;\n"
+      "    c := c and (f(4) = 4) and (sq(3) = 9)\n"
+      "end.\n",
+      0 },
+    { "guarded-traps",
+      "program Guarded;\n"
+      "var a, k: integer;\n"
+      "var c, d: boolean;\n"
+      "var z: array [1..4] of integer;\n"
+      "begin\n"
+      "    a := 0;\n"
+      "    k := 0;\n"
+      "    z[1] := 5;\n"
+      "    c := (a < 1) or (z[a + 10] = 1);\n"
+      "    d := (a > 1) and ((k div a) = 1);\n"
+      "    c := c and (z[a + 1] = 5);\n"
+      "    d := d or (z[a + 1] = 6)\n"
+      "end.\n",
+      0 },
+    { "trap-after-call",
+      "program Trap;\n"
+      "var g3, k0: integer;\n"
+      "var b0: boolean;\n"
+      "var z: array [1..4] of integer;\n"
+      "function f0(v: integer): integer;\n"
+      "begin\n"
+      "    g3 := g3 + 1;\n"
+      "    f0 := v\n"
+      "end;\n"
+      "begin\n"
+      "    k0 := 7;\n"
+      "    b0 := not ((74 <= f0(1)) or (g3 = z[k0 + 0]))\n"
+      "end.\n",
+      0 },
+    { "division-by-zero",
+      "program Zero;\n"
+      "var j, k, x: integer;\n"
+      "function bad(v: integer): integer;\n"
+      "begin\n"
+      "    bad := v div j\n"
+      "end;\n"
+      "begin\n"
+      "    j := 0;\n"
+      "    k := 3;\n"
+      "    x := 0 * bad(k);\n"
+      "    x := 1\n"
+      "end.\n",
+      0 },
+};
+
+// Whether two runs left the program's own globals the same.
+static bool sameGlobals(const SemanticInfo& info, const Value* a, const Value* b) {
+    for (const VariableInfo& variable : info.variables) {
+        if (variable.storage != Storage::GLOBAL) continue;
+        DataType type = variable.type.baseType == DataType::ARRAY ? variable.type.elementType : variable.type.baseType;
+        for (uint32_t cell = variable.slot; cell < variable.slot + variable.cells; ++cell) {
+            if (type == DataType::REAL ? std::memcmp(&a[cell].r, &b[cell].r, sizeof(double)) != 0 : a[cell].i != b[cell].i) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int runOptimizerTest() {
+    int failures = 0;
+    for (const BenchProgram& program : optimizerCases) {
+        AstArena plainArena, optimizedArena;
+        SemanticInfo plainInfo, optimizedInfo;
+        NodeId plainRoot = compileBenchProgram(program, plainArena, plainInfo);
+        NodeId optimizedRoot = compileBenchProgram(program, optimizedArena, optimizedInfo);
+        if (!plainRoot || !optimizedRoot) return 1;
+        OptimizationReport report;
+        setAstArena(&optimizedArena);
+        optimize(optimizedArena, optimizedRoot, optimizedInfo, OptimizationOptions(), report);
+        setAstArena(nullptr);
+
+        TreeWalker plain(plainArena, plainRoot, plainInfo);
+        TreeWalker optimized(optimizedArena, optimizedRoot, optimizedInfo);
+        bool plainOk = plain.run();
+        bool optimizedOk = optimized.run();
+        bool same = plainOk == optimizedOk &&
+                    (plainOk ? sameGlobals(plainInfo, plain.globals(), optimized.globals())
+                             : plain.error() == optimized.error());
+        std::cout << "  " << program.name << ": " << (plainOk ? "runs" : "traps: " + plain.error())
+                  << (same ? "" : ", DIFFERS with --optimize") << std::endl;
+        if (!same) ++failures;
+    }
+    std::cout << (failures ? "optimizer check FAILED" : "optimizer check passed") << std::endl;
+    return failures ? 1 : 0;
+}
+
+// Runs a shell command and returns its elapsed time, or -1 when it fails.
+static double timeCommand(const std::string& command) {
+    double start = nowMs();
+    if (std::system(command.c_str()) != 0) return -1.0;
+    return nowMs() - start;
+}
+
+// Runs a native program and reads `check` back from its "check = ..." line.
+static bool runNative(const std::string& program, double& elapsed, int32_t& result) {
+    double start = nowMs();
+    FILE* output = popen(program.c_str(), "r");
+    if (!output) return false;
+    char line[256];
+    bool found = false;
+    while (std::fgets(line, sizeof line, output)) {
+        if (std::strncmp(line, "check = ", 8) != 0) continue;
+        const char* value = line + 8;
+        if (std::strncmp(value, "true", 4) == 0) result = 1;
+        else if (std::strncmp(value, "false", 5) == 0) result = 0;
+        else result = std::atoi(value);
+        found = true;
+    }
+    int status = pclose(output);
+    elapsed = nowMs() - start;
+    return found && status == 0;
+}
+
+static bool reportNative(const char* label, double generateMs, double buildMs, const std::string& program,
+                         const BenchProgram& bench) {
+    double runMs = 0.0;
+    int32_t result = -1;
+    if (buildMs < 0.0 || !runNative(program, runMs, result)) {
+        std::cerr << "Error: " << bench.name << ": " << label << "could not build or run " << program << std::endl;
+        return false;
+    }
+    std::cout << "  " << label << "generate " << generateMs << " ms, build " << buildMs << " ms, run "
+              << runMs << " ms" << (result == bench.expected ? "" : ", WRONG RESULT") << std::endl;
+    return result == bench.expected;
+}
+
+int runNativeBenchmark(const char* directory) {
+    std::filesystem::path dir = directory ? std::filesystem::path(directory) : std::filesystem::temp_directory_path();
+    const char* cxx = std::getenv("CXX");
+    std::string compiler = cxx ? cxx : "c++";
+
+    int status = 0;
+    for (const BenchProgram& bench : benchPrograms) {
+        AstArena arena;
+        SemanticInfo info;
+        NodeId programRoot = compileBenchProgram(bench, arena, info);
+        if (!programRoot) return 1;
+
+        std::string base = (dir / (std::string("mpc_") + bench.name)).string();
+        std::cout << bench.name << ":" << std::endl;
+
+        // Straight to machine code with the system assembler and linker
+        double start = nowMs();
+        {
+            AsmGenerator generator(base + ".s");
+            generator.generate(arena, programRoot, info);
+        }
+        double generateMs = nowMs() - start;
+        double buildMs = timeCommand("as " + base + ".s -o " + base + ".o && ld " + base + ".o -o " + base + "_asm");
+        if (!reportNative("assembly: ", generateMs, buildMs, base + "_asm", bench)) status = 1;
+
+        // Through C++ and an optimizing compiler
+        start = nowMs();
+        {
+            CodeGenerator generator(base + ".cpp");
+            generator.generate(arena, programRoot, info);
+        }
+        generateMs = nowMs() - start;
+        buildMs = timeCommand(compiler + " -O2 -fwrapv " + base + ".cpp -o " + base + "_cpp");
+        if (!reportNative("c++ -O2:  ", generateMs, buildMs, base + "_cpp", bench)) status = 1;
+    }
+    return status;
+}
+
+// Loop kernels for the register allocator. Each leaves a known value in `check`.
+static const BenchProgram loopKernels[] = {
+    { "factorial-loop", benchPrograms[0].source, benchPrograms[0].expected },
+    { "sum-of-squares",
+      "program SumOfSquares;\n"
+      "var i, s, check: integer;\n"
+      "begin\n"
+      "    i := 0;\n"
+      "    s := 0;\n"
+      "    while i < 30000000 do\n"
+      "    begin\n"
+      "        s := s + i * i;\n"
+      "        i := i + 1\n"
+      "    end;\n"
+      "    check := s\n"
+      "end.\n",
+      163982144 },
+    { "collatz",
+      "program Collatz;\n"
+      "var n, steps, start, check: integer;\n"
+      "begin\n"
+      "    start := 1;\n"
+      "    check := 0;\n"
+      "    while start < 100000 do\n"
+      "    begin\n"
+      "        n := start;\n"
+      "        steps := 0;\n"
+      "        while n <> 1 do\n"
+      "        begin\n"
+      "            if n - n div 2 * 2 = 0 then n := n div 2\n"
+      "            else n := 3 * n + 1;\n"
+      "            steps := steps + 1\n"
+      "        end;\n"
+      "        check := check + steps;\n"
+      "        start := start + 1\n"
+      "    end\n"
+      "end.\n",
+      10753712 },
+    { "horner",
+      "program Horner;\n"
+      "var x, y, acc: real;\n"
+      "var i: integer;\n"
+      "var check: boolean;\n"
+      "begin\n"
+      "    x := 0.0;\n"
+      "    acc := 0.0;\n"
+      "    i := 0;\n"
+      "    while i < 10000000 do\n"
+      "    begin\n"
+      "        y := ((2.0 * x + 3.0) * x + 5.0) * x + 7.0;\n"
+      "        acc := acc + y * 0.000001;\n"
+      "        x := x + 0.0000001;\n"
+      "        i := i + 1\n"
+      "    end;\n"
+      "    check := (acc > 109.99) and (acc < 110.01)\n"
+      "end.\n",
+      1 },
+    { "pressure",
+      "program Pressure;\n"
+      "var a, b, c, d, e, f, g, h, p, q, r, s, i, check: integer;\n"
+      "begin\n"
+      "    a := 1; b := 2; c := 3; d := 4; e := 5; f := 6;\n"
+      "    g := 7; h := 8; p := 9; q := 10; r := 11; s := 12;\n"
+      "    i := 0;\n"
+      "    while i < 10000000 do\n"
+      "    begin\n"
+      "        a := a + b; b := b + c; c := c + d; d := d + e; e := e + f; f := f + g;\n"
+      "        g := g + h; h := h + p; p := p + q; q := q + r; r := r + s; s := s + i;\n"
+      "        i := i + 1\n"
+      "    end;\n"
+      "    check := a + b + c + d + e + f + g + h + p + q + r + s\n"
+      "end.\n",
+      -1475852706 },
+    { "loop-with-call",
+      "program LoopWithCall;\n"
+      "var total, i, check: integer;\n"
+      "function step(x: integer): integer;\n"
+      "begin\n"
+      "    total := total + 1;\n"
+      "    step := (x * 7 + 3) div 5\n"
+      "end;\n"
+      "begin\n"
+      "    i := 0;\n"
+      "    while i < 5000000 do\n"
+      "    begin\n"
+      "        check := check + step(i);\n"
+      "        check := check + total;\n"
+      "        i := i + 1\n"
+      "    end\n"
+      "end.\n",
+      -346562560 },
+    { "defined-across-call",
+      "program DefinedAcrossCall;\n"
+      "var g, check: integer;\n"
+      "function peek(x: integer): integer;\n"
+      "begin\n"
+      "    peek := g\n"
+      "end;\n"
+      "procedure bump;\n"
+      "begin\n"
+      "    g := 5 + peek(1)\n"
+      "end;\n"
+      "begin\n"
+      "    check := 3;\n"
+      "    g := 7;\n"
+      "    bump;\n"
+      "    check := check + g\n"
+      "end.\n",
+      15 },
+};
+
+// Writes `bench` as assembly, with or without register allocation, and
+// assembles and links it into `base`.
+static bool buildAsm(const BenchProgram& bench, const AstArena& arena, NodeId programRoot, const SemanticInfo& info,
+                     const std::string& base, bool allocate, RegisterAllocationStats& stats) {
+    {
+        AsmGenerator generator(base + ".s");
+        generator.setRegisterAllocation(allocate);
+        generator.generate(arena, programRoot, info);
+        stats = generator.allocationStats();
+    }
+    if (timeCommand("as " + base + ".s -o " + base + ".o && ld " + base + ".o -o " + base) < 0.0) {
+        std::cerr << "Error: " << bench.name << ": could not assemble " << base << ".s" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int runRegisterAllocationBenchmark(const char* directory, int rounds) {
+    std::filesystem::path dir = directory ? std::filesystem::path(directory) : std::filesystem::temp_directory_path();
+    if (rounds < 1) rounds = 1;
+
+    int status = 0;
+    for (const BenchProgram& bench : loopKernels) {
+        AstArena arena;
+        SemanticInfo info;
+        NodeId programRoot = compileBenchProgram(bench, arena, info);
+        if (!programRoot) return 1;
+
+        std::string base = (dir / (std::string("mpc_") + bench.name)).string();
+        RegisterAllocationStats memoryStats;
+        RegisterAllocationStats registerStats;
+        if (!buildAsm(bench, arena, programRoot, info, base + "_memory", false, memoryStats) ||
+            !buildAsm(bench, arena, programRoot, info, base + "_registers", true, registerStats)) return 1;
+
+        double memoryMs = 0.0;
+        double registerMs = 0.0;
+        bool correct = true;
+        for (int round = 0; round < rounds; ++round) {
+            double elapsed = 0.0;
+            int32_t result = -1;
+            if (!runNative(base + "_memory", elapsed, result)) return 1;
+            if (round == 0 || elapsed < memoryMs) memoryMs = elapsed;
+            correct = correct && result == bench.expected;
+            if (!runNative(base + "_registers", elapsed, result)) return 1;
+            if (round == 0 || elapsed < registerMs) registerMs = elapsed;
+            correct = correct && result == bench.expected;
+        }
+
+        std::cout << bench.name << ": memory " << memoryMs << " ms, registers " << registerMs << " ms, "
+                  << memoryMs / registerMs << "x" << (correct ? "" : ", WRONG RESULT") << std::endl << "  ";
+        printAllocationStats(registerStats, std::cout);
+        if (!correct) status = 1;
+    }
+    return status;
+}
+
+// Element-wise kernels over 1M-element arrays. Each kernel loop starts or
+// stops one element short, so the scalar remainder runs too.
+static const BenchProgram vectorKernels[] = {
+    { "int-add",
+      "program IntAdd;\n"
+      "var a, b, c: array [0..999999] of integer;\n"
+      "var i, round, check: integer;\n"
+      "begin\n"
+      "    i := 0;\n"
+      "    while i < 1000000 do\n"
+      "    begin\n"
+      "        a[i] := i * 3;\n"
+      "        b[i] := 7 - i;\n"
+      "        i := i + 1\n"
+      "    end;\n"
+      "    round := 0;\n"
+      "    while round < 200 do\n"
+      "    begin\n"
+      "        i := 1;\n"
+      "        while i < 1000000 do\n"
+      "        begin\n"
+      "            c[i] := a[i] + b[i - 1] * round;\n"
+      "            i := i + 1\n"
+      "        end;\n"
+      "        round := round + 1\n"
+      "    end;\n"
+      "    check := 0;\n"
+      "    i := 0;\n"
+      "    while i < 1000000 do\n"
+      "    begin\n"
+      "        check := check + c[i];\n"
+      "        i := i + 1\n"
+      "    end\n"
+      "end.\n",
+      -41208760 },
+    { "stencil",
+      "program Stencil;\n"
+      "var src, dst, diff: array [1..1000000] of integer;\n"
+      "var i, round, check: integer;\n"
+      "begin\n"
+      "    i := 1;\n"
+      "    while i <= 1000000 do\n"
+      "    begin\n"
+      "        src[i] := i * i;\n"
+      "        i := i + 1\n"
+      "    end;\n"
+      "    round := 0;\n"
+      "    while round < 200 do\n"
+      "    begin\n"
+      "        i := 2;\n"
+      "        while i <= 999999 do\n"
+      "        begin\n"
+      "            dst[i] := src[i - 1] + 2 * src[i] + src[i + 1];\n"
+      "            diff[i] := -(dst[i] - 4 * src[i]);\n"
+      "            i := i + 1\n"
+      "        end;\n"
+      "        round := round + 1\n"
+      "    end;\n"
+      "    check := 0;\n"
+      "    i := 1;\n"
+      "    while i <= 1000000 do\n"
+      "    begin\n"
+      "        check := check + dst[i] - diff[i];\n"
+      "        i := i + 1\n"
+      "    end\n"
+      "end.\n",
+      -1954387340 },
+    { "daxpy",
+      "program Daxpy;\n"
+      "var x, y, z: array [1..1000000] of real;\n"
+      "var alpha, t, sum: real;\n"
+      "var i, round: integer;\n"
+      "var check: boolean;\n"
+      "begin\n"
+      "    t := 0.0;\n"
+      "    i := 1;\n"
+      "    while i <= 1000000 do\n"
+      "    begin\n"
+      "        x[i] := t * 0.001;\n"
+      "        y[i] := 1.0 - t * 0.000002;\n"
+      "        t := t + 1.0;\n"
+      "        i := i + 1\n"
+      "    end;\n"
+      "    alpha := 0.25;\n"
+      "    round := 0;\n"
+      "    while round < 200 do\n"
+      "    begin\n"
+      "        i := 1;\n"
+      "        while i < 1000000 do\n"
+      "        begin\n"
+      "            z[i] := alpha * x[i] + y[i + 1] / 3.0;\n"
+      "            i := i + 1\n"
+      "        end;\n"
+      "        alpha := alpha + 0.5;\n"
+      "        round := round + 1\n"
+      "    end;\n"
+      "    sum := 0.0;\n"
+      "    i := 1;\n"
+      "    while i <= 1000000 do\n"
+      "    begin\n"
+      "        sum := sum + z[i];\n"
+      "        i := i + 1\n"
+      "    end;\n"
+      "    check := sum > 0.0\n"
+      "end.\n",
+      1 },
+};
+
+// Runs a native program and collects everything it prints.
+static bool captureNative(const std::string& program, double& elapsed, std::string& output) {
+    double start = nowMs();
+    FILE* pipe = popen(program.c_str(), "r");
+    if (!pipe) return false;
+    output.clear();
+    char buffer[4096];
+    size_t read;
+    while ((read = std::fread(buffer, 1, sizeof buffer, pipe)) > 0) output.append(buffer, read);
+    int status = pclose(pipe);
+    elapsed = nowMs() - start;
+    return status == 0;
+}
+
+static int32_t printedCheck(const std::string& output) {
+    size_t at = output.find("check = ");
+    if (at == std::string::npos) return -1;
+    const char* value = output.c_str() + at + 8;
+    if (std::strncmp(value, "true", 4) == 0) return 1;
+    if (std::strncmp(value, "false", 5) == 0) return 0;
+    return std::atoi(value);
+}
+
+// Best of `rounds` runs; the output of the first one is kept.
+static bool timeNative(const std::string& program, int rounds, double& best, std::string& output) {
+    for (int round = 0; round < rounds; ++round) {
+        double elapsed = 0.0;
+        std::string text;
+        if (!captureNative(program, elapsed, text)) return false;
+        if (round == 0) output = text;
+        if (round == 0 || elapsed < best) best = elapsed;
+    }
+    return true;
+}
+
+int runVectorizationBenchmark(const char* directory, int rounds) {
+    std::filesystem::path dir = directory ? std::filesystem::path(directory) : std::filesystem::temp_directory_path();
+    const char* cxx = std::getenv("CXX");
+    std::string compiler = cxx ? cxx : "c++";
+    if (rounds < 1) rounds = 1;
+
+    int status = 0;
+    for (const BenchProgram& bench : vectorKernels) {
+        AstArena arena;
+        SemanticInfo info;
+        NodeId programRoot = compileBenchProgram(bench, arena, info);
+        if (!programRoot) return 1;
+        std::cout << bench.name << ":" << std::endl;
+
+        for (int backend = 0; backend < 2; ++backend) {
+            double times[2] = { 0.0, 0.0 };
+            std::string outputs[2];
+            uint32_t loops = 0;
+            for (int vector = 0; vector < 2; ++vector) {
+                std::string base = (dir / (std::string("mpc_") + bench.name + (vector ? "_vector" : "_scalar"))).string();
+                double built;
+                if (backend == 0) {
+                    AsmGenerator generator(base + ".s");
+                    generator.setVectorization(vector != 0);
+                    generator.generate(arena, programRoot, info);
+                    loops = generator.vectorizedLoops();
+                    built = timeCommand("as " + base + ".s -o " + base + ".o && ld " + base + ".o -o " + base + "_asm");
+                    base += "_asm";
+                }
+                else {
+                    {
+                        CodeGenerator generator(base + ".cpp");
+                        generator.setVectorization(vector != 0);
+                        generator.generate(arena, programRoot, info);
+                        loops = generator.vectorizedLoops();
+                    }
+                    built = timeCommand(compiler + " -O2 -fwrapv " + base + ".cpp -o " + base + "_cpp");
+                    base += "_cpp";
+                }
+                if (built < 0.0 || !timeNative(base, rounds, times[vector], outputs[vector])) {
+                    std::cerr << "Error: " << bench.name << ": could not build or run " << base << std::endl;
+                    return 1;
+                }
+            }
+
+            bool same = outputs[0] == outputs[1];
+            bool correct = printedCheck(outputs[1]) == bench.expected;
+            std::cout << "  " << (backend == 0 ? "assembly: " : "c++ -O2:  ") << "scalar " << times[0] << " ms, vector "
+                      << times[1] << " ms, " << times[0] / times[1] << "x, " << loops << " loop"
+                      << (loops == 1 ? "" : "s") << " vectorized" << (same ? "" : ", OUTPUT DIFFERS")
+                      << (correct ? "" : ", WRONG RESULT") << std::endl;
+            if (!same || !correct) status = 1;
+        }
+    }
+    return status;
+}
+
+// Call-heavy programs: small accessors and helpers called from hot loops.
+// Each leaves a known value in `check`.
+static const BenchProgram callKernels[] = {
+    { "accessors",
+      "program Accessors;\n"
+      "var data: array [0..9999] of integer;\n"
+      "var i, round, check: integer;\n"
+      "function get(k: integer): integer;\n"
+      "begin\n"
+      "    get := data[k]\n"
+      "end;\n"
+      "procedure put(k, v: integer);\n"
+      "begin\n"
+      "    data[k] := v\n"
+      "end;\n"
+      "function clamp(v, low, high: integer): integer;\n"
+      "begin\n"
+      "    if v < low then clamp := low\n"
+      "    else if v > high then clamp := high\n"
+      "    else clamp := v\n"
+      "end;\n"
+      "begin\n"
+      "    round := 0;\n"
+      "    check := 0;\n"
+      "    while round < 1000 do\n"
+      "    begin\n"
+      "        i := 1;\n"
+      "        while i < 10000 do\n"
+      "        begin\n"
+      "            put(i, clamp(get(i - 1) + i - round, -5000, 5000));\n"
+      "            i := i + 1\n"
+      "        end;\n"
+      "        check := check + get(9999);\n"
+      "        round := round + 1\n"
+      "    end\n"
+      "end.\n",
+      5000000 },
+    { "vector-math",
+      "program VectorMath;\n"
+      "var i: integer;\n"
+      "var x, y, acc: real;\n"
+      "var check: boolean;\n"
+      "function sq(v: real): real;\n"
+      "begin\n"
+      "    sq := v * v\n"
+      "end;\n"
+      "function dot(ax, ay, bx, by: real): real;\n"
+      "begin\n"
+      "    dot := ax * bx + ay * by\n"
+      "end;\n"
+      "function norm2(vx, vy: real): real;\n"
+      "begin\n"
+      "    norm2 := sq(vx) + sq(vy)\n"
+      "end;\n"
+      "begin\n"
+      "    acc := 0.0;\n"
+      "    x := 0.0;\n"
+      "    y := 1.0;\n"
+      "    i := 0;\n"
+      "    while i < 10000000 do\n"
+      "    begin\n"
+      "        acc := acc + dot(x, y, 0.5, 0.25) - norm2(x, y) * 0.001;\n"
+      "        x := x + 0.0000001;\n"
+      "        y := y - 0.00000005;\n"
+      "        i := i + 1\n"
+      "    end;\n"
+      "    check := acc > 0.0\n"
+      "end.\n",
+      1 },
+    { "counter",
+      "program Counter;\n"
+      "var count, i, check: integer;\n"
+      "procedure bump(by: integer);\n"
+      "begin\n"
+      "    count := count + by\n"
+      "end;\n"
+      "function odd(v: integer): boolean;\n"
+      "begin\n"
+      "    odd := v - v div 2 * 2 = 1\n"
+      "end;\n"
+      "begin\n"
+      "    i := 0;\n"
+      "    while i < 20000000 do\n"
+      "    begin\n"
+      "        if odd(i) then bump(3) else bump(-1);\n"
+      "        i := i + 1\n"
+      "    end;\n"
+      "    check := count\n"
+      "end.\n",
+      20000000 },
+};
+
+int runInliningBenchmark(const char* directory, int rounds) {
+    std::filesystem::path dir = directory ? std::filesystem::path(directory) : std::filesystem::temp_directory_path();
+    if (rounds < 1) rounds = 1;
+
+    int status = 0;
+    for (const BenchProgram& bench : callKernels) {
+        std::cout << bench.name << ":" << std::endl;
+        double vmTimes[2] = { 0.0, 0.0 };
+        double nativeTimes[2] = { 0.0, 0.0 };
+        size_t inlined = 0;
+        bool correct = true;
+        for (int inlining = 0; inlining < 2; ++inlining) {
+            AstArena arena;
+            SemanticInfo info;
+            NodeId programRoot = compileBenchProgram(bench, arena, info);
+            if (!programRoot) return 1;
+            OptimizationOptions options;
+            if (!inlining) options.inlineBudget = 0;
+            OptimizationReport report;
+            optimize(arena, programRoot, info, options, report);
+            if (inlining) inlined = report.inlined.size();
+
+            RegisterProgram program;
+            compileRegisterBytecode(arena, programRoot, info, program);
+            RegisterVM vm(program);
+            if (!timeEngine(vm, rounds, vmTimes[inlining])) {
+                std::cerr << "Error: " << bench.name << ": register vm: runtime error: " << vm.error() << std::endl;
+                return 1;
+            }
+            correct = correct && checkValue(info, vm.globals()) == bench.expected;
+
+            std::string base = (dir / (std::string("mpc_") + bench.name + (inlining ? "_inlined" : "_calls"))).string();
+            RegisterAllocationStats stats;
+            if (!buildAsm(bench, arena, programRoot, info, base, true, stats)) return 1;
+            std::string output;
+            if (!timeNative(base, rounds, nativeTimes[inlining], output)) {
+                std::cerr << "Error: " << bench.name << ": could not run " << base << std::endl;
+                return 1;
+            }
+            correct = correct && printedCheck(output) == bench.expected;
+        }
+
+        std::cout << "  register vm: calls " << vmTimes[0] << " ms, inlined " << vmTimes[1] << " ms, "
+                  << vmTimes[0] / vmTimes[1] << "x" << std::endl
+                  << "  assembly:    calls " << nativeTimes[0] << " ms, inlined " << nativeTimes[1] << " ms, "
+                  << nativeTimes[0] / nativeTimes[1] << "x" << std::endl
+                  << "  " << inlined << " call site" << (inlined == 1 ? "" : "s") << " inlined"
+                  << (correct ? "" : ", WRONG RESULT") << std::endl;
+        if (!correct) status = 1;
+    }
+    return status;
+}
+
+// A program of `subprograms` functions, each with locals, loops and a call
+// to the one before it, so there is a body of some size to check per task.
+static std::string manySubprogramsSource(int subprograms) {
+    std::string source = "program Many;\nvar total, i: integer;\nvar table: array [1..64] of integer;\n";
+    for (int s = 0; s < subprograms; ++s) {
+        std::string name = "f" + std::to_string(s);
+        source += "function " + name + "(n: integer; scale: real): integer;\n"
+                  "var k, acc: integer;\nvar x: real;\nvar local: array [0..15] of integer;\n"
+                  "begin\n"
+                  "    k := 0;\n    acc := n;\n    x := scale;\n"
+                  "    while k < 16 do\n    begin\n"
+                  "        local[k] := acc * k + " + std::to_string(s) + ";\n"
+                  "        if local[k] > 1000 then acc := acc - local[k] div 7\n"
+                  "        else acc := acc + table[k * 4 + 1];\n"
+                  "        x := x * 0.5 + k / 3;\n"
+                  "        k := k + 1\n    end;\n";
+        if (s > 0) source += "    acc := acc + f" + std::to_string(s - 1) + "(acc - acc div 3 * 3, x);\n";
+        source += "    if (x > 2.0) and not (acc = 0) then " + name + " := acc\n"
+                  "    else " + name + " := acc - 1\n"
+                  "end;\n";
+    }
+    source += "begin\n    i := 1;\n    while i <= 64 do\n    begin\n        table[i] := i;\n        i := i + 1\n    end;\n"
+              "    total := f" + std::to_string(subprograms - 1) + "(3, 1.5)\nend.\n";
+    return source;
+}
+
+static bool sameResolution(const SemanticInfo& a, const SemanticInfo& b) {
+    if (a.variables.size() != b.variables.size() || a.subprograms.size() != b.subprograms.size()) return false;
+    for (size_t i = 0; i < a.refs.size(); ++i) {
+        if (a.refs[i].kind != b.refs[i].kind || a.refs[i].index != b.refs[i].index) return false;
+    }
+    for (size_t i = 0; i < a.subprograms.size(); ++i) {
+        if (a.subprograms[i].frameCells != b.subprograms[i].frameCells) return false;
+    }
+    return a.exprTypes == b.exprTypes;
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+int runParallelCompileBenchmark(int subprograms, int maxThreads) {
+    if (subprograms < 1) subprograms = 1;
+    if (maxThreads < 1) maxThreads = static_cast<int>(std::thread::hardware_concurrency());
+    if (maxThreads < 1) maxThreads = 1;
+    const int rounds = 3;
+
+    std::string source = manySubprogramsSource(subprograms);
+    AstArena arena;
+    setAstArena(&arena);
+    Lexer lexer(source.data(), source.size());
+    ErrorHandler errors;
+    Parser parser(lexer, errors);
+    NodeId programRoot = parser.parseProgram();
+    setAstArena(nullptr);
+    if (parser.errorCount() != 0) {
+        errors.print_errors();
+        std::cerr << "Error: generated program does not parse" << std::endl;
+        return 1;
+    }
+    unsigned cores = std::thread::hardware_concurrency();
+    std::cout << subprograms << " subprograms, " << source.size() / 1024 << " KB of source, "
+              << arena.nodeCount() << " nodes, " << cores << " hardware threads" << std::endl;
+
+    std::string path = (std::filesystem::temp_directory_path() / "mpc_parallel.cpp").string();
+    SemanticInfo serialInfo;
+    std::string serialText;
+    double serialTime = 0.0;
+    int status = 0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        ThreadPool pool(static_cast<unsigned>(threads));
+        double analyzeBest = 0.0, emitBest = 0.0;
+        bool same = true;
+        for (int round = 0; round < rounds; ++round) {
+            SemanticInfo info;
+            SemanticAnalyzer analyzer;
+            analyzer.setThreadPool(&pool);
+            double start = nowMs();
+            if (!analyzer.analyze(arena, programRoot, &info)) {
+                std::cerr << "Error: generated program fails analysis" << std::endl;
+                return 1;
+            }
+            double analyzed = nowMs();
+            {
+                CodeGenerator generator(path);
+                generator.setThreadPool(&pool);
+                generator.generate(arena, programRoot, info);
+            }
+            double emitted = nowMs();
+            if (round == 0 || analyzed - start < analyzeBest) analyzeBest = analyzed - start;
+            if (round == 0 || emitted - analyzed < emitBest) emitBest = emitted - analyzed;
+
+            std::string text = readFile(path);
+            if (threads == 1 && round == 0) {
+                serialInfo = info;
+                serialText = text;
+            }
+            else if (text != serialText || !sameResolution(info, serialInfo)) {
+                same = false;
+            }
+        }
+        if (threads == 1) serialTime = analyzeBest + emitBest;
+        std::cout << "  " << threads << " thread" << (threads == 1 ? ": " : "s:") << " analysis " << analyzeBest
+                  << " ms, C++ " << emitBest << " ms, " << serialTime / (analyzeBest + emitBest) << "x"
+                  << (static_cast<unsigned>(threads) > cores ? " (more threads than hardware threads)" : "")
+                  << (same ? "" : ", OUTPUT DIFFERS") << std::endl;
+        if (!same) status = 1;
+    }
+    std::filesystem::remove(path);
+    return status;
+}
+
+// Replaces the first `from` at or after `at` with `to`.
+static void editSource(std::string& source, size_t at, const std::string& from, const std::string& to) {
+    size_t found = source.find(from, at);
+    if (found != std::string::npos) source.replace(found, from.size(), to);
+}
+
+// One update of `session`, timed, then C++ for it, timed separately since
+// emission always covers the whole program.
+static double rebuild(CompileSession& session, const std::string& source, const std::string& cppPath,
+                      std::string& diagnostics, RebuildStats& stats, double& emitMs) {
+    std::ostringstream messages;
+    double start = nowMs();
+    bool ok = session.update(source.data(), source.size(), messages, stats);
+    double updated = nowMs();
+    if (ok) session.emit(nullptr, cppPath.c_str());
+    emitMs = nowMs() - updated;
+    diagnostics = messages.str();
+    return updated - start;
+}
+
+int runIncrementalBenchmark(int subprograms) {
+    if (subprograms < 3) subprograms = 3;
+    CompileOptions options;
+    std::string source = manySubprogramsSource(subprograms);
+    std::string middle = "function f" + std::to_string(subprograms / 2) + "(";
+    std::cout << subprograms << " subprograms, " << source.size() / 1024 << " KB of source" << std::endl;
+
+    std::string warmPath = (std::filesystem::temp_directory_path() / "mpc_incremental.cpp").string();
+    std::string coldPath = (std::filesystem::temp_directory_path() / "mpc_incremental_full.cpp").string();
+    CompileSession session(options);
+    std::string warmDiagnostics, coldDiagnostics;
+    RebuildStats stats;
+    double emitMs;
+    double first = rebuild(session, source, warmPath, warmDiagnostics, stats, emitMs);
+    std::cout << "  first build: " << first << " ms, C++ " << emitMs << " ms" << std::endl;
+
+    // Each edit applies to the text the previous one left
+    struct Edit {
+        const char* label;
+        std::string from, to;
+        bool inMiddle;
+    };
+    const Edit edits[] = {
+        { "body", "k := k + 1", "k := k + 2", true },
+        { "signature", "scale: real", "scale: integer", true },
+        { "signature back", "scale: integer", "scale: real", true },
+        { "global", "var total, i: integer;", "var extra, total, i: integer;", false },
+        { "main block", "i := 1;", "i := 2;", false },
+        { "new subprogram", "function f1(", "procedure p(n: integer);\nbegin\n    total := n\nend;\nfunction f1(", false },
+    };
+    int status = 0;
+    for (const Edit& edit : edits) {
+        editSource(source, edit.inMiddle ? source.find(middle) : 0, edit.from, edit.to);
+        double warm = rebuild(session, source, warmPath, warmDiagnostics, stats, emitMs);
+        double cold, coldEmitMs;
+        {
+            CompileSession fresh(options);
+            RebuildStats freshStats;
+            cold = rebuild(fresh, source, coldPath, coldDiagnostics, freshStats, coldEmitMs);
+        }
+        bool same = warmDiagnostics == coldDiagnostics && readFile(warmPath) == readFile(coldPath);
+        std::cout << "  " << edit.label << ": " << warm << " ms (" << stats.reparsed << " reparsed, " << stats.rechecked
+                  << " re-checked" << (warmDiagnostics.empty() ? "" : ", with errors") << "), from scratch " << cold
+                  << " ms, " << cold / warm << "x; C++ " << emitMs << " ms" << (same ? "" : ", OUTPUT DIFFERS")
+                  << std::endl;
+        if (!same) status = 1;
+    }
+    std::filesystem::remove(warmPath);
+    std::filesystem::remove(coldPath);
+    return status;
+}
+
+static bool writeFile(const std::string& path, const std::string& bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    out.close();
+    return !out.fail();
+}
+
+static bool sameSemanticInfo(const SemanticInfo& a, const SemanticInfo& b) {
+    if (a.globalCells != b.globalCells || a.variables.size() != b.variables.size() ||
+        a.subprograms.size() != b.subprograms.size() || a.refs.size() != b.refs.size() ||
+        a.exprTypes != b.exprTypes || a.boundsProven != b.boundsProven) {
+        return false;
+    }
+    for (size_t i = 0; i < a.variables.size(); ++i) {
+        const VariableInfo& x = a.variables[i];
+        const VariableInfo& y = b.variables[i];
+        if (x.name != y.name || x.type != y.type || x.storage != y.storage || x.slot != y.slot || x.cells != y.cells ||
+            x.owner != y.owner || x.isParameter != y.isParameter || x.isTemporary != y.isTemporary ||
+            x.isUnused != y.isUnused) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < a.subprograms.size(); ++i) {
+        const SubprogramInfo& x = a.subprograms[i];
+        const SubprogramInfo& y = b.subprograms[i];
+        if (x.name != y.name || x.node != y.node || x.isFunction != y.isFunction || x.returnType != y.returnType ||
+            x.firstParam != y.firstParam || x.paramCount != y.paramCount || x.paramCells != y.paramCells ||
+            x.resultSlot != y.resultSlot || x.frameCells != y.frameCells || x.isReachable != y.isReachable) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < a.refs.size(); ++i) {
+        if (a.refs[i].kind != b.refs[i].kind || a.refs[i].index != b.refs[i].index) return false;
+    }
+    return true;
+}
+
+static bool sameNames(const StringInterner& a, const StringInterner& b) {
+    if (a.size() != b.size()) return false;
+    for (NameId id = 1; id <= a.size(); ++id) {
+        if (a.length(id) != b.length(id) || std::memcmp(a.spelling(id), b.spelling(id), a.length(id)) != 0) return false;
+    }
+    return true;
+}
+
+// A tree file for `source` from a fresh Compilation, with its C++.
+static bool writeTreeOf(const CompileOptions& options, const std::string& source, const std::string& astPath,
+                        const std::string& cppPath) {
+    Compilation compilation(options, std::cerr);
+    if (!compilation.parse(source.c_str()) || !compilation.analyze(true) || !compilation.save(astPath.c_str())) {
+        return false;
+    }
+    emitNative(options, compilation.arena, compilation.root, compilation.info, nullptr, cppPath.c_str());
+    return true;
+}
+
+int runAstFileTest(const char* path) {
+    std::filesystem::path temp = std::filesystem::temp_directory_path();
+    std::string source = path ? path : (temp / "mpc_tree.pas").string();
+    std::string astPath = (temp / "mpc_tree.ast").string();
+    std::string badPath = (temp / "mpc_tree_bad.ast").string();
+    std::string cppPath = (temp / "mpc_tree.cpp").string();
+    std::string loadedCppPath = (temp / "mpc_tree_loaded.cpp").string();
+    if (!path) writeFile(source, manySubprogramsSource(200));
+
+    CompileOptions options;
+    options.descentParser = options.fastLexer = true;
+    int failures = 0;
+    auto check = [&](bool ok, const char* what) {
+        if (!ok) {
+            std::cerr << "FAILED: " << what << std::endl;
+            ++failures;
+        }
+    };
+
+    // Straight from the parser, against the same file loaded back
+    {
+        Compilation parsed(options, std::cerr);
+        if (!parsed.parse(source.c_str()) || !parsed.analyze(true) || !parsed.save(astPath.c_str())) return 1;
+        emitNative(options, parsed.arena, parsed.root, parsed.info, nullptr, cppPath.c_str());
+
+        Compilation loaded(options, std::cerr);
+        check(loaded.load(astPath.c_str()), "load");
+        check(loaded.root == parsed.root && loaded.arena.nodeCount() == parsed.arena.nodeCount() &&
+                  std::memcmp(loaded.arena.data(), parsed.arena.data(), loaded.arena.bytesUsed()) == 0,
+              "nodes");
+        check(sameNames(loaded.names, parsed.names), "names");
+        check(sameSemanticInfo(loaded.info, parsed.info), "semantic info");
+        emitNative(options, loaded.arena, loaded.root, loaded.info, nullptr, loadedCppPath.c_str());
+        check(readFile(cppPath) == readFile(loadedCppPath), "C++ from the loaded tree");
+        std::cout << parsed.arena.nodeCount() << " nodes, " << parsed.names.size() << " names, "
+                  << std::filesystem::file_size(astPath) / 1024 << " KB tree file" << std::endl;
+    }
+
+    // Optimized after loading, which writes to the copy-on-write mapping
+    // and grows the arena out of it, then saved and loaded once more
+    {
+        options.optimize = true;
+        std::string optimizedPath = (temp / "mpc_tree_optimized.ast").string();
+        Compilation parsed(options, std::cerr);
+        OptimizationReport report;
+        if (!parsed.parse(source.c_str()) || !parsed.analyze(true)) return 1;
+        parsed.optimize(report);
+        emitNative(options, parsed.arena, parsed.root, parsed.info, nullptr, cppPath.c_str());
+
+        std::string before = readFile(astPath);
+        {
+            Compilation loaded(options, std::cerr);
+            check(loaded.load(astPath.c_str()), "load for optimizing");
+            loaded.optimize(report);
+            emitNative(options, loaded.arena, loaded.root, loaded.info, nullptr, loadedCppPath.c_str());
+            check(readFile(cppPath) == readFile(loadedCppPath), "C++ from the loaded tree, optimized");
+            check(loaded.save(optimizedPath.c_str()), "save the optimized tree");
+        }
+        check(readFile(astPath) == before, "file untouched by optimizing its mapping");
+        {
+            Compilation loaded(options, std::cerr);
+            check(loaded.load(optimizedPath.c_str()), "load the optimized tree");
+            emitNative(options, loaded.arena, loaded.root, loaded.info, nullptr, loadedCppPath.c_str());
+            check(readFile(cppPath) == readFile(loadedCppPath), "C++ from the optimized tree file");
+        }
+        std::filesystem::remove(optimizedPath);
+        options.optimize = false;
+    }
+
+    // Damaged files are refused, not walked
+    std::string good = readFile(astPath);
+    struct Damage {
+        const char* label;
+        size_t offset;
+        uint32_t value;
+        size_t keep;
+    };
+    uint64_t nodesAt;   // the node section's offset, first in the section table
+    std::memcpy(&nodesAt, good.data() + 56, sizeof(nodesAt));
+    const Damage damages[] = {
+        { "wrong magic", 0, 0x21212121u, good.size() },
+        { "other version", 8, AST_FILE_VERSION + 1, good.size() },
+        { "other byte order", 12, 0x04030201u, good.size() },
+        { "truncated", 0, 0, good.size() / 2 },
+        { "empty", 0, 0, 0 },
+        { "child out of range", static_cast<size_t>(nodesAt) + sizeof(ASTNode) + offsetof(ASTNode, firstChild),
+          0x7FFFFFFFu, good.size() },
+    };
+    for (const Damage& damage : damages) {
+        std::string bad = good.substr(0, damage.keep);
+        if (damage.keep == good.size()) std::memcpy(&bad[damage.offset], &damage.value, sizeof(damage.value));
+        writeFile(badPath, bad);
+        std::ostringstream diagnostics;
+        Compilation loaded(options, diagnostics);
+        bool refused = !loaded.load(badPath.c_str()) && !diagnostics.str().empty();
+        check(refused, damage.label);
+    }
+
+    std::filesystem::remove(astPath);
+    std::filesystem::remove(badPath);
+    std::filesystem::remove(cppPath);
+    std::filesystem::remove(loadedCppPath);
+    if (!path) std::filesystem::remove(source);
+    std::cout << (failures ? "tree file check FAILED" : "tree file check passed") << std::endl;
+    return failures ? 1 : 0;
+}
+
+int runAstLoadBenchmark(int subprograms) {
+    if (subprograms < 1) subprograms = 1;
+    const int rounds = 5;
+    std::filesystem::path temp = std::filesystem::temp_directory_path();
+    std::string source = (temp / "mpc_load.pas").string();
+    std::string astPath = (temp / "mpc_load.ast").string();
+    std::string parsedCpp = (temp / "mpc_load_parsed.cpp").string();
+    std::string loadedCpp = (temp / "mpc_load_loaded.cpp").string();
+    writeFile(source, manySubprogramsSource(subprograms));
+
+    CompileOptions options;
+    options.descentParser = options.fastLexer = true;
+    if (!writeTreeOf(options, source, astPath, parsedCpp)) return 1;
+    std::cout << subprograms << " subprograms, " << std::filesystem::file_size(source) / 1024 << " KB of source, "
+              << std::filesystem::file_size(astPath) / 1024 << " KB tree file" << std::endl;
+
+    double parseBest = 0.0, loadBest = 0.0, walkBest = 0.0;
+    size_t walked = 0;
+    bool same = true;
+    for (int round = 0; round < rounds; ++round) {
+        {
+            Compilation compilation(options, std::cerr);
+            double start = nowMs();
+            if (!compilation.parse(source.c_str()) || !compilation.analyze(true)) return 1;
+            double elapsed = nowMs() - start;
+            if (round == 0 || elapsed < parseBest) parseBest = elapsed;
+        }
+        {
+            Compilation compilation(options, std::cerr);
+            double start = nowMs();
+            if (!compilation.load(astPath.c_str())) return 1;
+            double elapsed = nowMs() - start;
+            if (round == 0 || elapsed < loadBest) loadBest = elapsed;
+        }
+        {
+            Compilation compilation(options, std::cerr);
+            double start = nowMs();
+            if (!compilation.load(astPath.c_str())) return 1;
+            walked = subtreeSize(compilation.arena, compilation.root);
+            double elapsed = nowMs() - start;
+            if (round == 0 || elapsed < walkBest) walkBest = elapsed;
+            if (round == 0) {
+                emitNative(options, compilation.arena, compilation.root, compilation.info, nullptr, loadedCpp.c_str());
+                same = readFile(parsedCpp) == readFile(loadedCpp);
+            }
+        }
+    }
+    std::cout << "  parse + analyze: " << parseBest << " ms" << std::endl
+              << "  load:            " << loadBest << " ms, " << parseBest / loadBest << "x" << std::endl
+              << "  load + walk:     " << walkBest << " ms (" << walked << " nodes), " << parseBest / walkBest << "x"
+              << (same ? "" : ", OUTPUT DIFFERS") << std::endl;
+
+    std::filesystem::remove(source);
+    std::filesystem::remove(astPath);
+    std::filesystem::remove(parsedCpp);
+    std::filesystem::remove(loadedCpp);
+    return same ? 0 : 1;
+}
+
+// The token mix a code generator writes, `rounds` times over, to any sink
+// with operator<<.
+template <typename Sink>
+static void writeTokens(Sink& out, int rounds, const std::vector<double>& reals) {
+    for (int round = 0; round < rounds; ++round) {
+        for (size_t i = 0; i < reals.size(); ++i) {
+            int value = static_cast<int>((i * 2654435761u >> 7) & 0xFFFFFF) - (1 << 23);
+            out << "    v_total = (v_total + pascal_at(v_table, " << value << ", " << static_cast<long long>(i)
+                << ")) * " << reals[i] << ";\n";
+        }
+    }
+}
+
+int runEmitterBenchmark(int subprograms, int maxThreads) {
+    if (subprograms < 1) subprograms = 1;
+    if (maxThreads < 1) maxThreads = static_cast<int>(std::thread::hardware_concurrency());
+    if (maxThreads < 1) maxThreads = 1;
+    const int rounds = 3;
+    std::filesystem::path temp = std::filesystem::temp_directory_path();
+    std::string path = (temp / "mpc_emit.txt").string();
+    int status = 0;
+
+    // Doubles of every magnitude, from random bit patterns
+    std::vector<double> reals;
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    while (reals.size() < 100000) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        double value;
+        std::memcpy(&value, &seed, sizeof(value));
+        if (value == value && value - value == 0) reals.push_back(value);
+    }
+
+    double streamBest = 0.0, bufferBest = 0.0;
+    size_t bytes = 0;
+    const int tokenRounds = 20;
+    for (int round = 0; round < rounds; ++round) {
+        double start = nowMs();
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.precision(17);
+            writeTokens(out, tokenRounds, reals);
+        }
+        double streamed = nowMs();
+        {
+            OutputBuffer out;
+            out.open(path);
+            writeTokens(out, tokenRounds, reals);
+            out.close();
+        }
+        double buffered = nowMs();
+        if (round == 0 || streamed - start < streamBest) streamBest = streamed - start;
+        if (round == 0 || buffered - streamed < bufferBest) bufferBest = buffered - streamed;
+        bytes = static_cast<size_t>(std::filesystem::file_size(path));
+    }
+
+    // The last file came from the OutputBuffer; its doubles have to read back exactly
+    size_t wrong = 0;
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string line;
+        for (size_t i = 0; i < reals.size() && std::getline(in, line); ++i) {
+            size_t star = line.rfind("* ");
+            if (star == std::string::npos || std::strtod(line.c_str() + star + 2, nullptr) != reals[i]) ++wrong;
+        }
+    }
+    double megabytes = bytes / (1024.0 * 1024.0);
+    std::cout << "token stream, " << megabytes << " MB:" << std::endl
+              << "  ofstream:     " << streamBest << " ms, " << megabytes * 1000 / streamBest << " MB/s" << std::endl
+              << "  OutputBuffer: " << bufferBest << " ms, " << megabytes * 1000 / bufferBest << " MB/s, "
+              << streamBest / bufferBest << "x" << (wrong ? ", DOUBLES DO NOT ROUND-TRIP" : "") << std::endl;
+    if (wrong) status = 1;
+
+    // The C++ generator on a large program
+    std::string source = manySubprogramsSource(subprograms);
+    AstArena arena;
+    setAstArena(&arena);
+    Lexer lexer(source.data(), source.size());
+    ErrorHandler errors;
+    Parser parser(lexer, errors);
+    NodeId programRoot = parser.parseProgram();
+    setAstArena(nullptr);
+    SemanticInfo info;
+    SemanticAnalyzer analyzer;
+    if (parser.errorCount() != 0 || !analyzer.analyze(arena, programRoot, &info)) {
+        std::cerr << "Error: generated program does not compile" << std::endl;
+        return 1;
+    }
+
+    std::string cppPath = (temp / "mpc_emit.cpp").string();
+    std::string serialText;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        ThreadPool pool(static_cast<unsigned>(threads));
+        double best = 0.0;
+        bool same = true;
+        for (int round = 0; round < rounds; ++round) {
+            double start = nowMs();
+            {
+                CodeGenerator generator(cppPath);
+                generator.setThreadPool(&pool);
+                generator.generate(arena, programRoot, info);
+            }
+            double elapsed = nowMs() - start;
+            if (round == 0 || elapsed < best) best = elapsed;
+            std::string text = readFile(cppPath);
+            if (serialText.empty()) serialText = text;
+            else if (text != serialText) same = false;
+        }
+        double size = serialText.size() / (1024.0 * 1024.0);
+        if (threads == 1) std::cout << "C++ for " << subprograms << " subprograms, " << size << " MB:" << std::endl;
+        std::cout << "  " << threads << " thread" << (threads == 1 ? ": " : "s:") << " " << best << " ms, "
+                  << size * 1000 / best << " MB/s" << (same ? "" : ", OUTPUT DIFFERS") << std::endl;
+        if (!same) status = 1;
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(cppPath);
+    return status;
+}
+
+// manySubprogramsSource with two semantic errors in every `every`th body:
+// an undeclared name, which also makes the assignment a type mismatch.
+static std::string faultySubprogramsSource(int subprograms, int every) {
+    std::string source = manySubprogramsSource(subprograms);
+    size_t at = 0;
+    for (int s = 0; s < subprograms; s += every) {
+        at = source.find("function f" + std::to_string(s) + "(", at);
+        at = source.find("    acc := n;\n", at);
+        source.insert(at, "    acc := missing" + std::to_string(s) + " * 2.5;\n");
+    }
+    return source;
+}
+
+// Whether each of `errors` points into `source` where the name it is about
+// starts: the undeclared name, or the assignment's target.
+static bool pointsAtNames(const ErrorHandler& errors, const std::string& source) {
+    std::vector<size_t> lineStarts(1, 0);
+    for (size_t i = 0; i < source.size(); ++i) {
+        if (source[i] == '\n') lineStarts.push_back(i + 1);
+    }
+    for (const Diagnostic& diagnostic : errors.diagnostics()) {
+        if (diagnostic.line == 0 || diagnostic.line > lineStarts.size() || diagnostic.column == 0) return false;
+        std::string_view expected = diagnostic.code == DiagnosticCode::UNDECLARED_IDENTIFIER
+                                        ? errors.argument(diagnostic, 0)
+                                        : std::string_view("acc");
+        size_t at = lineStarts[diagnostic.line - 1] + diagnostic.column - 1;
+        if (expected.empty() || source.compare(at, expected.size(), expected) != 0) return false;
+    }
+    return true;
+}
+
+// What a fresh Compilation prints for `path`, and whether its diagnostics
+// point at the right names.
+static std::string compileDiagnostics(const CompileOptions& options, const std::string& path,
+                                      const std::string& source, ThreadPool* pool, bool& located) {
+    std::ostringstream out;
+    Compilation compilation(options, out);
+    if (compilation.parse(path.c_str())) compilation.analyze(true, pool);
+    located = pointsAtNames(compilation.errors, source);
+    return out.str();
+}
+
+int runDiagnosticsTest(int subprograms) {
+    if (subprograms < 10) subprograms = 10;
+    std::string path = (std::filesystem::temp_directory_path() / "mpc_diagnostics.pas").string();
+    std::string source = faultySubprogramsSource(subprograms, 10);
+    size_t planted = static_cast<size_t>((subprograms + 9) / 10) * 2;
+    writeFile(path, source);
+
+    CompileOptions options;
+    options.fastLexer = true;
+    options.maxErrors = planted + 1;
+    int failures = 0;
+    auto check = [&](bool ok, const char* what) {
+        if (!ok) {
+            std::cerr << "FAILED: " << what << std::endl;
+            ++failures;
+        }
+    };
+    std::cout << subprograms << " subprograms, " << planted << " errors planted" << std::endl;
+
+    // The same diagnostics, at the same places, from both parsers, serially
+    // and on four threads
+    ThreadPool pool(4);
+    bool located;
+    std::string expected = compileDiagnostics(options, path, source, nullptr, located);
+    check(located, "bison parser positions");
+    check(std::count(expected.begin(), expected.end(), '\n') == static_cast<std::ptrdiff_t>(planted + 1),
+          "number of diagnostics");
+    check(compileDiagnostics(options, path, source, &pool, located) == expected && located, "bison parser, 4 threads");
+    options.descentParser = true;
+    check(compileDiagnostics(options, path, source, nullptr, located) == expected && located,
+          "recursive descent parser");
+    check(compileDiagnostics(options, path, source, &pool, located) == expected && located,
+          "recursive descent parser, 4 threads");
+
+    // A session that keeps subprograms across edits has to move their
+    // diagnostics along with them
+    struct Edit {
+        const char* label;
+        std::string from, to;
+    };
+    const Edit edits[] = {
+        { "lines above every subprogram", "var total, i: integer;\n", "var total, i: integer;\n\n\n" },
+        { "indented subprogram", "function f10(", "  function f10(" },
+        { "line in the middle", "function f" + std::to_string(subprograms / 2) + "(",
+          "\nfunction f" + std::to_string(subprograms / 2) + "(" },
+        { "fixed error", "missing0 * 2.5", "n" },
+    };
+    for (ThreadPool* sessionPool : { static_cast<ThreadPool*>(nullptr), &pool }) {
+        std::string text = source;
+        CompileSession session(options, sessionPool);
+        RebuildStats stats;
+        std::ostringstream first;
+        session.update(text.data(), text.size(), first, stats);
+        check(first.str() == expected, "first session update");
+        for (const Edit& edit : edits) {
+            editSource(text, 0, edit.from, edit.to);
+            std::ostringstream out;
+            session.update(text.data(), text.size(), out, stats);
+            writeFile(path, text);
+            std::string fresh = compileDiagnostics(options, path, text, nullptr, located);
+            check(located && out.str() == fresh, edit.label);
+        }
+    }
+
+    // Recording costs a few words per diagnostic; the text is only put
+    // together when it is printed
+    {
+        writeFile(path, source);
+        std::ostringstream ignored;
+        Compilation compilation(options, ignored);
+        compilation.parse(path.c_str());
+        SemanticAnalyzer analyzer;
+        double start = nowMs();
+        analyzer.analyze(compilation.arena, compilation.root);
+        double unrecorded = nowMs() - start;
+        ErrorHandler errors;
+        errors.set_max_errors(options.maxErrors);
+        analyzer.setErrorHandler(&errors);
+        start = nowMs();
+        analyzer.analyze(compilation.arena, compilation.root);
+        double recorded = nowMs() - start;
+        std::ostringstream text, json;
+        start = nowMs();
+        errors.print_errors(text);
+        double textMs = nowMs() - start;
+        start = nowMs();
+        errors.print_json(json);
+        double jsonMs = nowMs() - start;
+        check(errors.error_count() == planted, "recorded diagnostics");
+        std::cout << "  " << errors.error_count() << " diagnostics of " << sizeof(Diagnostic)
+                  << " bytes; analysis " << unrecorded << " ms, recording them " << recorded << " ms; text "
+                  << textMs << " ms (" << text.str().size() / 1024 << " KB), JSON " << jsonMs << " ms ("
+                  << json.str().size() / 1024 << " KB)" << std::endl;
+    }
+
+    std::filesystem::remove(path);
+    std::cout << (failures ? "diagnostics check FAILED" : "diagnostics check passed") << std::endl;
+    return failures ? 1 : 0;
+}
+
+// The entry files below a cache directory.
+static std::vector<std::filesystem::path> cacheEntries(const std::string& directory, uint64_t& bytes) {
+    std::vector<std::filesystem::path> entries;
+    bytes = 0;
+    std::error_code error;
+    std::filesystem::recursive_directory_iterator it(directory, error), end;
+    for (; !error && it != end; it.increment(error)) {
+        if (it->path().extension() != ".entry") continue;
+        entries.push_back(it->path());
+        bytes += it->file_size(error);
+    }
+    return entries;
+}
+
+int runCacheTest() {
+    std::filesystem::path temp = std::filesystem::temp_directory_path();
+    std::string directory = (temp / "mpc_cache_check").string();
+    std::string path = (temp / "mpc_cache_check.pas").string();
+    std::string cppPath = (temp / "mpc_cache_check.cpp").string();
+    std::filesystem::remove_all(directory);
+    std::string source = manySubprogramsSource(50);
+    writeFile(path, source);
+
+    CompileOptions options;
+    options.fastLexer = true;
+    int failures = 0;
+    auto check = [&](bool ok, const char* what) {
+        if (!ok) {
+            std::cerr << "FAILED: " << what << std::endl;
+            ++failures;
+        }
+    };
+
+    // A miss compiles and stores; the same source and options then hit
+    // and write the same output
+    {
+        CompileCache cache(directory, 64 * 1024 * 1024);
+        std::ostringstream log;
+        bool hit;
+        bool ok = compileCached(&cache, path.c_str(), options, nullptr, cppPath.c_str(), log, hit);
+        check(ok && !hit, "first compile misses");
+        std::string compiled = readFile(cppPath);
+        std::filesystem::remove(cppPath);
+        ok = compileCached(&cache, path.c_str(), options, nullptr, cppPath.c_str(), log, hit);
+        check(ok && hit && readFile(cppPath) == compiled, "second compile hits with the same C++");
+
+        // One byte of source or one option makes a different key
+        std::string edited = source;
+        edited[edited.find("i := 1;") + 5] = '2';
+        writeFile(path, edited);
+        compileCached(&cache, path.c_str(), options, nullptr, cppPath.c_str(), log, hit);
+        check(!hit, "one-byte edit misses");
+        writeFile(path, source);
+        compileCached(&cache, path.c_str(), options, nullptr, cppPath.c_str(), log, hit);
+        check(hit, "edit undone hits");
+        CompileOptions changed = options;
+        changed.vectorize = false;
+        compileCached(&cache, path.c_str(), changed, nullptr, cppPath.c_str(), log, hit);
+        check(!hit, "option change misses");
+        compileCached(&cache, path.c_str(), options, cppPath.c_str(), nullptr, log, hit);
+        check(!hit, "other output misses");
+
+        CacheStats stats = cache.stats();
+        std::cout << "hits and misses: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.stores
+                  << " stored" << std::endl;
+        check(stats.hits == 2 && stats.misses == 4 && stats.stores == 4, "hit and miss counts");
+    }
+
+    // Entries of a known size: once a store takes the directory over the
+    // cap, the least recently used go until it is under three quarters
+    std::filesystem::remove_all(directory);
+    {
+        CacheEntry entry;
+        entry.ok = true;
+        entry.cpp.assign(8000, 'x');
+        uint64_t entryBytes = sizeof(uint64_t) * 5 + 8 + 1 + entry.cpp.size();
+        uint64_t cap = entryBytes * 8 + 100;
+        CompileCache cache(directory, cap);
+        std::vector<CacheKey> keys;
+        for (int i = 0; i < 9; ++i) {
+            std::string variant = source + "{" + std::to_string(i) + "}";
+            keys.push_back(cache.key(variant.data(), variant.size(), options, false, true));
+        }
+        CacheEntry found;
+        for (int i = 0; i < 8; ++i) {
+            cache.store(keys[i], entry);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        check(cache.lookup(keys[0], found), "entry under the cap");
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        cache.store(keys[8], entry);
+
+        uint64_t bytes;
+        size_t left = cacheEntries(directory, bytes).size();
+        std::cout << "eviction: " << cache.stats().evictions << " of 9 entries evicted, " << bytes << " of " << cap
+                  << " bytes left" << std::endl;
+        check(bytes <= cap / 4 * 3 && left == 6, "evicted down to three quarters of the cap");
+        check(cache.lookup(keys[0], found), "recently used entry kept");
+        check(!cache.lookup(keys[1], found) && !cache.lookup(keys[3], found), "least recently used entries evicted");
+        check(cache.lookup(keys[4], found) && cache.lookup(keys[8], found), "newer entries kept");
+    }
+
+    // A damaged entry is a miss, and compiling over it stores a good one
+    std::filesystem::remove_all(directory);
+    {
+        CompileCache cache(directory, 64 * 1024 * 1024);
+        std::ostringstream log;
+        bool hit;
+        compileCached(&cache, path.c_str(), options, nullptr, cppPath.c_str(), log, hit);
+        std::string compiled = readFile(cppPath);
+        uint64_t bytes;
+        std::vector<std::filesystem::path> entries = cacheEntries(directory, bytes);
+        check(entries.size() == 1, "one entry stored");
+        if (entries.size() == 1) {
+            std::string good = readFile(entries[0].string());
+            std::string bad[] = { good.substr(0, good.size() / 2), good + "x", good };
+            bad[2][0] = 'X';
+            const char* what[] = { "half-written entry misses", "entry with trailing bytes misses",
+                                   "entry with a bad header misses" };
+            for (int i = 0; i < 3; ++i) {
+                writeFile(entries[0].string(), bad[i]);
+                bool ok = compileCached(&cache, path.c_str(), options, nullptr, cppPath.c_str(), log, hit);
+                check(ok && !hit && readFile(cppPath) == compiled, what[i]);
+                check(readFile(entries[0].string()) == good, "damaged entry replaced");
+            }
+            compileCached(&cache, path.c_str(), options, nullptr, cppPath.c_str(), log, hit);
+            check(hit, "replaced entry hits");
+        }
+    }
+
+    std::filesystem::remove_all(directory);
+    std::filesystem::remove(path);
+    std::filesystem::remove(cppPath);
+    std::cout << (failures ? "cache check FAILED" : "cache check passed") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstddef>
+
+// Peak resident set size of the current process in kilobytes (0 if unknown).
+size_t peakResidentSetKB();
+
+// Elapsed wall-clock time in milliseconds since an arbitrary fixed point.
+double nowMs();
+
+// Parses and analyzes a synthetic program of `statements` assignments and
+// reports parse and analysis time, arena usage and peak RSS.
+int runParseBenchmark(int statements);
+
+// Tokenizes `path` (or a synthetic source when null) `iterations` times with
+// the hand-written Lexer under each scan kernel, with the Lexer behind
+// yylex(), and with flex, and reports throughput in MB/s.
+int runLexerBenchmark(const char* path, int iterations);
+
+// Checks that every scan kernel produces the same tokens as the scalar one,
+// and that the Lexer feeds the parser the same tokens as flex, on `path` (or
+// the synthetic source) and on random inputs. Returns 1 on any mismatch.
+int runLexerDifferentialTest(const char* path);
+
+// Parses a synthetic program of `statements` assignments with bison and
+// with the recursive-descent parser, both fed by the hand-written lexer,
+// and reports throughput, node count, tree depth and whether the ASTs match.
+int runParserComparisonBenchmark(int statements);
+
+// Parses a synthetic program where every `errorEvery`-th (at least every
+// second) of `statements` statements has one mistake, with both parsers,
+// with and without the error cap, and reports time and the number of
+// errors found. Fails unless each parser reports one error per mistake, or
+// the cap.
+int runErrorRecoveryBenchmark(int statements, int errorEvery);
+
+// Times lookups and scope entry/exit in SymbolTable against a map-per-scope
+// table, over `depth` nested scopes and `subprograms` sibling scopes.
+int runSymbolTableBenchmark(int depth, int subprograms);
+
+// Runs a set of small programs (loops, arrays, recursion, reals) on the
+// tree walker, the stack VM, the register VM and the IR interpreter,
+// checking a result variable and reporting the best of `rounds` run times
+// and the dispatch counts.
+int runVMBenchmark(int rounds);
+
+// Runs programs whose and/or, calls and array reads could trap or have side
+// effects on the tree walker, as written and after optimize(), and checks
+// that both leave the same globals or stop with the same runtime error.
+int runOptimizerTest();
+
+// Builds the same programs natively, once through the assembly backend with
+// as and ld and once through the C++ emitter with $CXX (default c++) -O2,
+// in `directory` (the temp directory when null), and reports generation,
+// build and run times for both.
+int runNativeBenchmark(const char* directory);
+
+// Builds a set of loop kernels with the assembly backend with every variable
+// in memory and with register allocation, runs both `rounds` times and
+// reports the best times and the allocator's spill and reload counts.
+int runRegisterAllocationBenchmark(const char* directory, int rounds);
+
+// Builds element-wise kernels over 1M-element arrays with both native
+// backends, with and without vectorized loops, runs each `rounds` times and
+// reports the best times; scalar and vector builds must print the same.
+int runVectorizationBenchmark(const char* directory, int rounds);
+
+// Runs call-heavy programs optimized with and without inlining on the
+// register VM and through the assembly backend, `rounds` times each, and
+// reports the best times and the inlined call sites; both builds must
+// leave the expected value in `check`.
+int runInliningBenchmark(const char* directory, int rounds);
+
+// Analyzes a generated program of `subprograms` functions and emits it as
+// C++ on 1, 2, 4, ... up to `maxThreads` threads (0: the hardware threads),
+// reporting the best times and the speedup over one thread. Past one thread
+// analysis pays for a second pass over the declarations, so it only comes
+// out ahead with spare cores; rows with more threads than the machine has
+// are marked. Every run has to produce the same C++ and the same resolution
+// as the serial one.
+int runParallelCompileBenchmark(int subprograms, int maxThreads);
+
+// Makes a series of edits to a generated program of `subprograms` functions
+// (one body, one signature, a global, the main block, a new subprogram) and
+// rebuilds it with a CompileSession after each, reporting the time and what
+// was redone against compiling the edited text from scratch, and the time
+// C++ emission adds; both have to print the same diagnostics and emit the
+// same C++.
+int runIncrementalBenchmark(int subprograms);
+
+// Writes the analyzed tree of `path` (null: a generated program) in the
+// format of ast_file.h and loads it back, checking that the nodes, names
+// and resolution come back the same and emit the same C++, also after
+// optimizing the loaded tree and saving it again, and that damaged files
+// are refused.
+int runAstFileTest(const char* path);
+
+// Compares parsing and analyzing a generated program of `subprograms`
+// functions with loading the tree file written for it, with and without a
+// walk over every node, and reports the file size; both have to emit the
+// same C++.
+int runAstLoadBenchmark(int subprograms);
+
+// Measures the throughput of the code generators' OutputBuffer against an
+// ofstream on the same stream of names, integers, doubles and punctuation,
+// checking that every double reads back as the same value, then times C++
+// emission of a generated program of `subprograms` functions on 1, 2, 4,
+// ... up to `maxThreads` threads (0: the hardware threads), which has to
+// produce the same file every time.
+int runEmitterBenchmark(int subprograms, int maxThreads);
+
+// Plants errors in a program of `subprograms` subprograms and checks that
+// each diagnostic points at what it is about, that both parsers and any
+// number of threads report the same, and that an incremental session moves
+// the diagnostics of subprograms an edit shifted. Then times recording
+// them against printing them as text and as JSON.
+int runDiagnosticsTest(int subprograms);
+
+// Checks the on-disk compilation cache in a scratch directory: a miss then
+// a hit, misses after a one-byte edit or an option change, least recently
+// used eviction down to three quarters of the cap, and damaged entries
+// read as misses.
+int runCacheTest();
+
+#endif // BENCHMARK_H
@@ -0,0 +1,421 @@
+#include "bytecode.h"
+
+#include <cstring>
+#include <iomanip>
+
+static const char* const opcodeNames[BC_OPCODE_COUNT] = {
+#define BYTECODE_NAME(name) #name,
+    BYTECODE_OPS(BYTECODE_NAME)
+#undef BYTECODE_NAME
+};
+
+const char* opcodeName(Opcode op) {
+    return op < BC_OPCODE_COUNT ? opcodeNames[op] : "?";
+}
+
+// Operand layout per opcode for the disassembler: u = u32, i = i32,
+// r = relative jump target.
+static const char* operandLayout(Opcode op) {
+    switch (op) {
+    case BC_PUSH_INT:
+        return "i";
+    case BC_PUSH_REAL:
+    case BC_LOAD_GLOBAL:
+    case BC_STORE_GLOBAL:
+    case BC_LOAD_LOCAL:
+    case BC_STORE_LOCAL:
+    case BC_CALL:
+    case BC_RETURN_VALUE:
+        return "u";
+    case BC_LOAD_ELEM_GLOBAL:
+    case BC_STORE_ELEM_GLOBAL:
+    case BC_LOAD_ELEM_LOCAL:
+    case BC_STORE_ELEM_LOCAL:
+        return "uiu";
+    case BC_LOAD_ARRAY_GLOBAL:
+    case BC_STORE_ARRAY_GLOBAL:
+    case BC_LOAD_ARRAY_LOCAL:
+    case BC_STORE_ARRAY_LOCAL:
+        return "uu";
+    case BC_JUMP:
+    case BC_JUMP_IF_FALSE:
+    case BC_JUMP_IF_TRUE:
+        return "r";
+    default:
+        return "";
+    }
+}
+
+namespace {
+
+class BytecodeCompiler {
+public:
+    BytecodeCompiler(const AstArena& ast, const SemanticInfo& info, BytecodeProgram& out)
+        : ast(ast), info(info), out(out), depth(0), maxDepth(0) {}
+
+    void compileProgram(NodeId root);
+
+private:
+    void beginBody() { depth = 0; maxDepth = 0; }
+    void statement(NodeId id);
+    void expression(NodeId id);
+    void call(NodeId id, uint32_t subprogram);
+    void load(const VariableInfo& variable);
+    void store(const VariableInfo& variable);
+
+    // Every emitted opcode states its effect on the operand stack depth, so
+    // each body knows how much stack it needs.
+    void op(Opcode opcode, int stackEffect);
+    void u32(uint32_t value);
+    void i32(int32_t value);
+    size_t jump(Opcode opcode);
+    void patch(size_t operand);
+    void jumpTo(Opcode opcode, size_t target);
+    size_t here() const { return out.code.size(); }
+
+    const AstArena& ast;
+    const SemanticInfo& info;
+    BytecodeProgram& out;
+    int depth;
+    int maxDepth;
+};
+
+void BytecodeCompiler::op(Opcode opcode, int stackEffect) {
+    out.code.push_back(opcode);
+    depth += stackEffect;
+    if (depth > maxDepth) maxDepth = depth;
+}
+
+void BytecodeCompiler::u32(uint32_t value) {
+    uint8_t bytes[4];
+    std::memcpy(bytes, &value, 4);
+    out.code.insert(out.code.end(), bytes, bytes + 4);
+}
+
+void BytecodeCompiler::i32(int32_t value) {
+    u32(static_cast<uint32_t>(value));
+}
+
+size_t BytecodeCompiler::jump(Opcode opcode) {
+    op(opcode, opcode == BC_JUMP ? 0 : -1);
+    size_t operand = here();
+    u32(0);
+    return operand;
+}
+
+void BytecodeCompiler::patch(size_t operand) {
+    int32_t rel = static_cast<int32_t>(here() - (operand + 4));
+    std::memcpy(&out.code[operand], &rel, 4);
+}
+
+void BytecodeCompiler::jumpTo(Opcode opcode, size_t target) {
+    op(opcode, opcode == BC_JUMP ? 0 : -1);
+    i32(static_cast<int32_t>(target) - static_cast<int32_t>(here() + 4));
+}
+
+void BytecodeCompiler::compileProgram(NodeId root) {
+    out.code.clear();
+    out.reals.clear();
+    out.functions.clear();
+    out.globalCells = info.globalCells;
+
+    beginBody();
+    out.mainEntry = 0;
+    statement(ast.child(root, 2));
+    op(BC_HALT, 0);
+    out.mainMaxStack = static_cast<uint32_t>(maxDepth);
+
+    for (const SubprogramInfo& subprogram : info.subprograms) {
+        BytecodeFunction function;
+        function.name = subprogram.name;
+        function.entry = static_cast<uint32_t>(here());
+        function.paramCells = subprogram.paramCells;
+        function.frameCells = subprogram.frameCells;
+        function.resultSlot = subprogram.resultSlot;
+        function.isFunction = subprogram.isFunction;
+
+        beginBody();
+        statement(ast.child(subprogram.node, 2));
+        if (subprogram.isFunction) {
+            op(BC_RETURN_VALUE, 1);
+            u32(subprogram.resultSlot);
+        }
+        else {
+            op(BC_RETURN, 0);
+        }
+        function.maxStack = static_cast<uint32_t>(maxDepth);
+        out.functions.push_back(function);
+    }
+}
+
+void BytecodeCompiler::load(const VariableInfo& variable) {
+    bool global = variable.storage == Storage::GLOBAL;
+    if (variable.type.baseType == DataType::ARRAY) {
+        op(global ? BC_LOAD_ARRAY_GLOBAL : BC_LOAD_ARRAY_LOCAL, static_cast<int>(variable.cells));
+        u32(variable.slot);
+        u32(variable.cells);
+    }
+    else {
+        op(global ? BC_LOAD_GLOBAL : BC_LOAD_LOCAL, 1);
+        u32(variable.slot);
+    }
+}
+
+void BytecodeCompiler::store(const VariableInfo& variable) {
+    bool global = variable.storage == Storage::GLOBAL;
+    if (variable.type.baseType == DataType::ARRAY) {
+        op(global ? BC_STORE_ARRAY_GLOBAL : BC_STORE_ARRAY_LOCAL, -static_cast<int>(variable.cells));
+        u32(variable.slot);
+        u32(variable.cells);
+    }
+    else {
+        op(global ? BC_STORE_GLOBAL : BC_STORE_LOCAL, -1);
+        u32(variable.slot);
+    }
+}
+
+// Arguments are pushed left to right and become the callee's first frame
+// cells; arrays are passed by value, one cell per element.
+void BytecodeCompiler::call(NodeId id, uint32_t index) {
+    const SubprogramInfo& subprogram = info.subprograms[index];
+    for (NodeId arg = ast.firstChild(id); arg; arg = ast.nextSibling(arg)) {
+        expression(arg);
+    }
+    op(BC_CALL, (subprogram.isFunction ? 1 : 0) - static_cast<int>(subprogram.paramCells));
+    u32(index);
+}
+
+void BytecodeCompiler::expression(NodeId id) {
+    const ASTNode& node = ast.node(id);
+    switch (node.type) {
+    case NODE_INT_NUM:
+        op(BC_PUSH_INT, 1);
+        i32(node.intVal);
+        break;
+    case NODE_REAL_NUM:
+        op(BC_PUSH_REAL, 1);
+        u32(static_cast<uint32_t>(out.reals.size()));
+        out.reals.push_back(node.realVal);
+        break;
+    case NODE_BOOLEAN:
+        op(BC_PUSH_INT, 1);
+        i32(node.boolVal ? 1 : 0);
+        break;
+    case NODE_VARIABLE:
+        if (info.ref(id).kind == RefKind::CALL) call(id, info.ref(id).index);
+        else load(info.variable(id));
+        break;
+    case NODE_ARRAY_ACCESS: {
+        const VariableInfo& array = info.variable(id);
+        expression(ast.child(id, 0));
+        op(array.storage == Storage::GLOBAL ? BC_LOAD_ELEM_GLOBAL : BC_LOAD_ELEM_LOCAL, 0);
+        u32(array.slot);
+        i32(array.type.arrayStart);
+        u32(array.cells);
+        break;
+    }
+    case NODE_FUNCTION_CALL:
+        call(id, info.ref(id).index);
+        break;
+    case NODE_UNARY_OP: {
+        NodeId operand = ast.child(id, 0);
+        expression(operand);
+        if (node.op == OP_NOT) op(BC_NOT, 0);
+        else op(info.typeOf(operand) == DataType::REAL ? BC_NEG_R : BC_NEG_I, 0);
+        break;
+    }
+    case NODE_BINARY_OP: {
+        NodeId left = ast.child(id, 0);
+        NodeId right = ast.child(id, 1);
+
+        // and / or short-circuit, as in the C++ backend
+        if (node.op == OP_AND || node.op == OP_OR) {
+            expression(left);
+            size_t shortCut = jump(node.op == OP_AND ? BC_JUMP_IF_FALSE : BC_JUMP_IF_TRUE);
+            expression(right);
+            size_t end = jump(BC_JUMP);
+            patch(shortCut);
+            --depth;
+            op(BC_PUSH_INT, 1);
+            i32(node.op == OP_AND ? 0 : 1);
+            patch(end);
+            break;
+        }
+
+        bool real = info.typeOf(left) == DataType::REAL;
+        if (node.op == OP_DIVIDE) {
+            expression(left);
+            if (!real) op(BC_INT_TO_REAL, 0);
+            expression(right);
+            if (!real) op(BC_INT_TO_REAL, 0);
+            op(BC_DIV_R, -1);
+            break;
+        }
+
+        expression(left);
+        expression(right);
+        switch (node.op) {
+        case OP_ADD: op(real ? BC_ADD_R : BC_ADD_I, -1); break;
+        case OP_SUB: op(real ? BC_SUB_R : BC_SUB_I, -1); break;
+        case OP_MUL: op(real ? BC_MUL_R : BC_MUL_I, -1); break;
+        case OP_DIV: op(BC_DIV_I, -1); break;
+        case OP_EQ: op(real ? BC_EQ_R : BC_EQ_I, -1); break;
+        case OP_NEQ: op(real ? BC_NE_R : BC_NE_I, -1); break;
+        case OP_LT: op(real ? BC_LT_R : BC_LT_I, -1); break;
+        case OP_LE: op(real ? BC_LE_R : BC_LE_I, -1); break;
+        case OP_GT: op(real ? BC_GT_R : BC_GT_I, -1); break;
+        case OP_GE: op(real ? BC_GE_R : BC_GE_I, -1); break;
+        default: break;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void BytecodeCompiler::statement(NodeId id) {
+    if (!id) return;
+
+    const ASTNode& node = ast.node(id);
+    switch (node.type) {
+    case NODE_COMPOUND_STMT:
+        for (NodeId child = ast.firstChild(id); child; child = ast.nextSibling(child)) {
+            statement(child);
+        }
+        break;
+    case NODE_ASSIGNMENT: {
+        NodeId target = ast.child(id, 0);
+        NodeId value = ast.child(id, 1);
+        if (ast.node(target).type == NODE_ARRAY_ACCESS) {
+            const VariableInfo& array = info.variable(target);
+            expression(ast.child(target, 0));
+            expression(value);
+            op(array.storage == Storage::GLOBAL ? BC_STORE_ELEM_GLOBAL : BC_STORE_ELEM_LOCAL, -2);
+            u32(array.slot);
+            i32(array.type.arrayStart);
+            u32(array.cells);
+        }
+        else if (info.ref(target).kind == RefKind::RESULT) {
+            expression(value);
+            op(BC_STORE_LOCAL, -1);
+            u32(info.subprogram(target).resultSlot);
+        }
+        else {
+            expression(value);
+            store(info.variable(target));
+        }
+        break;
+    }
+    case NODE_IF: {
+        expression(ast.child(id, 0));
+        size_t skipThen = jump(BC_JUMP_IF_FALSE);
+        statement(ast.child(id, 1));
+        NodeId elseStmt = ast.child(id, 2);
+        if (elseStmt) {
+            size_t skipElse = jump(BC_JUMP);
+            patch(skipThen);
+            statement(elseStmt);
+            patch(skipElse);
+        }
+        else {
+            patch(skipThen);
+        }
+        break;
+    }
+    case NODE_WHILE: {
+        // Condition at the bottom: one conditional jump per iteration
+        size_t toCondition = jump(BC_JUMP);
+        size_t body = here();
+        statement(ast.child(id, 1));
+        patch(toCondition);
+        expression(ast.child(id, 0));
+        jumpTo(BC_JUMP_IF_TRUE, body);
+        break;
+    }
+    case NODE_PROCEDURE_CALL:
+    case NODE_FUNCTION_CALL: {
+        uint32_t index = info.ref(id).index;
+        call(id, index);
+        if (info.subprograms[index].isFunction) op(BC_POP, -1);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+} // namespace
+
+void compileBytecode(const AstArena& ast, NodeId root, const SemanticInfo& info, BytecodeProgram& out) {
+    BytecodeCompiler compiler(ast, info, out);
+    compiler.compileProgram(root);
+}
+
+void disassemble(const BytecodeProgram& program, std::ostream& out) {
+    const std::vector<uint8_t>& code = program.code;
+    size_t function = 0;
+    out << "main:\n";
+    for (size_t pc = 0; pc < code.size();) {
+        while (function < program.functions.size() && program.functions[function].entry == pc) {
+            out << nameOf(program.functions[function].name) << ":\n";
+            ++function;
+        }
+
+        Opcode opcode = static_cast<Opcode>(code[pc]);
+        out << std::setw(6) << pc << "  " << opcodeName(opcode);
+        size_t at = pc + 1;
+        for (const char* layout = operandLayout(opcode); *layout; ++layout) {
+            uint32_t raw;
+            std::memcpy(&raw, &code[at], 4);
+            at += 4;
+            int32_t value = static_cast<int32_t>(raw);
+            if (*layout == 'u') out << ' ' << raw;
+            else if (*layout == 'i') out << ' ' << value;
+            else out << " -> " << static_cast<int64_t>(at) + value;
+        }
+        if (opcode == BC_PUSH_REAL) {
+            uint32_t index;
+            std::memcpy(&index, &code[pc + 1], 4);
+            out << "  ; " << program.reals[index];
+        }
+        else if (opcode == BC_CALL) {
+            uint32_t index;
+            std::memcpy(&index, &code[pc + 1], 4);
+            out << "  ; " << nameOf(program.functions[index].name);
+        }
+        out << '\n';
+        pc = at;
+    }
+}
+
+static void printCell(DataType type, const Value& cell, std::ostream& out) {
+    switch (type) {
+    case DataType::INTEGER: out << cell.i; break;
+    case DataType::REAL: out << cell.r; break;
+    case DataType::BOOLEAN: out << (cell.i ? "true" : "false"); break;
+    default: out << '?'; break;
+    }
+}
+
+void printGlobals(const SemanticInfo& info, const Value* globals, std::ostream& out) {
+    const uint32_t shownElements = 8;
+    for (const VariableInfo& variable : info.variables) {
+        if (variable.storage != Storage::GLOBAL || variable.isTemporary) continue;
+
+        out << nameOf(variable.name) << " = ";
+        if (variable.type.baseType != DataType::ARRAY) {
+            printCell(variable.type.baseType, globals[variable.slot], out);
+        }
+        else {
+            out << '[';
+            for (uint32_t i = 0; i < variable.cells && i < shownElements; ++i) {
+                if (i) out << ", ";
+                printCell(variable.type.elementType, globals[variable.slot + i], out);
+            }
+            if (variable.cells > shownElements) out << ", ... (" << variable.cells << " elements)";
+            out << ']';
+        }
+        out << '\n';
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "ast.h"
+#include "ast_arena.h"
+#include "semantic_info.h"
+
+// One storage cell: every scalar is one cell, an array one cell per element.
+// Booleans are integers 0 / 1.
+union Value {
+    int32_t i;
+    double r;
+};
+
+// Stack bytecode. Each instruction is a one-byte opcode followed by its
+// operands, little-endian and unaligned:
+//
+//   u32 / i32 / rel   4 bytes; rel is a jump offset from the next instruction
+//   slot              u32 cell index in the global area or the current frame
+//   low, count        i32 / u32 index range of an array
+//
+#define BYTECODE_OPS(X) \
+    X(PUSH_INT)          /* i32           -> value */ \
+    X(PUSH_REAL)         /* u32 constant  -> value */ \
+    X(LOAD_GLOBAL)       /* slot          -> value */ \
+    X(STORE_GLOBAL)      /* slot          value -> */ \
+    X(LOAD_LOCAL)        /* slot          -> value */ \
+    X(STORE_LOCAL)       /* slot          value -> */ \
+    X(LOAD_ELEM_GLOBAL)  /* slot low count   index -> value */ \
+    X(STORE_ELEM_GLOBAL) /* slot low count   index value -> */ \
+    X(LOAD_ELEM_LOCAL)   /* slot low count   index -> value */ \
+    X(STORE_ELEM_LOCAL)  /* slot low count   index value -> */ \
+    X(LOAD_ARRAY_GLOBAL) /* slot count    -> count values */ \
+    X(STORE_ARRAY_GLOBAL)/* slot count    count values -> */ \
+    X(LOAD_ARRAY_LOCAL)  /* slot count    -> count values */ \
+    X(STORE_ARRAY_LOCAL) /* slot count    count values -> */ \
+    X(ADD_I) X(SUB_I) X(MUL_I) X(DIV_I) X(NEG_I) \
+    X(ADD_R) X(SUB_R) X(MUL_R) X(DIV_R) X(NEG_R) \
+    X(INT_TO_REAL) \
+    X(EQ_I) X(NE_I) X(LT_I) X(LE_I) X(GT_I) X(GE_I) \
+    X(EQ_R) X(NE_R) X(LT_R) X(LE_R) X(GT_R) X(GE_R) \
+    X(NOT) \
+    X(JUMP)              /* rel */ \
+    X(JUMP_IF_FALSE)     /* rel           cond -> */ \
+    X(JUMP_IF_TRUE)      /* rel           cond -> */ \
+    X(CALL)              /* u32 function  args -> [result] */ \
+    X(RETURN) \
+    X(RETURN_VALUE)      /* slot          -> result */ \
+    X(POP) \
+    X(HALT)
+
+enum Opcode : uint8_t {
+#define BYTECODE_ENUM(name) BC_##name,
+    BYTECODE_OPS(BYTECODE_ENUM)
+#undef BYTECODE_ENUM
+    BC_OPCODE_COUNT
+};
+
+const char* opcodeName(Opcode op);
+
+struct BytecodeFunction {
+    NameId name;
+    uint32_t entry;         // offset of the first instruction in code
+    uint32_t paramCells;    // argument cells the caller leaves on the stack
+    uint32_t frameCells;
+    uint32_t resultSlot;
+    uint32_t maxStack;      // deepest operand stack above the frame
+    bool isFunction;
+};
+
+struct BytecodeProgram {
+    std::vector<uint8_t> code;
+    std::vector<double> reals;
+    std::vector<BytecodeFunction> functions;   // same order as SemanticInfo::subprograms
+    uint32_t mainEntry = 0;
+    uint32_t mainMaxStack = 0;
+    uint32_t globalCells = 0;
+};
+
+// Lowers an analyzed program to bytecode. `info` must come from a
+// successful SemanticAnalyzer::analyze of the same tree.
+void compileBytecode(const AstArena& ast, NodeId root, const SemanticInfo& info, BytecodeProgram& out);
+
+void disassemble(const BytecodeProgram& program, std::ostream& out);
+
+// Prints "name = value" for each global, as every execution backend reports
+// its result.
+void printGlobals(const SemanticInfo& info, const Value* globals, std::ostream& out);
+
+#endif // BYTECODE_H
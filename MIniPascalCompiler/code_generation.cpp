@@ -2,91 +2,289 @@
 #include "semantic_analyzer.h"
 #include "ast.h"
 #include "symbol_table.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <charconv>
 #include <iostream>
+#include <memory>
+
+static const char* cppOperator(OpKind op) {
+    switch (op) {
+    case OP_DIV: return "/";
+    case OP_EQ: return "==";
+    case OP_NEQ: return "!=";
+    case OP_AND: return "&&";
+    case OP_OR: return "||";
+    case OP_NOT: return "!";
+    default: return opSpelling(op);
+    }
+}
+
+static const char* cppType(DataType type) {
+    switch (type) {
+    case DataType::INTEGER: return "int";
+    case DataType::REAL: return "double";
+    case DataType::BOOLEAN: return "bool";
+    default: return "unknown";
+    }
+}
+
+// Pascal names are prefixed so they cannot collide with C++ keywords or
+// with the helpers below. Both are written straight into the output.
+struct CppName {
+    const char* prefix;
+    NameId name;
+};
+
+static CppName cppName(const char* prefix, NameId name) {
+    return CppName{ prefix, name };
+}
+
+static OutputBuffer& operator<<(OutputBuffer& out, const CppName& name) {
+    const StringInterner& names = globalInterner();
+    out << name.prefix;
+    out.write(names.spelling(name.name), names.length(name.name));
+    return out;
+}
+
+struct CppDeclaration {
+    const VariableInfo& variable;
+};
+
+static CppDeclaration cppDeclaration(const VariableInfo& variable) {
+    return CppDeclaration{ variable };
+}
 
-CodeGenerator::CodeGenerator(const std::string& outputFilename) {
-    outFile.open(outputFilename);
-    if (!outFile.is_open()) {
+static OutputBuffer& operator<<(OutputBuffer& out, const CppDeclaration& declaration) {
+    const VariableInfo& variable = declaration.variable;
+    if (variable.type.baseType != DataType::ARRAY)
+        return out << cppType(variable.type.baseType) << " " << cppName("v_", variable.name);
+    return out << "std::array<" << cppType(variable.type.elementType) << ", " << variable.cells << "> "
+               << cppName("v_", variable.name);
+}
+
+static const char* const runtimeHelpers =
+    "[[noreturn]] static void pascal_fail(const char* message) {\n"
+    "    std::fprintf(stderr, \"Runtime error: %s\\n\", message);\n"
+    "    std::exit(1);\n"
+    "}\n\n"
+    "template <typename T, std::size_t N>\n"
+    "static T& pascal_at(std::array<T, N>& array, int index, int start) {\n"
+    "    unsigned offset = static_cast<unsigned>(index) - static_cast<unsigned>(start);\n"
+    "    if (offset >= N) pascal_fail(\"array index out of range\");\n"
+    "    return array[offset];\n"
+    "}\n\n";
+
+// Only for programs that use div, so the output builds clean under -Wall.
+static const char* const divHelper =
+    "static int pascal_div(int a, int b) {\n"
+    "    if (b == 0) pascal_fail(\"division by zero\");\n"
+    "    if (b == -1) return static_cast<int>(0u - static_cast<unsigned>(a));\n"
+    "    return a / b;\n"
+    "}\n\n";
+
+// SSE4.1 has a 32-bit lane multiply; plain SSE2 builds it from two 64-bit ones.
+static const char* const multiplyHelper =
+    "static __m128i pascal_mullo(__m128i a, __m128i b) {\n"
+    "#ifdef __SSE4_1__\n"
+    "    return _mm_mullo_epi32(a, b);\n"
+    "#else\n"
+    "    __m128i even = _mm_mul_epu32(a, b);\n"
+    "    __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));\n"
+    "    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, 8), _mm_shuffle_epi32(odd, 8));\n"
+    "#endif\n"
+    "}\n\n";
+
+// Whether the subtree has a binary operation `op`.
+static bool hasBinaryOp(const AstArena& ast, NodeId node, OpKind op) {
+    if (!node) return false;
+    if (ast.node(node).type == NODE_BINARY_OP && ast.node(node).op == op) return true;
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        if (hasBinaryOp(ast, child, op)) return true;
+    }
+    return false;
+}
+
+CodeGenerator::CodeGenerator(const std::string& outputFilename)
+    : ast(nullptr), info(nullptr), vectorize(true), pool(nullptr) {
+    if (!outFile.open(outputFilename)) {
         std::cerr << "Error: Could not open output file: " << outputFilename << std::endl;
         exit(1);
     }
+    filename = outputFilename;
 }
 
-void CodeGenerator::generate(ASTNode* root) {
+CodeGenerator::CodeGenerator(const CodeGenerator& parent)
+    : ast(parent.ast), info(parent.info), vectorize(parent.vectorize), pool(nullptr),
+      vectorLoops(parent.vectorLoops), vectorLoopOf(parent.vectorLoopOf), declared(parent.declared),
+      declaredStart(parent.declaredStart) {}
+
+void CodeGenerator::generate(const AstArena& tree, NodeId root, const SemanticInfo& semanticInfo) {
     if (!root) return;
 
-    outFile << "#include <iostream>\n";
-    outFile << "#include <string>\n";
-    outFile << "using namespace std;\n\n";
+    ast = &tree;
+    info = &semanticInfo;
+    vectorLoops.clear();
+    vectorLoopOf.clear();
+    if (vectorize) findVectorLoops(tree, root, semanticInfo, vectorLoops);
+    for (size_t i = 0; i < vectorLoops.size(); ++i) vectorLoopOf[vectorLoops[i].loop] = i;
+
+    // Each subprogram's variables in declaration order, without a pass over
+    // all of them per subprogram
+    size_t owners = semanticInfo.subprograms.size() + 1;
+    auto ownerSlot = [&](uint32_t owner) { return owner == NO_SUBPROGRAM ? owners - 1 : owner; };
+    declaredStart.assign(owners + 1, 0);
+    for (const VariableInfo& variable : semanticInfo.variables) ++declaredStart[ownerSlot(variable.owner) + 1];
+    for (size_t i = 1; i <= owners; ++i) declaredStart[i] += declaredStart[i - 1];
+    declared.resize(semanticInfo.variables.size());
+    std::vector<uint32_t> next(declaredStart.begin(), declaredStart.end() - 1);
+    for (uint32_t i = 0; i < semanticInfo.variables.size(); ++i) declared[next[ownerSlot(semanticInfo.variables[i].owner)]++] = i;
+
+    outFile << "#include <array>\n";
+    outFile << "#include <cstddef>\n";
+    outFile << "#include <cstdio>\n";
+    outFile << "#include <cstdlib>\n";
+    if (!vectorLoops.empty()) outFile << "#include <immintrin.h>\n";
+    outFile << "\n" << runtimeHelpers;
+
+    // Helpers nothing emitted below calls are left out
+    bool divides = hasBinaryOp(tree, tree.child(root, 2), OP_DIV);
+    for (const SubprogramInfo& subprogram : semanticInfo.subprograms) {
+        if (!divides && subprogram.isReachable) divides = hasBinaryOp(tree, tree.child(subprogram.node, 2), OP_DIV);
+    }
+    bool multiplies = false;
+    for (const VectorLoop& loop : vectorLoops) {
+        if (loop.elementType == DataType::REAL) continue;
+        for (NodeId store : loop.stores) multiplies = multiplies || hasBinaryOp(tree, tree.child(store, 1), OP_MUL);
+    }
+    if (divides) outFile << divHelper;
+    if (multiplies) outFile << multiplyHelper;
 
     visitProgram(root);
 
-    outFile.close();
+    if (!outFile.close()) std::cerr << "Error: Could not write output file: " << filename << std::endl;
 }
 
-void CodeGenerator::visitProgram(ASTNode* node) {
-    outFile << "int main() {\n";
+void CodeGenerator::visitProgram(NodeId node) {
+    // Globals
+    visitDeclarations(NO_SUBPROGRAM, "static ");
+    outFile << "\n";
 
-    // Local variables
-    if (node->children.size() > 0 && node->children[0]) {
-        visitDeclarations(node->children[0]);
+    // Subprograms, declared first so they can call each other
+    for (uint32_t i = 0; i < info->subprograms.size(); ++i) {
+        if (!info->subprograms[i].isReachable) continue;
+        visitSubprogramHead(i);
+        outFile << ";\n";
     }
+    outFile << "\n";
+    visitSubprograms();
+
+    outFile << "int main() {\n";
 
     // Main compound statement
-    if (node->children.size() > 2 && node->children[2]) {
-        visitCompoundStatement(node->children[2]);
+    visitCompoundStatement(ast->child(node, 2));
+
+    for (const VariableInfo& variable : info->variables) {
+        if (variable.storage != Storage::GLOBAL || variable.type.baseType == DataType::ARRAY || variable.isTemporary)
+            continue;
+
+        CppName name = cppName("v_", variable.name);
+        outFile << "    std::printf(\"" << nameOf(variable.name) << " = ";
+        switch (variable.type.baseType) {
+        case DataType::REAL: outFile << "%f\\n\", " << name; break;
+        case DataType::BOOLEAN: outFile << "%s\\n\", " << name << " ? \"true\" : \"false\""; break;
+        default: outFile << "%d\\n\", " << name; break;
+        }
+        outFile << ");\n";
     }
-
     outFile << "    return 0;\n}\n";
 }
 
-void CodeGenerator::visitDeclarations(ASTNode* node) {
-    if (!node || node->type != NODE_DECLARATIONS) return;
-
-    for (ASTNode* decl : node->children) {
-        if (decl->type == NODE_DECLARATIONS) {
-            ASTNode* ids = decl->children[0];
-            ASTNode* typeNode = decl->children[1];
-
-            std::string cType;
-            if (typeNode->type == NODE_TYPE) {
-                if (typeNode->name == "integer") cType = "int";
-                else if (typeNode->name == "real") cType = "double";
-                else if (typeNode->name == "boolean") cType = "bool";
-                else cType = "unknown";
-            }
-            else if (typeNode->type == NODE_ARRAY_TYPE) {
-                ASTNode* baseTypeNode = typeNode->children[0];
-                std::string baseType;
-                if (baseTypeNode->name == "integer") baseType = "int";
-                else if (baseTypeNode->name == "real") baseType = "double";
-                else if (baseTypeNode->name == "boolean") baseType = "bool";
-                else baseType = "unknown";
-
-                int size = static_cast<int>(typeNode->real_val) - typeNode->int_val + 1;
-                for (ASTNode* idNode : ids->children) {
-                    outFile << "    " << baseType << " " << idNode->name << "[" << size << "];\n";
-                }
-                continue;
-            }
-
-            for (ASTNode* idNode : ids->children) {
-                outFile << "    " << cType << " " << idNode->name << ";\n";
-            }
+// Variables of one subprogram (or the globals), excluding parameters and
+// unused arrays; all of them start out zero.
+void CodeGenerator::visitDeclarations(uint32_t owner, const char* indent) {
+    size_t slot = owner == NO_SUBPROGRAM ? info->subprograms.size() : owner;
+    for (size_t i = declaredStart[slot]; i < declaredStart[slot + 1]; ++i) {
+        const VariableInfo& variable = info->variables[declared[i]];
+        if (variable.isParameter || variable.isUnused) continue;
+        outFile << indent << cppDeclaration(variable) << "{};\n";
+    }
+}
+
+void CodeGenerator::visitSubprograms() {
+    size_t count = info->subprograms.size();
+    if (!pool || pool->size() < 2 || count < 2) {
+        for (uint32_t i = 0; i < count; ++i) {
+            if (info->subprograms[i].isReachable) visitSubprogram(i);
         }
+        return;
     }
 
-    outFile << "\n";
+    // Each subprogram's text stays in its worker's buffer; the file gathers
+    // the pieces from there
+    struct Text {
+        unsigned worker;
+        size_t begin, end;
+    };
+    std::vector<std::unique_ptr<CodeGenerator>> workers;
+    for (unsigned i = 0; i < pool->size(); ++i) workers.push_back(std::unique_ptr<CodeGenerator>(new CodeGenerator(*this)));
+    std::vector<Text> texts(count, Text{ 0, 0, 0 });
+    StringInterner& names = globalInterner();
+    pool->run(count, [&](size_t index, unsigned worker) {
+        if (!info->subprograms[index].isReachable) return;
+        InternerScope scope(names);
+        CodeGenerator& generator = *workers[worker];
+        texts[index].worker = worker;
+        texts[index].begin = generator.outFile.tell();
+        generator.visitSubprogram(static_cast<uint32_t>(index));
+        texts[index].end = generator.outFile.tell();
+    });
+    for (const Text& text : texts) outFile.appendRange(workers[text.worker]->outFile, text.begin, text.end);
+    outFile.flush();
 }
 
-void CodeGenerator::visitCompoundStatement(ASTNode* node) {
-    for (ASTNode* stmt : node->children) {
+void CodeGenerator::visitSubprogramHead(uint32_t index) {
+    const SubprogramInfo& subprogram = info->subprograms[index];
+    outFile << "static " << (subprogram.isFunction ? cppType(subprogram.returnType) : "void") << " "
+            << cppName("p_", subprogram.name) << "(";
+    for (uint32_t i = 0; i < subprogram.paramCount; ++i) {
+        if (i) outFile << ", ";
+        outFile << cppDeclaration(info->variables[subprogram.firstParam + i]);
+    }
+    outFile << ")";
+}
+
+void CodeGenerator::visitSubprogram(uint32_t index) {
+    const SubprogramInfo& subprogram = info->subprograms[index];
+    visitSubprogramHead(index);
+    outFile << " {\n";
+    if (subprogram.isFunction) outFile << "    " << cppType(subprogram.returnType) << " result{};\n";
+    visitDeclarations(index, "    ");
+
+    visitCompoundStatement(ast->child(subprogram.node, 2));
+
+    if (subprogram.isFunction) outFile << "    return result;\n";
+    outFile << "}\n\n";
+}
+
+void CodeGenerator::visitCompoundStatement(NodeId node) {
+    if (!node) return;
+
+    if (ast->node(node).type != NODE_COMPOUND_STMT) {
+        visitStatement(node);
+        return;
+    }
+
+    for (NodeId stmt = ast->firstChild(node); stmt; stmt = ast->nextSibling(stmt)) {
         visitStatement(stmt);
     }
 }
 
-void CodeGenerator::visitStatement(ASTNode* node) {
-    switch (node->type) {
+void CodeGenerator::visitStatement(NodeId node) {
+    switch (ast->node(node).type) {
+    case NODE_COMPOUND_STMT:
+        visitCompoundStatement(node);
+        break;
     case NODE_ASSIGNMENT:
         visitAssignment(node);
         break;
@@ -100,111 +298,210 @@ void CodeGenerator::visitStatement(ASTNode* node) {
         visitProcedureCall(node);
         break;
     case NODE_FUNCTION_CALL:
+        outFile << "    ";
         visitFunctionCall(node);
+        outFile << ";\n";
         break;
     default:
         break;
     }
 }
 
-void CodeGenerator::visitAssignment(ASTNode* node) {
-    ASTNode* var = node->left;
-    ASTNode* expr = node->right;
+void CodeGenerator::visitAssignment(NodeId node) {
+    NodeId var = ast->child(node, 0);
+    NodeId expr = ast->child(node, 1);
 
     outFile << "    ";
-    visitVariable(var);
+    if (info->ref(var).kind == RefKind::RESULT) outFile << "result";
+    else visitVariable(var);
     outFile << " = ";
     visitExpression(expr);
     outFile << ";\n";
 }
 
-void CodeGenerator::visitIfStatement(ASTNode* node) {
+void CodeGenerator::visitIfStatement(NodeId node) {
     outFile << "    if (";
-    visitExpression(node->left);
+    visitExpression(ast->child(node, 0));
     outFile << ") {\n";
 
-    visitCompoundStatement(node->right);
+    visitCompoundStatement(ast->child(node, 1));
     outFile << "    }\n";
 
-    if (!node->children.empty()) {
+    NodeId elseStmt = ast->child(node, 2);
+    if (elseStmt) {
         outFile << "    else {\n";
-        visitCompoundStatement(node->children[0]->right);
+        visitCompoundStatement(elseStmt);
         outFile << "    }\n";
     }
 }
 
-void CodeGenerator::visitWhileLoop(ASTNode* node) {
+void CodeGenerator::visitWhileLoop(NodeId node) {
+    auto vector = vectorLoopOf.find(node);
+    if (vector != vectorLoopOf.end()) visitVectorLoop(vectorLoops[vector->second]);
+
     outFile << "    while(";
-    visitExpression(node->left);
+    visitExpression(ast->child(node, 0));
     outFile << ") {\n";
 
-    visitCompoundStatement(node->right);
+    visitCompoundStatement(ast->child(node, 1));
     outFile << "    }\n";
 }
 
-void CodeGenerator::visitProcedureCall(ASTNode* node) {
-    outFile << "    " << node->name << "(";
-    if (node->children.size() > 0) {
-        ASTNode* args = node->children[0];
-        for (size_t i = 0; i < args->children.size(); ++i) {
-            if (i > 0) outFile << ", ";
-            visitExpression(args->children[i]);
+// Whole groups of lanes with every access in bounds; the loop that follows
+// does the rest.
+void CodeGenerator::visitVectorLoop(const VectorLoop& loop) {
+    int lanes = loop.elementType == DataType::REAL ? 2 : 4;
+    CppName counter = cppName("v_", info->variables[loop.counter].name);
+
+    outFile << "    {\n";
+    outFile << "    long long last = static_cast<long long>(";
+    visitExpression(loop.bound);
+    outFile << ")" << (loop.inclusive ? "" : " - 1") << ";\n";
+    outFile << "    if (last > " << loop.highest << "LL) last = " << loop.highest << "LL;\n";
+    outFile << "    if (" << counter << " >= " << loop.lowest << "LL) {\n";
+    outFile << "    for (; " << counter << " <= last - " << lanes - 1 << "; " << counter << " += " << lanes << ") {\n";
+    for (NodeId store : loop.stores) {
+        NodeId target = ast->child(store, 0);
+        if (loop.elementType == DataType::REAL) {
+            outFile << "    _mm_storeu_pd(";
+            visitVectorElement(target, loop);
+        }
+        else {
+            outFile << "    _mm_storeu_si128(reinterpret_cast<__m128i*>(";
+            visitVectorElement(target, loop);
+            outFile << ")";
         }
+        outFile << ", ";
+        visitVectorExpression(ast->child(store, 1), loop);
+        outFile << ");\n";
     }
-    outFile << ");\n";
+    outFile << "    }\n";
+    outFile << "    }\n";
+    outFile << "    }\n";
+}
+
+// Address of the element the first lane uses.
+void CodeGenerator::visitVectorElement(NodeId node, const VectorLoop& loop) {
+    const VariableInfo& array = info->variable(node);
+    int64_t offset = 0;
+    counterOffset(*ast, *info, ast->child(node, 0), loop.counter, offset);
+    outFile << cppName("v_", array.name) << ".data() + (static_cast<long long>("
+            << cppName("v_", info->variables[loop.counter].name) << ") - " << array.type.arrayStart - offset << "LL)";
 }
 
-void CodeGenerator::visitFunctionCall(ASTNode* node) {
-    outFile << "    " << node->name << "(";
-    if (node->children.size() > 0) {
-        ASTNode* args = node->children[0];
-        for (size_t i = 0; i < args->children.size(); ++i) {
-            if (i > 0) outFile << ", ";
-            visitExpression(args->children[i]);
+void CodeGenerator::visitVectorExpression(NodeId node, const VectorLoop& loop) {
+    const ASTNode& n = ast->node(node);
+    bool real = loop.elementType == DataType::REAL;
+    switch (n.type) {
+    case NODE_INT_NUM:
+    case NODE_REAL_NUM:
+        outFile << (real ? "_mm_set1_pd(" : "_mm_set1_epi32(");
+        visitLiteral(node);
+        outFile << ")";
+        break;
+    case NODE_VARIABLE:
+        if (info->ref(node).index == loop.counter) {
+            outFile << "_mm_add_epi32(_mm_set1_epi32(" << cppName("v_", info->variable(node).name)
+                    << "), _mm_setr_epi32(0, 1, 2, 3))";
+            break;
+        }
+        outFile << (real ? "_mm_set1_pd(" : "_mm_set1_epi32(") << cppName("v_", info->variable(node).name) << ")";
+        break;
+    case NODE_ARRAY_ACCESS:
+        if (real) {
+            outFile << "_mm_loadu_pd(";
+            visitVectorElement(node, loop);
+        }
+        else {
+            outFile << "_mm_loadu_si128(reinterpret_cast<const __m128i*>(";
+            visitVectorElement(node, loop);
+            outFile << ")";
+        }
+        outFile << ")";
+        break;
+    case NODE_UNARY_OP:
+        // Flipping the sign bit keeps -(0.0) apart from 0.0 - 0.0
+        outFile << (real ? "_mm_xor_pd(" : "_mm_sub_epi32(_mm_setzero_si128(), ");
+        visitVectorExpression(ast->child(node, 0), loop);
+        outFile << (real ? ", _mm_set1_pd(-0.0))" : ")");
+        break;
+    case NODE_BINARY_OP: {
+        const char* function = "";
+        switch (n.op) {
+        case OP_ADD: function = real ? "_mm_add_pd(" : "_mm_add_epi32("; break;
+        case OP_SUB: function = real ? "_mm_sub_pd(" : "_mm_sub_epi32("; break;
+        case OP_MUL: function = real ? "_mm_mul_pd(" : "pascal_mullo("; break;
+        default: function = "_mm_div_pd("; break;
         }
+        outFile << function;
+        visitVectorExpression(ast->child(node, 0), loop);
+        outFile << ", ";
+        visitVectorExpression(ast->child(node, 1), loop);
+        outFile << ")";
+        break;
+    }
+    default:
+        break;
     }
-    outFile << ");\n";
 }
 
-void CodeGenerator::visitVariable(ASTNode* node) {
-    outFile << node->name;
-    if (node->type == NODE_ARRAY_ACCESS) {
-        outFile << "[";
-        visitExpression(node->children[1]);
-        outFile << "]";
+void CodeGenerator::visitProcedureCall(NodeId node) {
+    outFile << "    ";
+    visitFunctionCall(node);
+    outFile << ";\n";
+}
+
+void CodeGenerator::visitFunctionCall(NodeId node) {
+    outFile << cppName("p_", info->subprogram(node).name) << "(";
+    for (NodeId arg = ast->firstChild(node); arg; arg = ast->nextSibling(arg)) {
+        if (arg != ast->firstChild(node)) outFile << ", ";
+        visitExpression(arg);
     }
+    outFile << ")";
 }
 
-void CodeGenerator::visitArrayAccess(ASTNode* node) {
-    outFile << node->children[0]->name << "[";
-    visitExpression(node->children[1]);
-    outFile << "]";
+void CodeGenerator::visitVariable(NodeId node) {
+    if (ast->node(node).type == NODE_ARRAY_ACCESS) {
+        visitArrayAccess(node);
+        return;
+    }
+    // A function's name read inside an expression calls it
+    if (info->ref(node).kind == RefKind::CALL) {
+        outFile << cppName("p_", info->subprogram(node).name) << "()";
+        return;
+    }
+    outFile << cppName("v_", info->variable(node).name);
 }
 
-void CodeGenerator::visitExpression(ASTNode* node) {
+void CodeGenerator::visitArrayAccess(NodeId node) {
+    const VariableInfo& array = info->variable(node);
+    if (info->boundsProven[node]) {
+        outFile << cppName("v_", array.name) << "[";
+        visitExpression(ast->child(node, 0));
+        outFile << " - " << array.type.arrayStart << "]";
+        return;
+    }
+    outFile << "pascal_at(" << cppName("v_", array.name) << ", ";
+    visitExpression(ast->child(node, 0));
+    outFile << ", " << array.type.arrayStart << ")";
+}
+
+void CodeGenerator::visitExpression(NodeId node) {
     if (!node) return;
 
-    switch (node->type) {
+    switch (ast->node(node).type) {
     case NODE_INT_NUM:
-        outFile << node->int_val;
-        break;
     case NODE_REAL_NUM:
-        outFile << node->real_val;
-        break;
     case NODE_BOOLEAN:
-        outFile << (node->bool_val ? "true" : "false");
+        visitLiteral(node);
         break;
     case NODE_BINARY_OP:
         outFile << "(";
-        visitExpression(node->children[0]);
-        outFile << " " << node->op << " ";
-        visitExpression(node->children[1]);
+        visitBinaryOp(node);
         outFile << ")";
         break;
     case NODE_UNARY_OP:
-        outFile << node->op << "(";
-        visitExpression(node->children[0]);
-        outFile << ")";
+        visitUnaryOp(node);
         break;
     case NODE_VARIABLE:
         visitVariable(node);
@@ -221,14 +518,55 @@ void CodeGenerator::visitExpression(ASTNode* node) {
     }
 }
 
-void CodeGenerator::visitBinaryOp(ASTNode* node) {
-    visitExpression(node->children[0]);
-    outFile << " " << node->op << " ";
-    visitExpression(node->children[1]);
+void CodeGenerator::visitBinaryOp(NodeId node) {
+    OpKind op = ast->node(node).op;
+    if (op == OP_DIV) {
+        outFile << "pascal_div(";
+        visitExpression(ast->child(node, 0));
+        outFile << ", ";
+        visitExpression(ast->child(node, 1));
+        outFile << ")";
+        return;
+    }
+    if (op == OP_DIVIDE) {
+        outFile << "static_cast<double>(";
+        visitExpression(ast->child(node, 0));
+        outFile << ") / static_cast<double>(";
+        visitExpression(ast->child(node, 1));
+        outFile << ")";
+        return;
+    }
+
+    visitExpression(ast->child(node, 0));
+    outFile << " " << cppOperator(op) << " ";
+    visitExpression(ast->child(node, 1));
 }
 
-void CodeGenerator::visitUnaryOp(ASTNode* node) {
-    outFile << node->op << "(";
-    visitExpression(node->children[0]);
+void CodeGenerator::visitUnaryOp(NodeId node) {
+    outFile << cppOperator(ast->node(node).op) << "(";
+    visitExpression(ast->child(node, 0));
     outFile << ")";
-}
\ No newline at end of file
+}
+
+void CodeGenerator::visitLiteral(NodeId node) {
+    const ASTNode& literal = ast->node(node);
+    switch (literal.type) {
+    case NODE_INT_NUM:
+        outFile << literal.intVal;
+        break;
+    case NODE_REAL_NUM: {
+        // The shortest digits that read back as the same value, and always
+        // a double literal
+        char digits[32];
+        char* end = std::to_chars(digits, digits + sizeof(digits), literal.realVal).ptr;
+        outFile.write(digits, static_cast<size_t>(end - digits));
+        if (std::none_of(digits, end, [](char c) { return c == '.' || c == 'e' || c == 'n'; })) outFile << ".0";
+        break;
+    }
+    case NODE_BOOLEAN:
+        outFile << (literal.boolVal ? "true" : "false");
+        break;
+    default:
+        break;
+    }
+}
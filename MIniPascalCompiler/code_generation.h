@@ -2,34 +2,72 @@
 #define CODE_GENERATOR_H
 
 #include "ast.h"
+#include "ast_arena.h"
+#include "output_buffer.h"
+#include "semantic_info.h"
+#include "vectorization.h"
+#include <cstdint>
 #include <string>
-#include <fstream>
+#include <unordered_map>
+#include <vector>
 
+class ThreadPool;
+
+// Emits the analyzed program as C++. Globals go to file scope, subprograms
+// become static functions taking arrays by value, and the generated main
+// prints the scalar globals when the program ends. Integer arithmetic wraps
+// only when the output is built with -fwrapv. Loops vectorization.h accepts
+// get an SSE2 copy in front of them, which needs an x86-64 target.
+//
+// With a thread pool the subprograms are emitted in parallel, into one
+// in-memory OutputBuffer per worker, and written out from those in
+// declaration order; the file is the same whatever the thread count.
 class CodeGenerator {
 public:
     CodeGenerator(const std::string& outputFilename);
 
-    void generate(ASTNode* root);
+    void setVectorization(bool enabled) { vectorize = enabled; }
+    void setThreadPool(ThreadPool* threads) { pool = threads; }
+    void generate(const AstArena& tree, NodeId root, const SemanticInfo& semanticInfo);
+
+    uint32_t vectorizedLoops() const { return static_cast<uint32_t>(vectorLoops.size()); }
 
 private:
-    std::ofstream outFile;
-
-    void visitProgram(ASTNode* node);
-    void visitDeclarations(ASTNode* node);
-    void visitSubprogram(ASTNode* node);
-    void visitCompoundStatement(ASTNode* node);
-    void visitStatement(ASTNode* node);
-    void visitAssignment(ASTNode* node);
-    void visitIfStatement(ASTNode* node);
-    void visitWhileLoop(ASTNode* node);
-    void visitProcedureCall(ASTNode* node);
-    void visitFunctionCall(ASTNode* node);
-    void visitExpression(ASTNode* node);
-    void visitVariable(ASTNode* node);
-    void visitArrayAccess(ASTNode* node);
-    void visitBinaryOp(ASTNode* node);
-    void visitUnaryOp(ASTNode* node);
-    void visitLiteral(ASTNode* node);
+    // A worker for one pool thread, sharing the parent's tables
+    explicit CodeGenerator(const CodeGenerator& parent);
+
+    OutputBuffer outFile;       // the file, or a worker's text
+    std::string filename;
+    const AstArena* ast;
+    const SemanticInfo* info;
+    bool vectorize;
+    ThreadPool* pool;
+    std::vector<VectorLoop> vectorLoops;
+    std::unordered_map<NodeId, size_t> vectorLoopOf;   // by while node
+    std::vector<uint32_t> declared;         // variables grouped by owner, globals last
+    std::vector<uint32_t> declaredStart;    // by subprogram index: first entry in `declared`
+
+    void visitProgram(NodeId node);
+    void visitDeclarations(uint32_t owner, const char* indent);
+    void visitSubprogram(uint32_t index);
+    void visitSubprograms();
+    void visitSubprogramHead(uint32_t index);
+    void visitCompoundStatement(NodeId node);
+    void visitStatement(NodeId node);
+    void visitAssignment(NodeId node);
+    void visitIfStatement(NodeId node);
+    void visitWhileLoop(NodeId node);
+    void visitVectorLoop(const VectorLoop& loop);
+    void visitVectorExpression(NodeId node, const VectorLoop& loop);
+    void visitVectorElement(NodeId node, const VectorLoop& loop);
+    void visitProcedureCall(NodeId node);
+    void visitFunctionCall(NodeId node);
+    void visitExpression(NodeId node);
+    void visitVariable(NodeId node);
+    void visitArrayAccess(NodeId node);
+    void visitBinaryOp(NodeId node);
+    void visitUnaryOp(NodeId node);
+    void visitLiteral(NodeId node);
 };
 
-#endif // CODE_GENERATOR_H#pragma once
+#endif // CODE_GENERATOR_H
@@ -0,0 +1,258 @@
+#include "compilation.h"
+#include "asm_generation.h"
+#include "ast_file.h"
+#include "code_generation.h"
+#include "compile_cache.h"
+#include "lexer.h"
+#include "mapped_file.h"
+#include "minipascal.tab.h"
+#include "parser.h"
+#include "semantic_analyzer.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+Compilation::Compilation(const CompileOptions& options, std::ostream& diagnostics)
+    : options(options), root(NULL_NODE), diagnostics(diagnostics), scope(names), previousArena(getAstArena()) {
+    errors.set_max_errors(options.maxErrors);
+    setAstArena(&arena);
+}
+
+Compilation::~Compilation() {
+    setAstArena(previousArena);
+}
+
+bool Compilation::parse(const char* path) {
+    // Both parsers recover from syntax errors and keep going, so every
+    // error in the file is reported together once parsing is done.
+    int result = 0;
+    if (options.fastLexer || options.descentParser) {
+        MappedFile mapped;
+        if (!mapped.open(path)) {
+            diagnostics << "Error: Cannot open file " << path << std::endl;
+            return false;
+        }
+        Lexer lexer(mapped.data(), mapped.size());
+        if (options.descentParser) {
+            Parser parser(lexer, errors);
+            root = parser.parseProgram();
+        }
+        else {
+            ParseContext context = { nullptr, &lexer, &errors, NULL_NODE };
+            result = yyparse(context);
+            root = context.root;
+        }
+    }
+    else {
+        FILE* input = fopen(path, "r");
+        if (!input) {
+            diagnostics << "Error: Cannot open file " << path << std::endl;
+            return false;
+        }
+        ParseContext context = { nullptr, nullptr, &errors, NULL_NODE };
+        context.scanner = flexScannerOpen(input, &context);
+        if (context.scanner) {
+            result = yyparse(context);
+            flexScannerClose(context.scanner);
+        }
+        else {
+            result = 1;
+        }
+        fclose(input);
+        root = context.root;
+    }
+
+    if (result != 0 || errors.has_errors()) {
+        printDiagnostics(options, errors, diagnostics);
+        if (!options.jsonDiagnostics) {
+            diagnostics << "Error: Parsing failed (" << errors.error_count() << " error"
+                        << (errors.error_count() == 1 ? "" : "s") << ")" << std::endl;
+        }
+        return false;
+    }
+    if (!root) {
+        diagnostics << "Error: No AST generated" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Compilation::analyze(bool resolve, ThreadPool* pool) {
+    SemanticAnalyzer analyzer;
+    analyzer.setThreadPool(pool);
+    analyzer.setErrorHandler(&errors);
+    bool ok = analyzer.analyze(arena, root, resolve ? &info : nullptr);
+    printDiagnostics(options, errors, diagnostics);
+    if (!ok && !options.jsonDiagnostics) diagnostics << "Error: Semantic analysis failed" << std::endl;
+    return ok;
+}
+
+void Compilation::optimize(OptimizationReport& report) {
+    ::optimize(arena, root, info, options.optimization, report);
+}
+
+bool Compilation::save(const char* path) {
+    std::string error;
+    if (!writeAstFile(path, arena, root, info, names, error)) {
+        diagnostics << "Error: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Compilation::load(const char* path) {
+    std::string error;
+    if (!loadAstFile(path, image, arena, names, info, root, error)) {
+        diagnostics << "Error: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Compilation::compile(const char* path, const char* asmPath, const char* cppPath, ThreadPool* pool) {
+    if (!parse(path) || !analyze(options.optimize || asmPath || cppPath, pool)) return false;
+    if (options.optimize) {
+        OptimizationReport report;
+        optimize(report);
+    }
+    emitNative(options, arena, root, info, asmPath, cppPath, pool);
+    return true;
+}
+
+void printDiagnostics(const CompileOptions& options, const ErrorHandler& errors, std::ostream& out) {
+    if (options.jsonDiagnostics) errors.print_json(out);
+    else errors.print_errors(out);
+}
+
+void emitNative(const CompileOptions& options, const AstArena& arena, NodeId root, const SemanticInfo& info,
+                const char* asmPath, const char* cppPath, ThreadPool* pool, NativeStats* stats) {
+    if (asmPath) {
+        AsmGenerator generator(asmPath);
+        generator.setRegisterAllocation(options.registerAllocation);
+        generator.setVectorization(options.vectorize);
+        generator.generate(arena, root, info);
+        if (stats) {
+            stats->asmVectorizedLoops = generator.vectorizedLoops();
+            stats->allocation = generator.allocationStats();
+        }
+    }
+    if (cppPath) {
+        CodeGenerator generator(cppPath);
+        generator.setVectorization(options.vectorize);
+        generator.setThreadPool(pool);
+        generator.generate(arena, root, info);
+        if (stats) stats->cppVectorizedLoops = generator.vectorizedLoops();
+    }
+}
+
+// The .pas files below a directory, or the lines of a file list.
+static bool batchInputs(const char* input, std::vector<std::string>& files, std::ostream& out) {
+    std::error_code error;
+    if (std::filesystem::is_directory(input, error)) {
+        std::filesystem::recursive_directory_iterator it(input, error), end;
+        for (; !error && it != end; it.increment(error)) {
+            if (it->path().extension() == ".pas" && it->is_regular_file(error)) files.push_back(it->path().string());
+        }
+        if (error) {
+            out << "Error: Cannot read directory " << input << ": " << error.message() << std::endl;
+            return false;
+        }
+        std::sort(files.begin(), files.end());
+        return true;
+    }
+
+    std::ifstream list(input);
+    if (!list) {
+        out << "Error: Cannot open file list " << input << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(list, line)) {
+        size_t last = line.find_last_not_of(" \t\r");
+        if (last != std::string::npos) files.push_back(line.substr(0, last + 1));
+    }
+    return true;
+}
+
+// Where a batch puts one file's output: its relative path below
+// `directory`, each ".." spelled "__" so that it stays inside, with
+// `extension` in place of .pas.
+static std::string batchOutput(const char* directory, const std::string& file, const char* extension) {
+    std::filesystem::path target(directory);
+    for (const std::filesystem::path& part : std::filesystem::path(file).relative_path()) {
+        if (part == "..") target /= "__";
+        else if (part != ".") target /= part;
+    }
+    target.replace_extension(extension);
+    return target.lexically_normal().string();
+}
+
+// False, naming both files, if two inputs would write the same output.
+static bool distinctOutputs(const std::vector<std::string>& files, const std::vector<std::string>& paths,
+                            std::ostream& out) {
+    std::unordered_map<std::string, size_t> writer;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (paths[i].empty()) continue;
+        auto inserted = writer.emplace(paths[i], i);
+        if (!inserted.second) {
+            out << "Error: " << files[inserted.first->second] << " and " << files[i] << " would both write "
+                << paths[i] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int compileBatch(const char* input, const CompileOptions& options, unsigned threads, const char* asmDir,
+                 const char* cppDir, CompileCache* cache, std::ostream& out) {
+    std::vector<std::string> files;
+    if (!batchInputs(input, files, out)) return 1;
+
+    // Output directories are made up front, so workers only open files
+    std::vector<std::string> asmPaths(files.size()), cppPaths(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (asmDir) asmPaths[i] = batchOutput(asmDir, files[i], ".s");
+        if (cppDir) cppPaths[i] = batchOutput(cppDir, files[i], ".cpp");
+    }
+    if (!distinctOutputs(files, asmPaths, out) || !distinctOutputs(files, cppPaths, out)) return 1;
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::error_code error;
+        if (asmDir) std::filesystem::create_directories(std::filesystem::path(asmPaths[i]).parent_path(), error);
+        if (cppDir) std::filesystem::create_directories(std::filesystem::path(cppPaths[i]).parent_path(), error);
+    }
+
+    struct Result {
+        bool ok;
+        bool cached;
+        std::string log;
+    };
+    std::vector<Result> results(files.size());
+    ThreadPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    pool.run(files.size(), [&](size_t index, unsigned) {
+        std::ostringstream log;
+        results[index].ok = compileCached(cache, files[index].c_str(), options,
+                                          asmDir ? asmPaths[index].c_str() : nullptr,
+                                          cppDir ? cppPaths[index].c_str() : nullptr, log, results[index].cached);
+        results[index].log = log.str();
+    });
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        out << files[i] << (results[i].ok ? ": ok" : ": failed") << (results[i].cached ? " (cached)" : "") << "\n"
+            << results[i].log;
+        if (!results[i].ok) ++failed;
+    }
+    out << files.size() << " file" << (files.size() == 1 ? "" : "s") << ", " << failed << " failed, " << elapsed
+        << " ms on " << pool.size() << " thread" << (pool.size() == 1 ? "" : "s") << std::endl;
+    if (cache) cache->printStats(out);
+    return failed ? 1 : 0;
+}
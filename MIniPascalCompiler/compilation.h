@@ -0,0 +1,102 @@
+#ifndef COMPILATION_H
+#define COMPILATION_H
+
+#include "ast.h"
+#include "ast_arena.h"
+#include "error_handler.h"
+#include "mapped_file.h"
+#include "optimizer.h"
+#include "register_allocation.h"
+#include "semantic_info.h"
+#include "string_interner.h"
+#include <ostream>
+
+class CompileCache;
+class ThreadPool;
+
+// How to compile a file. One set is shared, read-only, by every file of a
+// batch.
+struct CompileOptions {
+    bool fastLexer = false;
+    bool descentParser = false;
+    size_t maxErrors = 100;
+    bool jsonDiagnostics = false;   // syntax and semantic errors as JSON lines
+    bool optimize = false;
+    OptimizationOptions optimization;
+    bool registerAllocation = true;
+    bool vectorize = true;
+};
+
+// The state of compiling one source file: its tree, its names, its syntax
+// errors and its resolution, with nothing shared with other compilations.
+// The thread that creates a Compilation builds nodes in its arena and
+// resolves names in its interner until the Compilation is destroyed, so
+// several can run at once on different threads.
+class Compilation {
+public:
+    Compilation(const CompileOptions& options, std::ostream& diagnostics);
+    ~Compilation();
+
+    Compilation(const Compilation&) = delete;
+    Compilation& operator=(const Compilation&) = delete;
+
+    // Each step records its errors in `errors`, prints them to the
+    // diagnostics stream and returns false if there were any. analyze() fills `info` only when `resolve`
+    // is set and checks subprogram bodies on `pool` when given one.
+    bool parse(const char* path);
+    bool analyze(bool resolve, ThreadPool* pool = nullptr);
+    void optimize(OptimizationReport& report);
+
+    // An analyzed tree in the format of ast_file.h. load() stands in for
+    // parse() and analyze() on a fresh Compilation; the nodes stay in the
+    // mapped file until the tree grows.
+    bool save(const char* path);
+    bool load(const char* path);
+
+    // parse(), analyze(), optimize() when the options ask for it, then the
+    // assembly and C++ to the paths that are not null, on `pool` when given
+    // one.
+    bool compile(const char* path, const char* asmPath, const char* cppPath, ThreadPool* pool = nullptr);
+
+    const CompileOptions& options;
+    StringInterner names;
+    AstArena arena;
+    ErrorHandler errors;
+    SemanticInfo info;
+    NodeId root;
+
+private:
+    std::ostream& diagnostics;
+    MappedFile image;       // the file load() read, while the arena uses it
+    InternerScope scope;
+    AstArena* previousArena;
+};
+
+// Writes what `errors` recorded to `out`, as text or as JSON lines as the
+// options say.
+void printDiagnostics(const CompileOptions& options, const ErrorHandler& errors, std::ostream& out);
+
+// What the native backends report about the code they wrote.
+struct NativeStats {
+    uint32_t asmVectorizedLoops = 0;
+    uint32_t cppVectorizedLoops = 0;
+    RegisterAllocationStats allocation;
+};
+
+// Writes the assembly and C++ for an analyzed tree to the paths that are
+// not null, the C++ on `pool` when given one. `stats` may be null.
+void emitNative(const CompileOptions& options, const AstArena& arena, NodeId root, const SemanticInfo& info,
+                const char* asmPath, const char* cppPath, ThreadPool* pool = nullptr, NativeStats* stats = nullptr);
+
+// Compiles the files `input` names, one path per line of a list file or
+// every .pas file below a directory in sorted order, on `threads` workers
+// (0: one per hardware thread), each file in its own Compilation unless
+// `cache` (may be null) has it. With `asmDir` or `cppDir` a file's output
+// goes below that directory under the file's own relative path, ".."
+// spelled "__"; two files that would still share an output are refused
+// before anything is compiled. Results and diagnostics are written to
+// `out` in input order, then a summary; returns 0 if every file compiled.
+int compileBatch(const char* input, const CompileOptions& options, unsigned threads, const char* asmDir,
+                 const char* cppDir, CompileCache* cache, std::ostream& out);
+
+#endif // COMPILATION_H
@@ -0,0 +1,305 @@
+#include "compile_cache.h"
+#include "compilation.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static const char ENTRY_MAGIC[8] = { 'M', 'P', 'C', 'A', 'C', 'H', 'E', '1' };
+
+// Temporary files older than this belong to a compiler that died mid-write.
+static const std::chrono::hours STALE_TEMPORARY(1);
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Eight bytes per step; not cryptographic, but two of these with different
+// seeds make accidental collisions between sources a non-issue.
+static uint64_t hashBytes(const char* data, size_t size, uint64_t seed) {
+    uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        h = (h ^ mix(word)) * 0x9e3779b97f4a7c15ULL;
+        h = (h << 27) | (h >> 37);
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, data + i, size - i);
+    h ^= mix(tail ^ seed);
+    return mix(h);
+}
+
+// Entries from another build of the compiler never match, since its output
+// may differ even for the same source and options: the running binary's
+// size and modification time are part of every key.
+static std::string compilerBuild() {
+    std::filesystem::path binary;
+    std::error_code error;
+#ifdef _WIN32
+    char name[MAX_PATH];
+    DWORD length = GetModuleFileNameA(nullptr, name, MAX_PATH);
+    if (length > 0 && length < MAX_PATH) binary = std::string(name, length);
+#else
+    binary = std::filesystem::read_symlink("/proc/self/exe", error);
+#endif
+    std::ostringstream build;
+    build << "minipascal";
+    if (!binary.empty()) {
+        build << ' ' << std::filesystem::file_size(binary, error) << ' '
+              << std::filesystem::last_write_time(binary, error).time_since_epoch().count();
+    }
+    return build.str();
+}
+
+std::string CacheKey::hex() const {
+    static const char digits[] = "0123456789abcdef";
+    std::string text(32, '0');
+    for (int i = 0; i < 16; ++i) {
+        text[15 - i] = digits[(high >> (4 * i)) & 15];
+        text[31 - i] = digits[(low >> (4 * i)) & 15];
+    }
+    return text;
+}
+
+CompileCache::CompileCache(const std::string& directory, uint64_t maxBytes)
+    : directory(directory), maxBytes(maxBytes), build(compilerBuild()), sequence(0), hits(0), misses(0), stores(0), sized(false),
+      knownBytes(0), evictions(0), evictedBytes(0) {
+    std::random_device random;
+    nonce = (static_cast<uint64_t>(random()) << 32) ^ random();
+}
+
+CacheKey CompileCache::key(const char* source, size_t size, const CompileOptions& options, bool assembly,
+                          bool cpp) const {
+    std::ostringstream fingerprint;
+    fingerprint << build << '\n'
+                << options.fastLexer << options.descentParser << options.optimize << options.registerAllocation
+                << options.vectorize << options.jsonDiagnostics << assembly << cpp << '\n'
+                << options.maxErrors << ' ' << options.optimization.evaluationBudget << ' '
+                << options.optimization.inlineBudget;
+    std::string settings = fingerprint.str();
+    CacheKey key;
+    key.high = hashBytes(source, size, hashBytes(settings.data(), settings.size(), 0x243f6a8885a308d3ULL));
+    key.low = hashBytes(source, size, hashBytes(settings.data(), settings.size(), 0x13198a2e03707344ULL));
+    return key;
+}
+
+std::string CompileCache::entryPath(const CacheKey& key) const {
+    std::string name = key.hex();
+    return (std::filesystem::path(directory) / name.substr(0, 2) / (name.substr(2) + ".entry")).string();
+}
+
+static void appendField(std::string& out, const std::string& field) {
+    uint64_t length = field.size();
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out += field;
+}
+
+static bool readField(const std::string& in, size_t& at, std::string& field) {
+    uint64_t length;
+    if (in.size() - at < sizeof(length)) return false;
+    std::memcpy(&length, in.data() + at, sizeof(length));
+    at += sizeof(length);
+    if (in.size() - at < length) return false;
+    field.assign(in, at, static_cast<size_t>(length));
+    at += static_cast<size_t>(length);
+    return true;
+}
+
+static bool readWholeFile(const std::string& path, std::string& text) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::ostringstream bytes;
+    bytes << in.rdbuf();
+    text = bytes.str();
+    return !in.bad();
+}
+
+static bool writeWholeFile(const std::string& path, const std::string& text) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    out.close();
+    return !out.fail();
+}
+
+bool CompileCache::lookup(const CacheKey& key, CacheEntry& entry) {
+    std::string path = entryPath(key);
+    std::string bytes;
+    if (!readWholeFile(path, bytes)) {
+        ++misses;
+        return false;
+    }
+
+    // magic, key, ok flag, then the three texts
+    size_t at = sizeof(ENTRY_MAGIC) + 2 * sizeof(uint64_t) + 1;
+    CacheKey stored;
+    if (bytes.size() < at || std::memcmp(bytes.data(), ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) != 0) {
+        ++misses;
+        return false;
+    }
+    std::memcpy(&stored.high, bytes.data() + sizeof(ENTRY_MAGIC), sizeof(uint64_t));
+    std::memcpy(&stored.low, bytes.data() + sizeof(ENTRY_MAGIC) + sizeof(uint64_t), sizeof(uint64_t));
+    entry.ok = bytes[at - 1] != 0;
+    if (stored.high != key.high || stored.low != key.low || !readField(bytes, at, entry.diagnostics) ||
+        !readField(bytes, at, entry.assembly) || !readField(bytes, at, entry.cpp) || at != bytes.size()) {
+        ++misses;
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    ++hits;
+    return true;
+}
+
+void CompileCache::store(const CacheKey& key, const CacheEntry& entry) {
+    std::string bytes(ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+    bytes.append(reinterpret_cast<const char*>(&key.high), sizeof(key.high));
+    bytes.append(reinterpret_cast<const char*>(&key.low), sizeof(key.low));
+    bytes += entry.ok ? '\1' : '\0';
+    appendField(bytes, entry.diagnostics);
+    appendField(bytes, entry.assembly);
+    appendField(bytes, entry.cpp);
+
+    // Written in full under a name nobody else uses, then renamed over the
+    // entry in one step
+    std::string path = entryPath(key);
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    std::ostringstream temporary;
+    temporary << path << '.' << std::hex << nonce << '.' << sequence++ << ".tmp";
+    if (!writeWholeFile(temporary.str(), bytes)) {
+        std::filesystem::remove(temporary.str(), error);
+        return;
+    }
+    std::filesystem::rename(temporary.str(), path, error);
+    if (error) {
+        std::filesystem::remove(temporary.str(), error);
+        return;
+    }
+    ++stores;
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (sized) knownBytes += bytes.size();
+    if (!sized || knownBytes > maxBytes) evict();
+}
+
+// Measures the directory and, when it is over the cap, deletes the entries
+// used longest ago. Called with `lock` held.
+void CompileCache::evict() {
+    struct File {
+        std::filesystem::file_time_type used;
+        uint64_t size;
+        std::filesystem::path path;
+    };
+    std::vector<File> files;
+    uint64_t total = 0;
+    auto now = std::filesystem::file_time_type::clock::now();
+    std::error_code error;
+    std::filesystem::recursive_directory_iterator it(directory, error), end;
+    for (; !error && it != end; it.increment(error)) {
+        std::error_code fileError;
+        if (!it->is_regular_file(fileError)) continue;
+        File file{ it->last_write_time(fileError), it->file_size(fileError), it->path() };
+        if (fileError) continue;
+        if (file.path.extension() == ".tmp") {
+            if (now - file.used > STALE_TEMPORARY) std::filesystem::remove(file.path, fileError);
+            continue;
+        }
+        if (file.path.extension() != ".entry") continue;
+        total += file.size;
+        files.push_back(file);
+    }
+    sized = true;
+    knownBytes = total;
+    if (total <= maxBytes) return;
+
+    std::sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.used < b.used; });
+    uint64_t target = maxBytes / 4 * 3;
+    for (const File& file : files) {
+        if (knownBytes <= target) break;
+        std::error_code removeError;
+        if (!std::filesystem::remove(file.path, removeError)) continue;
+        knownBytes -= file.size;
+        ++evictions;
+        evictedBytes += file.size;
+    }
+}
+
+CacheStats CompileCache::stats() const {
+    CacheStats result;
+    result.hits = hits;
+    result.misses = misses;
+    result.stores = stores;
+    std::lock_guard<std::mutex> guard(lock);
+    result.evictions = evictions;
+    result.evictedBytes = evictedBytes;
+    return result;
+}
+
+void CompileCache::printStats(std::ostream& out) const {
+    CacheStats counts = stats();
+    uint64_t lookups = counts.hits + counts.misses;
+    out << "cache: " << counts.hits << " hit" << (counts.hits == 1 ? "" : "s") << ", " << counts.misses << " miss"
+        << (counts.misses == 1 ? "" : "es");
+    if (lookups) out << " (" << counts.hits * 100 / lookups << "% hits)";
+    out << ", " << counts.stores << " stored, " << counts.evictions << " evicted (" << counts.evictedBytes / 1024
+        << " KB)" << std::endl;
+}
+
+bool compileCached(CompileCache* cache, const char* path, const CompileOptions& options, const char* asmPath,
+                   const char* cppPath, std::ostream& diagnostics, bool& hit, ThreadPool* pool) {
+    hit = false;
+    if (!cache) {
+        Compilation compilation(options, diagnostics);
+        return compilation.compile(path, asmPath, cppPath, pool);
+    }
+
+    MappedFile source;
+    if (!source.open(path)) {
+        diagnostics << "Error: Cannot open file " << path << std::endl;
+        return false;
+    }
+    CacheKey key = cache->key(source.data(), source.size(), options, asmPath != nullptr, cppPath != nullptr);
+    CacheEntry entry;
+    if (cache->lookup(key, entry)) {
+        hit = true;
+        diagnostics << entry.diagnostics;
+        if (!entry.ok) return false;
+        const char* failed = nullptr;
+        if (asmPath && !writeWholeFile(asmPath, entry.assembly)) failed = asmPath;
+        else if (cppPath && !writeWholeFile(cppPath, entry.cpp)) failed = cppPath;
+        if (failed) diagnostics << "Error: Could not open output file: " << failed << std::endl;
+        return !failed;
+    }
+
+    std::ostringstream log;
+    {
+        Compilation compilation(options, log);
+        entry.ok = compilation.compile(path, asmPath, cppPath, pool);
+    }
+    entry.diagnostics = log.str();
+    diagnostics << entry.diagnostics;
+    if (entry.ok && ((asmPath && !readWholeFile(asmPath, entry.assembly)) ||
+                     (cppPath && !readWholeFile(cppPath, entry.cpp)))) {
+        return entry.ok;    // the output is there; it just cannot be cached
+    }
+    cache->store(key, entry);
+    return entry.ok;
+}
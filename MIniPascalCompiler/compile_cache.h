@@ -0,0 +1,89 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+struct CompileOptions;
+class ThreadPool;
+
+// 128-bit content address of one compilation: the source bytes, the
+// compiler build and every option that can change what it prints or emits.
+struct CacheKey {
+    uint64_t high;
+    uint64_t low;
+
+    std::string hex() const;
+};
+
+// What a compilation left behind, enough to replay it without compiling.
+struct CacheEntry {
+    bool ok = false;
+    std::string diagnostics;
+    std::string assembly;       // empty unless assembly was asked for
+    std::string cpp;            // empty unless C++ was asked for
+};
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t stores = 0;
+    uint64_t evictions = 0;
+    uint64_t evictedBytes = 0;
+};
+
+// On-disk compilation cache, one file per entry, named by its key, under
+// two-character fan-out directories. Entries are written to a temporary
+// file and renamed into place, so concurrent compilers, in this process or
+// others, see either a whole entry or none; an entry that fails to parse
+// is a miss. A hit refreshes the entry's modification time, and once the
+// directory outgrows `maxBytes` the least recently used entries are
+// deleted until it is back under three quarters of that.
+class CompileCache {
+public:
+    CompileCache(const std::string& directory, uint64_t maxBytes);
+
+    CompileCache(const CompileCache&) = delete;
+    CompileCache& operator=(const CompileCache&) = delete;
+
+    // The key for compiling `source` with `options` into the given outputs.
+    CacheKey key(const char* source, size_t size, const CompileOptions& options, bool assembly, bool cpp) const;
+
+    bool lookup(const CacheKey& key, CacheEntry& entry);
+    void store(const CacheKey& key, const CacheEntry& entry);
+
+    CacheStats stats() const;
+    void printStats(std::ostream& out) const;
+
+private:
+    std::string entryPath(const CacheKey& key) const;
+    void evict();
+
+    std::string directory;
+    uint64_t maxBytes;
+    std::string build;                  // identifies the compiler binary
+    uint64_t nonce;                     // tells this process's temporary files apart
+    std::atomic<uint64_t> sequence;
+
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> stores;
+
+    mutable std::mutex lock;            // guards the fields below
+    bool sized;
+    uint64_t knownBytes;                // the directory's size as far as this process knows
+    uint64_t evictions;
+    uint64_t evictedBytes;
+};
+
+// Compiles `path` like Compilation::compile, on `pool` when given one,
+// unless `cache` (may be null) already holds the result, in which case the
+// outputs and diagnostics are replayed from it. `hit` tells which happened.
+bool compileCached(CompileCache* cache, const char* path, const CompileOptions& options, const char* asmPath,
+                   const char* cppPath, std::ostream& diagnostics, bool& hit, ThreadPool* pool = nullptr);
+
+#endif // COMPILE_CACHE_H
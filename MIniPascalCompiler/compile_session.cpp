@@ -0,0 +1,368 @@
+#include "compile_session.h"
+#include "ast_rewrite.h"
+#include "lexer.h"
+#include "minipascal.tab.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+// The arena only grows; once replaced pieces outweigh the live tree by this
+// much, the next update starts from an empty one.
+static const size_t GARBAGE_FACTOR = 4;
+static const size_t GARBAGE_SLACK = 1 << 16;
+
+CompileSession::CompileSession(const CompileOptions& options, ThreadPool* pool)
+    : options(options), pool(pool), scope(names), previousArena(getAstArena()), tree(NULL_NODE), checked(false),
+      liveNodes(0) {
+    errors.set_max_errors(options.maxErrors);
+    setAstArena(&arena);
+}
+
+CompileSession::~CompileSession() {
+    setAstArena(previousArena);
+}
+
+// Cuts the source at the top-level subprogram declarations: each one runs
+// from its 'function' or 'procedure' to the ';' after the 'end' that closes
+// its body, the heading is everything before the first, and the main block
+// starts at the first 'begin' outside them. False if the tokens do not have
+// that shape, which leaves it to the parser to say what is wrong.
+//
+// Only the part of the text that differs from the last good source is
+// lexed again: pieces that end before the first changed byte are kept, and
+// once lexing reaches a piece that started the same way in the unchanged
+// tail, the rest of the old layout is kept too, moved by the change in
+// length. Kept pieces keep their subtrees.
+bool CompileSession::split(const char* source, size_t size, Layout& layout) const {
+    size_t from = 0;
+    size_t same = 0, sameTail = 0;
+    ptrdiff_t delta = static_cast<ptrdiff_t>(size) - static_cast<ptrdiff_t>(text.size());
+    if (current.valid && !current.subprograms.empty()) {
+        size_t limit = std::min(size, text.size());
+        same = std::mismatch(source, source + limit, text.data()).first - source;
+        while (sameTail < limit - same && source[size - 1 - sameTail] == text[text.size() - 1 - sameTail]) ++sameTail;
+        if (same >= current.subprograms[0].begin) {
+            size_t kept = 0;
+            while (kept < current.subprograms.size() && current.subprograms[kept].end <= same) ++kept;
+            layout.name = current.name;
+            layout.heading = current.heading;
+            layout.subprograms.assign(current.subprograms.begin(), current.subprograms.begin() + kept);
+            from = kept == 0 ? current.subprograms[0].begin : current.subprograms[kept - 1].end;
+        }
+    }
+
+    Lexer lexer(source + from, size - from);
+    bool seenSubprogram = from != 0;
+    for (Token token = lexer.next();; token = lexer.next()) {
+        size_t offset = static_cast<size_t>(token.text - source);
+        if (token.kind == FUNCTION || token.kind == PROCEDURE) {
+            if (from != 0 && offset >= size - sameTail) {
+                Piece probe;
+                probe.begin = offset - delta;
+                auto old = std::lower_bound(current.subprograms.begin(), current.subprograms.end(), probe,
+                                            [](const Piece& a, const Piece& b) { return a.begin < b.begin; });
+                if (old != current.subprograms.end() && old->begin == probe.begin) {
+                    for (; old != current.subprograms.end(); ++old) {
+                        Piece moved = *old;
+                        moved.begin += delta;
+                        moved.end += delta;
+                        layout.subprograms.push_back(moved);
+                    }
+                    layout.main = current.main;
+                    layout.main.begin += delta;
+                    layout.main.end = size;
+                    layout.valid = true;
+                    return true;
+                }
+            }
+            if (!seenSubprogram) layout.heading.end = offset;
+            seenSubprogram = true;
+            int depth = 0;
+            for (token = lexer.next(); token.kind != 0 && token.kind != TOKEN_INVALID; token = lexer.next()) {
+                if (token.kind == BEGIN) ++depth;
+                else if (token.kind == END && --depth == 0) break;
+            }
+            if (token.kind != END) return false;
+            token = lexer.next();
+            if (token.kind != SEMICOLON) return false;
+            Piece piece;
+            piece.begin = offset;
+            piece.end = static_cast<size_t>(token.text - source) + 1;
+            layout.subprograms.push_back(piece);
+        }
+        else if (token.kind == BEGIN) {
+            if (!seenSubprogram) layout.heading.end = offset;
+            layout.main.begin = offset;
+            layout.main.end = size;
+            layout.valid = true;
+            return true;
+        }
+        else if (token.kind == 0 || token.kind == TOKEN_INVALID || seenSubprogram) {
+            return false;
+        }
+    }
+}
+
+bool CompileSession::parseWhole(const char* source, size_t size, Layout& layout, std::ostream& diagnostics) {
+    Lexer lexer(source, size);
+    Parser parser(lexer, errors);
+    NodeId root = parser.parseProgram();
+    if (parser.errorCount() != 0 || errors.has_errors()) {
+        printDiagnostics(options, errors, diagnostics);
+        if (!options.jsonDiagnostics) {
+            diagnostics << "Error: Parsing failed (" << errors.error_count() << " error"
+                        << (errors.error_count() == 1 ? "" : "s") << ")" << std::endl;
+        }
+        return false;
+    }
+
+    // The pieces of the next update are matched against this tree's
+    NodeId subprogs = arena.child(root, 1);
+    if (!layout.valid || layout.subprograms.size() != arena.childCount(subprogs)) {
+        layout = Layout();
+    }
+    else {
+        layout.heading.node = arena.child(root, 0);
+        layout.main.node = arena.child(root, 2);
+        NodeId subprog = arena.firstChild(subprogs);
+        for (Piece& piece : layout.subprograms) {
+            piece.node = subprog;
+            subprog = arena.nextSibling(subprog);
+        }
+        locatePieces(source, layout, false);
+    }
+    layout.name = arena.node(root).name;
+    tree = root;
+    return true;
+}
+
+// Gives every piece split() did not keep a subtree: the old one if an old
+// piece had the same text, say because the declaration only moved, else a
+// new parse, positioned as if the piece started the text. False on the
+// first syntax error.
+bool CompileSession::parsePieces(const char* source, Layout& layout, RebuildStats& stats) {
+    auto textOf = [](const char* base, const Piece& piece) {
+        return std::string_view(base + piece.begin, piece.end - piece.begin);
+    };
+
+    if (!layout.heading.node) {
+        if (textOf(source, layout.heading) == textOf(text.data(), current.heading)) {
+            layout.name = current.name;
+            layout.heading = current.heading;
+        }
+        else {
+            Lexer lexer(source + layout.heading.begin, layout.heading.end - layout.heading.begin);
+            Parser parser(lexer, errors);
+            layout.heading.node = parser.parseHeading(layout.name);
+            if (parser.errorCount() != 0) return false;
+            layout.heading.line = layout.heading.column = 1;
+        }
+    }
+
+    // Old declarations split() did not carry over, matched up in order
+    std::unordered_set<NodeId> kept;
+    for (const Piece& piece : layout.subprograms) {
+        if (piece.node) kept.insert(piece.node);
+    }
+    std::unordered_map<std::string_view, std::vector<const Piece*>> unchanged;
+    for (size_t i = current.subprograms.size(); i-- > 0;) {
+        const Piece& old = current.subprograms[i];
+        if (!kept.count(old.node)) unchanged[textOf(text.data(), old)].push_back(&old);
+    }
+    for (Piece& piece : layout.subprograms) {
+        if (piece.node) continue;
+        auto found = unchanged.find(textOf(source, piece));
+        if (found != unchanged.end() && !found->second.empty()) {
+            const Piece& old = *found->second.back();
+            piece.node = old.node;
+            piece.line = old.line;
+            piece.column = old.column;
+            found->second.pop_back();
+            continue;
+        }
+        Lexer lexer(source + piece.begin, piece.end - piece.begin);
+        Parser parser(lexer, errors);
+        piece.node = parser.parseSubprogramPiece();
+        if (parser.errorCount() != 0) return false;
+        piece.line = piece.column = 1;
+        ++stats.reparsed;
+    }
+
+    if (!layout.main.node) {
+        if (textOf(source, layout.main) == textOf(text.data(), current.main)) {
+            layout.main.node = current.main.node;
+            layout.main.line = current.main.line;
+            layout.main.column = current.main.column;
+        }
+        else {
+            Lexer lexer(source + layout.main.begin, layout.main.end - layout.main.begin);
+            Parser parser(lexer, errors);
+            layout.main.node = parser.parseMainBlock();
+            if (parser.errorCount() != 0) return false;
+            layout.main.line = layout.main.column = 1;
+        }
+    }
+    return true;
+}
+
+// Moves the positions under `root`, recorded for text that started at
+// fromLine:fromColumn, to text that starts at toLine:toColumn.
+static void moveSubtree(AstArena& arena, NodeId root, uint32_t fromLine, uint32_t fromColumn, uint32_t toLine,
+                        uint32_t toColumn) {
+    std::vector<NodeId> pending(1, root);
+    while (!pending.empty()) {
+        ASTNode& node = arena.node(pending.back());
+        pending.pop_back();
+        if (node.line != 0) {
+            if (node.line == fromLine) {
+                uint32_t column = node.column - fromColumn + toColumn;
+                node.column = static_cast<uint16_t>(column < 0xFFFF ? column : 0xFFFF);
+            }
+            node.line = node.line - fromLine + toLine;
+        }
+        for (NodeId child = node.firstChild; child; child = arena.nextSibling(child)) pending.push_back(child);
+    }
+}
+
+// Works out where each piece starts in `source` and, with `moveSubtrees`,
+// moves the positions of every subtree that was placed elsewhere.
+void CompileSession::locatePieces(const char* source, Layout& layout, bool moveSubtrees) {
+    size_t scanned = 0;
+    uint32_t line = 1;
+    size_t lineStart = 0;
+    auto place = [&](Piece& piece) {
+        while (const char* newline =
+                   static_cast<const char*>(std::memchr(source + scanned, '\n', piece.begin - scanned))) {
+            ++line;
+            scanned = static_cast<size_t>(newline - source) + 1;
+            lineStart = scanned;
+        }
+        scanned = piece.begin;
+        uint32_t column = static_cast<uint32_t>(piece.begin - lineStart) + 1;
+        if (moveSubtrees && piece.node && (piece.line != line || piece.column != column))
+            moveSubtree(arena, piece.node, piece.line, piece.column, line, column);
+        piece.line = line;
+        piece.column = column;
+    };
+    place(layout.heading);
+    for (Piece& piece : layout.subprograms) place(piece);
+    place(layout.main);
+}
+
+// A new program node over the pieces' subtrees, relinked in their new order.
+NodeId CompileSession::assemble(const Layout& layout) {
+    arena.node(layout.heading.node).nextSibling = NULL_NODE;
+    arena.node(layout.main.node).nextSibling = NULL_NODE;
+    NodeId subprogs = createSubprogramDeclarationsNode();
+    for (const Piece& piece : layout.subprograms) {
+        arena.node(piece.node).nextSibling = NULL_NODE;
+        appendSubprogramDeclarationsNode(subprogs, piece.node);
+    }
+    return createProgramNode(layout.name, layout.heading.node, subprogs, layout.main.node);
+}
+
+bool CompileSession::update(const char* source, size_t size, std::ostream& diagnostics, RebuildStats& stats) {
+    auto start = std::chrono::steady_clock::now();
+    stats = RebuildStats();
+
+    if (tree && arena.nodeCount() > GARBAGE_FACTOR * liveNodes + GARBAGE_SLACK) {
+        arena.release();
+        bodies.clear();
+        text.clear();
+        current = Layout();
+        tree = NULL_NODE;
+        checked = false;
+    }
+
+    Layout layout;
+    bool pieces = split(source, size, layout);
+    errors.clear();
+    if (tree && pieces && parsePieces(source, layout, stats)) {
+        locatePieces(source, layout, true);
+        tree = assemble(layout);
+    }
+    else {
+        // Reported the way a whole-file compile reports them
+        errors.clear();
+        stats.fullParse = true;
+        stats.reparsed = layout.subprograms.size();
+        if (!parseWhole(source, size, layout, diagnostics)) {
+            stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return false;
+        }
+    }
+    text.assign(source, size);
+    current = layout;
+    liveNodes = subtreeSize(arena, tree);
+
+    SemanticAnalyzer analyzer;
+    analyzer.setThreadPool(pool);
+    analyzer.setErrorHandler(&errors);
+    analyzer.setBodyCache(&bodies);
+    checked = analyzer.analyze(arena, tree, &info);
+    printDiagnostics(options, errors, diagnostics);
+    if (!checked && !options.jsonDiagnostics) diagnostics << "Error: Semantic analysis failed" << std::endl;
+    stats.subprograms = info.subprograms.size();
+    stats.rechecked = analyzer.bodiesChecked();
+    stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return checked;
+}
+
+void CompileSession::emit(const char* asmPath, const char* cppPath) {
+    if (!checked) return;
+    if (!options.optimize) {
+        emitNative(options, arena, tree, info, asmPath, cppPath, pool);
+        return;
+    }
+
+    scratch.assign(arena);
+    SemanticInfo optimized = info;
+    OptimizationReport report;
+    setAstArena(&scratch);
+    ::optimize(scratch, tree, optimized, options.optimization, report);
+    emitNative(options, scratch, tree, optimized, asmPath, cppPath, pool);
+    setAstArena(&arena);
+}
+
+int watchFile(const char* path, const CompileOptions& options, unsigned threads, const char* asmPath,
+              const char* cppPath, std::ostream& out) {
+    ThreadPool pool(threads);
+    CompileSession session(options, &pool);
+    std::filesystem::file_time_type seen;
+    bool first = true;
+    out << "Watching " << path << std::endl;
+    for (;; std::this_thread::sleep_for(std::chrono::milliseconds(100))) {
+        std::error_code error;
+        std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, error);
+        if (error || (!first && modified == seen)) continue;
+        first = false;
+        seen = modified;
+
+        // Read rather than mapped: an editor may truncate the file under us
+        auto start = std::chrono::steady_clock::now();
+        std::ifstream in(path, std::ios::binary);
+        std::ostringstream text;
+        text << in.rdbuf();
+        std::string source = text.str();
+
+        RebuildStats stats;
+        bool ok = session.update(source.data(), source.size(), out, stats);
+        if (ok) session.emit(asmPath, cppPath);
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        out << (ok ? "Rebuilt in " : "Failed in ") << elapsed << " ms: " << stats.subprograms << " subprogram"
+            << (stats.subprograms == 1 ? "" : "s") << ", ";
+        if (stats.fullParse) out << "whole file parsed, ";
+        else out << stats.reparsed << " reparsed, ";
+        out << stats.rechecked << " re-checked" << std::endl;
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef COMPILE_SESSION_H
+#define COMPILE_SESSION_H
+
+#include "ast.h"
+#include "ast_arena.h"
+#include "compilation.h"
+#include "error_handler.h"
+#include "semantic_analyzer.h"
+#include "semantic_info.h"
+#include "string_interner.h"
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// What one update of a CompileSession had to redo.
+struct RebuildStats {
+    double milliseconds = 0;
+    bool fullParse = false;     // the file was parsed as a whole
+    size_t subprograms = 0;
+    size_t reparsed = 0;        // subprogram declarations parsed again
+    size_t rechecked = 0;       // subprogram bodies checked again
+};
+
+// One source file compiled again and again as it is edited, for an editor
+// or --watch. The text is split at subprogram declarations into pieces:
+// the heading with the global declarations, each subprogram, and the main
+// block. A piece whose text is unchanged keeps its subtree; the others are
+// parsed on their own. Analysis then declares everything again, which is
+// cheap, but replays each unchanged body from the BodyCache unless a name
+// it uses now resolves differently, say because a global or a signature it
+// depends on changed.
+//
+// A piece parsed on its own, or kept from an older text, has the node
+// positions of wherever it was parsed; they are moved to where the piece
+// is now before analysis, so diagnostics point into the current text.
+//
+// Pieces are parsed with the hand-written lexer and parser whatever the
+// options say. If any piece has a syntax error, or the text does not split
+// cleanly, the whole file is parsed instead, so errors are reported exactly
+// as a full compile reports them. A failed update leaves the last good tree
+// in place for the next one.
+//
+// Like Compilation, a session binds its arena and names to the thread that
+// creates it, for its lifetime.
+class CompileSession {
+public:
+    CompileSession(const CompileOptions& options, ThreadPool* pool = nullptr);
+    ~CompileSession();
+
+    CompileSession(const CompileSession&) = delete;
+    CompileSession& operator=(const CompileSession&) = delete;
+
+    // Brings the tree and its analysis up to date with `source`; errors go
+    // to `diagnostics`. Returns false if the source does not compile.
+    bool update(const char* source, size_t size, std::ostream& diagnostics, RebuildStats& stats);
+
+    // Writes native code for the last successful update, optimizing a copy
+    // of the tree when the options ask for it so the session's own tree is
+    // left as parsed.
+    void emit(const char* asmPath, const char* cppPath);
+
+private:
+    struct Piece {
+        size_t begin = 0;           // byte range in the source
+        size_t end = 0;
+        NodeId node = NULL_NODE;    // set once the piece has a subtree
+        uint32_t line = 0;          // where the positions in the subtree say the piece starts
+        uint32_t column = 0;
+    };
+    struct Layout {
+        bool valid = false;
+        NameId name = NO_NAME;
+        Piece heading;
+        std::vector<Piece> subprograms;
+        Piece main;
+    };
+
+    bool split(const char* source, size_t size, Layout& layout) const;
+    bool parseWhole(const char* source, size_t size, Layout& layout, std::ostream& diagnostics);
+    bool parsePieces(const char* source, Layout& layout, RebuildStats& stats);
+    void locatePieces(const char* source, Layout& layout, bool moveSubtrees);
+    NodeId assemble(const Layout& layout);
+
+    const CompileOptions& options;
+    ThreadPool* pool;
+    StringInterner names;
+    AstArena arena;
+    AstArena scratch;               // the optimized copy emit() works on
+    InternerScope scope;
+    AstArena* previousArena;
+    ErrorHandler errors;
+    SemanticInfo info;
+    BodyCache bodies;
+    std::string text;               // the source of the last good tree
+    Layout current;                 // and its pieces
+    NodeId tree;
+    bool checked;                   // the last update compiled
+    size_t liveNodes;               // nodes reachable from `tree`; the rest of the arena is garbage
+};
+
+// Compiles `path` with a CompileSession every time its modification time
+// changes, until the process is interrupted, writing native code to the
+// paths that are not null and reporting how long each rebuild took and
+// what it redid to `out`. Bodies are checked on `threads` workers.
+int watchFile(const char* path, const CompileOptions& options, unsigned threads, const char* asmPath,
+              const char* cppPath, std::ostream& out);
+
+#endif // COMPILE_SESSION_H
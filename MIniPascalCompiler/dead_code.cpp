@@ -0,0 +1,277 @@
+#include "optimizer.h"
+#include "ast_rewrite.h"
+#include "register_allocation.h"
+
+#include <unordered_map>
+
+namespace {
+
+// Subprograms the main program calls, directly or through others.
+void markCalls(const AstArena& ast, const SemanticInfo& info, NodeId node, std::vector<bool>& reached,
+               std::vector<uint32_t>& work) {
+    const NodeRef& ref = info.ref(node);
+    if (ref.kind == RefKind::CALL && !reached[ref.index]) {
+        reached[ref.index] = true;
+        work.push_back(ref.index);
+    }
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        markCalls(ast, info, child, reached, work);
+    }
+}
+
+void reachableSubprograms(const AstArena& ast, NodeId root, const SemanticInfo& info, std::vector<bool>& reached) {
+    reached.assign(info.subprograms.size(), false);
+    std::vector<uint32_t> work;
+    markCalls(ast, info, ast.child(root, 2), reached, work);
+    while (!work.empty()) {
+        uint32_t next = work.back();
+        work.pop_back();
+        markCalls(ast, info, ast.child(info.subprograms[next].node, 2), reached, work);
+    }
+}
+
+// Counts, by variable, the reads and the mentions of any kind below `node`.
+void countUses(const AstArena& ast, const SemanticInfo& info, NodeId node, std::vector<uint32_t>& reads,
+               std::vector<uint32_t>& mentions) {
+    const ASTNode& n = ast.node(node);
+    if (n.type == NODE_ASSIGNMENT) {
+        NodeId target = ast.child(node, 0);
+        if (info.ref(target).kind == RefKind::VARIABLE) ++mentions[info.ref(target).index];
+        if (ast.node(target).type == NODE_ARRAY_ACCESS) countUses(ast, info, ast.child(target, 0), reads, mentions);
+        countUses(ast, info, ast.child(node, 1), reads, mentions);
+        return;
+    }
+    if ((n.type == NODE_VARIABLE || n.type == NODE_ARRAY_ACCESS) && info.ref(node).kind == RefKind::VARIABLE) {
+        ++reads[info.ref(node).index];
+        ++mentions[info.ref(node).index];
+    }
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        countUses(ast, info, child, reads, mentions);
+    }
+}
+
+// Backward liveness over one routine's statements. A loop's live-in set is
+// kept between sweeps and grows until a sweep changes none of them; only
+// then does a sweep remove the stores nothing reads.
+class DeadStores {
+public:
+    DeadStores(AstArena& ast, SemanticInfo& info, PassReport& report) : ast(ast), info(info), report(report) {
+        findSharedGlobals(ast, info, shared);
+    }
+
+    bool routine(NodeId body);
+
+private:
+    typedef std::vector<bool> Live;
+
+    void statement(NodeId node, Live& live);
+    void uses(NodeId node, Live& live);
+    bool pure(NodeId node) const;
+    bool scalar(NodeId target) const;
+
+    AstArena& ast;
+    SemanticInfo& info;
+    PassReport& report;
+    std::vector<bool> shared;
+    std::unordered_map<NodeId, Live> loopLive;
+    bool changed;
+    bool removing;
+    uint32_t removed;
+};
+
+// Whether evaluating the expression could be skipped: no calls, no traps.
+bool DeadStores::pure(NodeId node) const {
+    const ASTNode& n = ast.node(node);
+    switch (n.type) {
+    case NODE_INT_NUM:
+    case NODE_REAL_NUM:
+    case NODE_BOOLEAN:
+        return true;
+    case NODE_VARIABLE:
+        return info.ref(node).kind == RefKind::VARIABLE;
+    case NODE_ARRAY_ACCESS:
+        return info.boundsProven[node] && pure(ast.child(node, 0));
+    case NODE_UNARY_OP:
+        return pure(ast.child(node, 0));
+    case NODE_BINARY_OP: {
+        NodeId right = ast.child(node, 1);
+        if (n.op == OP_DIV && (ast.node(right).type != NODE_INT_NUM || ast.node(right).intVal == 0)) return false;
+        return pure(ast.child(node, 0)) && pure(right);
+    }
+    default:
+        return false;
+    }
+}
+
+bool DeadStores::scalar(NodeId target) const {
+    return ast.node(target).type == NODE_VARIABLE && info.ref(target).kind == RefKind::VARIABLE &&
+           info.variable(target).type.baseType != DataType::ARRAY;
+}
+
+// Adds what an expression reads; a call may read any global a subprogram uses.
+void DeadStores::uses(NodeId node, Live& live) {
+    const ASTNode& n = ast.node(node);
+    const NodeRef& ref = info.ref(node);
+    if ((n.type == NODE_VARIABLE || n.type == NODE_ARRAY_ACCESS) && ref.kind == RefKind::VARIABLE) live[ref.index] = true;
+    if (ref.kind == RefKind::CALL) {
+        for (size_t v = 0; v < shared.size(); ++v) {
+            if (shared[v]) live[v] = true;
+        }
+    }
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) uses(child, live);
+}
+
+// Turns the set live after `node` into the set live before it.
+void DeadStores::statement(NodeId node, Live& live) {
+    if (!node) return;
+    const ASTNode& n = ast.node(node);
+    switch (n.type) {
+    case NODE_COMPOUND_STMT: {
+        std::vector<NodeId> children;
+        for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) children.push_back(child);
+        for (size_t i = children.size(); i-- > 0;) statement(children[i], live);
+        break;
+    }
+    case NODE_ASSIGNMENT: {
+        NodeId target = ast.child(node, 0);
+        NodeId value = ast.child(node, 1);
+        if (scalar(target)) {
+            uint32_t variable = info.ref(target).index;
+            if (!live[variable] && pure(value)) {
+                if (removing) {
+                    removed += replaceWithEmpty(ast, info, node);
+                    ++report.rewritten;
+                }
+                return;
+            }
+            live[variable] = false;
+        }
+        else if (ast.node(target).type == NODE_ARRAY_ACCESS) {
+            uses(ast.child(target, 0), live);
+        }
+        uses(value, live);
+        break;
+    }
+    case NODE_IF: {
+        Live otherwise(live);
+        statement(ast.child(node, 1), live);
+        statement(ast.child(node, 2), otherwise);
+        for (size_t v = 0; v < live.size(); ++v) {
+            if (otherwise[v]) live[v] = true;
+        }
+        uses(ast.child(node, 0), live);
+        break;
+    }
+    case NODE_WHILE: {
+        // The condition runs before the body and after every iteration
+        Live& entry = loopLive[node];
+        if (entry.empty()) entry.assign(live.size(), false);
+        Live body(entry);
+        statement(ast.child(node, 1), body);
+        for (size_t v = 0; v < live.size(); ++v) {
+            if (body[v]) live[v] = true;
+        }
+        uses(ast.child(node, 0), live);
+        Live& stored = loopLive[node];
+        for (size_t v = 0; v < live.size(); ++v) {
+            if (live[v] && !stored[v]) {
+                stored[v] = true;
+                changed = true;
+            }
+            if (stored[v]) live[v] = true;
+        }
+        break;
+    }
+    default:
+        uses(node, live);
+        break;
+    }
+}
+
+bool DeadStores::routine(NodeId body) {
+    // What the routine leaves behind: every global a caller or the final
+    // printout could read; a subprogram's frame is gone
+    Live exit(info.variables.size(), false);
+    for (size_t v = 0; v < info.variables.size(); ++v) {
+        const VariableInfo& variable = info.variables[v];
+        exit[v] = variable.storage == Storage::GLOBAL && !variable.isTemporary;
+    }
+
+    loopLive.clear();
+    removing = false;
+    do {
+        changed = false;
+        Live live(exit);
+        statement(body, live);
+    } while (changed);
+
+    removing = true;
+    removed = 0;
+    Live live(exit);
+    statement(body, live);
+    report.removed += removed;
+    return removed != 0;
+}
+
+}
+
+void findUnusedSymbols(const AstArena& ast, NodeId root, const SemanticInfo& info, OptimizationReport& report) {
+    std::vector<bool> reached;
+    reachableSubprograms(ast, root, info, reached);
+    std::vector<uint32_t> reads(info.variables.size(), 0);
+    std::vector<uint32_t> mentions(info.variables.size(), 0);
+    countUses(ast, info, ast.child(root, 2), reads, mentions);
+    for (uint32_t i = 0; i < info.subprograms.size(); ++i) {
+        if (reached[i]) countUses(ast, info, ast.child(info.subprograms[i].node, 2), reads, mentions);
+        else report.unused.push_back(UnusedSymbol{ info.subprograms[i].name, ast.node(root).name, true });
+    }
+
+    // Globals are printed at the end, so only those nothing mentions count
+    for (size_t v = 0; v < info.variables.size(); ++v) {
+        const VariableInfo& variable = info.variables[v];
+        if (variable.isTemporary) continue;
+        if (variable.owner == NO_SUBPROGRAM) {
+            if (!mentions[v]) report.unused.push_back(UnusedSymbol{ variable.name, ast.node(root).name, false });
+        }
+        else if (reached[variable.owner] && !reads[v]) {
+            report.unused.push_back(UnusedSymbol{ variable.name, info.subprograms[variable.owner].name, false });
+        }
+    }
+}
+
+void removeDeadStores(AstArena& ast, NodeId root, SemanticInfo& info, PassReport& report) {
+    DeadStores stores(ast, info, report);
+    // Removing a store can leave the stores feeding it dead too
+    for (uint32_t i = 0; i < info.subprograms.size(); ++i) {
+        while (stores.routine(ast.child(info.subprograms[i].node, 2))) {}
+    }
+    while (stores.routine(ast.child(root, 2))) {}
+}
+
+void removeUnreachableCode(AstArena& ast, NodeId root, SemanticInfo& info, PassReport& report) {
+    std::vector<bool> reached;
+    reachableSubprograms(ast, root, info, reached);
+    for (uint32_t i = 0; i < info.subprograms.size(); ++i) {
+        if (reached[i]) continue;
+        SubprogramInfo& subprogram = info.subprograms[i];
+        subprogram.isReachable = false;
+        report.removed += replaceWithEmpty(ast, info, ast.child(subprogram.node, 2));
+        ++report.rewritten;
+    }
+
+    // Arrays and temporaries nothing reachable mentions need no storage in
+    // the native code; the temporaries are what inlining left behind once
+    // the stores nobody read were removed
+    std::vector<uint32_t> reads(info.variables.size(), 0);
+    std::vector<uint32_t> mentions(info.variables.size(), 0);
+    countUses(ast, info, ast.child(root, 2), reads, mentions);
+    for (uint32_t i = 0; i < info.subprograms.size(); ++i) {
+        if (reached[i]) countUses(ast, info, ast.child(info.subprograms[i].node, 2), reads, mentions);
+    }
+    for (size_t v = 0; v < info.variables.size(); ++v) {
+        VariableInfo& variable = info.variables[v];
+        if ((variable.type.baseType == DataType::ARRAY || variable.isTemporary) && !variable.isParameter && !mentions[v]) {
+            variable.isUnused = true;
+        }
+    }
+}
@@ -1,22 +1,182 @@
 #include "error_handler.h"
 #include <iostream>
 
+struct DiagnosticFormat {
+    const char* name;       // the code in JSON output
+    const char* text;       // {n} is argument n
+};
+
+// In DiagnosticCode order
+static const DiagnosticFormat FORMATS[] = {
+    { "syntax-error", "{0}" },
+    { "empty-array-range", "Empty array range for '{0}'" },
+    { "redeclaration", "Redeclaration of '{0}'" },
+    { "subprogram-redeclaration", "Redeclaration of subprogram '{0}'" },
+    { "duplicate-parameter", "Duplicate parameter '{0}' in subprogram '{1}'" },
+    { "undeclared-identifier", "Undeclared identifier '{0}'" },
+    { "procedure-as-value", "Procedure '{0}' does not return a value" },
+    { "undeclared-array", "Undeclared array '{0}'" },
+    { "index-not-integer", "Array index must be integer" },
+    { "operand-type-mismatch", "Type mismatch in binary operation" },
+    { "array-comparison", "Arrays cannot be compared" },
+    { "boolean-operands", "'{0}' requires boolean operands" },
+    { "numeric-operands", "'{0}' requires numeric operands" },
+    { "integer-operands", "'{0}' requires integer operands" },
+    { "not-operand", "NOT operator requires boolean operand" },
+    { "sign-operand", "Unary minus/plus requires numeric operand" },
+    { "undeclared-function", "Undeclared function '{0}'" },
+    { "condition-not-boolean", "Condition must be boolean, got {0}" },
+    { "argument-count", "Function '{0}' expects {1} arguments but got {2}" },
+    { "argument-count", "Subprogram '{0}' expects {1} arguments but got {2}" },
+    { "argument-type", "Argument {0} of function '{1}' expects type {2}, got {3}" },
+    { "argument-type", "Argument {0} of subprogram '{1}' expects type {2}, got {3}" },
+    { "undeclared-variable", "Undeclared variable '{0}'" },
+    { "assignment-to-subprogram", "Cannot assign to subprogram '{0}'" },
+    { "assignment-type-mismatch", "Type mismatch in assignment" },
+    { "undeclared-subprogram", "Undeclared subprogram '{0}'" },
+};
+
+static const DiagnosticFormat& formatOf(DiagnosticCode code) {
+    return FORMATS[static_cast<size_t>(code)];
+}
+
+ErrorHandler::ErrorHandler() : max_errors(100) {}
+
+uint32_t ErrorHandler::intern(std::string_view text) {
+    if (!arguments) arguments.reset(new StringInterner());
+    return arguments->intern(text.data(), text.size());
+}
+
+std::string_view ErrorHandler::text(uint32_t id) const {
+    return std::string_view(arguments->spelling(id), arguments->length(id));
+}
+
+std::string_view ErrorHandler::argument(const Diagnostic& diagnostic, size_t index) const {
+    return index < diagnostic.argCount ? text(diagnostic.args[index]) : std::string_view();
+}
+
 void ErrorHandler::add_error(const std::string& message, int line, int column) {
-    errors.push_back({ message, line, column });
+    report(DiagnosticCode::SYNTAX_ERROR, static_cast<uint32_t>(line), static_cast<uint32_t>(column), { message });
+}
+
+void ErrorHandler::report(DiagnosticCode code, uint32_t line, uint32_t column,
+                          std::initializer_list<std::string_view> args) {
+    if (too_many_errors()) return;
+    Diagnostic diagnostic = { code, 0, line, column, {} };
+    for (std::string_view arg : args) {
+        if (diagnostic.argCount == MAX_DIAGNOSTIC_ARGS) break;
+        diagnostic.args[diagnostic.argCount++] = intern(arg);
+    }
+    errors.push_back(diagnostic);
+}
+
+void ErrorHandler::append(const ErrorHandler& other) {
+    for (const Diagnostic& diagnostic : other.errors) {
+        if (too_many_errors()) return;
+        Diagnostic copy = diagnostic;
+        for (uint16_t i = 0; i < copy.argCount; ++i) copy.args[i] = intern(other.text(copy.args[i]));
+        errors.push_back(copy);
+    }
+}
+
+void ErrorHandler::move(size_t first, uint32_t fromLine, uint32_t fromColumn, uint32_t toLine, uint32_t toColumn) {
+    for (size_t i = first; i < errors.size(); ++i) {
+        Diagnostic& diagnostic = errors[i];
+        if (diagnostic.line == 0) continue;
+        if (diagnostic.line == fromLine) diagnostic.column = diagnostic.column - fromColumn + toColumn;
+        diagnostic.line = diagnostic.line - fromLine + toLine;
+    }
+}
+
+std::string ErrorHandler::message(const Diagnostic& diagnostic) const {
+    std::string result;
+    for (const char* c = formatOf(diagnostic.code).text; *c; ++c) {
+        if (c[0] == '{' && c[1] >= '0' && c[1] <= '9' && c[2] == '}') {
+            result += argument(diagnostic, static_cast<size_t>(c[1] - '0'));
+            c += 2;
+        }
+        else {
+            result += *c;
+        }
+    }
+    return result;
+}
+
+const char* ErrorHandler::code_name(DiagnosticCode code) {
+    return formatOf(code).name;
 }
 
 void ErrorHandler::print_errors() const {
-    for (const auto& error : errors) {
-        std::cerr << "Error at line " << error.line
-            << ", column " << error.column
-            << ": " << error.message << std::endl;
+    print_errors(std::cerr);
+}
+
+void ErrorHandler::print_errors(std::ostream& out) const {
+    for (const Diagnostic& error : errors) {
+        out << (error.code == DiagnosticCode::SYNTAX_ERROR ? "Error" : "Semantic error");
+        if (error.line != 0) out << " at line " << error.line << ", column " << error.column;
+        out << ": " << message(error) << '\n';
+    }
+    if (too_many_errors()) {
+        out << "Too many errors (" << max_errors << "), stopping\n";
+    }
+    out << std::flush;
+}
+
+static void writeJsonString(std::ostream& out, std::string_view text) {
+    static const char digits[] = "0123456789abcdef";
+    out << '"';
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if (c == '\n') out << "\\n";
+        else if (c == '\t') out << "\\t";
+        else if (byte < 0x20) out << "\\u00" << digits[byte >> 4] << digits[byte & 15];
+        else out << c;
+    }
+    out << '"';
+}
+
+void ErrorHandler::print_json(std::ostream& out) const {
+    for (const Diagnostic& error : errors) {
+        out << "{\"severity\":\"error\",\"code\":\"" << code_name(error.code) << "\"";
+        if (error.line != 0) out << ",\"line\":" << error.line << ",\"column\":" << error.column;
+        out << ",\"message\":";
+        writeJsonString(out, message(error));
+        out << ",\"args\":[";
+        for (uint16_t i = 0; i < error.argCount; ++i) {
+            if (i) out << ',';
+            writeJsonString(out, text(error.args[i]));
+        }
+        out << "]}\n";
+    }
+    if (too_many_errors()) {
+        out << "{\"severity\":\"fatal\",\"code\":\"too-many-errors\",\"message\":\"Too many errors (" << max_errors
+            << "), stopping\",\"args\":[]}\n";
     }
+    out << std::flush;
 }
 
 bool ErrorHandler::has_errors() const {
     return !errors.empty();
 }
 
+size_t ErrorHandler::error_count() const {
+    return errors.size();
+}
+
+void ErrorHandler::set_max_errors(size_t limit) {
+    max_errors = limit > 0 ? limit : 1;
+}
+
+size_t ErrorHandler::max_error_count() const {
+    return max_errors;
+}
+
+bool ErrorHandler::too_many_errors() const {
+    return errors.size() >= max_errors;
+}
+
 void ErrorHandler::clear() {
     errors.clear();
-}
\ No newline at end of file
+    if (arguments) arguments->clear();
+}
@@ -2,24 +2,112 @@
 #ifndef ERROR_HANDLER_H
 #define ERROR_HANDLER_H
 
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iosfwd>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
+#include "string_interner.h"
 
-struct Error {
-    std::string message;
-    int line;
-    int column;
+// What a diagnostic says. Each code has one message, with {0}, {1}, ...
+// standing for its arguments; the table is in error_handler.cpp.
+enum class DiagnosticCode : uint16_t {
+    SYNTAX_ERROR,               // the parser's own text
+    EMPTY_ARRAY_RANGE,          // variable
+    REDECLARATION,              // name
+    SUBPROGRAM_REDECLARATION,   // name
+    DUPLICATE_PARAMETER,        // parameter, subprogram
+    UNDECLARED_IDENTIFIER,      // name
+    PROCEDURE_AS_VALUE,         // procedure
+    UNDECLARED_ARRAY,           // name
+    INDEX_NOT_INTEGER,
+    OPERAND_TYPE_MISMATCH,
+    ARRAY_COMPARISON,
+    BOOLEAN_OPERANDS,           // operator
+    NUMERIC_OPERANDS,           // operator
+    INTEGER_OPERANDS,           // operator
+    NOT_OPERAND,
+    SIGN_OPERAND,
+    UNDECLARED_FUNCTION,        // name
+    CONDITION_NOT_BOOLEAN,      // type
+    FUNCTION_ARGUMENT_COUNT,    // function, expected, given
+    SUBPROGRAM_ARGUMENT_COUNT,  // subprogram, expected, given
+    FUNCTION_ARGUMENT_TYPE,     // position, function, expected type, given type
+    SUBPROGRAM_ARGUMENT_TYPE,   // position, subprogram, expected type, given type
+    UNDECLARED_VARIABLE,        // name
+    ASSIGNMENT_TO_SUBPROGRAM,   // name
+    ASSIGNMENT_TYPE_MISMATCH,
+    UNDECLARED_SUBPROGRAM       // name
 };
 
+const size_t MAX_DIAGNOSTIC_ARGS = 4;
+
+// One diagnostic as it is recorded: the code, where it is, and its
+// arguments as ids in the recording handler's argument table. The message
+// is only put together when the diagnostic is printed.
+struct Diagnostic {
+    DiagnosticCode code;
+    uint16_t argCount;
+    uint32_t line;          // 0 when the position is not known
+    uint32_t column;
+    uint32_t args[MAX_DIAGNOSTIC_ARGS];
+};
+
+// Collects diagnostics so a whole run can be reported at the end. Once
+// `max_errors` have been recorded further errors are dropped and
+// too_many_errors() tells the caller to stop.
+//
+// A handler is not shared between threads: code that reports from several
+// threads gives each its own and merges them with append() in a fixed
+// order. Argument text is interned per handler, in a table made on the
+// first argument, so a handler that stays empty costs next to nothing.
 class ErrorHandler {
 public:
+    ErrorHandler();
+
+    ErrorHandler(ErrorHandler&&) = default;
+    ErrorHandler& operator=(ErrorHandler&&) = default;
+
+    // A syntax error with the parser's message.
     void add_error(const std::string& message, int line, int column);
+    // `code` at line:column, with the text of each argument.
+    void report(DiagnosticCode code, uint32_t line, uint32_t column, std::initializer_list<std::string_view> args = {});
+    // Appends `other`'s diagnostics, as far as the limit allows.
+    void append(const ErrorHandler& other);
+    // Moves the diagnostics from index `first` on that were recorded for a
+    // piece of source starting at fromLine:fromColumn to where the piece
+    // starts now. Columns only change on the piece's first line.
+    void move(size_t first, uint32_t fromLine, uint32_t fromColumn, uint32_t toLine, uint32_t toColumn);
+
+    // "Error at line 3, column 7: ...", one line each.
     void print_errors() const;
+    void print_errors(std::ostream& out) const;
+    // One JSON object per line, with the code, position, message and
+    // arguments of each diagnostic.
+    void print_json(std::ostream& out) const;
+
+    const std::vector<Diagnostic>& diagnostics() const { return errors; }
+    std::string message(const Diagnostic& diagnostic) const;
+    std::string_view argument(const Diagnostic& diagnostic, size_t index) const;
+    static const char* code_name(DiagnosticCode code);
+
     bool has_errors() const;
+    size_t error_count() const;
+    void set_max_errors(size_t limit);
+    size_t max_error_count() const;
+    bool too_many_errors() const;
     void clear();
 
 private:
-    std::vector<Error> errors;
+    uint32_t intern(std::string_view text);
+    std::string_view text(uint32_t id) const;
+
+    std::vector<Diagnostic> errors;
+    std::unique_ptr<StringInterner> arguments;
+    size_t max_errors;
 };
 
-#endif
\ No newline at end of file
+#endif
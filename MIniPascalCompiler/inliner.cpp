@@ -0,0 +1,476 @@
+#include "optimizer.h"
+#include "ast_rewrite.h"
+
+#include <algorithm>
+#include <map>
+
+namespace {
+
+const uint32_t LOOP_BOOST = 4;          // a call in a loop may copy this many times the budget
+const uint32_t SINGLE_SITE_BOOST = 2;   // and so may the only call of a subprogram
+
+// Element type and bounds; scalars have empty bounds.
+typedef std::pair<DataType, std::pair<int, int>> TemporaryKind;
+
+// A call picked for inlining.
+struct Site {
+    NodeId call;
+    uint32_t callee;
+};
+
+class Inliner {
+public:
+    Inliner(AstArena& ast, NodeId root, SemanticInfo& info, const OptimizationOptions& options,
+            OptimizationReport& report);
+
+    void run();
+
+private:
+    void analyzeCalls();
+    void summarize(NodeId node, uint32_t subprogram);
+    void order(uint32_t subprogram, std::vector<uint8_t>& state);
+
+    void routine(uint32_t subprogram);
+    void statement(NodeId node);
+    void walk(NodeId node, std::vector<Site>& sites);
+    bool worthInlining(uint32_t callee) const;
+    bool writesGlobal(uint32_t subprogram, uint32_t variable) const;
+
+    void inlineSite(const Site& site, std::vector<NodeId>& out, bool keepResult);
+    NodeId clone(NodeId node, uint32_t callee, const std::vector<uint32_t>& temps,
+                 const std::vector<NodeId>& arguments, uint32_t result);
+    uint32_t temporary(const TypeInfo& type);
+    bool definedBeforeUse(NodeId body, uint32_t variable) const;
+
+    AstArena& ast;
+    NodeId root;
+    SemanticInfo& info;
+    const OptimizationOptions& options;
+    OptimizationReport& report;
+    PassReport& pass;
+
+    // Per subprogram
+    std::vector<std::vector<uint32_t>> callees;
+    std::vector<uint32_t> sites;            // static call count
+    std::vector<bool> recursive;
+    std::vector<bool> writesGlobals;        // directly or through a call
+    std::vector<std::vector<bool>> globalWrites;
+    std::vector<bool> localArrays;
+    std::vector<uint32_t> bottomUp;
+
+    std::vector<bool> written;              // by variable: assigned somewhere in its owner
+    uint32_t budgetLeft;
+
+    // State of the routine being rewritten
+    uint32_t owner;
+    uint32_t loopDepth;
+    bool conditional;                       // under the right operand of and / or
+    bool blocked;                           // something before may trap or call
+    bool readsGlobal;
+    std::map<TemporaryKind, std::vector<uint32_t>> pool;         // free temporaries of the routine
+    std::vector<std::pair<TemporaryKind, uint32_t>> inUse;      // taken by the current statement
+};
+
+Inliner::Inliner(AstArena& ast, NodeId root, SemanticInfo& info, const OptimizationOptions& options,
+                 OptimizationReport& report)
+    : ast(ast), root(root), info(info), options(options), report(report), pass(report.pass("inlining")),
+      budgetLeft(0), owner(NO_SUBPROGRAM), loopDepth(0), conditional(false), blocked(false), readsGlobal(false) {}
+
+// Records calls, direct global writes and written variables of one routine.
+void Inliner::summarize(NodeId node, uint32_t subprogram) {
+    const ASTNode& n = ast.node(node);
+    const NodeRef& ref = info.ref(node);
+    if (ref.kind == RefKind::CALL) {
+        if (subprogram != NO_SUBPROGRAM) callees[subprogram].push_back(ref.index);
+        ++sites[ref.index];
+    }
+    if (n.type == NODE_ASSIGNMENT) {
+        NodeId target = ast.child(node, 0);
+        if (info.ref(target).kind == RefKind::VARIABLE) {
+            uint32_t variable = info.ref(target).index;
+            written[variable] = true;
+            if (subprogram != NO_SUBPROGRAM && info.variables[variable].storage == Storage::GLOBAL) {
+                globalWrites[subprogram][variable] = true;
+                writesGlobals[subprogram] = true;
+            }
+        }
+    }
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) summarize(child, subprogram);
+}
+
+// Post-order over the call graph: callees before their callers.
+void Inliner::order(uint32_t subprogram, std::vector<uint8_t>& state) {
+    if (state[subprogram]) return;
+    state[subprogram] = 1;
+    for (uint32_t callee : callees[subprogram]) order(callee, state);
+    state[subprogram] = 2;
+    bottomUp.push_back(subprogram);
+}
+
+void Inliner::analyzeCalls() {
+    size_t count = info.subprograms.size();
+    callees.assign(count, std::vector<uint32_t>());
+    sites.assign(count, 0);
+    writesGlobals.assign(count, false);
+    globalWrites.assign(count, std::vector<bool>(info.variables.size(), false));
+    localArrays.assign(count, false);
+    written.assign(info.variables.size(), false);
+
+    for (uint32_t i = 0; i < count; ++i) summarize(ast.child(info.subprograms[i].node, 2), i);
+    summarize(ast.child(root, 2), NO_SUBPROGRAM);
+    for (const VariableInfo& variable : info.variables) {
+        if (variable.owner != NO_SUBPROGRAM && !variable.isParameter && variable.type.baseType == DataType::ARRAY)
+            localArrays[variable.owner] = true;
+    }
+
+    // A subprogram is recursive when it can reach itself
+    recursive.assign(count, false);
+    for (uint32_t i = 0; i < count; ++i) {
+        std::vector<bool> seen(count, false);
+        std::vector<uint32_t> work(callees[i]);
+        while (!work.empty() && !recursive[i]) {
+            uint32_t next = work.back();
+            work.pop_back();
+            if (next == i) recursive[i] = true;
+            if (seen[next]) continue;
+            seen[next] = true;
+            work.insert(work.end(), callees[next].begin(), callees[next].end());
+        }
+    }
+
+    // Global writes flow from callees to callers
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t i = 0; i < count; ++i) {
+            for (uint32_t callee : callees[i]) {
+                for (size_t v = 0; v < info.variables.size(); ++v) {
+                    if (globalWrites[callee][v] && !globalWrites[i][v]) {
+                        globalWrites[i][v] = true;
+                        writesGlobals[i] = true;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<uint8_t> state(count, 0);
+    for (uint32_t i = 0; i < count; ++i) order(i, state);
+}
+
+void Inliner::run() {
+    analyzeCalls();
+    // The program may at most double in size
+    budgetLeft = static_cast<uint32_t>(std::min<size_t>(ast.nodeCount(), UINT32_MAX));
+    for (uint32_t subprogram : bottomUp) routine(subprogram);
+    routine(NO_SUBPROGRAM);
+}
+
+void Inliner::routine(uint32_t subprogram) {
+    owner = subprogram;
+    loopDepth = 0;
+    pool.clear();
+    NodeId body = subprogram == NO_SUBPROGRAM ? ast.child(root, 2) : ast.child(info.subprograms[subprogram].node, 2);
+    statement(body);
+}
+
+// Temporaries added since the analysis belong to a caller.
+bool Inliner::writesGlobal(uint32_t subprogram, uint32_t variable) const {
+    return variable < globalWrites[subprogram].size() && globalWrites[subprogram][variable];
+}
+
+// The callee's size decides, weighed by how often the site runs and how
+// many sites there are.
+bool Inliner::worthInlining(uint32_t callee) const {
+    if (recursive[callee] || localArrays[callee] || callee == owner) return false;
+    uint32_t size = subtreeSize(ast, ast.child(info.subprograms[callee].node, 2));
+    uint32_t limit = options.inlineBudget;
+    if (loopDepth) limit *= LOOP_BOOST;
+    if (sites[callee] == 1) limit *= SINGLE_SITE_BOOST;
+    return size <= limit && size <= budgetLeft;
+}
+
+// Visits an expression in evaluation order. A function call can move in
+// front of the statement when nothing evaluated before it could trap or
+// call, and, if the callee writes globals, nothing before it read one.
+void Inliner::walk(NodeId node, std::vector<Site>& found) {
+    const ASTNode& n = ast.node(node);
+    const NodeRef& ref = info.ref(node);
+    switch (n.type) {
+    case NODE_VARIABLE:
+        if (ref.kind == RefKind::CALL) break;
+        if (ref.kind == RefKind::VARIABLE && info.variables[ref.index].storage == Storage::GLOBAL) readsGlobal = true;
+        return;
+    case NODE_ARRAY_ACCESS:
+        walk(ast.child(node, 0), found);
+        if (info.variables[ref.index].storage == Storage::GLOBAL) readsGlobal = true;
+        if (!info.boundsProven[node]) blocked = true;
+        return;
+    case NODE_UNARY_OP:
+        walk(ast.child(node, 0), found);
+        return;
+    case NODE_BINARY_OP: {
+        NodeId right = ast.child(node, 1);
+        walk(ast.child(node, 0), found);
+        bool outer = conditional;
+        if (n.op == OP_AND || n.op == OP_OR) conditional = true;
+        walk(right, found);
+        conditional = outer;
+        if (n.op == OP_DIV && (ast.node(right).type != NODE_INT_NUM || ast.node(right).intVal == 0)) blocked = true;
+        return;
+    }
+    case NODE_FUNCTION_CALL:
+        break;
+    default:
+        return;
+    }
+
+    // The arguments move along with the call
+    bool before = blocked;
+    bool readBefore = readsGlobal;
+    for (NodeId arg = ast.firstChild(node); arg; arg = ast.nextSibling(arg)) walk(arg, found);
+    uint32_t callee = ref.index;
+    if (!conditional && !before && !(writesGlobals[callee] && readBefore) && worthInlining(callee)) {
+        found.push_back(Site{ node, callee });
+        budgetLeft -= subtreeSize(ast, ast.child(info.subprograms[callee].node, 2));
+        blocked = before;
+        readsGlobal = readBefore;
+        return;
+    }
+    blocked = true;
+    readsGlobal = true;
+}
+
+void Inliner::statement(NodeId node) {
+    if (!node) return;
+    NodeType type = ast.node(node).type;
+    std::vector<Site> found;
+    conditional = blocked = readsGlobal = false;
+
+    switch (type) {
+    case NODE_COMPOUND_STMT:
+        for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) statement(child);
+        return;
+    case NODE_ASSIGNMENT: {
+        NodeId target = ast.child(node, 0);
+        // An element's index is evaluated before the value
+        if (ast.node(target).type == NODE_ARRAY_ACCESS) walk(target, found);
+        walk(ast.child(node, 1), found);
+        break;
+    }
+    case NODE_IF:
+        walk(ast.child(node, 0), found);
+        break;
+    case NODE_WHILE:
+        // The condition runs every iteration; its calls stay calls
+        ++loopDepth;
+        statement(ast.child(node, 1));
+        --loopDepth;
+        return;
+    case NODE_PROCEDURE_CALL:
+    case NODE_FUNCTION_CALL: {
+        for (NodeId arg = ast.firstChild(node); arg; arg = ast.nextSibling(arg)) walk(arg, found);
+        uint32_t callee = info.ref(node).index;
+        // Arguments are evaluated in order either way
+        if (worthInlining(callee)) {
+            budgetLeft -= subtreeSize(ast, ast.child(info.subprograms[callee].node, 2));
+            std::vector<NodeId> before;
+            for (const Site& site : found) inlineSite(site, before, true);
+            Site self = { detachStatement(ast, info, node), callee };
+            inlineSite(self, before, false);
+            for (NodeId stmt : before) ast.appendChild(node, stmt);
+            found.clear();
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    if (!found.empty()) {
+        std::vector<NodeId> before;
+        for (const Site& site : found) inlineSite(site, before, true);
+        prependStatements(ast, info, node, before);
+    }
+    // Temporaries are free again once the statement is done
+    for (const auto& used : inUse) pool[used.first].push_back(used.second);
+    inUse.clear();
+
+    if (type == NODE_IF) {
+        NodeId moved = found.empty() ? node : ast.node(node).lastChild;
+        statement(ast.child(moved, 1));
+        statement(ast.child(moved, 2));
+    }
+}
+
+uint32_t Inliner::temporary(const TypeInfo& type) {
+    TemporaryKind key(type.baseType == DataType::ARRAY ? type.elementType : type.baseType,
+        type.baseType == DataType::ARRAY ? std::make_pair(type.arrayStart, type.arrayEnd) : std::make_pair(0, -1));
+    std::vector<uint32_t>& free = pool[key];
+    uint32_t variable;
+    if (free.empty()) {
+        variable = addTemporary(info, owner, type, "inl");
+    }
+    else {
+        variable = free.back();
+        free.pop_back();
+    }
+    inUse.push_back(std::make_pair(key, variable));
+    return variable;
+}
+
+static bool mentions(const AstArena& ast, const SemanticInfo& info, NodeId node, uint32_t variable) {
+    if (info.ref(node).kind == RefKind::VARIABLE && info.ref(node).index == variable) return true;
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        if (mentions(ast, info, child, variable)) return true;
+    }
+    return false;
+}
+
+// Whether the first top-level statement that mentions the variable sets
+// it without reading it, so it needs no zero first.
+bool Inliner::definedBeforeUse(NodeId body, uint32_t variable) const {
+    for (NodeId statement = ast.firstChild(body); statement; statement = ast.nextSibling(statement)) {
+        if (!mentions(ast, info, statement, variable)) continue;
+        if (ast.node(statement).type != NODE_ASSIGNMENT) return false;
+        NodeId target = ast.child(statement, 0);
+        return ast.node(target).type == NODE_VARIABLE && info.ref(target).index == variable &&
+               !mentions(ast, info, ast.child(statement, 1), variable);
+    }
+    return false;
+}
+
+// Copies the callee's body for one site. Parameters, result and locals
+// become the site's temporaries, or, for a parameter the callee never
+// assigns, the argument itself when that is a literal or a variable the
+// callee cannot change.
+NodeId Inliner::clone(NodeId node, uint32_t callee, const std::vector<uint32_t>& temps,
+                      const std::vector<NodeId>& arguments, uint32_t result) {
+    ASTNode copy = ast.node(node);
+    NodeRef ref = info.ref(node);
+    if (callee != NO_SUBPROGRAM && ref.kind == RefKind::VARIABLE && info.variables[ref.index].owner == callee) {
+        uint32_t first = info.subprograms[callee].firstParam;
+        uint32_t position = ref.index - first;
+        bool parameter = info.variables[ref.index].isParameter;
+        if (parameter && arguments[position] != NULL_NODE) {
+            NodeId argument = arguments[position];
+            if (copy.type == NODE_VARIABLE) return clone(argument, NO_SUBPROGRAM, temps, arguments, result);
+            ref = info.ref(argument);
+        }
+        else {
+            ref.index = temps[ref.index - first];
+        }
+        copy.name = info.variables[ref.index].name;
+    }
+    else if (ref.kind == RefKind::RESULT && ref.index == callee) {
+        ref = NodeRef{ RefKind::VARIABLE, result };
+        copy.name = info.variables[result].name;
+    }
+
+    NodeId id = newNode(ast, info, copy.type);
+    copy.firstChild = copy.lastChild = copy.nextSibling = NULL_NODE;
+    ast.node(id) = copy;
+    info.refs[id] = ref;
+    info.exprTypes[id] = ref.kind == RefKind::VARIABLE && copy.type == NODE_VARIABLE
+                             ? info.variables[ref.index].type.baseType : info.exprTypes[node];
+    info.boundsProven[id] = info.boundsProven[node];
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        ast.appendChild(id, clone(child, callee, temps, arguments, result));
+    }
+    return id;
+}
+
+static bool containsCall(const AstArena& ast, const SemanticInfo& info, NodeId node) {
+    if (info.ref(node).kind == RefKind::CALL) return true;
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        if (containsCall(ast, info, child)) return true;
+    }
+    return false;
+}
+
+// Appends the statements that run the call to `out`. A function call left
+// in an expression becomes a read of its result temporary.
+void Inliner::inlineSite(const Site& site, std::vector<NodeId>& out, bool keepResult) {
+    const SubprogramInfo& callee = info.subprograms[site.callee];
+    NodeId body = ast.child(callee.node, 2);
+
+    std::vector<NodeId> args;
+    bool argumentCalls = false;
+    for (NodeId arg = ast.firstChild(site.call); arg; arg = ast.nextSibling(arg)) {
+        args.push_back(arg);
+        argumentCalls = argumentCalls || containsCall(ast, info, arg);
+    }
+
+    uint32_t result = NO_SUBPROGRAM;
+    if (callee.isFunction) result = temporary(TypeInfo(callee.returnType));
+    if (keepResult) replaceWithVariable(ast, info, site.call, result);
+
+    // Everything the callee owns, parameters first
+    std::vector<uint32_t> temps;
+    std::vector<NodeId> substitutes(callee.paramCount, NULL_NODE);
+    std::vector<NodeId> assignments;
+    uint32_t end = static_cast<uint32_t>(info.variables.size());
+    for (uint32_t v = callee.firstParam; v < end; ++v) {
+        VariableInfo variable = info.variables[v];
+        if (variable.owner != site.callee) {
+            temps.push_back(NO_SUBPROGRAM);
+            continue;
+        }
+        if (variable.isParameter) {
+            NodeId arg = args[v - callee.firstParam];
+            const ASTNode& a = ast.node(arg);
+            bool stable = isLiteral(ast, arg) ||
+                          (a.type == NODE_VARIABLE && info.ref(arg).kind == RefKind::VARIABLE &&
+                           (info.variable(arg).storage != Storage::GLOBAL ||
+                            (!writesGlobal(site.callee, info.ref(arg).index) && !argumentCalls)));
+            if (!written[v] && stable) {
+                substitutes[v - callee.firstParam] = arg;
+                temps.push_back(NO_SUBPROGRAM);
+                continue;
+            }
+            uint32_t temp = temporary(variable.type);
+            temps.push_back(temp);
+            ast.node(arg).nextSibling = NULL_NODE;
+            assignments.push_back(newAssignment(ast, info, temp, arg));
+            continue;
+        }
+        temps.push_back(temporary(variable.type));
+    }
+
+    NodeId copy = clone(body, site.callee, temps, substitutes, result);
+    NodeId block = newNode(ast, info, NODE_COMPOUND_STMT);
+    for (NodeId assignment : assignments) ast.appendChild(block, assignment);
+
+    // Locals and the result start out zero on every call
+    std::vector<uint32_t> zeroed;
+    for (uint32_t v = callee.firstParam; v < end; ++v) {
+        const VariableInfo& variable = info.variables[v];
+        if (variable.owner == site.callee && !variable.isParameter && !variable.isTemporary) zeroed.push_back(temps[v - callee.firstParam]);
+    }
+    if (callee.isFunction) zeroed.push_back(result);
+    Value zero;
+    zero.r = 0;
+    for (uint32_t variable : zeroed) {
+        if (definedBeforeUse(copy, variable)) continue;
+        NodeId literal = newLiteral(ast, info, info.variables[variable].type.baseType, zero);
+        ast.appendChild(block, newAssignment(ast, info, variable, literal));
+    }
+    ast.appendChild(block, copy);
+    out.push_back(block);
+
+    uint32_t nodes = subtreeSize(ast, block);
+    pass.added += nodes;
+    ++pass.rewritten;
+    report.inlined.push_back(InlinedCall{ owner == NO_SUBPROGRAM ? ast.node(root).name : info.subprograms[owner].name,
+                                          callee.name, nodes, loopDepth });
+}
+
+}
+
+void inlineCalls(AstArena& ast, NodeId root, SemanticInfo& info, const OptimizationOptions& options,
+                 OptimizationReport& report) {
+    if (!options.inlineBudget) return;
+    Inliner inliner(ast, root, info, options, report);
+    inliner.run();
+}
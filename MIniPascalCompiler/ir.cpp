@@ -0,0 +1,536 @@
+#include "ir.h"
+#include "string_interner.h"
+
+#include <algorithm>
+#include <cctype>
+
+static const char* const irOpNames[IR_OP_COUNT] = {
+#define IR_NAME(name) #name,
+    IR_OPS(IR_NAME)
+#undef IR_NAME
+};
+
+const char* irOpName(IrOp op) {
+    return op < IR_OP_COUNT ? irOpNames[op] : "?";
+}
+
+bool isPure(IrOp op) {
+    switch (op) {
+    case IR_CONST: case IR_PARAM: case IR_PHI:
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_NEG:
+    case IR_FADD: case IR_FSUB: case IR_FMUL: case IR_FDIV: case IR_FNEG:
+    case IR_ITOF:
+    case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+    case IR_FEQ: case IR_FNE: case IR_FLT: case IR_FLE: case IR_FGT: case IR_FGE:
+    case IR_NOT: case IR_AND: case IR_OR:
+    case IR_ADDR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static inline int32_t wrap(uint32_t value) {
+    return static_cast<int32_t>(value);
+}
+
+bool foldIrOp(IrOp op, const Value* v, Value& out) {
+    uint32_t a = static_cast<uint32_t>(v[0].i);
+    switch (op) {
+    case IR_ADD: out.i = wrap(a + static_cast<uint32_t>(v[1].i)); break;
+    case IR_SUB: out.i = wrap(a - static_cast<uint32_t>(v[1].i)); break;
+    case IR_MUL: out.i = wrap(a * static_cast<uint32_t>(v[1].i)); break;
+    case IR_DIV:
+        if (v[1].i == 0) return false;
+        out.i = v[1].i == -1 ? wrap(0u - a) : v[0].i / v[1].i;
+        break;
+    case IR_NEG: out.i = wrap(0u - a); break;
+    case IR_FADD: out.r = v[0].r + v[1].r; break;
+    case IR_FSUB: out.r = v[0].r - v[1].r; break;
+    case IR_FMUL: out.r = v[0].r * v[1].r; break;
+    case IR_FDIV: out.r = v[0].r / v[1].r; break;
+    case IR_FNEG: out.r = -v[0].r; break;
+    case IR_ITOF: out.r = static_cast<double>(v[0].i); break;
+    case IR_EQ: out.i = v[0].i == v[1].i; break;
+    case IR_NE: out.i = v[0].i != v[1].i; break;
+    case IR_LT: out.i = v[0].i < v[1].i; break;
+    case IR_LE: out.i = v[0].i <= v[1].i; break;
+    case IR_GT: out.i = v[0].i > v[1].i; break;
+    case IR_GE: out.i = v[0].i >= v[1].i; break;
+    case IR_FEQ: out.i = v[0].r == v[1].r; break;
+    case IR_FNE: out.i = v[0].r != v[1].r; break;
+    case IR_FLT: out.i = v[0].r < v[1].r; break;
+    case IR_FLE: out.i = v[0].r <= v[1].r; break;
+    case IR_FGT: out.i = v[0].r > v[1].r; break;
+    case IR_FGE: out.i = v[0].r >= v[1].r; break;
+    case IR_NOT: out.i = !v[0].i; break;
+    case IR_AND: out.i = v[0].i && v[1].i; break;
+    case IR_OR: out.i = v[0].i || v[1].i; break;
+    default: return false;
+    }
+    return true;
+}
+
+ValueId IrFunction::append(IrOp op, IrType type, BlockId block, const ValueId* args, uint32_t count) {
+    IrInst inst;
+    inst.op = op;
+    inst.type = type;
+    inst.block = block;
+    inst.firstOperand = static_cast<uint32_t>(operands.size());
+    inst.operandCount = count;
+    inst.realValue = 0.0;
+    operands.insert(operands.end(), args, args + count);
+    values.push_back(inst);
+    return static_cast<ValueId>(values.size() - 1);
+}
+
+uint32_t IrFunction::successors(BlockId block, BlockId out[2]) const {
+    const std::vector<ValueId>& instructions = blocks[block].instructions;
+    if (instructions.empty()) return 0;
+    const IrInst& last = values[instructions.back()];
+    switch (last.op) {
+    case IR_JUMP:
+        out[0] = last.targets[0];
+        return 1;
+    case IR_BRANCH:
+        out[0] = last.targets[0];
+        out[1] = last.targets[1];
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+// Cooper, Harvey and Kennedy's iterative algorithm over reverse postorder.
+void computeDominators(const IrFunction& function, std::vector<BlockId>& idom, std::vector<BlockId>& order) {
+    size_t count = function.blocks.size();
+    std::vector<uint32_t> postorderIndex(count, NO_BLOCK);
+    std::vector<BlockId> postorder;
+    postorder.reserve(count);
+
+    // Iterative DFS from the entry
+    std::vector<std::pair<BlockId, uint32_t>> stack;
+    std::vector<bool> visited(count, false);
+    stack.push_back({ 0, 0 });
+    visited[0] = true;
+    while (!stack.empty()) {
+        BlockId block = stack.back().first;
+        BlockId next[2];
+        uint32_t n = function.successors(block, next);
+        if (stack.back().second < n) {
+            BlockId successor = next[stack.back().second++];
+            if (!visited[successor]) {
+                visited[successor] = true;
+                stack.push_back({ successor, 0 });
+            }
+            continue;
+        }
+        postorderIndex[block] = static_cast<uint32_t>(postorder.size());
+        postorder.push_back(block);
+        stack.pop_back();
+    }
+    order.assign(postorder.rbegin(), postorder.rend());
+
+    idom.assign(count, NO_BLOCK);
+    idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (BlockId block : order) {
+            if (block == 0) continue;
+            BlockId newIdom = NO_BLOCK;
+            for (BlockId pred : function.blocks[block].predecessors) {
+                if (idom[pred] == NO_BLOCK) continue;
+                if (newIdom == NO_BLOCK) {
+                    newIdom = pred;
+                    continue;
+                }
+                BlockId a = pred;
+                BlockId b = newIdom;
+                while (a != b) {
+                    while (postorderIndex[a] < postorderIndex[b]) a = idom[a];
+                    while (postorderIndex[b] < postorderIndex[a]) b = idom[b];
+                }
+                newIdom = a;
+            }
+            if (idom[block] != newIdom) {
+                idom[block] = newIdom;
+                changed = true;
+            }
+        }
+    }
+}
+
+static const char* typeName(IrType type) {
+    switch (type) {
+    case IR_INT: return "int";
+    case IR_REAL: return "real";
+    case IR_BOOL: return "bool";
+    case IR_ARRAY: return "array";
+    default: return "void";
+    }
+}
+
+static void dumpOperands(const IrFunction& function, ValueId value, uint32_t from, std::ostream& out) {
+    const IrInst& inst = function.values[value];
+    for (uint32_t i = from; i < inst.operandCount; ++i) {
+        out << (i == from ? " " : ", ") << "%" << function.operand(value, i);
+    }
+}
+
+static void dumpInstruction(const IrModule& module, const IrFunction& function, ValueId value, std::ostream& out) {
+    const IrInst& inst = function.values[value];
+    const SemanticInfo* info = module.info;
+    out << "    ";
+    if (inst.type != IR_VOID) out << "%" << value << ":" << typeName(inst.type) << " = ";
+
+    std::string op = irOpName(inst.op);
+    std::transform(op.begin(), op.end(), op.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+    out << op;
+
+    switch (inst.op) {
+    case IR_CONST:
+        if (inst.type == IR_REAL) out << " " << inst.realValue;
+        else if (inst.type == IR_BOOL) out << (inst.intValue ? " true" : " false");
+        else out << " " << inst.intValue;
+        break;
+    case IR_PARAM:
+        out << " " << inst.index;
+        break;
+    case IR_PHI: {
+        const IrBlock& block = function.blocks[inst.block];
+        for (uint32_t i = 0; i < inst.operandCount; ++i) {
+            out << (i ? ", [" : " [") << "%" << function.operand(value, i) << ", bb"
+                << (i < block.predecessors.size() ? block.predecessors[i] : NO_BLOCK) << "]";
+        }
+        break;
+    }
+    case IR_LOAD_GLOBAL:
+    case IR_STORE_GLOBAL:
+    case IR_ADDR:
+        out << " " << (info ? nameOf(info->variables[inst.index].name) : "?");
+        if (inst.op == IR_STORE_GLOBAL) out << ",";
+        dumpOperands(function, value, 0, out);
+        break;
+    case IR_BOUNDS:
+        dumpOperands(function, value, 0, out);
+        out << ", " << inst.bounds.low << ", " << inst.bounds.count;
+        break;
+    case IR_COPY_ARRAY:
+        dumpOperands(function, value, 0, out);
+        out << ", " << inst.index;
+        break;
+    case IR_CALL:
+        out << " " << module.functions[inst.index].name << "(";
+        for (uint32_t i = 0; i < inst.operandCount; ++i) out << (i ? ", %" : "%") << function.operand(value, i);
+        out << ")";
+        break;
+    case IR_JUMP:
+        out << " bb" << inst.targets[0];
+        break;
+    case IR_BRANCH:
+        dumpOperands(function, value, 0, out);
+        out << ", bb" << inst.targets[0] << ", bb" << inst.targets[1];
+        break;
+    default:
+        dumpOperands(function, value, 0, out);
+        break;
+    }
+    out << "\n";
+}
+
+void dumpIr(const IrModule& module, const IrFunction& function, std::ostream& out) {
+    out << "function " << function.name << "(";
+    for (size_t i = 0; i < function.paramTypes.size(); ++i) out << (i ? ", " : "") << typeName(function.paramTypes[i]);
+    out << ")";
+    if (function.returnType != IR_VOID) out << " -> " << typeName(function.returnType);
+    out << "\n";
+
+    for (BlockId b = 0; b < function.blocks.size(); ++b) {
+        const IrBlock& block = function.blocks[b];
+        out << "bb" << b << ":";
+        if (!block.predecessors.empty()) {
+            out << "    ; preds";
+            for (BlockId pred : block.predecessors) out << " bb" << pred;
+        }
+        out << "\n";
+        for (ValueId value : block.instructions) dumpInstruction(module, function, value, out);
+    }
+}
+
+void dumpIr(const IrModule& module, std::ostream& out) {
+    for (size_t i = 0; i < module.functions.size(); ++i) {
+        if (i) out << "\n";
+        dumpIr(module, module.functions[i], out);
+    }
+}
+
+namespace {
+
+class IrVerifier {
+public:
+    IrVerifier(const IrModule& module, std::ostream& errors) : module(module), errors(errors), ok(true) {}
+
+    bool run() {
+        for (const IrFunction& function : module.functions) verify(function);
+        return ok;
+    }
+
+private:
+    void fail(const IrFunction& function, ValueId value, const char* message) {
+        errors << "IR error in " << function.name;
+        if (value != NO_VALUE) errors << " at %" << value << " (" << irOpName(function.values[value].op) << ")";
+        errors << ": " << message << "\n";
+        ok = false;
+    }
+
+    bool dominates(BlockId a, BlockId b) const {
+        while (true) {
+            if (a == b) return true;
+            if (b == 0 || idom[b] == NO_BLOCK) return false;
+            b = idom[b];
+        }
+    }
+
+    void verify(const IrFunction& function) {
+        if (function.values.empty() || function.values[0].op != IR_NOP) fail(function, NO_VALUE, "value 0 is not the placeholder");
+        if (function.blocks.empty()) {
+            fail(function, NO_VALUE, "no blocks");
+            return;
+        }
+        if (!function.blocks[0].predecessors.empty()) fail(function, NO_VALUE, "entry block has predecessors");
+
+        computeDominators(function, idom, order);
+
+        // Where each value is placed
+        position.assign(function.values.size(), NO_BLOCK);
+        for (BlockId b = 0; b < function.blocks.size(); ++b) {
+            const std::vector<ValueId>& instructions = function.blocks[b].instructions;
+            for (uint32_t i = 0; i < instructions.size(); ++i) {
+                ValueId value = instructions[i];
+                if (value == NO_VALUE || value >= function.values.size()) {
+                    fail(function, NO_VALUE, "block lists an invalid value");
+                    continue;
+                }
+                if (position[value] != NO_BLOCK) fail(function, value, "placed twice");
+                position[value] = i;
+                if (function.values[value].block != b) fail(function, value, "block field does not match its block");
+            }
+        }
+
+        for (BlockId b = 0; b < function.blocks.size(); ++b) {
+            const IrBlock& block = function.blocks[b];
+            if (block.instructions.empty()) {
+                fail(function, NO_VALUE, "empty block");
+                continue;
+            }
+
+            // Edges agree in both directions
+            BlockId next[2];
+            uint32_t count = function.successors(b, next);
+            for (uint32_t i = 0; i < count; ++i) {
+                if (next[i] >= function.blocks.size()) {
+                    fail(function, block.instructions.back(), "branch to a missing block");
+                    continue;
+                }
+                const std::vector<BlockId>& preds = function.blocks[next[i]].predecessors;
+                if (std::find(preds.begin(), preds.end(), b) == preds.end())
+                    fail(function, block.instructions.back(), "successor does not list this block as a predecessor");
+            }
+            for (BlockId pred : block.predecessors) {
+                BlockId predNext[2];
+                uint32_t n = pred < function.blocks.size() ? function.successors(pred, predNext) : 0;
+                if (std::find(predNext, predNext + n, b) == predNext + n)
+                    fail(function, block.instructions.front(), "predecessor does not branch here");
+            }
+
+            bool phis = true;
+            for (uint32_t i = 0; i < block.instructions.size(); ++i) {
+                ValueId value = block.instructions[i];
+                if (value == NO_VALUE || value >= function.values.size()) continue;
+                const IrInst& inst = function.values[value];
+                if (inst.op == IR_NOP) fail(function, value, "removed instruction still placed");
+                if (inst.op != IR_PHI) phis = false;
+                else if (!phis) fail(function, value, "phi after a non-phi");
+                if (isTerminator(inst.op) != (i + 1 == block.instructions.size()))
+                    fail(function, value, "terminator not at the end of its block");
+                instruction(function, value, b, i);
+            }
+        }
+    }
+
+    IrType operandType(const IrFunction& function, ValueId value, uint32_t i) const {
+        ValueId operand = function.operand(value, i);
+        return operand < function.values.size() ? function.values[operand].type : IR_VOID;
+    }
+
+    void expect(const IrFunction& function, ValueId value, IrType result, IrType operands) {
+        const IrInst& inst = function.values[value];
+        if (inst.type != result) fail(function, value, "wrong result type");
+        for (uint32_t i = 0; i < inst.operandCount; ++i) {
+            if (operandType(function, value, i) != operands) fail(function, value, "wrong operand type");
+        }
+    }
+
+    void expectCount(const IrFunction& function, ValueId value, uint32_t count) {
+        if (function.values[value].operandCount != count) fail(function, value, "wrong operand count");
+    }
+
+    void instruction(const IrFunction& function, ValueId value, BlockId block, uint32_t index) {
+        const IrInst& inst = function.values[value];
+        if (inst.firstOperand + inst.operandCount > function.operands.size()) {
+            fail(function, value, "operands out of range");
+            return;
+        }
+
+        // Every operand is a placed value whose definition dominates the use
+        bool reachable = idom[block] != NO_BLOCK;
+        for (uint32_t i = 0; i < inst.operandCount; ++i) {
+            ValueId operand = function.operand(value, i);
+            if (operand == NO_VALUE || operand >= function.values.size() || position[operand] == NO_BLOCK) {
+                fail(function, value, "operand is not a placed value");
+                continue;
+            }
+            const IrInst& def = function.values[operand];
+            if (def.type == IR_VOID) fail(function, value, "operand has no value");
+            if (!reachable) continue;
+
+            if (inst.op == IR_PHI) {
+                const std::vector<BlockId>& preds = function.blocks[block].predecessors;
+                if (i < preds.size() && idom[preds[i]] != NO_BLOCK && !dominates(def.block, preds[i]))
+                    fail(function, value, "phi operand does not dominate its predecessor");
+            }
+            else if (def.block == block ? position[operand] >= index : !dominates(def.block, block)) {
+                fail(function, value, "use not dominated by its definition");
+            }
+        }
+
+        switch (inst.op) {
+        case IR_CONST:
+            expectCount(function, value, 0);
+            if (inst.type != IR_INT && inst.type != IR_REAL && inst.type != IR_BOOL) fail(function, value, "bad constant type");
+            break;
+        case IR_PARAM:
+            if (inst.index >= function.paramTypes.size() || function.paramTypes[inst.index] != inst.type)
+                fail(function, value, "parameter does not match the signature");
+            break;
+        case IR_PHI:
+            if (inst.operandCount != function.blocks[block].predecessors.size())
+                fail(function, value, "phi operand count differs from the predecessor count");
+            for (uint32_t i = 0; i < inst.operandCount; ++i) {
+                if (operandType(function, value, i) != inst.type) fail(function, value, "phi operand of another type");
+            }
+            break;
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
+            expectCount(function, value, 2);
+            expect(function, value, IR_INT, IR_INT);
+            break;
+        case IR_NEG:
+            expectCount(function, value, 1);
+            expect(function, value, IR_INT, IR_INT);
+            break;
+        case IR_FADD: case IR_FSUB: case IR_FMUL: case IR_FDIV:
+            expectCount(function, value, 2);
+            expect(function, value, IR_REAL, IR_REAL);
+            break;
+        case IR_FNEG:
+            expectCount(function, value, 1);
+            expect(function, value, IR_REAL, IR_REAL);
+            break;
+        case IR_ITOF:
+            expectCount(function, value, 1);
+            expect(function, value, IR_REAL, IR_INT);
+            break;
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+            expectCount(function, value, 2);
+            if (inst.type != IR_BOOL) fail(function, value, "comparison is not boolean");
+            if (operandType(function, value, 0) != operandType(function, value, 1) ||
+                (operandType(function, value, 0) != IR_INT && operandType(function, value, 0) != IR_BOOL))
+                fail(function, value, "compares operands of different or non-integer types");
+            break;
+        case IR_FEQ: case IR_FNE: case IR_FLT: case IR_FLE: case IR_FGT: case IR_FGE:
+            expectCount(function, value, 2);
+            expect(function, value, IR_BOOL, IR_REAL);
+            break;
+        case IR_NOT:
+            expectCount(function, value, 1);
+            expect(function, value, IR_BOOL, IR_BOOL);
+            break;
+        case IR_AND: case IR_OR:
+            expectCount(function, value, 2);
+            expect(function, value, IR_BOOL, IR_BOOL);
+            break;
+        case IR_LOAD_GLOBAL:
+            expectCount(function, value, 0);
+            break;
+        case IR_STORE_GLOBAL:
+            expectCount(function, value, 1);
+            break;
+        case IR_ADDR:
+            expectCount(function, value, 0);
+            if (inst.type != IR_ARRAY) fail(function, value, "address is not an array");
+            break;
+        case IR_BOUNDS:
+            expectCount(function, value, 1);
+            expect(function, value, IR_INT, IR_INT);
+            break;
+        case IR_LOAD_ELEM:
+            expectCount(function, value, 2);
+            if (operandType(function, value, 0) != IR_ARRAY || operandType(function, value, 1) != IR_INT)
+                fail(function, value, "element load needs an array and an offset");
+            break;
+        case IR_STORE_ELEM:
+            expectCount(function, value, 3);
+            if (operandType(function, value, 0) != IR_ARRAY || operandType(function, value, 1) != IR_INT)
+                fail(function, value, "element store needs an array and an offset");
+            break;
+        case IR_COPY_ARRAY:
+            expectCount(function, value, 2);
+            expect(function, value, IR_VOID, IR_ARRAY);
+            break;
+        case IR_CALL: {
+            if (inst.index >= module.functions.size()) {
+                fail(function, value, "call to a missing function");
+                break;
+            }
+            const IrFunction& callee = module.functions[inst.index];
+            if (inst.type != callee.returnType) fail(function, value, "call type differs from the callee's result");
+            if (inst.operandCount != callee.paramTypes.size()) {
+                fail(function, value, "wrong argument count");
+                break;
+            }
+            for (uint32_t i = 0; i < inst.operandCount; ++i) {
+                if (operandType(function, value, i) != callee.paramTypes[i]) fail(function, value, "argument of the wrong type");
+            }
+            break;
+        }
+        case IR_JUMP:
+            expectCount(function, value, 0);
+            break;
+        case IR_BRANCH:
+            expectCount(function, value, 1);
+            if (operandType(function, value, 0) != IR_BOOL) fail(function, value, "branch on a non-boolean");
+            break;
+        case IR_RETURN:
+            if (function.returnType == IR_VOID ? inst.operandCount != 0
+                                               : inst.operandCount != 1 || operandType(function, value, 0) != function.returnType)
+                fail(function, value, "return does not match the function's result");
+            break;
+        default:
+            break;
+        }
+    }
+
+    const IrModule& module;
+    std::ostream& errors;
+    bool ok;
+    std::vector<BlockId> idom;
+    std::vector<BlockId> order;
+    std::vector<uint32_t> position;     // by value: index within its block
+};
+
+}
+
+bool verifyIr(const IrModule& module, std::ostream& errors) {
+    return IrVerifier(module, errors).run();
+}
@@ -0,0 +1,158 @@
+#ifndef IR_H
+#define IR_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ast.h"
+#include "ast_arena.h"
+#include "bytecode.h"
+#include "semantic_info.h"
+
+// Typed mid-level IR in SSA form, built from the analyzed AST.
+//
+// Each function owns its instructions, operand lists and blocks; a value is
+// the dense index of the instruction that defines it, so per-value side
+// tables are plain vectors. Scalars local to a function (parameters, locals,
+// the function result, and in the main program the globals no subprogram
+// touches) are SSA values; every other global is read and written with
+// LOAD_GLOBAL / STORE_GLOBAL. Arrays stay in memory: ADDR names one, BOUNDS
+// turns an index into a checked offset, LOAD_ELEM / STORE_ELEM access it.
+// A function's frame arrays start out zero, as in the interpreters.
+
+typedef uint32_t ValueId;
+typedef uint32_t BlockId;
+
+const ValueId NO_VALUE = 0;     // instruction 0 of every function is a NOP
+
+enum IrType : uint8_t {
+    IR_VOID,
+    IR_INT,
+    IR_REAL,
+    IR_BOOL,
+    IR_ARRAY    // address of an array's first cell
+};
+
+#define IR_OPS(X) \
+    X(NOP) \
+    X(CONST)         /* intValue or realValue */ \
+    X(PARAM)         /* index: parameter number */ \
+    X(PHI)           /* one operand per predecessor, in predecessor order */ \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(NEG) \
+    X(FADD) X(FSUB) X(FMUL) X(FDIV) X(FNEG) \
+    X(ITOF) \
+    X(EQ) X(NE) X(LT) X(LE) X(GT) X(GE) \
+    X(FEQ) X(FNE) X(FLT) X(FLE) X(FGT) X(FGE) \
+    X(NOT) X(AND) X(OR) \
+    X(LOAD_GLOBAL)   /* index: variable */ \
+    X(STORE_GLOBAL)  /* index: variable       value */ \
+    X(ADDR)          /* index: array variable */ \
+    X(BOUNDS)        /* bounds.low, count     index -> offset */ \
+    X(LOAD_ELEM)     /* array offset */ \
+    X(STORE_ELEM)    /* array offset value */ \
+    X(COPY_ARRAY)    /* index: cells          destination source */ \
+    X(CALL)          /* index: subprogram     args */ \
+    X(JUMP)          /* targets[0] */ \
+    X(BRANCH)        /* targets[0] if true, targets[1] if false   cond */ \
+    X(RETURN)        /* [value] */
+
+enum IrOp : uint8_t {
+#define IR_ENUM(name) IR_##name,
+    IR_OPS(IR_ENUM)
+#undef IR_ENUM
+    IR_OP_COUNT
+};
+
+const char* irOpName(IrOp op);
+
+inline bool isTerminator(IrOp op) {
+    return op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN;
+}
+
+// Instructions whose only effect is their value: unused ones can go.
+// DIV and BOUNDS trap, so they are not on the list.
+bool isPure(IrOp op);
+
+// Computes an arithmetic, comparison or logic op on constant operands with
+// the interpreters' semantics. Returns false for anything else, and for an
+// integer division by zero, which has to trap at run time.
+bool foldIrOp(IrOp op, const Value* operands, Value& out);
+
+struct IrInst {
+    IrOp op;
+    IrType type;
+    BlockId block;
+    uint32_t firstOperand;      // into IrFunction::operands
+    uint32_t operandCount;
+    union {
+        int32_t intValue;
+        double realValue;
+        uint32_t index;
+        BlockId targets[2];
+        struct {
+            int32_t low;
+            uint32_t count;
+        } bounds;
+    };
+};
+
+struct IrBlock {
+    std::vector<ValueId> instructions;  // phis first, one terminator last
+    std::vector<BlockId> predecessors;
+};
+
+struct IrFunction {
+    std::string name;
+    uint32_t subprogram;        // NO_SUBPROGRAM for the main program
+    IrType returnType;          // IR_VOID for procedures and the main program
+    std::vector<IrType> paramTypes;
+    std::vector<IrInst> values;
+    std::vector<ValueId> operands;
+    std::vector<IrBlock> blocks;    // blocks[0] is the entry
+
+    // Where the function came from, for passes that rewrite the tree: the
+    // value of each expression node lowered, and the block each statement
+    // starts in. Nodes whose value is an array, or that are lowered as
+    // branches (and, or, not in conditions), have no value.
+    std::vector<std::pair<NodeId, ValueId>> nodeValues;
+    std::vector<std::pair<NodeId, BlockId>> statementBlocks;
+
+    ValueId operand(ValueId value, uint32_t i) const { return operands[values[value].firstOperand + i]; }
+    ValueId* operandsOf(ValueId value) { return operands.data() + values[value].firstOperand; }
+    const ValueId* operandsOf(ValueId value) const { return operands.data() + values[value].firstOperand; }
+
+    // Appends an instruction (not yet placed in a block) and returns its id.
+    ValueId append(IrOp op, IrType type, BlockId block, const ValueId* args, uint32_t count);
+
+    // Successors of a block, read from its terminator.
+    uint32_t successors(BlockId block, BlockId out[2]) const;
+};
+
+struct IrModule {
+    std::vector<IrFunction> functions;  // subprograms in SemanticInfo order, then the main program
+    uint32_t main = 0;
+    const SemanticInfo* info = nullptr; // variable indices refer to info->variables
+};
+
+// Builds the IR of an analyzed program. `info` must come from a successful
+// SemanticAnalyzer::analyze of the same tree.
+void buildIr(const AstArena& ast, NodeId root, const SemanticInfo& info, IrModule& out);
+
+void dumpIr(const IrModule& module, std::ostream& out);
+void dumpIr(const IrModule& module, const IrFunction& function, std::ostream& out);
+
+// Checks the structural rules above: one terminator per block, phis first
+// with one operand per predecessor, predecessor lists matching the
+// terminators, operand types, and every use dominated by its definition.
+// Reports each problem to `errors` and returns whether there were none.
+bool verifyIr(const IrModule& module, std::ostream& errors);
+
+// Immediate dominators of the blocks reachable from the entry (the entry is
+// its own); unreachable blocks get NO_BLOCK. `order` receives the reachable
+// blocks in reverse postorder.
+const BlockId NO_BLOCK = 0xFFFFFFFFu;
+void computeDominators(const IrFunction& function, std::vector<BlockId>& idom, std::vector<BlockId>& order);
+
+#endif // IR_H
@@ -0,0 +1,633 @@
+#include "ir.h"
+#include "register_allocation.h"
+#include "string_interner.h"
+
+#include <unordered_map>
+
+static IrType irType(DataType type) {
+    switch (type) {
+    case DataType::INTEGER: return IR_INT;
+    case DataType::REAL: return IR_REAL;
+    case DataType::BOOLEAN: return IR_BOOL;
+    case DataType::ARRAY: return IR_ARRAY;
+    default: return IR_VOID;
+    }
+}
+
+namespace {
+
+// SSA construction straight from the tree, after Braun et al., "Simple and
+// Efficient Construction of Static Single Assignment Form": each block keeps
+// the current value of every variable it assigns, reads look backwards
+// through the predecessors, and a block's phis are completed once all its
+// predecessors are known (the block is sealed). Trivial phis are removed at
+// the end in one sweep.
+class IrBuilder {
+public:
+    IrBuilder(const AstArena& ast, const SemanticInfo& info, const std::vector<bool>& shared, IrModule& module)
+        : ast(ast), info(info), shared(shared), module(module), function(nullptr), current(0),
+          resultVariable(static_cast<uint32_t>(info.variables.size())) {}
+
+    void buildSubprogram(uint32_t index);
+    void buildMain(NodeId body);
+
+private:
+    void begin(IrFunction& target);
+    void finish();
+
+    BlockId newBlock();
+    void seal(BlockId block);
+    ValueId emit(IrOp op, IrType type, const ValueId* args = nullptr, uint32_t count = 0);
+    ValueId constant(IrType type, int32_t value);
+    ValueId realConstant(double value);
+    void jump(BlockId target);
+    void branch(ValueId condition, BlockId ifTrue, BlockId ifFalse);
+
+    IrType variableType(uint32_t variable) const;
+    void writeVariable(uint32_t variable, BlockId block, ValueId value);
+    ValueId readVariable(uint32_t variable, BlockId block);
+    ValueId newPhi(BlockId block, IrType type);
+    void addPhiOperands(uint32_t variable, ValueId phi);
+    void removeTrivialPhis();
+
+    bool promoted(uint32_t variable) const { return variable == resultVariable || isPromoted[variable]; }
+    void statement(NodeId node);
+    void condition(NodeId node, BlockId ifTrue, BlockId ifFalse);
+    ValueId expression(NodeId node);
+    ValueId lowerExpression(NodeId node);
+    ValueId convert(ValueId value, IrType type);
+    ValueId elementOffset(NodeId access);
+    ValueId address(uint32_t variable);
+    ValueId call(NodeId node);
+    bool simple(NodeId node) const;
+
+    const AstArena& ast;
+    const SemanticInfo& info;
+    const std::vector<bool>& shared;
+    IrModule& module;
+    IrFunction* function;
+    BlockId current;
+    uint32_t resultVariable;            // stands for the function result
+    IrType resultType;
+    std::vector<bool> isPromoted;       // by variable: an SSA value in this function
+    std::unordered_map<uint64_t, ValueId> definitions;  // (block, variable) -> value
+    std::vector<bool> sealed;
+    std::vector<std::vector<std::pair<uint32_t, ValueId>>> incompletePhis;
+};
+
+void IrBuilder::begin(IrFunction& target) {
+    function = &target;
+    function->values.clear();
+    function->operands.clear();
+    function->blocks.clear();
+    function->nodeValues.clear();
+    function->statementBlocks.clear();
+    function->append(IR_NOP, IR_VOID, 0, nullptr, 0);
+    definitions.clear();
+    sealed.clear();
+    incompletePhis.clear();
+    isPromoted.assign(info.variables.size(), false);
+    current = newBlock();
+    seal(current);
+}
+
+BlockId IrBuilder::newBlock() {
+    function->blocks.emplace_back();
+    sealed.push_back(false);
+    incompletePhis.emplace_back();
+    return static_cast<BlockId>(function->blocks.size() - 1);
+}
+
+void IrBuilder::seal(BlockId block) {
+    for (const std::pair<uint32_t, ValueId>& phi : incompletePhis[block]) {
+        addPhiOperands(phi.first, phi.second);
+    }
+    incompletePhis[block].clear();
+    sealed[block] = true;
+}
+
+ValueId IrBuilder::emit(IrOp op, IrType type, const ValueId* args, uint32_t count) {
+    ValueId value = function->append(op, type, current, args, count);
+    function->blocks[current].instructions.push_back(value);
+    return value;
+}
+
+ValueId IrBuilder::constant(IrType type, int32_t value) {
+    ValueId id = emit(IR_CONST, type);
+    function->values[id].intValue = value;
+    return id;
+}
+
+ValueId IrBuilder::realConstant(double value) {
+    ValueId id = emit(IR_CONST, IR_REAL);
+    function->values[id].realValue = value;
+    return id;
+}
+
+void IrBuilder::jump(BlockId target) {
+    ValueId id = emit(IR_JUMP, IR_VOID);
+    function->values[id].targets[0] = target;
+    function->blocks[target].predecessors.push_back(current);
+}
+
+void IrBuilder::branch(ValueId condition, BlockId ifTrue, BlockId ifFalse) {
+    ValueId id = emit(IR_BRANCH, IR_VOID, &condition, 1);
+    function->values[id].targets[0] = ifTrue;
+    function->values[id].targets[1] = ifFalse;
+    function->blocks[ifTrue].predecessors.push_back(current);
+    function->blocks[ifFalse].predecessors.push_back(current);
+}
+
+IrType IrBuilder::variableType(uint32_t variable) const {
+    return variable == resultVariable ? resultType : irType(info.variables[variable].type.baseType);
+}
+
+void IrBuilder::writeVariable(uint32_t variable, BlockId block, ValueId value) {
+    definitions[(static_cast<uint64_t>(block) << 32) | variable] = value;
+}
+
+ValueId IrBuilder::readVariable(uint32_t variable, BlockId block) {
+    auto found = definitions.find((static_cast<uint64_t>(block) << 32) | variable);
+    if (found != definitions.end()) return found->second;
+
+    const std::vector<BlockId>& preds = function->blocks[block].predecessors;
+    ValueId value;
+    if (!sealed[block]) {
+        value = newPhi(block, variableType(variable));
+        incompletePhis[block].push_back({ variable, value });
+    }
+    else if (preds.size() == 1) {
+        value = readVariable(variable, preds[0]);
+    }
+    else {
+        // Written first so a loop reaching back here finds the phi
+        value = newPhi(block, variableType(variable));
+        writeVariable(variable, block, value);
+        addPhiOperands(variable, value);
+    }
+    writeVariable(variable, block, value);
+    return value;
+}
+
+ValueId IrBuilder::newPhi(BlockId block, IrType type) {
+    ValueId phi = function->append(IR_PHI, type, block, nullptr, 0);
+    std::vector<ValueId>& instructions = function->blocks[block].instructions;
+    size_t at = 0;
+    while (at < instructions.size() && function->values[instructions[at]].op == IR_PHI) ++at;
+    instructions.insert(instructions.begin() + at, phi);
+    return phi;
+}
+
+// Reading the predecessors may create more phis and operands, so this phi's
+// operands are placed only once they are all known.
+void IrBuilder::addPhiOperands(uint32_t variable, ValueId phi) {
+    BlockId block = function->values[phi].block;
+    std::vector<ValueId> values;
+    values.reserve(function->blocks[block].predecessors.size());
+    for (size_t i = 0; i < function->blocks[block].predecessors.size(); ++i) {
+        values.push_back(readVariable(variable, function->blocks[block].predecessors[i]));
+    }
+    IrInst& inst = function->values[phi];
+    inst.firstOperand = static_cast<uint32_t>(function->operands.size());
+    inst.operandCount = static_cast<uint32_t>(values.size());
+    function->operands.insert(function->operands.end(), values.begin(), values.end());
+}
+
+// A phi whose operands are all one value (or itself) is that value.
+void IrBuilder::removeTrivialPhis() {
+    std::vector<ValueId> replacement(function->values.size());
+    for (ValueId v = 0; v < replacement.size(); ++v) replacement[v] = v;
+    auto find = [&](ValueId v) {
+        while (replacement[v] != v) v = replacement[v] = replacement[replacement[v]];
+        return v;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (ValueId v = 1; v < function->values.size(); ++v) {
+            IrInst& inst = function->values[v];
+            if (inst.op != IR_PHI || replacement[v] != v) continue;
+            ValueId same = NO_VALUE;
+            bool trivial = true;
+            for (uint32_t i = 0; i < inst.operandCount; ++i) {
+                ValueId operand = find(function->operand(v, i));
+                if (operand == v || operand == same) continue;
+                if (same != NO_VALUE) {
+                    trivial = false;
+                    break;
+                }
+                same = operand;
+            }
+            if (!trivial || same == NO_VALUE) continue;
+            replacement[v] = same;
+            changed = true;
+        }
+    }
+
+    for (ValueId& operand : function->operands) operand = find(operand);
+    for (std::pair<NodeId, ValueId>& source : function->nodeValues) source.second = find(source.second);
+    for (IrBlock& block : function->blocks) {
+        size_t kept = 0;
+        for (ValueId value : block.instructions) {
+            if (replacement[value] != value) {
+                function->values[value].op = IR_NOP;
+                function->values[value].type = IR_VOID;
+                function->values[value].operandCount = 0;
+                continue;
+            }
+            block.instructions[kept++] = value;
+        }
+        block.instructions.resize(kept);
+    }
+}
+
+void IrBuilder::finish() {
+    removeTrivialPhis();
+    function = nullptr;
+}
+
+void IrBuilder::buildSubprogram(uint32_t index) {
+    const SubprogramInfo& subprogram = info.subprograms[index];
+    IrFunction& target = module.functions[index];
+    target.name = nameOf(subprogram.name);
+    target.subprogram = index;
+    target.returnType = subprogram.isFunction ? irType(subprogram.returnType) : IR_VOID;
+    resultType = target.returnType;
+    target.paramTypes.clear();
+    for (uint32_t i = 0; i < subprogram.paramCount; ++i) {
+        target.paramTypes.push_back(irType(info.variables[subprogram.firstParam + i].type.baseType));
+    }
+
+    begin(target);
+    for (uint32_t v = 0; v < info.variables.size(); ++v) {
+        const VariableInfo& variable = info.variables[v];
+        if (variable.owner == index && variable.type.baseType != DataType::ARRAY) isPromoted[v] = true;
+    }
+
+    // Parameters arrive as PARAMs; arrays are copied into the frame, since
+    // they are passed by value
+    for (uint32_t i = 0; i < subprogram.paramCount; ++i) {
+        uint32_t v = subprogram.firstParam + i;
+        ValueId param = emit(IR_PARAM, target.paramTypes[i]);
+        function->values[param].index = i;
+        if (target.paramTypes[i] == IR_ARRAY) {
+            ValueId copy[2] = { address(v), param };
+            ValueId id = emit(IR_COPY_ARRAY, IR_VOID, copy, 2);
+            function->values[id].index = info.variables[v].cells;
+        }
+        else {
+            writeVariable(v, current, param);
+        }
+    }
+    for (uint32_t v = 0; v < info.variables.size(); ++v) {
+        if (isPromoted[v] && !info.variables[v].isParameter) writeVariable(v, current, constant(variableType(v), 0));
+    }
+    if (subprogram.isFunction) {
+        writeVariable(resultVariable, current,
+                      resultType == IR_REAL ? realConstant(0.0) : constant(resultType, 0));
+    }
+
+    statement(ast.child(subprogram.node, 2));
+
+    if (subprogram.isFunction) {
+        ValueId result = readVariable(resultVariable, current);
+        emit(IR_RETURN, IR_VOID, &result, 1);
+    }
+    else {
+        emit(IR_RETURN, IR_VOID);
+    }
+    finish();
+}
+
+void IrBuilder::buildMain(NodeId body) {
+    IrFunction& target = module.functions[module.main];
+    target.name = "main";
+    target.subprogram = NO_SUBPROGRAM;
+    target.returnType = IR_VOID;
+    target.paramTypes.clear();
+    resultType = IR_VOID;
+
+    begin(target);
+    for (uint32_t v = 0; v < info.variables.size(); ++v) {
+        const VariableInfo& variable = info.variables[v];
+        if (variable.storage != Storage::GLOBAL || variable.type.baseType == DataType::ARRAY || shared[v]) continue;
+        isPromoted[v] = true;
+        IrType type = variableType(v);
+        writeVariable(v, current, type == IR_REAL ? realConstant(0.0) : constant(type, 0));
+    }
+
+    statement(body);
+
+    // Promoted globals go back to memory once the program ends
+    for (uint32_t v = 0; v < info.variables.size(); ++v) {
+        if (!isPromoted[v]) continue;
+        ValueId value = readVariable(v, current);
+        ValueId id = emit(IR_STORE_GLOBAL, IR_VOID, &value, 1);
+        function->values[id].index = v;
+    }
+    emit(IR_RETURN, IR_VOID);
+    finish();
+}
+
+void IrBuilder::statement(NodeId node) {
+    if (!node) return;
+    function->statementBlocks.push_back({ node, current });
+
+    switch (ast.node(node).type) {
+    case NODE_COMPOUND_STMT:
+        for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+            statement(child);
+        }
+        break;
+    case NODE_ASSIGNMENT: {
+        NodeId target = ast.child(node, 0);
+        NodeId valueNode = ast.child(node, 1);
+        if (ast.node(target).type == NODE_ARRAY_ACCESS) {
+            // Index first, as the interpreters do
+            ValueId offset = elementOffset(target);
+            const VariableInfo& array = info.variable(target);
+            ValueId value = convert(expression(valueNode), irType(array.type.elementType));
+            ValueId args[3] = { address(info.ref(target).index), offset, value };
+            emit(IR_STORE_ELEM, IR_VOID, args, 3);
+            break;
+        }
+        if (info.ref(target).kind == RefKind::RESULT) {
+            writeVariable(resultVariable, current, convert(expression(valueNode), resultType));
+            break;
+        }
+
+        uint32_t variable = info.ref(target).index;
+        const VariableInfo& v = info.variables[variable];
+        if (v.type.baseType == DataType::ARRAY) {
+            ValueId args[2] = { address(variable), address(info.ref(valueNode).index) };
+            ValueId id = emit(IR_COPY_ARRAY, IR_VOID, args, 2);
+            function->values[id].index = v.cells;
+            break;
+        }
+        ValueId value = convert(expression(valueNode), variableType(variable));
+        if (promoted(variable)) {
+            writeVariable(variable, current, value);
+        }
+        else {
+            ValueId id = emit(IR_STORE_GLOBAL, IR_VOID, &value, 1);
+            function->values[id].index = variable;
+        }
+        break;
+    }
+    case NODE_IF: {
+        NodeId elseStmt = ast.child(node, 2);
+        BlockId thenBlock = newBlock();
+        BlockId elseBlock = elseStmt ? newBlock() : 0;
+        BlockId join = newBlock();
+        condition(ast.child(node, 0), thenBlock, elseStmt ? elseBlock : join);
+
+        seal(thenBlock);
+        current = thenBlock;
+        statement(ast.child(node, 1));
+        jump(join);
+        if (elseStmt) {
+            seal(elseBlock);
+            current = elseBlock;
+            statement(elseStmt);
+            jump(join);
+        }
+        seal(join);
+        current = join;
+        break;
+    }
+    case NODE_WHILE: {
+        // The header is sealed once the body's back edge exists
+        BlockId header = newBlock();
+        BlockId body = newBlock();
+        BlockId exit = newBlock();
+        jump(header);
+        current = header;
+        condition(ast.child(node, 0), body, exit);
+
+        seal(body);
+        current = body;
+        statement(ast.child(node, 1));
+        jump(header);
+        seal(header);
+        seal(exit);
+        current = exit;
+        break;
+    }
+    case NODE_PROCEDURE_CALL:
+    case NODE_FUNCTION_CALL:
+        call(node);
+        break;
+    default:
+        break;
+    }
+}
+
+// and / or / not become branches, the way the jump-chain backends do it.
+void IrBuilder::condition(NodeId node, BlockId ifTrue, BlockId ifFalse) {
+    const ASTNode& n = ast.node(node);
+    if (n.type == NODE_UNARY_OP && n.op == OP_NOT) {
+        condition(ast.child(node, 0), ifFalse, ifTrue);
+        return;
+    }
+    if (n.type == NODE_BINARY_OP && (n.op == OP_AND || n.op == OP_OR)) {
+        BlockId right = newBlock();
+        if (n.op == OP_AND) condition(ast.child(node, 0), right, ifFalse);
+        else condition(ast.child(node, 0), ifTrue, right);
+        seal(right);
+        current = right;
+        condition(ast.child(node, 1), ifTrue, ifFalse);
+        return;
+    }
+    branch(expression(node), ifTrue, ifFalse);
+}
+
+// Whether evaluating the node can neither trap nor call: then and / or may
+// evaluate it unconditionally.
+bool IrBuilder::simple(NodeId node) const {
+    const ASTNode& n = ast.node(node);
+    switch (n.type) {
+    case NODE_INT_NUM:
+    case NODE_REAL_NUM:
+    case NODE_BOOLEAN:
+        return true;
+    case NODE_VARIABLE:
+        return info.ref(node).kind == RefKind::VARIABLE;
+    case NODE_UNARY_OP:
+        return simple(ast.child(node, 0));
+    case NODE_BINARY_OP:
+        return n.op != OP_DIV && simple(ast.child(node, 0)) && simple(ast.child(node, 1));
+    default:
+        return false;
+    }
+}
+
+ValueId IrBuilder::convert(ValueId value, IrType type) {
+    if (type == IR_REAL && function->values[value].type == IR_INT) return emit(IR_ITOF, IR_REAL, &value, 1);
+    return value;
+}
+
+ValueId IrBuilder::address(uint32_t variable) {
+    ValueId id = emit(IR_ADDR, IR_ARRAY);
+    function->values[id].index = variable;
+    return id;
+}
+
+ValueId IrBuilder::elementOffset(NodeId access) {
+    const VariableInfo& array = info.variable(access);
+    ValueId index = expression(ast.child(access, 0));
+    if (info.boundsProven[access]) {
+        ValueId args[2] = { index, constant(IR_INT, array.type.arrayStart) };
+        return emit(IR_SUB, IR_INT, args, 2);
+    }
+    ValueId offset = emit(IR_BOUNDS, IR_INT, &index, 1);
+    function->values[offset].bounds.low = array.type.arrayStart;
+    function->values[offset].bounds.count = array.cells;
+    return offset;
+}
+
+ValueId IrBuilder::call(NodeId node) {
+    uint32_t index = info.ref(node).index;
+    const SubprogramInfo& subprogram = info.subprograms[index];
+    std::vector<ValueId> args;
+    uint32_t param = subprogram.firstParam;
+    for (NodeId arg = ast.firstChild(node); arg; arg = ast.nextSibling(arg), ++param) {
+        const VariableInfo& target = info.variables[param];
+        if (target.type.baseType == DataType::ARRAY) args.push_back(address(info.ref(arg).index));
+        else args.push_back(convert(expression(arg), irType(target.type.baseType)));
+    }
+    IrType type = subprogram.isFunction ? irType(subprogram.returnType) : IR_VOID;
+    ValueId id = emit(IR_CALL, type, args.data(), static_cast<uint32_t>(args.size()));
+    function->values[id].index = index;
+    return id;
+}
+
+ValueId IrBuilder::expression(NodeId node) {
+    ValueId value = lowerExpression(node);
+    function->nodeValues.push_back({ node, value });
+    return value;
+}
+
+ValueId IrBuilder::lowerExpression(NodeId node) {
+    const ASTNode& n = ast.node(node);
+    switch (n.type) {
+    case NODE_INT_NUM:
+        return constant(IR_INT, n.intVal);
+    case NODE_REAL_NUM:
+        return realConstant(n.realVal);
+    case NODE_BOOLEAN:
+        return constant(IR_BOOL, n.boolVal ? 1 : 0);
+    case NODE_VARIABLE: {
+        if (info.ref(node).kind == RefKind::CALL) return call(node);
+        uint32_t variable = info.ref(node).index;
+        if (promoted(variable)) return readVariable(variable, current);
+        ValueId id = emit(IR_LOAD_GLOBAL, variableType(variable));
+        function->values[id].index = variable;
+        return id;
+    }
+    case NODE_ARRAY_ACCESS: {
+        ValueId offset = elementOffset(node);
+        const VariableInfo& array = info.variable(node);
+        ValueId args[2] = { address(info.ref(node).index), offset };
+        return emit(IR_LOAD_ELEM, irType(array.type.elementType), args, 2);
+    }
+    case NODE_FUNCTION_CALL:
+        return call(node);
+    case NODE_UNARY_OP: {
+        ValueId operand = expression(ast.child(node, 0));
+        if (n.op == OP_NOT) return emit(IR_NOT, IR_BOOL, &operand, 1);
+        if (function->values[operand].type == IR_REAL) return emit(IR_FNEG, IR_REAL, &operand, 1);
+        return emit(IR_NEG, IR_INT, &operand, 1);
+    }
+    case NODE_BINARY_OP: {
+        NodeId left = ast.child(node, 0);
+        NodeId right = ast.child(node, 1);
+
+        if (n.op == OP_AND || n.op == OP_OR) {
+            ValueId a = expression(left);
+            if (simple(right)) {
+                ValueId args[2] = { a, expression(right) };
+                return emit(n.op == OP_AND ? IR_AND : IR_OR, IR_BOOL, args, 2);
+            }
+            // Short-circuit: the right operand only runs when it decides
+            ValueId shortCut = constant(IR_BOOL, n.op == OP_AND ? 0 : 1);
+            BlockId from = current;
+            BlockId rightBlock = newBlock();
+            BlockId join = newBlock();
+            if (n.op == OP_AND) branch(a, rightBlock, join);
+            else branch(a, join, rightBlock);
+            seal(rightBlock);
+            current = rightBlock;
+            ValueId b = expression(right);
+            jump(join);
+            seal(join);
+            current = join;
+            ValueId phi = newPhi(join, IR_BOOL);
+            const std::vector<BlockId>& preds = function->blocks[join].predecessors;
+            ValueId args[2] = { preds[0] == from ? shortCut : b, preds[1] == from ? shortCut : b };
+            IrInst& inst = function->values[phi];
+            inst.firstOperand = static_cast<uint32_t>(function->operands.size());
+            inst.operandCount = 2;
+            function->operands.insert(function->operands.end(), args, args + 2);
+            return phi;
+        }
+
+        ValueId a = expression(left);
+        ValueId b = expression(right);
+        bool real = function->values[a].type == IR_REAL || function->values[b].type == IR_REAL;
+        if (n.op == OP_DIVIDE) real = true;
+        if (real) {
+            ValueId args[2] = { convert(a, IR_REAL), convert(b, IR_REAL) };
+            switch (n.op) {
+            case OP_ADD: return emit(IR_FADD, IR_REAL, args, 2);
+            case OP_SUB: return emit(IR_FSUB, IR_REAL, args, 2);
+            case OP_MUL: return emit(IR_FMUL, IR_REAL, args, 2);
+            case OP_DIVIDE: return emit(IR_FDIV, IR_REAL, args, 2);
+            case OP_EQ: return emit(IR_FEQ, IR_BOOL, args, 2);
+            case OP_NEQ: return emit(IR_FNE, IR_BOOL, args, 2);
+            case OP_LT: return emit(IR_FLT, IR_BOOL, args, 2);
+            case OP_LE: return emit(IR_FLE, IR_BOOL, args, 2);
+            case OP_GT: return emit(IR_FGT, IR_BOOL, args, 2);
+            case OP_GE: return emit(IR_FGE, IR_BOOL, args, 2);
+            default: break;
+            }
+        }
+        ValueId args[2] = { a, b };
+        switch (n.op) {
+        case OP_ADD: return emit(IR_ADD, IR_INT, args, 2);
+        case OP_SUB: return emit(IR_SUB, IR_INT, args, 2);
+        case OP_MUL: return emit(IR_MUL, IR_INT, args, 2);
+        case OP_DIV: return emit(IR_DIV, IR_INT, args, 2);
+        case OP_EQ: return emit(IR_EQ, IR_BOOL, args, 2);
+        case OP_NEQ: return emit(IR_NE, IR_BOOL, args, 2);
+        case OP_LT: return emit(IR_LT, IR_BOOL, args, 2);
+        case OP_LE: return emit(IR_LE, IR_BOOL, args, 2);
+        case OP_GT: return emit(IR_GT, IR_BOOL, args, 2);
+        case OP_GE: return emit(IR_GE, IR_BOOL, args, 2);
+        default: break;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return constant(IR_INT, 0);
+}
+
+}
+
+void buildIr(const AstArena& ast, NodeId root, const SemanticInfo& info, IrModule& out) {
+    out.functions.clear();
+    out.functions.resize(info.subprograms.size() + 1);
+    out.main = static_cast<uint32_t>(info.subprograms.size());
+    out.info = &info;
+
+    std::vector<bool> shared;
+    findSharedGlobals(ast, info, shared);
+
+    IrBuilder builder(ast, info, shared, out);
+    for (uint32_t i = 0; i < info.subprograms.size(); ++i) {
+        builder.buildSubprogram(i);
+    }
+    builder.buildMain(ast.child(root, 2));
+}
@@ -0,0 +1,198 @@
+#include "ir_interpreter.h"
+
+#include <algorithm>
+
+static const size_t MAX_CALL_DEPTH = 1u << 16;
+
+static inline int32_t wrap(uint32_t value) {
+    return static_cast<int32_t>(value);
+}
+
+IrInterpreter::IrInterpreter(const IrModule& module, size_t stackCells, size_t registerCells)
+    : module(module), globalCells(module.info->globalCells), memory(globalCells + stackCells),
+      registers(registerCells), memoryTop(0), registerTop(0), depth(0), failed(false), dispatches(0),
+      stepLimit(UINT64_MAX) {}
+
+bool IrInterpreter::run() {
+    std::fill(memory.begin(), memory.end(), Value{});
+    memoryTop = globalCells;
+    registerTop = 0;
+    depth = 0;
+    failed = false;
+    errorMessage.clear();
+    dispatches = 0;
+    stepLimit = UINT64_MAX;
+
+    execute(module.main, nullptr, nullptr);
+    return !failed;
+}
+
+bool IrInterpreter::evaluate(uint32_t index, const Value* args, uint32_t count, uint64_t budget, Value& result) {
+    memoryTop = globalCells;
+    registerTop = 0;
+    depth = 0;
+    failed = false;
+    errorMessage.clear();
+    dispatches = 0;
+    stepLimit = budget;
+
+    std::vector<ValueId> ids(count);
+    for (uint32_t i = 0; i < count; ++i) ids[i] = i;
+    result = execute(index, args, ids.data());
+    return !failed;
+}
+
+void IrInterpreter::fail(const char* message) {
+    if (!failed) errorMessage = message;
+    failed = true;
+}
+
+// Arguments are read out of the caller's registers by the callee's PARAMs;
+// array arguments are cell addresses, copied by the callee.
+Value IrInterpreter::execute(uint32_t index, const Value* callerRegisters, const ValueId* args) {
+    const IrFunction& function = module.functions[index];
+    const SemanticInfo& info = *module.info;
+    uint32_t frameCells = function.subprogram == NO_SUBPROGRAM ? 0 : info.subprograms[function.subprogram].frameCells;
+    if (memoryTop + frameCells > memory.size() || registerTop + function.values.size() > registers.size() ||
+        depth >= MAX_CALL_DEPTH) {
+        fail("stack overflow");
+        return Value{};
+    }
+
+    size_t fp = memoryTop;
+    std::fill(memory.begin() + fp, memory.begin() + fp + frameCells, Value{});
+    memoryTop += frameCells;
+    Value* r = registers.data() + registerTop;
+    registerTop += function.values.size();
+    ++depth;
+
+    Value result{};
+    std::vector<Value> incoming;
+    BlockId block = 0;
+    BlockId from = NO_BLOCK;
+    bool running = true;
+    while (running && !failed) {
+        const IrBlock& b = function.blocks[block];
+        size_t i = 0;
+        if (dispatches > stepLimit) {
+            fail("step budget exceeded");
+            break;
+        }
+
+        // Phis read their operands before any of them is written
+        if (from != NO_BLOCK) {
+            uint32_t edge = static_cast<uint32_t>(std::find(b.predecessors.begin(), b.predecessors.end(), from) -
+                                                  b.predecessors.begin());
+            incoming.clear();
+            for (; i < b.instructions.size() && function.values[b.instructions[i]].op == IR_PHI; ++i) {
+                incoming.push_back(r[function.operand(b.instructions[i], edge)]);
+            }
+            for (size_t p = 0; p < i; ++p) r[b.instructions[p]] = incoming[p];
+            dispatches += i;
+        }
+
+        for (; i < b.instructions.size(); ++i) {
+            ValueId v = b.instructions[i];
+            const IrInst& inst = function.values[v];
+            const ValueId* ops = function.operandsOf(v);
+            ++dispatches;
+            Value& out = r[v];
+            switch (inst.op) {
+            case IR_NOP:
+            case IR_PHI:
+                break;
+            case IR_CONST:
+                if (inst.type == IR_REAL) out.r = inst.realValue;
+                else out.i = inst.intValue;
+                break;
+            case IR_PARAM:
+                out = callerRegisters[args[inst.index]];
+                break;
+            case IR_ADD: out.i = wrap(static_cast<uint32_t>(r[ops[0]].i) + static_cast<uint32_t>(r[ops[1]].i)); break;
+            case IR_SUB: out.i = wrap(static_cast<uint32_t>(r[ops[0]].i) - static_cast<uint32_t>(r[ops[1]].i)); break;
+            case IR_MUL: out.i = wrap(static_cast<uint32_t>(r[ops[0]].i) * static_cast<uint32_t>(r[ops[1]].i)); break;
+            case IR_DIV: {
+                int32_t a = r[ops[0]].i;
+                int32_t d = r[ops[1]].i;
+                if (d == 0) fail("division by zero");
+                else if (d == -1) out.i = wrap(0u - static_cast<uint32_t>(a));
+                else out.i = a / d;
+                break;
+            }
+            case IR_NEG: out.i = wrap(0u - static_cast<uint32_t>(r[ops[0]].i)); break;
+            case IR_FADD: out.r = r[ops[0]].r + r[ops[1]].r; break;
+            case IR_FSUB: out.r = r[ops[0]].r - r[ops[1]].r; break;
+            case IR_FMUL: out.r = r[ops[0]].r * r[ops[1]].r; break;
+            case IR_FDIV: out.r = r[ops[0]].r / r[ops[1]].r; break;
+            case IR_FNEG: out.r = -r[ops[0]].r; break;
+            case IR_ITOF: out.r = static_cast<double>(r[ops[0]].i); break;
+            case IR_EQ: out.i = r[ops[0]].i == r[ops[1]].i; break;
+            case IR_NE: out.i = r[ops[0]].i != r[ops[1]].i; break;
+            case IR_LT: out.i = r[ops[0]].i < r[ops[1]].i; break;
+            case IR_LE: out.i = r[ops[0]].i <= r[ops[1]].i; break;
+            case IR_GT: out.i = r[ops[0]].i > r[ops[1]].i; break;
+            case IR_GE: out.i = r[ops[0]].i >= r[ops[1]].i; break;
+            case IR_FEQ: out.i = r[ops[0]].r == r[ops[1]].r; break;
+            case IR_FNE: out.i = r[ops[0]].r != r[ops[1]].r; break;
+            case IR_FLT: out.i = r[ops[0]].r < r[ops[1]].r; break;
+            case IR_FLE: out.i = r[ops[0]].r <= r[ops[1]].r; break;
+            case IR_FGT: out.i = r[ops[0]].r > r[ops[1]].r; break;
+            case IR_FGE: out.i = r[ops[0]].r >= r[ops[1]].r; break;
+            case IR_NOT: out.i = !r[ops[0]].i; break;
+            case IR_AND: out.i = r[ops[0]].i && r[ops[1]].i; break;
+            case IR_OR: out.i = r[ops[0]].i || r[ops[1]].i; break;
+            case IR_LOAD_GLOBAL:
+                out = memory[info.variables[inst.index].slot];
+                break;
+            case IR_STORE_GLOBAL:
+                memory[info.variables[inst.index].slot] = r[ops[0]];
+                break;
+            case IR_ADDR: {
+                const VariableInfo& variable = info.variables[inst.index];
+                out.i = static_cast<int32_t>((variable.storage == Storage::GLOBAL ? 0 : fp) + variable.slot);
+                break;
+            }
+            case IR_BOUNDS: {
+                uint32_t offset = static_cast<uint32_t>(r[ops[0]].i) - static_cast<uint32_t>(inst.bounds.low);
+                if (offset >= inst.bounds.count) fail("array index out of range");
+                else out.i = static_cast<int32_t>(offset);
+                break;
+            }
+            case IR_LOAD_ELEM:
+                out = memory[r[ops[0]].i + r[ops[1]].i];
+                break;
+            case IR_STORE_ELEM:
+                memory[r[ops[0]].i + r[ops[1]].i] = r[ops[2]];
+                break;
+            case IR_COPY_ARRAY: {
+                const Value* source = memory.data() + r[ops[1]].i;
+                std::copy(source, source + inst.index, memory.data() + r[ops[0]].i);
+                break;
+            }
+            case IR_CALL:
+                out = execute(inst.index, r, ops);
+                break;
+            case IR_JUMP:
+                from = block;
+                block = inst.targets[0];
+                break;
+            case IR_BRANCH:
+                from = block;
+                block = r[ops[0]].i ? inst.targets[0] : inst.targets[1];
+                break;
+            case IR_RETURN:
+                if (inst.operandCount) result = r[ops[0]];
+                running = false;
+                break;
+            default:
+                break;
+            }
+            if (failed) break;
+        }
+    }
+
+    --depth;
+    registerTop -= function.values.size();
+    memoryTop = fp;
+    return result;
+}
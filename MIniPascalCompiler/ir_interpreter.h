@@ -0,0 +1,49 @@
+#ifndef IR_INTERPRETER_H
+#define IR_INTERPRETER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bytecode.h"
+#include "ir.h"
+
+// Runs an IrModule directly, block by block. It is slow next to the VMs;
+// it exists so the IR and the passes over it can be checked against them.
+//
+// Each call gets a window of registers, one per value of its function, and
+// a frame in the same memory as the globals for the arrays that live there.
+// Phis are evaluated together on entry to a block, reading the values on
+// the edge that was taken.
+class IrInterpreter {
+public:
+    explicit IrInterpreter(const IrModule& module, size_t stackCells = 1u << 20, size_t registerCells = 1u << 22);
+
+    bool run();
+
+    // Calls one function with scalar arguments, at compile time: fails as
+    // a run would, or once more than `budget` instructions have executed.
+    bool evaluate(uint32_t index, const Value* args, uint32_t count, uint64_t budget, Value& result);
+
+    const std::string& error() const { return errorMessage; }
+    const Value* globals() const { return memory.data(); }
+    uint64_t dispatchCount() const { return dispatches; }  // instructions executed
+
+private:
+    Value execute(uint32_t index, const Value* callerRegisters, const ValueId* args);
+    void fail(const char* message);
+
+    const IrModule& module;
+    size_t globalCells;
+    std::vector<Value> memory;      // globals, then the frames
+    std::vector<Value> registers;
+    size_t memoryTop;
+    size_t registerTop;
+    size_t depth;
+    bool failed;
+    std::string errorMessage;
+    uint64_t dispatches;
+    uint64_t stepLimit;
+};
+
+#endif // IR_INTERPRETER_H
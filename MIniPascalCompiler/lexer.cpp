@@ -0,0 +1,253 @@
+#include "lexer.h"
+#include "ast.h"
+#include "minipascal.tab.h"
+#include <charconv>
+#include <cstring>
+
+enum CharClass : uint8_t {
+    CC_OTHER,
+    CC_SPACE,
+    CC_ALPHA,
+    CC_DIGIT
+};
+
+struct CharTable {
+    uint8_t cls[256];
+
+    CharTable() {
+        std::memset(cls, CC_OTHER, sizeof(cls));
+        cls[(unsigned char)' '] = cls[(unsigned char)'\t'] = cls[(unsigned char)'\r'] = CC_SPACE;
+        cls[(unsigned char)'\n'] = CC_SPACE;
+        for (int c = 'a'; c <= 'z'; ++c) cls[c] = CC_ALPHA;
+        for (int c = 'A'; c <= 'Z'; ++c) cls[c] = CC_ALPHA;
+        cls[(unsigned char)'_'] = CC_ALPHA;
+        for (int c = '0'; c <= '9'; ++c) cls[c] = CC_DIGIT;
+    }
+};
+
+static const CharTable charTable;
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Perfect hash over the 22 keywords: (first + 19 * last + length) & 63 is
+// collision-free for this set, so one table probe and one memcmp decide.
+struct KeywordTable {
+    struct Entry {
+        const char* word;
+        uint8_t length;
+        int token;
+    };
+    Entry slots[64];
+
+    static unsigned hash(const char* text, size_t length) {
+        return ((unsigned char)text[0] + 19u * (unsigned char)text[length - 1] + (unsigned)length) & 63u;
+    }
+
+    KeywordTable() {
+        static const Entry keywords[] = {
+            { "program", 7, PROGRAM }, { "var", 3, VAR }, { "integer", 7, INTEGER },
+            { "real", 4, REAL }, { "boolean", 7, BOOLEAN }, { "function", 8, FUNCTION },
+            { "procedure", 9, PROCEDURE }, { "begin", 5, BEGIN }, { "end", 3, END },
+            { "if", 2, IF }, { "then", 4, THEN }, { "else", 4, ELSE },
+            { "while", 5, WHILE }, { "do", 2, DO }, { "array", 5, ARRAY },
+            { "of", 2, OF }, { "div", 3, DIV }, { "not", 3, NOT },
+            { "or", 2, OR }, { "and", 3, AND }, { "true", 4, TRUE },
+            { "false", 5, FALSE }
+        };
+        std::memset(slots, 0, sizeof(slots));
+        for (const Entry& e : keywords) {
+            slots[hash(e.word, e.length)] = e;
+        }
+    }
+};
+
+static const KeywordTable keywordTable;
+
+int lookupKeyword(const char* text, size_t length) {
+    if (length < 2 || length > 9) return 0;
+
+    const KeywordTable::Entry& e = keywordTable.slots[KeywordTable::hash(text, length)];
+    if (e.length == length && std::memcmp(e.word, text, length) == 0)
+        return e.token;
+    return 0;
+}
+
+Lexer::Lexer(const char* source, size_t size, ScanKernel kernel)
+    : scan(&scanKernels(kernel)), cur(source), end(source + size), lineStart(source), lineNo(1) {}
+
+void Lexer::advanceLines(const LineCount& lines) {
+    if (lines.newlines) {
+        lineNo += lines.newlines;
+        lineStart = lines.lastNewline + 1;
+    }
+}
+
+void Lexer::skipTrivia() {
+    while (cur < end) {
+        char c = *cur;
+        uint8_t cls = charTable.cls[(unsigned char)c];
+        if (cls == CC_SPACE) {
+            LineCount lines = { 0, nullptr };
+            cur = scan->skipWhitespace(cur, end, lines);
+            advanceLines(lines);
+        }
+        else if (c == '{') {
+            LineCount lines = { 0, nullptr };
+            const char* close = scan->findCommentEnd(cur + 1, end, lines);
+            if (!close) return; // unterminated: '{' is reported as an invalid character
+            advanceLines(lines);
+            cur = close + 1;
+        }
+        else if (c == '/' && cur + 1 < end && cur[1] == '/') {
+            const char* nl = static_cast<const char*>(std::memchr(cur, '\n', end - cur));
+            cur = nl ? nl : end;
+        }
+        else {
+            return;
+        }
+    }
+}
+
+Token Lexer::make(int kind, const char* start) {
+    Token token;
+    token.kind = kind;
+    token.text = start;
+    token.length = static_cast<uint32_t>(cur - start);
+    token.line = lineNo;
+    token.column = static_cast<uint32_t>(start - lineStart) + 1;
+    token.realVal = 0.0;
+    return token;
+}
+
+// Mirrors the INT_NUM / REAL_NUM rules, including flex's longest-match
+// choices: "0123" is two integers, but "0123..9" is the range 123..9 (the
+// {DIGIT}+/".." rule); "1." is a real, "1..9" is a range.
+Token Lexer::lexNumber(const char* start) {
+    const char* p = start;
+    while (p < end && isDigit(*p)) ++p;
+
+    bool isReal = false;
+    const char* q = p;
+    if (q < end && *q == '.' && !(q + 1 < end && q[1] == '.')) {
+        isReal = true;
+        ++q;
+        while (q < end && isDigit(*q)) ++q;
+    }
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        const char* e = q + 1;
+        if (e < end && (*e == '+' || *e == '-')) ++e;
+        if (e < end && isDigit(*e)) {
+            isReal = true;
+            while (e < end && isDigit(*e)) ++e;
+            q = e;
+        }
+    }
+
+    if (isReal) {
+        cur = q;
+        Token token = make(REAL_NUM, start);
+        std::from_chars(start, q, token.realVal);
+        return token;
+    }
+
+    bool range = p + 1 < end && p[0] == '.' && p[1] == '.';
+    cur = (*start == '0' && !range) ? start + 1 : p;
+    unsigned value = 0;
+    for (const char* d = start; d < cur; ++d) {
+        value = value * 10u + static_cast<unsigned>(*d - '0');
+    }
+    Token token = make(INT_NUM, start);
+    token.intVal = static_cast<int>(value);
+    return token;
+}
+
+Token Lexer::next() {
+    skipTrivia();
+
+    const char* start = cur;
+    if (cur >= end) return make(0, start);
+
+    char c = *cur;
+    switch (charTable.cls[(unsigned char)c]) {
+    case CC_ALPHA: {
+        cur = scan->identifierEnd(cur + 1, end);
+        int keyword = lookupKeyword(start, cur - start);
+        return make(keyword ? keyword : ID, start);
+    }
+    case CC_DIGIT:
+        return lexNumber(start);
+    default:
+        break;
+    }
+
+    ++cur;
+    char n = cur < end ? *cur : '\0';
+    switch (c) {
+    case '+': return make(PLUS, start);
+    case '-': return make(MINUS, start);
+    case '*': return make(MULT, start);
+    case '/': return make(DIVIDE, start);
+    case '=': return make(EQ, start);
+    case '<':
+        if (n == '>') { ++cur; return make(NEQ, start); }
+        if (n == '=') { ++cur; return make(LE, start); }
+        return make(LT, start);
+    case '>':
+        if (n == '=') { ++cur; return make(GE, start); }
+        return make(GT, start);
+    case ':':
+        if (n == '=') { ++cur; return make(ASSIGN, start); }
+        return make(COLON, start);
+    case ';': return make(SEMICOLON, start);
+    case ',': return make(COMMA, start);
+    case '(': return make(LPAREN, start);
+    case ')': return make(RPAREN, start);
+    case '[': return make(LBRACKET, start);
+    case ']': return make(RBRACKET, start);
+    case '.':
+        if (isDigit(n)) {
+            cur = start;
+            return lexNumber(start);
+        }
+        if (n == '.') { ++cur; return make(DOTDOT, start); }
+        return make(DOT, start);
+    default:
+        return make(TOKEN_INVALID, start);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// yylex() dispatch between the flex scanner and a hand-written Lexer
+
+extern int flexLex(YYSTYPE* value, YYLTYPE* location, void* scanner);
+
+int yylex(YYSTYPE* value, YYLTYPE* location, ParseContext& context) {
+    if (!context.lexer) return flexLex(value, location, context.scanner);
+
+    for (;;) {
+        Token token = context.lexer->next();
+        location->first_line = location->last_line = static_cast<int>(token.line);
+        location->first_column = static_cast<int>(token.column);
+        location->last_column = static_cast<int>(token.column + token.length) - 1;
+
+        switch (token.kind) {
+        case TOKEN_INVALID:
+            yyerror(location, context, "Invalid character");
+            continue;
+        case ID:
+            value->name_id = globalInterner().intern(token.text, token.length);
+            break;
+        case INT_NUM:
+            value->int_val = token.intVal;
+            break;
+        case REAL_NUM:
+            value->real_val = token.realVal;
+            break;
+        default:
+            break;
+        }
+        return token.kind;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "simd_scan.h"
+#include "string_interner.h"
+
+// Token kind for input the flex rules would reject with "Invalid character".
+const int TOKEN_INVALID = -1;
+
+// A token is a slice of the source buffer plus its decoded value. `kind` is
+// one of the bison token numbers from minipascal.tab.h, 0 at end of input.
+struct Token {
+    int kind;
+    const char* text;
+    uint32_t length;
+    uint32_t line;
+    uint32_t column;
+    union {
+        int intVal;     // INT_NUM
+        double realVal; // REAL_NUM
+    };
+};
+
+// Hand-written scanner over an in-memory (usually memory-mapped) buffer.
+// Recognises exactly the token set of minipascal.l without copying the
+// source: identifiers are returned as slices and numbers are decoded in place.
+// Whitespace runs, block comments and identifiers are scanned with `kernel`.
+class Lexer {
+public:
+    Lexer(const char* source, size_t size, ScanKernel kernel = bestScanKernel());
+
+    Token next();
+
+    uint32_t line() const { return lineNo; }
+
+private:
+    void skipTrivia();
+    Token make(int kind, const char* start);
+    Token lexNumber(const char* start);
+    void advanceLines(const LineCount& lines);
+
+    const ScanKernels* scan;
+    const char* cur;
+    const char* end;
+    const char* lineStart;
+    uint32_t lineNo;
+};
+
+// Keyword token for an identifier-shaped slice, or 0 if it is a plain ID.
+int lookupKeyword(const char* text, size_t length);
+
+// yylex() reads from ParseContext::lexer when it is set and from
+// ParseContext::scanner otherwise. A flex scanner reads `input` and reports
+// invalid characters to `context`; null if flex could not set one up.
+struct ParseContext;
+void* flexScannerOpen(FILE* input, ParseContext* context);
+void flexScannerClose(void* scanner);
+
+#endif // LEXER_H
@@ -0,0 +1,462 @@
+#include "optimizer.h"
+#include "ast_rewrite.h"
+#include "register_allocation.h"
+#include "vectorization.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+
+namespace {
+
+struct Range {
+    int64_t low;
+    int64_t high;
+};
+
+// A variable stepped once per iteration by a top-level `v := v + step` of
+// the loop body, and written nowhere else in the loop.
+struct InductionVariable {
+    uint32_t variable;
+    int32_t step;
+    size_t position;        // of the increment among the body's statements
+    NodeId increment;
+};
+
+class LoopOptimizer {
+public:
+    LoopOptimizer(AstArena& ast, SemanticInfo& info, OptimizationReport& report)
+        : ast(ast), info(info), report(report), owner(NO_SUBPROGRAM), routineBody(NULL_NODE) {
+        findSharedGlobals(ast, info, shared);
+    }
+
+    void routine(NodeId body, uint32_t subprogram);
+
+private:
+    void block(NodeId compound);
+    void statement(NodeId node, const std::vector<NodeId>& before, bool topLevel);
+    void loop(NodeId node, const std::vector<NodeId>& before, bool topLevel);
+
+    void scan(NodeId node);
+    bool mayWrite(NodeId node, uint32_t variable);
+    bool changes(uint32_t variable) const;
+    bool invariant(NodeId node) const;
+
+    bool initialValue(uint32_t variable, const std::vector<NodeId>& before, bool topLevel, int64_t& value);
+    void proveBounds(NodeId condition, NodeId body, const InductionVariable& iv, int64_t initial);
+    void proveAccesses(NodeId node, uint32_t variable, Range range);
+
+    void hoist(NodeId node, std::vector<NodeId>& preheader);
+    void reduce(NodeId node, const std::vector<InductionVariable>& ivs, std::vector<NodeId>& preheader,
+                NodeId body);
+
+    AstArena& ast;
+    SemanticInfo& info;
+    OptimizationReport& report;
+    std::vector<bool> shared;
+    uint32_t owner;
+    NodeId routineBody;
+
+    // Facts about the loop being optimized
+    std::vector<uint32_t> writes;   // by variable
+    bool calls;
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> reduced;  // (iv, factor) -> temporary
+};
+
+void LoopOptimizer::routine(NodeId body, uint32_t subprogram) {
+    owner = subprogram;
+    routineBody = body;
+    statement(body, std::vector<NodeId>(), true);
+}
+
+void LoopOptimizer::block(NodeId compound) {
+    std::vector<NodeId> before;
+    for (NodeId child = ast.firstChild(compound); child; child = ast.nextSibling(child)) {
+        statement(child, before, compound == routineBody);
+        before.push_back(child);
+    }
+}
+
+// Inner loops go first, so what they hoist is in place for the outer one.
+void LoopOptimizer::statement(NodeId node, const std::vector<NodeId>& before, bool topLevel) {
+    if (!node) return;
+    switch (ast.node(node).type) {
+    case NODE_COMPOUND_STMT:
+        block(node);
+        break;
+    case NODE_IF:
+        statement(ast.child(node, 1), std::vector<NodeId>(), false);
+        statement(ast.child(node, 2), std::vector<NodeId>(), false);
+        break;
+    case NODE_WHILE:
+        statement(ast.child(node, 1), std::vector<NodeId>(), false);
+        loop(node, before, topLevel);
+        break;
+    default:
+        break;
+    }
+}
+
+void LoopOptimizer::scan(NodeId node) {
+    const ASTNode& n = ast.node(node);
+    switch (n.type) {
+    case NODE_ASSIGNMENT: {
+        NodeId target = ast.child(node, 0);
+        if (info.ref(target).kind == RefKind::VARIABLE) ++writes[info.ref(target).index];
+        break;
+    }
+    case NODE_PROCEDURE_CALL:
+    case NODE_FUNCTION_CALL:
+        calls = true;
+        break;
+    case NODE_VARIABLE:
+        if (info.ref(node).kind == RefKind::CALL) calls = true;
+        break;
+    default:
+        break;
+    }
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) scan(child);
+}
+
+bool LoopOptimizer::mayWrite(NodeId node, uint32_t variable) {
+    writes.assign(info.variables.size(), 0);
+    calls = false;
+    scan(node);
+    return changes(variable);
+}
+
+// A callee can change a global that some subprogram uses, never a frame
+// variable of the caller.
+bool LoopOptimizer::changes(uint32_t variable) const {
+    if (variable < writes.size() && writes[variable]) return true;
+    return calls && info.variables[variable].storage == Storage::GLOBAL && shared[variable];
+}
+
+// Expressions safe to evaluate once before the loop: no calls, no array
+// reads, no division that could trap, and no variable the loop changes.
+bool LoopOptimizer::invariant(NodeId node) const {
+    const ASTNode& n = ast.node(node);
+    switch (n.type) {
+    case NODE_INT_NUM:
+    case NODE_REAL_NUM:
+    case NODE_BOOLEAN:
+        return true;
+    case NODE_VARIABLE:
+        return info.ref(node).kind == RefKind::VARIABLE &&
+               info.variable(node).type.baseType != DataType::ARRAY && !changes(info.ref(node).index);
+    case NODE_UNARY_OP:
+        return invariant(ast.child(node, 0));
+    case NODE_BINARY_OP: {
+        NodeId right = ast.child(node, 1);
+        if (n.op == OP_DIV && (ast.node(right).type != NODE_INT_NUM || ast.node(right).intVal == 0)) return false;
+        return invariant(ast.child(node, 0)) && invariant(right);
+    }
+    default:
+        return false;
+    }
+}
+
+static bool hasVariable(const AstArena& ast, NodeId node) {
+    if (ast.node(node).type == NODE_VARIABLE) return true;
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        if (hasVariable(ast, child)) return true;
+    }
+    return false;
+}
+
+// The value a variable has on entry to a loop: the literal last assigned to
+// it by a statement before the loop, or zero at the start of a routine.
+bool LoopOptimizer::initialValue(uint32_t variable, const std::vector<NodeId>& before, bool topLevel,
+                                 int64_t& value) {
+    for (size_t i = before.size(); i-- > 0;) {
+        NodeId statement = before[i];
+        if (!mayWrite(statement, variable)) continue;
+        if (ast.node(statement).type != NODE_ASSIGNMENT) return false;
+        NodeId source = ast.child(statement, 1);
+        if (info.ref(ast.child(statement, 0)).kind != RefKind::VARIABLE ||
+            info.ref(ast.child(statement, 0)).index != variable || ast.node(source).type != NODE_INT_NUM)
+            return false;
+        value = ast.node(source).intVal;
+        return true;
+    }
+    if (!topLevel || info.variables[variable].isParameter) return false;
+    value = 0;
+    return true;
+}
+
+static bool fitsInt(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+void LoopOptimizer::proveAccesses(NodeId node, uint32_t variable, Range range) {
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        proveAccesses(child, variable, range);
+    }
+    if (ast.node(node).type != NODE_ARRAY_ACCESS || info.boundsProven[node]) return;
+
+    int64_t offset = 0;
+    if (!counterOffset(ast, info, ast.child(node, 0), variable, offset)) return;
+    // The offset is added with wrapping, so the sum has to stay an int
+    if (!fitsInt(range.low + offset) || !fitsInt(range.high + offset)) return;
+
+    const TypeInfo& type = info.variable(node).type;
+    if (range.low + offset >= type.arrayStart && range.high + offset <= type.arrayEnd) {
+        info.boundsProven[node] = true;
+        ++report.pass("bounds checks").rewritten;
+    }
+}
+
+// The loop condition caps the variable: `v <= n` or `v < n` for a rising
+// one, `v >= n` or `v > n` for a falling one, n a literal, possibly as one
+// operand of an `and`. Until its increment runs, an iteration sees v within
+// the cap and the initial value; after it, that range moved by one step.
+void LoopOptimizer::proveBounds(NodeId condition, NodeId body, const InductionVariable& iv, int64_t initial) {
+    std::vector<NodeId> conjuncts(1, condition);
+    for (size_t i = 0; i < conjuncts.size(); ++i) {
+        const ASTNode& n = ast.node(conjuncts[i]);
+        if (n.type == NODE_BINARY_OP && n.op == OP_AND) {
+            conjuncts.push_back(ast.child(conjuncts[i], 0));
+            conjuncts.push_back(ast.child(conjuncts[i], 1));
+        }
+    }
+
+    bool found = false;
+    int64_t limit = 0;
+    for (NodeId conjunct : conjuncts) {
+        const ASTNode& n = ast.node(conjunct);
+        if (n.type != NODE_BINARY_OP || n.op < OP_EQ || n.op > OP_GE) continue;
+        NodeId left = ast.child(conjunct, 0);
+        NodeId right = ast.child(conjunct, 1);
+        OpKind op = n.op;
+        if (ast.node(left).type == NODE_INT_NUM) {
+            std::swap(left, right);
+            switch (op) {
+            case OP_LT: op = OP_GT; break;
+            case OP_LE: op = OP_GE; break;
+            case OP_GT: op = OP_LT; break;
+            case OP_GE: op = OP_LE; break;
+            default: break;
+            }
+        }
+        if (ast.node(left).type != NODE_VARIABLE || info.ref(left).kind != RefKind::VARIABLE ||
+            info.ref(left).index != iv.variable || ast.node(right).type != NODE_INT_NUM)
+            continue;
+        int64_t n64 = ast.node(right).intVal;
+        if (iv.step > 0 && op == OP_LE) limit = n64;
+        else if (iv.step > 0 && op == OP_LT) limit = n64 - 1;
+        else if (iv.step < 0 && op == OP_GE) limit = n64;
+        else if (iv.step < 0 && op == OP_GT) limit = n64 + 1;
+        else continue;
+        found = true;
+        break;
+    }
+    if (!found) return;
+
+    Range inside = iv.step > 0 ? Range{ initial, limit } : Range{ limit, initial };
+    if (inside.low > inside.high) return;
+    Range stepped = { inside.low + iv.step, inside.high + iv.step };
+    if (!fitsInt(stepped.low) || !fitsInt(stepped.high)) return;
+    Range tested = { std::min(inside.low, stepped.low), std::max(inside.high, stepped.high) };
+
+    proveAccesses(condition, iv.variable, tested);
+    size_t position = 0;
+    for (NodeId statement = ast.firstChild(body); statement; statement = ast.nextSibling(statement), ++position) {
+        if (position < iv.position) proveAccesses(statement, iv.variable, inside);
+        else if (position > iv.position) proveAccesses(statement, iv.variable, stepped);
+    }
+}
+
+// Replaces each largest invariant expression worth an instruction or more
+// with a temporary computed before the loop. Temporaries that inner loops
+// set up move out too once their value is invariant here.
+void LoopOptimizer::hoist(NodeId node, std::vector<NodeId>& preheader) {
+    const ASTNode& n = ast.node(node);
+    if (n.type == NODE_ASSIGNMENT) {
+        NodeId target = ast.child(node, 0);
+        NodeId value = ast.child(node, 1);
+        if (ast.node(target).type == NODE_VARIABLE && info.ref(target).kind == RefKind::VARIABLE &&
+            info.variable(target).isTemporary &&
+            writes[info.ref(target).index] == 1 && invariant(value)) {
+            preheader.push_back(detachStatement(ast, info, node));
+            report.pass("loop-invariant motion").rewritten++;
+            return;
+        }
+        if (ast.node(target).type == NODE_ARRAY_ACCESS) hoist(ast.child(target, 0), preheader);
+        hoist(value, preheader);
+        return;
+    }
+    if ((n.type == NODE_BINARY_OP || n.type == NODE_UNARY_OP) && invariant(node) && hasVariable(ast, node) &&
+        (n.type == NODE_BINARY_OP || ast.node(ast.child(node, 0)).type == NODE_BINARY_OP)) {
+        uint32_t temporary = addTemporary(info, owner, info.typeOf(node), "inv");
+        NodeId expression = replaceWithVariable(ast, info, node, temporary);
+        preheader.push_back(newAssignment(ast, info, temporary, expression));
+        PassReport& pass = report.pass("loop-invariant motion");
+        ++pass.rewritten;
+        pass.added += 3;
+        return;
+    }
+    if (n.type == NODE_VARIABLE) return;
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) hoist(child, preheader);
+}
+
+// i * k with i an induction variable and k invariant becomes a temporary t
+// set to i * k before the loop and advanced by step * k right after i is.
+void LoopOptimizer::reduce(NodeId node, const std::vector<InductionVariable>& ivs, std::vector<NodeId>& preheader,
+                           NodeId body) {
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        reduce(child, ivs, preheader, body);
+    }
+    const ASTNode& n = ast.node(node);
+    if (n.type != NODE_BINARY_OP || n.op != OP_MUL) return;
+
+    NodeId left = ast.child(node, 0);
+    NodeId right = ast.child(node, 1);
+    const InductionVariable* iv = nullptr;
+    NodeId factor = NULL_NODE;
+    for (int side = 0; side < 2 && !iv; ++side) {
+        NodeId candidate = side ? right : left;
+        NodeId other = side ? left : right;
+        if (ast.node(candidate).type != NODE_VARIABLE || info.ref(candidate).kind != RefKind::VARIABLE) continue;
+        const ASTNode& o = ast.node(other);
+        bool usable = o.type == NODE_INT_NUM ||
+                      (o.type == NODE_VARIABLE && info.ref(other).kind == RefKind::VARIABLE && invariant(other));
+        if (!usable) continue;
+        for (const InductionVariable& each : ivs) {
+            if (each.variable == info.ref(candidate).index) iv = &each;
+        }
+        factor = other;
+    }
+    if (!iv) return;
+
+    // Literal factors are keyed by value, variables by index
+    bool literal = ast.node(factor).type == NODE_INT_NUM;
+    uint32_t key = literal ? static_cast<uint32_t>(ast.node(factor).intVal) : info.ref(factor).index;
+    std::pair<uint32_t, uint32_t> id(iv->variable * 2 + (literal ? 1 : 0), key);
+    auto found = reduced.find(id);
+    PassReport& pass = report.pass("strength reduction");
+    if (found == reduced.end()) {
+        uint32_t temporary = addTemporary(info, owner, DataType::INTEGER, "iv");
+        found = reduced.emplace(id, temporary).first;
+
+        NodeId start = newBinary(ast, info, OP_MUL, newVariable(ast, info, iv->variable),
+                                 literal ? newIntLiteral(ast, info, ast.node(factor).intVal)
+                                         : newVariable(ast, info, info.ref(factor).index),
+                                 DataType::INTEGER);
+        preheader.push_back(newAssignment(ast, info, temporary, start));
+
+        NodeId step;
+        OpKind op = OP_ADD;
+        if (literal) {
+            uint32_t product = static_cast<uint32_t>(iv->step) * static_cast<uint32_t>(ast.node(factor).intVal);
+            step = newIntLiteral(ast, info, static_cast<int32_t>(product));
+        }
+        else if (iv->step == 1 || iv->step == -1) {
+            step = newVariable(ast, info, info.ref(factor).index);
+            if (iv->step < 0) op = OP_SUB;
+        }
+        else {
+            uint32_t stride = addTemporary(info, owner, DataType::INTEGER, "iv");
+            preheader.push_back(newAssignment(ast, info, stride,
+                newBinary(ast, info, OP_MUL, newIntLiteral(ast, info, iv->step),
+                          newVariable(ast, info, info.ref(factor).index), DataType::INTEGER)));
+            step = newVariable(ast, info, stride);
+        }
+        NodeId update = newAssignment(ast, info, temporary,
+            newBinary(ast, info, op, newVariable(ast, info, temporary), step, DataType::INTEGER));
+        insertAfter(ast, body, iv->increment, update);
+        pass.added += 10;
+    }
+    pass.removed += subtreeSize(ast, node) - 1;
+    replaceWithVariable(ast, info, node, found->second);
+    ++pass.rewritten;
+}
+
+void LoopOptimizer::loop(NodeId node, const std::vector<NodeId>& before, bool topLevel) {
+    NodeId condition = ast.child(node, 0);
+    NodeId body = ast.child(node, 1);
+    if (ast.node(body).type != NODE_COMPOUND_STMT) prependStatements(ast, info, body, std::vector<NodeId>());
+    ++report.loops;
+
+    writes.assign(info.variables.size(), 0);
+    calls = false;
+    scan(condition);
+    scan(body);
+
+    std::vector<InductionVariable> ivs;
+    size_t position = 0;
+    for (NodeId statement = ast.firstChild(body); statement; statement = ast.nextSibling(statement), ++position) {
+        if (ast.node(statement).type != NODE_ASSIGNMENT) continue;
+        NodeId target = ast.child(statement, 0);
+        NodeId value = ast.child(statement, 1);
+        if (info.ref(target).kind != RefKind::VARIABLE) continue;
+        uint32_t variable = info.ref(target).index;
+        const ASTNode& v = ast.node(value);
+        if (info.variables[variable].type.baseType != DataType::INTEGER || writes[variable] != 1 ||
+            (calls && info.variables[variable].storage == Storage::GLOBAL && shared[variable]) ||
+            v.type != NODE_BINARY_OP || (v.op != OP_ADD && v.op != OP_SUB))
+            continue;
+
+        NodeId left = ast.child(value, 0);
+        NodeId right = ast.child(value, 1);
+        if (v.op == OP_ADD && ast.node(left).type == NODE_INT_NUM) std::swap(left, right);
+        if (ast.node(left).type != NODE_VARIABLE || info.ref(left).kind != RefKind::VARIABLE ||
+            info.ref(left).index != variable || ast.node(right).type != NODE_INT_NUM)
+            continue;
+        int32_t step = ast.node(right).intVal;
+        if (step == 0 || (v.op == OP_SUB && step == INT32_MIN)) continue;
+        ivs.push_back(InductionVariable{ variable, v.op == OP_SUB ? -step : step, position, statement });
+    }
+    report.inductionVariables += static_cast<uint32_t>(ivs.size());
+
+    for (const InductionVariable& iv : ivs) {
+        int64_t initial = 0;
+        std::vector<uint32_t> loopWrites = writes;
+        bool loopCalls = calls;
+        bool known = initialValue(iv.variable, before, topLevel, initial);
+        writes.swap(loopWrites);
+        calls = loopCalls;
+        if (known) proveBounds(condition, body, iv, initial);
+    }
+
+    std::vector<NodeId> preheader;
+    hoist(condition, preheader);
+    hoist(body, preheader);
+    // A product the backends compute a vector at a time is cheaper than the
+    // scalar temporary that would stop them
+    VectorLoop vector;
+    reduced.clear();
+    if (!matchVectorLoop(ast, info, node, vector)) {
+        reduce(condition, ivs, preheader, body);
+        reduce(body, ivs, preheader, body);
+    }
+
+    if (!preheader.empty()) prependStatements(ast, info, node, preheader);
+}
+
+}
+
+// Accesses with a literal index need no loop to be proven.
+static void proveLiteralIndexes(AstArena& ast, SemanticInfo& info, NodeId node, PassReport& report) {
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        proveLiteralIndexes(ast, info, child, report);
+    }
+    if (ast.node(node).type != NODE_ARRAY_ACCESS || info.boundsProven[node]) return;
+    NodeId index = ast.child(node, 0);
+    if (ast.node(index).type != NODE_INT_NUM) return;
+    const TypeInfo& type = info.variable(node).type;
+    int32_t value = ast.node(index).intVal;
+    if (value >= type.arrayStart && value <= type.arrayEnd) {
+        info.boundsProven[node] = true;
+        ++report.rewritten;
+    }
+}
+
+void optimizeLoops(AstArena& ast, NodeId root, SemanticInfo& info, OptimizationReport& report) {
+    proveLiteralIndexes(ast, info, root, report.pass("bounds checks"));
+
+    LoopOptimizer optimizer(ast, info, report);
+    for (uint32_t i = 0; i < info.subprograms.size(); ++i) {
+        optimizer.routine(ast.child(info.subprograms[i].node, 2), i);
+    }
+    optimizer.routine(ast.child(root, 2), NO_SUBPROGRAM);
+}
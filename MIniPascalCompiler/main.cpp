@@ -1,49 +1,364 @@
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
+#include <memory>
+#include <cstring>
+#include <string>
+#include <vector>
 #include "ast.h"
-#include "semantic_analyzer.h"
-#include "symbol_table.h"
-
-extern int yyparse();
-extern FILE *yyin;
-extern ASTNode* root;
+#include "ast_arena.h"
+#include "benchmark.h"
+#include "compilation.h"
+#include "compile_cache.h"
+#include "compile_session.h"
+#include "ir.h"
+#include "ir_interpreter.h"
+#include "optimizer.h"
+#include "register_allocation.h"
+#include "register_vm.h"
+#include "semantic_info.h"
+#include "stack_vm.h"
+#include "thread_pool.h"
+#include "tree_walker.h"
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <hello.pas.pas>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [--lexer=fast|flex] [--parser=rd|bison] [--max-errors=N] [--diagnostics=text|json] [--run] [--vm=stack|register|tree|ir] [--dump-bytecode] [--dump-ir] [--verify-ir] [--optimize] [--opt-report] [--eval-budget=N] [--inline-budget=N] [--emit-asm=FILE] [--no-regalloc] [--regalloc-stats] [--emit-cpp=FILE] [--no-vectorize] [--emit-ast=FILE] [--from-ast] [--jobs=N] [--cache=DIR] [--cache-size=MB] [--cache-stats] <hello.pas.pas>" << std::endl;
+        std::cerr << "       " << argv[0] << " [options] [--jobs=N] --batch <file list or directory>" << std::endl;
+        std::cerr << "       " << argv[0] << " [options] [--jobs=N] --watch <file>" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-lex [file] [iterations]" << std::endl;
+        std::cerr << "       " << argv[0] << " --check-lex [file]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-parse [statements]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-parsers [statements]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-errors [statements] [every]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-symtab [depth] [subprograms]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-vm [rounds]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-native [directory]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-regalloc [directory] [rounds]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-vectorize [directory] [rounds]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-inline [directory] [rounds]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-parallel [subprograms] [max threads]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-incremental [subprograms]" << std::endl;
+        std::cerr << "       " << argv[0] << " --check-ast [file]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-ast-load [subprograms]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-emit [subprograms] [max threads]" << std::endl;
+        std::cerr << "       " << argv[0] << " --check-diagnostics [subprograms]" << std::endl;
+        std::cerr << "       " << argv[0] << " --check-cache" << std::endl;
+        std::cerr << "       " << argv[0] << " --check-opt" << std::endl;
         return 1;
     }
 
-    // Open input file
-    yyin = fopen(argv[1], "r");
-    if (!yyin) {
-        std::cerr << "Error: Cannot open file " << argv[1] << std::endl;
-        return 1;
+    if (std::strcmp(argv[1], "--bench-parse") == 0) {
+        int statements = argc > 2 ? std::atoi(argv[2]) : 1000000;
+        return runParseBenchmark(statements);
+    }
+    if (std::strcmp(argv[1], "--bench-parsers") == 0) {
+        int statements = argc > 2 ? std::atoi(argv[2]) : 1000000;
+        return runParserComparisonBenchmark(statements);
+    }
+    if (std::strcmp(argv[1], "--bench-errors") == 0) {
+        int statements = argc > 2 ? std::atoi(argv[2]) : 200000;
+        int every = argc > 3 ? std::atoi(argv[3]) : 10;
+        return runErrorRecoveryBenchmark(statements, every);
+    }
+    if (std::strcmp(argv[1], "--bench-symtab") == 0) {
+        int depth = argc > 2 ? std::atoi(argv[2]) : 200;
+        int subprograms = argc > 3 ? std::atoi(argv[3]) : 100000;
+        return runSymbolTableBenchmark(depth, subprograms);
+    }
+
+    if (std::strcmp(argv[1], "--bench-vm") == 0) {
+        int rounds = argc > 2 ? std::atoi(argv[2]) : 1;
+        return runVMBenchmark(rounds);
+    }
+    if (std::strcmp(argv[1], "--bench-native") == 0) {
+        return runNativeBenchmark(argc > 2 ? argv[2] : nullptr);
+    }
+    if (std::strcmp(argv[1], "--bench-regalloc") == 0) {
+        int rounds = argc > 3 ? std::atoi(argv[3]) : 3;
+        return runRegisterAllocationBenchmark(argc > 2 ? argv[2] : nullptr, rounds);
+    }
+    if (std::strcmp(argv[1], "--bench-vectorize") == 0) {
+        int rounds = argc > 3 ? std::atoi(argv[3]) : 3;
+        return runVectorizationBenchmark(argc > 2 ? argv[2] : nullptr, rounds);
+    }
+    if (std::strcmp(argv[1], "--bench-inline") == 0) {
+        int rounds = argc > 3 ? std::atoi(argv[3]) : 3;
+        return runInliningBenchmark(argc > 2 ? argv[2] : nullptr, rounds);
+    }
+    if (std::strcmp(argv[1], "--bench-parallel") == 0) {
+        int subprograms = argc > 2 ? std::atoi(argv[2]) : 5000;
+        int threads = argc > 3 ? std::atoi(argv[3]) : 0;
+        return runParallelCompileBenchmark(subprograms, threads);
+    }
+    if (std::strcmp(argv[1], "--bench-incremental") == 0) {
+        return runIncrementalBenchmark(argc > 2 ? std::atoi(argv[2]) : 2000);
+    }
+    if (std::strcmp(argv[1], "--check-ast") == 0) {
+        return runAstFileTest(argc > 2 ? argv[2] : nullptr);
+    }
+    if (std::strcmp(argv[1], "--bench-ast-load") == 0) {
+        return runAstLoadBenchmark(argc > 2 ? std::atoi(argv[2]) : 5000);
+    }
+    if (std::strcmp(argv[1], "--bench-emit") == 0) {
+        int subprograms = argc > 2 ? std::atoi(argv[2]) : 20000;
+        int threads = argc > 3 ? std::atoi(argv[3]) : 0;
+        return runEmitterBenchmark(subprograms, threads);
+    }
+    if (std::strcmp(argv[1], "--check-diagnostics") == 0) {
+        return runDiagnosticsTest(argc > 2 ? std::atoi(argv[2]) : 2000);
+    }
+    if (std::strcmp(argv[1], "--check-cache") == 0) {
+        return runCacheTest();
+    }
+    if (std::strcmp(argv[1], "--check-opt") == 0) {
+        return runOptimizerTest();
+    }
+
+    if (std::strcmp(argv[1], "--bench-lex") == 0) {
+        const char* path = argc > 2 ? argv[2] : nullptr;
+        int iterations = argc > 3 ? std::atoi(argv[3]) : 5;
+        return runLexerBenchmark(path, iterations);
+    }
+    if (std::strcmp(argv[1], "--check-lex") == 0) {
+        return runLexerDifferentialTest(argc > 2 ? argv[2] : nullptr);
     }
 
-    // Parse the input file
-    std::cout << "Parsing " << argv[1] << "..." << std::endl;
-    if (yyparse() != 0) {
-        std::cerr << "Error: Parsing failed" << std::endl;
-        fclose(yyin);
+    // Front-end selection: flex + bison by default, the hand-written lexer
+    // under bison, or the recursive-descent parser (which implies it).
+    CompileOptions options;
+    bool run = false;
+    enum { STACK_VM, REGISTER_VM, TREE_WALKER, IR_INTERPRETER } vmKind = STACK_VM;
+    bool dumpBytecode = false;
+    bool dumpIrText = false;
+    bool verifyIrOnly = false;
+    const char* asmPath = nullptr;
+    const char* cppPath = nullptr;
+    const char* astPath = nullptr;
+    bool fromAst = false;
+    bool allocationStats = false;
+    int jobs = -1;                  // 0: one per hardware thread
+    bool batch = false;
+    bool watch = false;
+    const char* cacheDir = nullptr;
+    uint64_t cacheMegabytes = 512;
+    bool cacheStats = false;
+    bool optimizationReport = false;
+    int arg = 1;
+    for (; arg < argc; ++arg) {
+        if (std::strcmp(argv[arg], "--lexer=fast") == 0) options.fastLexer = true;
+        else if (std::strcmp(argv[arg], "--lexer=flex") == 0) options.fastLexer = false;
+        else if (std::strcmp(argv[arg], "--parser=rd") == 0) options.descentParser = true;
+        else if (std::strcmp(argv[arg], "--parser=bison") == 0) options.descentParser = false;
+        else if (std::strncmp(argv[arg], "--max-errors=", 13) == 0) options.maxErrors = std::atoi(argv[arg] + 13);
+        else if (std::strcmp(argv[arg], "--diagnostics=json") == 0) options.jsonDiagnostics = true;
+        else if (std::strcmp(argv[arg], "--diagnostics=text") == 0) options.jsonDiagnostics = false;
+        else if (std::strcmp(argv[arg], "--run") == 0) run = true;
+        else if (std::strcmp(argv[arg], "--vm=stack") == 0) { run = true; vmKind = STACK_VM; }
+        else if (std::strcmp(argv[arg], "--vm=register") == 0) { run = true; vmKind = REGISTER_VM; }
+        else if (std::strcmp(argv[arg], "--vm=tree") == 0) { run = true; vmKind = TREE_WALKER; }
+        else if (std::strcmp(argv[arg], "--vm=ir") == 0) { run = true; vmKind = IR_INTERPRETER; }
+        else if (std::strcmp(argv[arg], "--dump-bytecode") == 0) dumpBytecode = true;
+        else if (std::strcmp(argv[arg], "--dump-ir") == 0) dumpIrText = true;
+        else if (std::strcmp(argv[arg], "--verify-ir") == 0) verifyIrOnly = true;
+        else if (std::strncmp(argv[arg], "--emit-asm=", 11) == 0) asmPath = argv[arg] + 11;
+        else if (std::strncmp(argv[arg], "--emit-cpp=", 11) == 0) cppPath = argv[arg] + 11;
+        else if (std::strcmp(argv[arg], "--no-regalloc") == 0) options.registerAllocation = false;
+        else if (std::strcmp(argv[arg], "--regalloc-stats") == 0) allocationStats = true;
+        else if (std::strcmp(argv[arg], "--no-vectorize") == 0) options.vectorize = false;
+        else if (std::strncmp(argv[arg], "--emit-ast=", 11) == 0) astPath = argv[arg] + 11;
+        else if (std::strcmp(argv[arg], "--from-ast") == 0) fromAst = true;
+        else if (std::strncmp(argv[arg], "--jobs=", 7) == 0) jobs = std::atoi(argv[arg] + 7);
+        else if (std::strcmp(argv[arg], "--batch") == 0) batch = true;
+        else if (std::strcmp(argv[arg], "--watch") == 0) watch = true;
+        else if (std::strncmp(argv[arg], "--cache=", 8) == 0) cacheDir = argv[arg] + 8;
+        else if (std::strncmp(argv[arg], "--cache-size=", 13) == 0) cacheMegabytes = std::strtoull(argv[arg] + 13, nullptr, 10);
+        else if (std::strcmp(argv[arg], "--cache-stats") == 0) cacheStats = true;
+        else if (std::strcmp(argv[arg], "--optimize") == 0) options.optimize = true;
+        else if (std::strcmp(argv[arg], "--opt-report") == 0) options.optimize = optimizationReport = true;
+        else if (std::strncmp(argv[arg], "--eval-budget=", 14) == 0) options.optimization.evaluationBudget = std::strtoull(argv[arg] + 14, nullptr, 10);
+        else if (std::strncmp(argv[arg], "--inline-budget=", 16) == 0) options.optimization.inlineBudget = static_cast<uint32_t>(std::strtoul(argv[arg] + 16, nullptr, 10));
+        else break;
+    }
+    if (options.descentParser) options.fastLexer = true;
+    if (arg >= argc) {
+        std::cerr << "Error: No input file" << std::endl;
         return 1;
     }
-    fclose(yyin);
+    const char* path = argv[arg];
+
+    // Rebuilt on every save, reusing what the edit did not touch
+    if (watch) {
+        return watchFile(path, options, jobs < 0 ? 1 : static_cast<unsigned>(jobs), asmPath, cppPath, std::cout);
+    }
+
+    // Compiled outputs are looked up by content first
+    std::unique_ptr<CompileCache> cache;
+    if (cacheDir) cache.reset(new CompileCache(cacheDir, cacheMegabytes * 1024 * 1024));
+
+    // Many files in one process, one file per worker at a time; the
+    // output paths name directories
+    if (batch) {
+        return compileBatch(path, options, jobs < 0 ? 0 : static_cast<unsigned>(jobs), asmPath, cppPath, cache.get(),
+                            std::cout);
+    }
+
+    // A run that only writes native code can come straight from the cache
+    if (cache && (asmPath || cppPath) && !astPath && !fromAst && !run && !dumpBytecode && !dumpIrText && !verifyIrOnly &&
+        !optimizationReport && !allocationStats) {
+        ThreadPool pool(jobs < 0 ? 1 : static_cast<unsigned>(jobs));
+        bool hit;
+        bool ok = compileCached(cache.get(), path, options, asmPath, cppPath, std::cerr, hit, &pool);
+        if (ok) {
+            if (asmPath) std::cout << "Assembly written to " << asmPath << (hit ? " (cached)" : "") << std::endl;
+            if (cppPath) std::cout << "C++ written to " << cppPath << (hit ? " (cached)" : "") << std::endl;
+        }
+        if (cacheStats) cache->printStats(std::cout);
+        return ok ? 0 : 1;
+    }
+
+    // Parse the input file, or pick up a tree another run wrote with
+    // --emit-ast, already analyzed
+    Compilation compilation(options, std::cerr);
+    if (fromAst) {
+        std::cout << "Loading " << path << "..." << std::endl;
+        if (!compilation.load(path)) return 1;
+    }
+    else {
+        std::cout << "Parsing " << path << "..." << std::endl;
+        if (!compilation.parse(path)) return 1;
+    }
+    NodeId root = compilation.root;
 
     // Print AST if parsing succeeded
     if (root) {
-        std::cout << "\nAbstract Syntax Tree (AST):" << std::endl;
-        printAST(root);
+        AstArena& ast = compilation.arena;
+        bool execute = run || dumpBytecode;
+        bool emit = asmPath || cppPath || astPath || dumpIrText || verifyIrOnly;
+        if (!execute && !emit) {
+            std::cout << "\nAbstract Syntax Tree (AST):" << std::endl;
+            printAST(ast, root);
+        }
         
         // Semantic analysis
-        std::cout << "\nPerforming semantic analysis..." << std::endl;
-        SemanticAnalyzer semanticAnalyzer;
-        if (!semanticAnalyzer.analyze(root)) {
-            std::cerr << "Error: Semantic analysis failed" << std::endl;
-            freeAST(root);
-            return 1;
-        }
-        std::cout << "Semantic analysis completed successfully!" << std::endl;
+        // Subprogram bodies are checked and emitted as C++ on `jobs` threads
+        ThreadPool pool(jobs < 0 ? 1 : static_cast<unsigned>(jobs));
+        SemanticInfo& info = compilation.info;
+        if (!fromAst) {
+            std::cout << "\nPerforming semantic analysis..." << std::endl;
+            if (!compilation.analyze(execute || emit || options.optimize, &pool)) {
+                freeAST(root);
+                return 1;
+            }
+            std::cout << "Semantic analysis completed successfully!" << std::endl;
+        }
+
+        // Rewrite the tree before any backend sees it
+        if (options.optimize) {
+            OptimizationReport report;
+            compilation.optimize(report);
+            if (optimizationReport) printOptimizationReport(report, std::cout);
+            if (!execute && !emit) {
+                std::cout << "\nOptimized AST:" << std::endl;
+                printAST(ast, root);
+            }
+        }
+
+        // The analyzed, optimized tree for a later run to start from
+        if (astPath) {
+            if (!compilation.save(astPath)) {
+                freeAST(root);
+                return 1;
+            }
+            std::cout << "Tree written to " << astPath << std::endl;
+        }
+
+        // Native code: assembly for as + ld, or C++
+        NativeStats native;
+        emitNative(options, ast, root, info, asmPath, cppPath, &pool, &native);
+        if (asmPath) {
+            std::cout << "Assembly written to " << asmPath << std::endl;
+            if (native.asmVectorizedLoops) std::cout << "Vectorized loops: " << native.asmVectorizedLoops << std::endl;
+            if (allocationStats) printAllocationStats(native.allocation, std::cout);
+        }
+        if (cppPath) {
+            std::cout << "C++ written to " << cppPath << std::endl;
+            if (native.cppVectorizedLoops) std::cout << "Vectorized loops: " << native.cppVectorizedLoops << std::endl;
+        }
+
+        // SSA IR: printed and/or checked on request, and run by --vm=ir
+        IrModule ir;
+        if (dumpIrText || verifyIrOnly || (run && vmKind == IR_INTERPRETER)) {
+            buildIr(ast, root, info, ir);
+            if (dumpIrText) dumpIr(ir, std::cout);
+            if (verifyIrOnly) {
+                if (!verifyIr(ir, std::cerr)) {
+                    std::cerr << "Error: IR verification failed" << std::endl;
+                    freeAST(root);
+                    return 1;
+                }
+                std::cout << "IR verified" << std::endl;
+            }
+        }
+
+        // Lower to bytecode and run it, reporting the final globals
+        if (execute) {
+            bool ok = true;
+            std::string error;
+            uint64_t dispatches = 0;
+            std::vector<Value> globals;
+            if (vmKind == REGISTER_VM) {
+                RegisterProgram program;
+                compileRegisterBytecode(ast, root, info, program);
+                if (dumpBytecode) disassemble(program, std::cout);
+                if (run) {
+                    RegisterVM vm(program);
+                    ok = vm.run();
+                    error = vm.error();
+                    dispatches = vm.dispatchCount();
+                    globals.assign(vm.globals(), vm.globals() + info.globalCells);
+                }
+            }
+            else if (vmKind == IR_INTERPRETER) {
+                if (run) {
+                    IrInterpreter interpreter(ir);
+                    ok = interpreter.run();
+                    error = interpreter.error();
+                    dispatches = interpreter.dispatchCount();
+                    globals.assign(interpreter.globals(), interpreter.globals() + info.globalCells);
+                }
+            }
+            else if (vmKind == TREE_WALKER) {
+                if (run) {
+                    TreeWalker walker(ast, root, info);
+                    ok = walker.run();
+                    error = walker.error();
+                    dispatches = walker.dispatchCount();
+                    globals.assign(walker.globals(), walker.globals() + info.globalCells);
+                }
+            }
+            else {
+                BytecodeProgram program;
+                compileBytecode(ast, root, info, program);
+                if (dumpBytecode) disassemble(program, std::cout);
+                if (run) {
+                    StackVM vm(program);
+                    ok = vm.run();
+                    error = vm.error();
+                    dispatches = vm.dispatchCount();
+                    globals.assign(vm.globals(), vm.globals() + info.globalCells);
+                }
+            }
+            if (!ok) {
+                std::cerr << "Runtime error: " << error << std::endl;
+                freeAST(root);
+                return 1;
+            }
+            if (run) {
+                std::cout << "Program finished (" << dispatches << " dispatches)" << std::endl;
+                printGlobals(info, globals.data(), std::cout);
+            }
+        }
         
         // Free AST memory
         freeAST(root);
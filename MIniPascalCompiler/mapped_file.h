@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file. The file is memory-mapped where the OS
+// allows it; the bytes are not NUL-terminated, so always use size(). A
+// file opened `writable` is mapped copy-on-write: the bytes can be changed
+// in memory, but the changes never reach the file.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path, bool writable = false);
+    void close();
+
+    const char* data() const { return bytes; }
+    char* writableData() { return writable ? bytes : nullptr; }
+    size_t size() const { return length; }
+    bool isOpen() const { return opened; }
+
+private:
+    char* bytes;
+    size_t length;
+    bool opened;
+    bool writable;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+#endif // MAPPED_FILE_H
@@ -1,36 +1,71 @@
+%code requires {
+#include "ast.h"
+
+class ErrorHandler;
+class Lexer;
+
+// Everything one parse works on, so parses on different threads share
+// nothing: where tokens come from (a hand-written Lexer, or else the flex
+// scanner made by flexScannerOpen), where syntax errors go, and the root
+// of the finished tree.
+struct ParseContext {
+    void* scanner;
+    Lexer* lexer;
+    ErrorHandler* errors;
+    NodeId root;
+};
+}
+
+%code provides {
+int yylex(YYSTYPE* value, YYLTYPE* location, ParseContext& context);
+void yyerror(YYLTYPE* location, ParseContext& context, const char* message);
+}
+
 %{
 #include <stdio.h>
 #include <stdlib.h>
 #include "ast.h"
-#include "symbol_table.h"
-#include "semantic_analyzer.h"
+#include "ast_arena.h"
+#include "error_handler.h"
+#include "lexer.h"
+%}
 
-extern int yylex();
-extern int yyparse();
-extern FILE *yyin;
-extern char* yytext;
-extern int yylineno;
+%code {
+// Records that `node` starts where `at` does.
+static NodeId located(NodeId node, const YYLTYPE& at) {
+    return locateNode(node, at.first_line, at.first_column);
+}
 
-SymbolTable symbolTable;
-void yyerror(const char *s);
-%}
+static NodeId locatedLastChild(NodeId list, const YYLTYPE& at) {
+    located(getAstArena()->node(list).lastChild, at);
+    return list;
+}
+}
+
+%define api.pure full
+%locations
+%param {ParseContext& context}
+%define parse.error verbose
 
 %union {
     int int_val;
     double real_val;
-    char* string_val;
-    ASTNode* node;
+    NameId name_id;
+    NodeId node;
 }
 
-%token PROGRAM VAR INTEGER REAL BOOLEAN FUNCTION PROCEDURE
-%token BEGIN END IF THEN ELSE WHILE DO ARRAY OF
-%token DIV NOT OR AND TRUE FALSE
-%token PLUS MINUS MULT DIVIDE
-%token EQ NEQ LT LE GT GE ASSIGN
-%token COLON SEMICOLON COMMA LPAREN RPAREN LBRACKET RBRACKET DOT DOTDOT
-%token <int_val> INT_NUM
-%token <real_val> REAL_NUM
-%token <string_val> ID
+%token PROGRAM "program" VAR "var" INTEGER "integer" REAL "real" BOOLEAN "boolean"
+%token FUNCTION "function" PROCEDURE "procedure"
+%token BEGIN "begin" END "end" IF "if" THEN "then" ELSE "else" WHILE "while" DO "do"
+%token ARRAY "array" OF "of"
+%token DIV "div" NOT "not" OR "or" AND "and" TRUE "true" FALSE "false"
+%token PLUS "+" MINUS "-" MULT "*" DIVIDE "/"
+%token EQ "=" NEQ "<>" LT "<" LE "<=" GT ">" GE ">=" ASSIGN ":="
+%token COLON ":" SEMICOLON ";" COMMA "," LPAREN "(" RPAREN ")"
+%token LBRACKET "[" RBRACKET "]" DOT "." DOTDOT ".."
+%token <int_val> INT_NUM "integer constant"
+%token <real_val> REAL_NUM "real constant"
+%token <name_id> ID "identifier"
 
 %type <node> program declarations subprogram_declarations subprogram_declaration
 %type <node> compound_statement statement expression variable
@@ -50,12 +85,14 @@ void yyerror(const char *s);
 %%
 
 program: PROGRAM ID SEMICOLON declarations subprogram_declarations compound_statement DOT
-        { $$ = createProgramNode($2, $4, $5, $6); }
+        { $$ = located(createProgramNode($2, $4, $5, $6), @1); context.root = $$; }
         ;
 
-declarations: /* empty */
+declarations: /* empty */ { $$ = createDeclarationsNode(); }
             | declarations VAR identifier_list COLON type SEMICOLON
-            { $$ = createDeclarationsNode($1, $3, $5); }
+            { $$ = appendDeclarationsNode($1, $3, $5); }
+            | declarations VAR error SEMICOLON
+            { if (context.errors->too_many_errors()) YYABORT; $$ = $1; yyerrok; }
             ;
 
 type: standard_type
@@ -63,27 +100,29 @@ type: standard_type
     { $$ = createArrayTypeNode($3, $5, $8); }
     ;
 
-standard_type: INTEGER { $$ = createTypeNode("integer"); }
-             | REAL { $$ = createTypeNode("real"); }
-             | BOOLEAN { $$ = createTypeNode("boolean"); }
+standard_type: INTEGER { $$ = createTypeNode(DataType::INTEGER); }
+             | REAL { $$ = createTypeNode(DataType::REAL); }
+             | BOOLEAN { $$ = createTypeNode(DataType::BOOLEAN); }
              ;
 
-subprogram_declarations: /* empty */
+subprogram_declarations: /* empty */ { $$ = createSubprogramDeclarationsNode(); }
                       | subprogram_declarations subprogram_declaration SEMICOLON
-                      { $$ = createSubprogramDeclarationsNode($1, $2); }
+                      { $$ = appendSubprogramDeclarationsNode($1, $2); }
+                      | subprogram_declarations error SEMICOLON
+                      { if (context.errors->too_many_errors()) YYABORT; $$ = $1; yyerrok; }
                       ;
 
-subprogram_declaration: subprogram_head compound_statement
-                      { $$ = createSubprogramNode($1, $2); }
+subprogram_declaration: subprogram_head declarations compound_statement
+                      { $$ = located(createSubprogramNode($1, $2, $3), @1); }
                       ;
 
 subprogram_head: FUNCTION ID arguments COLON standard_type SEMICOLON
-               { $$ = createFunctionHeadNode($2, $3, $5); }
+               { $$ = located(createFunctionHeadNode($2, $3, $5), @2); }
                | PROCEDURE ID arguments SEMICOLON
-               { $$ = createProcedureHeadNode($2, $3); }
+               { $$ = located(createProcedureHeadNode($2, $3), @2); }
                ;
 
-arguments: /* empty */
+arguments: /* empty */ { $$ = NULL_NODE; }
          | LPAREN parameter_list RPAREN
          { $$ = $2; }
          ;
@@ -94,83 +133,86 @@ parameter_list: identifier_list COLON type
               { $$ = appendParameterListNode($1, $3, $5); }
               ;
 
-identifier_list: ID { $$ = createIdentifierListNode($1); }
+identifier_list: ID { $$ = locatedLastChild(createIdentifierListNode($1), @1); }
                | identifier_list COMMA ID
-               { $$ = appendIdentifierListNode($1, $3); }
+               { $$ = locatedLastChild(appendIdentifierListNode($1, $3), @3); }
                ;
 
 compound_statement: BEGIN optional_statements END
-                  { $$ = createCompoundStatementNode($2); }
+                  { $$ = located(createCompoundStatementNode($2), @1); }
                   ;
 
-optional_statements: /* empty */
+optional_statements: /* empty */ { $$ = NULL_NODE; }
                   | statement_list
                   { $$ = $1; }
                   ;
 
-statement_list: statement
+statement_list: statement { $$ = createStatementListNode($1); }
               | statement_list SEMICOLON statement
               { $$ = appendStatementNode($1, $3); }
               ;
 
 statement: variable ASSIGN expression
-         { $$ = createAssignmentNode($1, $3); }
+         { $$ = located(createAssignmentNode($1, $3), @1); }
          | procedure_statement
          | compound_statement
          | IF expression THEN statement
-         { $$ = createIfNode($2, $4, NULL); }
+         { $$ = located(createIfNode($2, $4, NULL_NODE), @1); }
          | IF expression THEN statement ELSE statement
-         { $$ = createIfNode($2, $4, $6); }
+         { $$ = located(createIfNode($2, $4, $6), @1); }
          | WHILE expression DO statement
-         { $$ = createWhileNode($2, $4); }
+         { $$ = located(createWhileNode($2, $4), @1); }
+         | error
+         { if (context.errors->too_many_errors()) YYABORT; $$ = NULL_NODE; }
          ;
 
-variable: ID { $$ = createVariableNode($1, NULL); }
+variable: ID { $$ = located(createVariableNode($1), @1); }
         | ID LBRACKET expression RBRACKET
-        { $$ = createArrayAccessNode($1, $3); }
+        { $$ = located(createArrayAccessNode($1, $3), @1); }
         ;
 
 procedure_statement: ID
-                   { $$ = createProcedureCallNode($1, NULL); }
+                   { $$ = located(createProcedureCallNode($1, NULL_NODE), @1); }
                    | ID LPAREN expression_list RPAREN
-                   { $$ = createProcedureCallNode($1, $3); }
+                   { $$ = located(createProcedureCallNode($1, $3), @1); }
                    ;
 
-expression_list: expression
+expression_list: expression { $$ = createExpressionListNode($1); }
                | expression_list COMMA expression
                { $$ = appendExpressionListNode($1, $3); }
                ;
 
-expression: INT_NUM { $$ = createIntNumNode($1); }
-          | REAL_NUM { $$ = createRealNumNode($1); }
-          | TRUE { $$ = createBooleanNode(1); }
-          | FALSE { $$ = createBooleanNode(0); }
-          | ID { $$ = createVariableNode($1, NULL); }
+expression: INT_NUM { $$ = located(createIntNumNode($1), @1); }
+          | REAL_NUM { $$ = located(createRealNumNode($1), @1); }
+          | TRUE { $$ = located(createBooleanNode(1), @1); }
+          | FALSE { $$ = located(createBooleanNode(0), @1); }
+          | ID { $$ = located(createVariableNode($1), @1); }
+          | ID LBRACKET expression RBRACKET
+          { $$ = located(createArrayAccessNode($1, $3), @1); }
           | ID LPAREN expression_list RPAREN
-          { $$ = createFunctionCallNode($1, $3); }
+          { $$ = located(createFunctionCallNode($1, $3), @1); }
           | LPAREN expression RPAREN { $$ = $2; }
-          | expression PLUS expression { $$ = createBinaryOpNode($1, $3, "+"); }
-          | expression MINUS expression { $$ = createBinaryOpNode($1, $3, "-"); }
-          | expression MULT expression { $$ = createBinaryOpNode($1, $3, "*"); }
-          | expression DIVIDE expression { $$ = createBinaryOpNode($1, $3, "/"); }
-          | expression DIV expression { $$ = createBinaryOpNode($1, $3, "div"); }
-          | expression EQ expression { $$ = createBinaryOpNode($1, $3, "="); }
-          | expression NEQ expression { $$ = createBinaryOpNode($1, $3, "<>"); }
-          | expression LT expression { $$ = createBinaryOpNode($1, $3, "<"); }
-          | expression LE expression { $$ = createBinaryOpNode($1, $3, "<="); }
-          | expression GT expression { $$ = createBinaryOpNode($1, $3, ">"); }
-          | expression GE expression { $$ = createBinaryOpNode($1, $3, ">="); }
-          | expression AND expression { $$ = createBinaryOpNode($1, $3, "and"); }
-          | expression OR expression { $$ = createBinaryOpNode($1, $3, "or"); }
-          | MINUS expression %prec UMINUS { $$ = createUnaryOpNode($2, "-"); }
-          | NOT expression { $$ = createUnaryOpNode($2, "not"); }
+          | expression PLUS expression { $$ = located(createBinaryOpNode($1, $3, OP_ADD), @2); }
+          | expression MINUS expression { $$ = located(createBinaryOpNode($1, $3, OP_SUB), @2); }
+          | expression MULT expression { $$ = located(createBinaryOpNode($1, $3, OP_MUL), @2); }
+          | expression DIVIDE expression { $$ = located(createBinaryOpNode($1, $3, OP_DIVIDE), @2); }
+          | expression DIV expression { $$ = located(createBinaryOpNode($1, $3, OP_DIV), @2); }
+          | expression EQ expression { $$ = located(createBinaryOpNode($1, $3, OP_EQ), @2); }
+          | expression NEQ expression { $$ = located(createBinaryOpNode($1, $3, OP_NEQ), @2); }
+          | expression LT expression { $$ = located(createBinaryOpNode($1, $3, OP_LT), @2); }
+          | expression LE expression { $$ = located(createBinaryOpNode($1, $3, OP_LE), @2); }
+          | expression GT expression { $$ = located(createBinaryOpNode($1, $3, OP_GT), @2); }
+          | expression GE expression { $$ = located(createBinaryOpNode($1, $3, OP_GE), @2); }
+          | expression AND expression { $$ = located(createBinaryOpNode($1, $3, OP_AND), @2); }
+          | expression OR expression { $$ = located(createBinaryOpNode($1, $3, OP_OR), @2); }
+          | MINUS expression %prec UMINUS { $$ = located(createUnaryOpNode($2, OP_NEG), @1); }
+          | NOT expression { $$ = located(createUnaryOpNode($2, OP_NOT), @1); }
           ;
 
 %%
 
-void yyerror(const char *s) {
-    fprintf(stderr, "Error at line %d: %s\n", yylineno, s);
-    exit(1);
+void yyerror(YYLTYPE* location, ParseContext& context, const char* message) {
+    context.errors->add_error(message, location->first_line, location->first_column);
 }
 
 int main(int argc, char *argv[]) {
@@ -179,14 +221,19 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    yyin = fopen(argv[1], "r");
-    if (!yyin) {
+    FILE* input = fopen(argv[1], "r");
+    if (!input) {
         perror("Error opening file");
         return 1;
     }
     
-    yyparse();
-    fclose(yyin);
+    ErrorHandler errors;
+    ParseContext context = { nullptr, nullptr, &errors, NULL_NODE };
+    context.scanner = flexScannerOpen(input, &context);
+    int result = yyparse(context);
+    flexScannerClose(context.scanner);
+    fclose(input);
+    errors.print_errors();
     
-    return 0;
+    return (result != 0 || errors.has_errors()) ? 1 : 0;
 }
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include "optimizer.h"
+#include "ast_rewrite.h"
+#include "ir.h"
+
+#include <cmath>
+#include <cstring>
+
+PassReport& OptimizationReport::pass(const char* name) {
+    for (PassReport& report : passes) {
+        if (std::strcmp(report.name, name) == 0) return report;
+    }
+    passes.push_back(PassReport());
+    passes.back().name = name;
+    return passes.back();
+}
+
+static IrOp irOpFor(OpKind op, bool real) {
+    switch (op) {
+    case OP_ADD: return real ? IR_FADD : IR_ADD;
+    case OP_SUB: return real ? IR_FSUB : IR_SUB;
+    case OP_MUL: return real ? IR_FMUL : IR_MUL;
+    case OP_DIVIDE: return IR_FDIV;
+    case OP_DIV: return IR_DIV;
+    case OP_EQ: return real ? IR_FEQ : IR_EQ;
+    case OP_NEQ: return real ? IR_FNE : IR_NE;
+    case OP_LT: return real ? IR_FLT : IR_LT;
+    case OP_LE: return real ? IR_FLE : IR_LE;
+    case OP_GT: return real ? IR_FGT : IR_GT;
+    case OP_GE: return real ? IR_FGE : IR_GE;
+    default: return IR_NOP;
+    }
+}
+
+// Whether leaving the expression unevaluated could skip a call or a trap.
+static bool removable(const AstArena& ast, const SemanticInfo& info, NodeId node) {
+    const ASTNode& n = ast.node(node);
+    switch (n.type) {
+    case NODE_INT_NUM:
+    case NODE_REAL_NUM:
+    case NODE_BOOLEAN:
+        return true;
+    case NODE_VARIABLE:
+        return info.ref(node).kind == RefKind::VARIABLE;
+    case NODE_UNARY_OP:
+        return removable(ast, info, ast.child(node, 0));
+    case NODE_BINARY_OP:
+        return n.op != OP_DIV && removable(ast, info, ast.child(node, 0)) && removable(ast, info, ast.child(node, 1));
+    default:
+        return false;
+    }
+}
+
+static void fold(AstArena& ast, SemanticInfo& info, NodeId node, PassReport& report) {
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        fold(ast, info, child, report);
+    }
+
+    const ASTNode& n = ast.node(node);
+    if (n.type == NODE_UNARY_OP) {
+        NodeId operand = ast.child(node, 0);
+        if (!isLiteral(ast, operand)) return;
+        Value value = literalValue(ast, operand);
+        IrOp op = n.op == OP_NOT ? IR_NOT : info.typeOf(operand) == DataType::REAL ? IR_FNEG : IR_NEG;
+        Value result;
+        foldIrOp(op, &value, result);
+        report.removed += replaceWithLiteral(ast, info, node, info.typeOf(node), result);
+        ++report.rewritten;
+        return;
+    }
+    if (n.type != NODE_BINARY_OP) return;
+
+    NodeId left = ast.child(node, 0);
+    NodeId right = ast.child(node, 1);
+    bool leftLiteral = isLiteral(ast, left);
+    bool rightLiteral = isLiteral(ast, right);
+
+    // `false and x` never evaluates x; `x and false` only drops x when x
+    // has no effect. Likewise for or with true.
+    if (n.op == OP_AND || n.op == OP_OR) {
+        bool absorbing = n.op == OP_OR;
+        if (leftLiteral) {
+            if (ast.node(left).boolVal == absorbing) {
+                report.removed += replaceWithLiteral(ast, info, node, DataType::BOOLEAN, literalValue(ast, left));
+            }
+            else {
+                report.removed += replaceWithDescendant(ast, info, node, right);
+            }
+            ++report.rewritten;
+        }
+        else if (rightLiteral) {
+            if (ast.node(right).boolVal != absorbing) {
+                report.removed += replaceWithDescendant(ast, info, node, left);
+                ++report.rewritten;
+            }
+            else if (removable(ast, info, left)) {
+                report.removed += replaceWithLiteral(ast, info, node, DataType::BOOLEAN, literalValue(ast, right));
+                ++report.rewritten;
+            }
+        }
+        return;
+    }
+
+    if (!leftLiteral || !rightLiteral) return;
+    bool real = info.typeOf(left) == DataType::REAL || info.typeOf(right) == DataType::REAL;
+    Value operands[2] = { literalValue(ast, left), literalValue(ast, right) };
+    if (n.op == OP_DIVIDE) {
+        for (int i = 0; i < 2; ++i) {
+            if (info.typeOf(ast.child(node, i)) != DataType::REAL) operands[i].r = static_cast<double>(operands[i].i);
+        }
+    }
+    Value result;
+    if (!foldIrOp(irOpFor(n.op, real), operands, result)) return;
+    DataType type = info.typeOf(node);
+    // The C++ backend has no spelling for inf or nan
+    if (type == DataType::REAL && !std::isfinite(result.r)) return;
+    report.removed += replaceWithLiteral(ast, info, node, type, result);
+    ++report.rewritten;
+}
+
+void foldConstants(AstArena& ast, NodeId root, SemanticInfo& info, PassReport& report) {
+    fold(ast, info, root, report);
+}
+
+// False for a statement that provably never finishes: `while true`, or a
+// block or if that always ends up in one.
+static bool finishes(const AstArena& ast, NodeId node) {
+    const ASTNode& n = ast.node(node);
+    switch (n.type) {
+    case NODE_WHILE: {
+        NodeId condition = ast.child(node, 0);
+        return ast.node(condition).type != NODE_BOOLEAN || !ast.node(condition).boolVal;
+    }
+    case NODE_COMPOUND_STMT:
+        for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+            if (!finishes(ast, child)) return false;
+        }
+        return true;
+    case NODE_IF:
+        return !ast.child(node, 2) || finishes(ast, ast.child(node, 1)) || finishes(ast, ast.child(node, 2));
+    default:
+        return true;
+    }
+}
+
+static void removeBranches(AstArena& ast, SemanticInfo& info, NodeId node, PassReport& report) {
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        removeBranches(ast, info, child, report);
+    }
+
+    const ASTNode& n = ast.node(node);
+    if (n.type == NODE_COMPOUND_STMT) {
+        // Nothing after a statement that never finishes can run
+        for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+            if (finishes(ast, child) || !ast.nextSibling(child)) continue;
+            for (NodeId dead = ast.nextSibling(child); dead; dead = ast.nextSibling(dead)) {
+                report.removed += subtreeSize(ast, dead);
+            }
+            ast.node(child).nextSibling = NULL_NODE;
+            ast.node(node).lastChild = child;
+            ++report.rewritten;
+            break;
+        }
+        return;
+    }
+    if (n.type != NODE_IF && n.type != NODE_WHILE) return;
+    NodeId condition = ast.child(node, 0);
+    if (ast.node(condition).type != NODE_BOOLEAN) return;
+
+    bool value = ast.node(condition).boolVal;
+    if (n.type == NODE_WHILE) {
+        if (value) return;
+        report.removed += replaceWithEmpty(ast, info, node);
+    }
+    else {
+        NodeId taken = ast.child(node, value ? 1 : 2);
+        if (taken) report.removed += replaceWithDescendant(ast, info, node, taken);
+        else report.removed += replaceWithEmpty(ast, info, node);
+    }
+    ++report.rewritten;
+}
+
+void removeConstantBranches(AstArena& ast, NodeId root, SemanticInfo& info, PassReport& report) {
+    removeBranches(ast, info, root, report);
+}
+
+void optimize(AstArena& ast, NodeId root, SemanticInfo& info, const OptimizationOptions& options,
+              OptimizationReport& report) {
+    findUnusedSymbols(ast, root, info, report);
+    inlineCalls(ast, root, info, options, report);
+    // Folding again after propagation settles the and / or / not that
+    // lower to branches, which the IR gives no value of their own
+    foldConstants(ast, root, info, report.pass("constant folding"));
+    propagateConstants(ast, root, info, options, report.pass("constant propagation"));
+    foldConstants(ast, root, info, report.pass("constant folding"));
+    removeConstantBranches(ast, root, info, report.pass("constant branches"));
+    optimizeLoops(ast, root, info, report);
+    removeDeadStores(ast, root, info, report.pass("dead stores"));
+    removeUnreachableCode(ast, root, info, report.pass("unreachable code"));
+}
+
+void printOptimizationReport(const OptimizationReport& report, std::ostream& out) {
+    for (const PassReport& pass : report.passes) {
+        out << pass.name << ": " << pass.removed << " node" << (pass.removed == 1 ? "" : "s") << " removed, ";
+        if (pass.added) out << pass.added << " added, ";
+        out << pass.rewritten << " rewritten" << std::endl;
+    }
+    for (const UnusedSymbol& symbol : report.unused) {
+        out << (symbol.subprogram ? "never called: " : "never read: ") << nameOf(symbol.name);
+        if (!symbol.subprogram) out << " in " << nameOf(symbol.scope);
+        out << std::endl;
+    }
+    for (const InlinedCall& call : report.inlined) {
+        out << "inlined " << nameOf(call.callee) << " into " << nameOf(call.caller) << ": " << call.nodes << " node"
+            << (call.nodes == 1 ? "" : "s");
+        if (call.loopDepth) out << ", loop depth " << call.loopDepth;
+        out << std::endl;
+    }
+    if (report.loops) {
+        out << "loops: " << report.loops << ", " << report.inductionVariables << " induction variable"
+            << (report.inductionVariables == 1 ? "" : "s") << std::endl;
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "ast.h"
+#include "ast_arena.h"
+#include "semantic_info.h"
+
+// Passes that rewrite the analyzed AST in place, keeping SemanticInfo in
+// step, so every backend sees the result. A node that is replaced keeps its
+// NodeId and its place among its siblings; the nodes cut off below it stay
+// in the arena, unreachable.
+
+struct PassReport {
+    const char* name;
+    uint32_t removed = 0;       // AST nodes no longer reachable
+    uint32_t added = 0;         // nodes the pass created
+    uint32_t rewritten = 0;     // nodes replaced by a simpler one
+};
+
+// A call replaced by a copy of the callee's body.
+struct InlinedCall {
+    NameId caller;          // the program name for calls in the main block
+    NameId callee;
+    uint32_t nodes;         // size of the copy
+    uint32_t loopDepth;     // while loops around the call
+};
+
+// A declaration nothing reachable from the main program uses.
+struct UnusedSymbol {
+    NameId name;
+    NameId scope;           // the declaring subprogram, or the program name
+    bool subprogram;        // never called, rather than a variable never read
+};
+
+struct OptimizationReport {
+    std::vector<PassReport> passes;
+    std::vector<InlinedCall> inlined;
+    std::vector<UnusedSymbol> unused;
+    uint32_t loops = 0;
+    uint32_t inductionVariables = 0;
+
+    PassReport& pass(const char* name);
+};
+
+struct OptimizationOptions {
+    uint64_t evaluationBudget = 100000;     // IR instructions per compile-time call
+    uint32_t inlineBudget = 40;             // callee nodes copied per call site; 0 turns inlining off
+};
+
+// Replaces calls by a copy of the callee's body, callees first, so the
+// other passes see through them. A callee qualifies when it cannot reach
+// itself, declares no arrays of its own and is at most `inlineBudget` nodes
+// big; four times that inside a while loop and twice that when it has a
+// single call site. Growth stops once the program has doubled. Parameters,
+// the result and locals become temporaries of the caller, zeroed like the
+// callee's frame; a parameter the callee never assigns is replaced by its
+// argument when that is a literal or a variable the callee cannot change.
+// A function call inside an expression moves in front of its statement
+// when that keeps the order of every call, trap and global access: not
+// under and / or, not after an unproven array access, a div or a call that
+// stays, and not after reading a global the callee writes. Calls in while
+// conditions stay.
+void inlineCalls(AstArena& ast, NodeId root, SemanticInfo& info, const OptimizationOptions& options,
+                 OptimizationReport& report);
+
+// Folds operators whose operands are literals, using the analyzer's types;
+// and / or drop an operand only when that cannot skip a call or a trap.
+void foldConstants(AstArena& ast, NodeId root, SemanticInfo& info, PassReport& report);
+
+// Sparse conditional constant propagation over the SSA IR; every
+// expression it proves constant becomes a literal. Calls to functions that
+// touch no global state are run at compile time when their arguments are
+// constant, within `evaluationBudget` instructions each.
+void propagateConstants(AstArena& ast, NodeId root, SemanticInfo& info, const OptimizationOptions& options,
+                        PassReport& report);
+
+// Replaces an if with a literal condition by the branch it takes, drops
+// while loops whose condition is the literal false, and cuts the statements
+// after one whose condition is the literal true, which never finishes.
+void removeConstantBranches(AstArena& ast, NodeId root, SemanticInfo& info, PassReport& report);
+
+// For each while loop, innermost first: finds the induction variables (a
+// scalar int stepped by a literal once per iteration, at the top level of
+// the body), marks array accesses whose index provably stays in bounds,
+// moves invariant expressions into temporaries set before the loop, and
+// turns products of an induction variable and an invariant into a
+// temporary advanced by addition, unless the backends can vectorize the
+// loop as it stands. Bounds are proven from a literal initial value and a
+// literal cap in the loop condition, or from a literal index.
+void optimizeLoops(AstArena& ast, NodeId root, SemanticInfo& info, OptimizationReport& report);
+
+// Lists the subprograms the main program never reaches, the parameters and
+// locals of the others that nothing reads, and the globals nothing
+// mentions (globals are printed at the end). Run on the tree as written.
+void findUnusedSymbols(const AstArena& ast, NodeId root, const SemanticInfo& info, OptimizationReport& report);
+
+// Liveness-based dead store elimination: an assignment to a scalar that no
+// path reads before the next assignment or the end of its routine goes,
+// as long as the value has no call and cannot trap. Globals stay live at
+// the end of every routine and at calls into subprograms that use them;
+// arrays are never killed, so element stores stay.
+void removeDeadStores(AstArena& ast, NodeId root, SemanticInfo& info, PassReport& report);
+
+// Whole-program reachability from the main statement part: subprograms no
+// call reaches lose their body and are marked so the native backends skip
+// them, and arrays and temporaries no reachable code mentions are marked
+// isUnused.
+void removeUnreachableCode(AstArena& ast, NodeId root, SemanticInfo& info, PassReport& report);
+
+// Runs the passes above in order, reporting unused symbols first.
+void optimize(AstArena& ast, NodeId root, SemanticInfo& info, const OptimizationOptions& options,
+              OptimizationReport& report);
+
+void printOptimizationReport(const OptimizationReport& report, std::ostream& out);
+
+#endif // OPTIMIZER_H
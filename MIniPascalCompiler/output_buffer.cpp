@@ -0,0 +1,217 @@
+#include "output_buffer.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+static const size_t FIRST_CHUNK = 4096;
+static const size_t CHUNK_LIMIT = 256 * 1024;
+static const size_t FLUSH_BYTES = 1024 * 1024;
+static const size_t SPARE_CHUNKS = 8;
+static const size_t MAX_IOVECS = 1024;      // IOV_MAX on Linux and the BSDs
+
+static const char digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+OutputBuffer::OutputBuffer()
+    : start(nullptr), cursor(nullptr), limit(nullptr), written(0), pending(0), nextSize(FIRST_CHUNK), fd(-1),
+      failed(false) {}
+
+OutputBuffer::~OutputBuffer() {
+    if (fd >= 0) close();
+    for (const Chunk& chunk : chunks) {
+        if (chunk.capacity) std::free(chunk.data);
+    }
+    for (char* chunk : spare) std::free(chunk);
+}
+
+bool OutputBuffer::open(const std::string& path) {
+    if (fd >= 0) close();
+#ifdef _WIN32
+    fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#endif
+    failed = false;
+    nextSize = CHUNK_LIMIT;
+    return fd >= 0;
+}
+
+bool OutputBuffer::close() {
+    if (fd < 0) return !failed;
+    flush();
+#ifdef _WIN32
+    if (_close(fd) != 0) failed = true;
+#else
+    if (::close(fd) != 0) failed = true;
+#endif
+    fd = -1;
+    return !failed;
+}
+
+// Ends the chunk being filled; the next write starts a new one.
+void OutputBuffer::closeChunk() {
+    if (!start) return;
+    size_t size = static_cast<size_t>(cursor - start);
+    chunks.back().size = size;
+    written += size;
+    pending += size;
+    start = cursor = limit = nullptr;
+}
+
+// Starts a chunk with room for at least `size` bytes.
+void OutputBuffer::reserve(size_t size) {
+    closeChunk();
+    if (fd >= 0 && pending >= FLUSH_BYTES) flush();
+
+    size_t capacity = std::max(nextSize, size);
+    char* data;
+    if (capacity == CHUNK_LIMIT && !spare.empty()) {
+        data = spare.back();
+        spare.pop_back();
+    }
+    else {
+        data = static_cast<char*>(std::malloc(capacity));
+        if (!data) throw std::bad_alloc();
+    }
+    nextSize = std::min(nextSize * 2, CHUNK_LIMIT);
+    chunks.push_back({ data, 0, capacity });
+    start = cursor = data;
+    limit = data + capacity;
+}
+
+void OutputBuffer::writeSlow(const char* text, size_t size) {
+    for (;;) {
+        size_t room = static_cast<size_t>(limit - cursor);
+        size_t part = std::min(room, size);
+        if (part) std::memcpy(cursor, text, part);
+        cursor += part;
+        text += part;
+        size -= part;
+        if (size == 0) return;
+        reserve(1);
+    }
+}
+
+void OutputBuffer::flush() {
+    if (fd < 0) return;
+    closeChunk();
+
+#ifdef _WIN32
+    // No gather write here: the chunks go out one at a time
+    for (const Chunk& chunk : chunks) {
+        const char* data = chunk.data;
+        size_t left = chunk.size;
+        while (left > 0 && !failed) {
+            unsigned part = static_cast<unsigned>(std::min<size_t>(left, 1u << 30));
+            int done = _write(fd, data, part);
+            if (done <= 0) failed = true;
+            else {
+                data += done;
+                left -= static_cast<size_t>(done);
+            }
+        }
+    }
+#else
+    std::vector<iovec> parts;
+    parts.reserve(chunks.size());
+    for (const Chunk& chunk : chunks) {
+        if (chunk.size) parts.push_back({ chunk.data, chunk.size });
+    }
+    size_t next = 0;
+    while (next < parts.size() && !failed) {
+        int count = static_cast<int>(std::min(parts.size() - next, MAX_IOVECS));
+        ssize_t done = writev(fd, &parts[next], count);
+        if (done < 0) {
+            failed = true;
+            break;
+        }
+        // A short write leaves the rest of the batch for the next call
+        size_t left = static_cast<size_t>(done);
+        while (next < parts.size() && left >= parts[next].iov_len) left -= parts[next++].iov_len;
+        if (left) {
+            parts[next].iov_base = static_cast<char*>(parts[next].iov_base) + left;
+            parts[next].iov_len -= left;
+        }
+    }
+#endif
+
+    for (const Chunk& chunk : chunks) {
+        if (chunk.capacity == CHUNK_LIMIT && spare.size() < SPARE_CHUNKS) spare.push_back(chunk.data);
+        else if (chunk.capacity) std::free(chunk.data);
+    }
+    chunks.clear();
+    pending = 0;
+}
+
+void OutputBuffer::appendRange(const OutputBuffer& source, size_t begin, size_t end) {
+    if (begin >= end) return;
+    closeChunk();
+    size_t offset = 0;
+    for (const Chunk& chunk : source.chunks) {
+        size_t size = chunk.data == source.start ? static_cast<size_t>(source.cursor - source.start) : chunk.size;
+        size_t from = std::max(begin, offset);
+        size_t to = std::min(end, offset + size);
+        if (from < to) {
+            chunks.push_back({ chunk.data + (from - offset), to - from, 0 });
+            written += to - from;
+            pending += to - from;
+        }
+        offset += size;
+        if (offset >= end) break;
+    }
+    if (fd >= 0 && pending >= FLUSH_BYTES) flush();
+}
+
+OutputBuffer& OutputBuffer::writeUnsigned(unsigned long long value) {
+    char digits[20];
+    char* first = digits + sizeof(digits);
+    while (value >= 100) {
+        unsigned pair = static_cast<unsigned>(value % 100) * 2;
+        value /= 100;
+        *--first = digitPairs[pair + 1];
+        *--first = digitPairs[pair];
+    }
+    if (value >= 10) {
+        unsigned pair = static_cast<unsigned>(value) * 2;
+        *--first = digitPairs[pair + 1];
+        *--first = digitPairs[pair];
+    }
+    else {
+        *--first = static_cast<char>('0' + value);
+    }
+    write(first, static_cast<size_t>(digits + sizeof(digits) - first));
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::writeSigned(long long value) {
+    if (value >= 0) return writeUnsigned(static_cast<unsigned long long>(value));
+    *this << '-';
+    return writeUnsigned(0ull - static_cast<unsigned long long>(value));
+}
+
+OutputBuffer& OutputBuffer::operator<<(double value) {
+    // The longest shortest form is 24 characters, as in -2.2250738585072014e-308
+    if (limit - cursor < 32) reserve(32);
+    cursor = std::to_chars(cursor, limit, value).ptr;
+    return *this;
+}
@@ -0,0 +1,105 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Append-only text sink for the code generators, in place of an ostream
+// fed one token at a time. Text collects in a chain of chunks, which start
+// small and grow to 256 KB. A buffer opened on a file writes the
+// chain out once a megabyte or so is pending, or on flush(), in one gather
+// write (writev), and keeps the big chunks for the text that follows. A
+// buffer that was never opened keeps its text in memory, for a worker
+// thread to build text that another buffer then writes out with
+// appendRange() without copying it.
+//
+// Numbers are formatted by hand: integers digit pair by digit pair, and
+// doubles as the shortest text that reads back as the same value.
+class OutputBuffer {
+public:
+    OutputBuffer();
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    // Creates or truncates `path`. False if it cannot be opened.
+    bool open(const std::string& path);
+
+    // Writes out everything pending, then closes the file. False if any
+    // write failed since open().
+    bool close();
+
+    // Writes out everything pending; does nothing without a file.
+    void flush();
+
+    void write(const char* text, size_t size) {
+        if (size <= static_cast<size_t>(limit - cursor)) {
+            std::memcpy(cursor, text, size);
+            cursor += size;
+        }
+        else {
+            writeSlow(text, size);
+        }
+    }
+
+    OutputBuffer& operator<<(const char* text) {
+        write(text, std::strlen(text));
+        return *this;
+    }
+    OutputBuffer& operator<<(const std::string& text) {
+        write(text.data(), text.size());
+        return *this;
+    }
+    OutputBuffer& operator<<(char c) {
+        if (cursor == limit) reserve(1);
+        *cursor++ = c;
+        return *this;
+    }
+    OutputBuffer& operator<<(int value) { return writeSigned(value); }
+    OutputBuffer& operator<<(long value) { return writeSigned(value); }
+    OutputBuffer& operator<<(long long value) { return writeSigned(value); }
+    OutputBuffer& operator<<(unsigned value) { return writeUnsigned(value); }
+    OutputBuffer& operator<<(unsigned long value) { return writeUnsigned(value); }
+    OutputBuffer& operator<<(unsigned long long value) { return writeUnsigned(value); }
+    OutputBuffer& operator<<(double value);
+    OutputBuffer& operator<<(bool value) = delete;
+
+    // Bytes written since the buffer was made, flushed or not.
+    size_t tell() const { return written + static_cast<size_t>(cursor - start); }
+
+    // Appends bytes [begin, end) of `source`, as tell() counted them, by
+    // reference: `source` must be a buffer without a file, and must stay
+    // alive until this buffer's next flush(). Writing more to `source` in
+    // the meantime is fine; it only ever appends.
+    void appendRange(const OutputBuffer& source, size_t begin, size_t end);
+
+private:
+    struct Chunk {
+        char* data;
+        size_t size;
+        size_t capacity;    // 0 for text referenced from another buffer
+    };
+
+    void writeSlow(const char* text, size_t size);
+    void reserve(size_t size);
+    void closeChunk();
+    OutputBuffer& writeSigned(long long value);
+    OutputBuffer& writeUnsigned(unsigned long long value);
+
+    std::vector<Chunk> chunks;      // pending text in order; the last is being filled while cursor is set
+    std::vector<char*> spare;       // full-size chunks already written out
+    char* start;                    // the chunk being filled, cursor and limit within it
+    char* cursor;
+    char* limit;
+    size_t written;                 // bytes in chunks before the one being filled
+    size_t pending;                 // of those, bytes not written out yet
+    size_t nextSize;                // capacity of the next chunk
+    int fd;
+    bool failed;
+};
+
+#endif // OUTPUT_BUFFER_H
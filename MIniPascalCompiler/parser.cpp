@@ -0,0 +1,471 @@
+#include "parser.h"
+#include "ast_arena.h"
+#include "minipascal.tab.h"
+#include <string>
+
+// Binding powers, lowest first, mirroring the %left lines in minipascal.y.
+enum Precedence {
+    PREC_OR = 1,
+    PREC_AND,
+    PREC_NOT,
+    PREC_EQUALITY,   // = <>
+    PREC_RELATIONAL, // < <= > >=
+    PREC_ADDITIVE,   // + -
+    PREC_MULTIPLICATIVE, // * / div
+    PREC_UNARY_MINUS
+};
+
+static int binaryPrecedence(int kind, OpKind& op) {
+    switch (kind) {
+    case OR:     op = OP_OR;     return PREC_OR;
+    case AND:    op = OP_AND;    return PREC_AND;
+    case EQ:     op = OP_EQ;     return PREC_EQUALITY;
+    case NEQ:    op = OP_NEQ;    return PREC_EQUALITY;
+    case LT:     op = OP_LT;     return PREC_RELATIONAL;
+    case LE:     op = OP_LE;     return PREC_RELATIONAL;
+    case GT:     op = OP_GT;     return PREC_RELATIONAL;
+    case GE:     op = OP_GE;     return PREC_RELATIONAL;
+    case PLUS:   op = OP_ADD;    return PREC_ADDITIVE;
+    case MINUS:  op = OP_SUB;    return PREC_ADDITIVE;
+    case MULT:   op = OP_MUL;    return PREC_MULTIPLICATIVE;
+    case DIVIDE: op = OP_DIVIDE; return PREC_MULTIPLICATIVE;
+    case DIV:    op = OP_DIV;    return PREC_MULTIPLICATIVE;
+    default:     op = OP_NONE;   return 0;
+    }
+}
+
+static bool isStatementBoundary(int kind) {
+    return kind == SEMICOLON || kind == END || kind == ELSE;
+}
+
+static bool isDeclarationBoundary(int kind) {
+    return kind == SEMICOLON || kind == VAR || kind == FUNCTION || kind == PROCEDURE || kind == BEGIN;
+}
+
+static bool startsStatement(int kind) {
+    return kind == ID || kind == BEGIN || kind == IF || kind == WHILE;
+}
+
+Parser::Parser(Lexer& lexer, ErrorHandler& errors)
+    : lexer(lexer), errors(errors), errorsReported(0),
+      sinceError(0), recovering(false), stopped(false) {
+    advance();
+}
+
+void Parser::advance() {
+    if (stopped) {
+        token.kind = 0;
+        return;
+    }
+
+    token = lexer.next();
+    ++sinceError;
+    while (token.kind == TOKEN_INVALID) {
+        report("Invalid character");
+        if (stopped) {
+            token.kind = 0;
+            return;
+        }
+        token = lexer.next();
+    }
+}
+
+bool Parser::accept(int kind) {
+    if (token.kind != kind) return false;
+    advance();
+    return true;
+}
+
+bool Parser::expect(int kind) {
+    if (accept(kind)) return true;
+
+    switch (kind) {
+    case ID:        expected("identifier"); break;
+    case INT_NUM:   expected("integer"); break;
+    case SEMICOLON: expected("';'"); break;
+    case COLON:     expected("':'"); break;
+    case COMMA:     expected("','"); break;
+    case DOT:       expected("'.'"); break;
+    case DOTDOT:    expected("'..'"); break;
+    case ASSIGN:    expected("':='"); break;
+    case LPAREN:    expected("'('"); break;
+    case RPAREN:    expected("')'"); break;
+    case LBRACKET:  expected("'['"); break;
+    case RBRACKET:  expected("']'"); break;
+    case PROGRAM:   expected("'program'"); break;
+    case BEGIN:     expected("'begin'"); break;
+    case END:       expected("'end'"); break;
+    case THEN:      expected("'then'"); break;
+    case DO:        expected("'do'"); break;
+    case OF:        expected("'of'"); break;
+    default:        expected("token"); break;
+    }
+    return false;
+}
+
+void Parser::report(const char* message) {
+    errors.add_error(message, static_cast<int>(token.line), static_cast<int>(token.column));
+    ++errorsReported;
+    if (errors.too_many_errors()) stopped = true;
+}
+
+// Like bison, an error is only reported once three tokens have been
+// consumed since the previous one, which keeps a single mistake from
+// producing a cascade of follow-on messages.
+bool Parser::shouldReport() const {
+    return !recovering && !stopped && (errorsReported == 0 || sinceError >= 3);
+}
+
+void Parser::error(const char* message) {
+    if (shouldReport()) report(message);
+    recovering = true;
+    sinceError = 0;
+}
+
+void Parser::expected(const char* what) {
+    if (!shouldReport()) {
+        error(what);
+        return;
+    }
+
+    std::string message = std::string("syntax error: expected ") + what + ", found ";
+    if (token.kind == 0)
+        message += "end of file";
+    else
+        message += "'" + std::string(token.text, token.length) + "'";
+    error(message.c_str());
+}
+
+// Panic mode: drop tokens until one that can follow the construct that
+// failed, then resume reporting.
+void Parser::synchronize(bool (*isBoundary)(int kind)) {
+    while (token.kind != 0 && !isBoundary(token.kind)) {
+        advance();
+    }
+    recovering = false;
+}
+
+NameId Parser::identifier() {
+    if (!check(ID)) {
+        expect(ID);
+        return NO_NAME;
+    }
+    NameId name = globalInterner().intern(token.text, token.length);
+    advance();
+    return name;
+}
+
+NodeId Parser::parseProgram() {
+    Token start = token;
+    expect(PROGRAM);
+    NameId name = identifier();
+    expect(SEMICOLON);
+    if (recovering) synchronize(isDeclarationBoundary);
+
+    NodeId decls = parseDeclarations();
+    NodeId subprogs = parseSubprogramDeclarations();
+    NodeId body = parseCompoundStatement();
+    expect(DOT);
+    if (!check(0)) expected("end of file");
+
+    return located(createProgramNode(name, decls, subprogs, body), start);
+}
+
+NodeId Parser::parseHeading(NameId& name) {
+    expect(PROGRAM);
+    name = identifier();
+    expect(SEMICOLON);
+    if (recovering) synchronize(isDeclarationBoundary);
+
+    NodeId decls = parseDeclarations();
+    if (!check(0)) expected("end of file");
+    return decls;
+}
+
+NodeId Parser::parseSubprogramPiece() {
+    NodeId subprog = parseSubprogram();
+    expect(SEMICOLON);
+    if (!check(0)) expected("end of file");
+    return subprog;
+}
+
+NodeId Parser::parseMainBlock() {
+    NodeId body = parseCompoundStatement();
+    expect(DOT);
+    if (!check(0)) expected("end of file");
+    return body;
+}
+
+NodeId Parser::parseDeclarations() {
+    NodeId decls = createDeclarationsNode();
+    while (accept(VAR)) {
+        NodeId ids = parseIdentifierList();
+        expect(COLON);
+        NodeId type = parseType();
+        expect(SEMICOLON);
+
+        if (recovering) {
+            synchronize(isDeclarationBoundary);
+            accept(SEMICOLON);
+            continue;
+        }
+        appendDeclarationsNode(decls, ids, type);
+    }
+    return decls;
+}
+
+NodeId Parser::parseType() {
+    if (!accept(ARRAY)) return parseStandardType();
+
+    expect(LBRACKET);
+    int start = check(INT_NUM) ? token.intVal : 0;
+    expect(INT_NUM);
+    expect(DOTDOT);
+    int end = check(INT_NUM) ? token.intVal : 0;
+    expect(INT_NUM);
+    expect(RBRACKET);
+    expect(OF);
+    return createArrayTypeNode(start, end, parseStandardType());
+}
+
+NodeId Parser::parseStandardType() {
+    if (accept(INTEGER)) return createTypeNode(DataType::INTEGER);
+    if (accept(REAL)) return createTypeNode(DataType::REAL);
+    if (accept(BOOLEAN)) return createTypeNode(DataType::BOOLEAN);
+
+    expected("type");
+    return NULL_NODE;
+}
+
+NodeId Parser::parseSubprogramDeclarations() {
+    NodeId subprogs = createSubprogramDeclarationsNode();
+    while (check(FUNCTION) || check(PROCEDURE)) {
+        appendSubprogramDeclarationsNode(subprogs, parseSubprogram());
+        expect(SEMICOLON);
+        if (recovering) {
+            synchronize(isDeclarationBoundary);
+            accept(SEMICOLON);
+        }
+    }
+    return subprogs;
+}
+
+NodeId Parser::parseSubprogram() {
+    Token start = token;
+    NodeId head;
+    if (accept(FUNCTION)) {
+        Token nameStart = token;
+        NameId name = identifier();
+        NodeId params = parseArguments();
+        expect(COLON);
+        NodeId returnType = parseStandardType();
+        head = located(createFunctionHeadNode(name, params, returnType), nameStart);
+    }
+    else {
+        expect(PROCEDURE);
+        Token nameStart = token;
+        NameId name = identifier();
+        head = located(createProcedureHeadNode(name, parseArguments()), nameStart);
+    }
+    expect(SEMICOLON);
+    if (recovering) {
+        synchronize(isDeclarationBoundary);
+        accept(SEMICOLON);
+    }
+
+    NodeId decls = parseDeclarations();
+    NodeId body = parseCompoundStatement();
+    return located(createSubprogramNode(head, decls, body), start);
+}
+
+NodeId Parser::parseArguments() {
+    if (!accept(LPAREN)) return NULL_NODE;
+
+    NodeId params = NULL_NODE;
+    do {
+        NodeId ids = parseIdentifierList();
+        expect(COLON);
+        params = appendParameterListNode(params, ids, parseType());
+    } while (accept(SEMICOLON));
+    expect(RPAREN);
+    return params;
+}
+
+NodeId Parser::parseIdentifierList() {
+    AstArena& arena = *getAstArena();
+    Token start = token;
+    NodeId ids = createIdentifierListNode(identifier());
+    located(arena.node(ids).lastChild, start);
+    while (accept(COMMA)) {
+        start = token;
+        appendIdentifierListNode(ids, identifier());
+        located(arena.node(ids).lastChild, start);
+    }
+    return ids;
+}
+
+// Statements are appended straight onto one list node, which then becomes
+// the compound statement.
+NodeId Parser::parseCompoundStatement() {
+    Token start = token;
+    expect(BEGIN);
+    if (accept(END)) return located(createCompoundStatementNode(NULL_NODE), start);
+
+    NodeId list = createStatementListNode(NULL_NODE);
+    for (;;) {
+        appendStatementNode(list, parseStatement());
+        if (accept(SEMICOLON)) continue;
+        if (check(END) || check(0)) break;
+
+        // Missing separator: carry on with the next statement if one starts
+        // here, otherwise skip ahead to a statement boundary.
+        expected("';' or 'end'");
+        if (startsStatement(token.kind)) {
+            recovering = false;
+            continue;
+        }
+        advance();
+        synchronize(isStatementBoundary);
+        if (!accept(SEMICOLON) && !check(ELSE)) break;
+    }
+    expect(END);
+    return located(createCompoundStatementNode(list), start);
+}
+
+NodeId Parser::parseStatement() {
+    NodeId stmt = parseStatementBody();
+    if (recovering) synchronize(isStatementBoundary);
+    return stmt;
+}
+
+NodeId Parser::parseStatementBody() {
+    Token start = token;
+    switch (token.kind) {
+    case BEGIN:
+        return parseCompoundStatement();
+
+    case IF: {
+        advance();
+        NodeId cond = parseExpression(PREC_OR);
+        expect(THEN);
+        NodeId thenStmt = parseStatement();
+        NodeId elseStmt = accept(ELSE) ? parseStatement() : NULL_NODE;
+        return located(createIfNode(cond, thenStmt, elseStmt), start);
+    }
+
+    case WHILE: {
+        advance();
+        NodeId cond = parseExpression(PREC_OR);
+        expect(DO);
+        return located(createWhileNode(cond, parseStatement()), start);
+    }
+
+    case ID: {
+        NameId name = identifier();
+        if (accept(LPAREN)) {
+            NodeId args = parseExpressionList();
+            expect(RPAREN);
+            return located(createProcedureCallNode(name, args), start);
+        }
+
+        NodeId target;
+        if (accept(LBRACKET)) {
+            NodeId index = parseExpression(PREC_OR);
+            expect(RBRACKET);
+            target = located(createArrayAccessNode(name, index), start);
+        }
+        else if (check(ASSIGN)) {
+            target = located(createVariableNode(name), start);
+        }
+        else {
+            return located(createProcedureCallNode(name, NULL_NODE), start);
+        }
+
+        expect(ASSIGN);
+        return located(createAssignmentNode(target, parseExpression(PREC_OR)), start);
+    }
+
+    default:
+        expected("statement");
+        return NULL_NODE;
+    }
+}
+
+NodeId Parser::parseExpressionList() {
+    NodeId list = createExpressionListNode(parseExpression(PREC_OR));
+    while (accept(COMMA)) {
+        appendExpressionListNode(list, parseExpression(PREC_OR));
+    }
+    return list;
+}
+
+// Every binary operator is left-associative, so the right operand binds
+// one level tighter than the operator itself.
+NodeId Parser::parseExpression(int minPrecedence) {
+    NodeId left = parsePrefix();
+    for (;;) {
+        OpKind op;
+        int precedence = binaryPrecedence(token.kind, op);
+        if (precedence == 0 || precedence < minPrecedence) return left;
+
+        Token at = token;
+        advance();
+        NodeId right = parseExpression(precedence + 1);
+        left = located(createBinaryOpNode(left, right, op), at);
+    }
+}
+
+NodeId Parser::parsePrefix() {
+    Token start = token;
+    switch (token.kind) {
+    case INT_NUM: {
+        NodeId node = located(createIntNumNode(token.intVal), start);
+        advance();
+        return node;
+    }
+    case REAL_NUM: {
+        NodeId node = located(createRealNumNode(token.realVal), start);
+        advance();
+        return node;
+    }
+    case TRUE:
+        advance();
+        return located(createBooleanNode(true), start);
+    case FALSE:
+        advance();
+        return located(createBooleanNode(false), start);
+
+    case ID: {
+        NameId name = identifier();
+        if (accept(LBRACKET)) {
+            NodeId index = parseExpression(PREC_OR);
+            expect(RBRACKET);
+            return located(createArrayAccessNode(name, index), start);
+        }
+        if (!accept(LPAREN)) return located(createVariableNode(name), start);
+
+        NodeId args = parseExpressionList();
+        expect(RPAREN);
+        return located(createFunctionCallNode(name, args), start);
+    }
+
+    case LPAREN: {
+        advance();
+        NodeId inner = parseExpression(PREC_OR);
+        expect(RPAREN);
+        return inner;
+    }
+
+    // `not` sits below the comparisons, so `not a = b` is `not (a = b)`.
+    case NOT:
+        advance();
+        return located(createUnaryOpNode(parseExpression(PREC_NOT + 1), OP_NOT), start);
+    case MINUS:
+        advance();
+        return located(createUnaryOpNode(parseExpression(PREC_UNARY_MINUS), OP_NEG), start);
+
+    default:
+        expected("expression");
+        return NULL_NODE;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <cstddef>
+#include "ast.h"
+#include "error_handler.h"
+#include "lexer.h"
+
+// Hand-written recursive-descent parser for the grammar in minipascal.y,
+// with Pratt-style expression parsing. It accepts the same language, uses
+// the same operator precedence and builds the same AST through the create*
+// functions in ast.h, so the two parsers are interchangeable.
+//
+// Syntax errors go to the ErrorHandler and parsing resumes at the next
+// statement or declaration boundary until the handler's error cap is hit.
+class Parser {
+public:
+    Parser(Lexer& lexer, ErrorHandler& errors);
+
+    // Parses a whole program into the current AST arena. The result is only
+    // meaningful when errorCount() is 0.
+    NodeId parseProgram();
+
+    // The pieces an incremental session (compile_session.h) parses on their
+    // own, each of which has to make up the whole input: the program
+    // heading with the global declarations, one subprogram declaration with
+    // its ';', and the main block with the final '.'.
+    NodeId parseHeading(NameId& name);
+    NodeId parseSubprogramPiece();
+    NodeId parseMainBlock();
+
+    size_t errorCount() const { return errorsReported; }
+
+private:
+    void advance();
+    bool check(int kind) const { return token.kind == kind; }
+    bool accept(int kind);
+    bool expect(int kind);
+    void report(const char* message);
+    bool shouldReport() const;
+    void error(const char* message);
+    void expected(const char* what);
+    void synchronize(bool (*isBoundary)(int kind));
+    NodeId located(NodeId node, const Token& start) const { return locateNode(node, start.line, start.column); }
+
+    NameId identifier();
+    NodeId parseDeclarations();
+    NodeId parseType();
+    NodeId parseStandardType();
+    NodeId parseSubprogramDeclarations();
+    NodeId parseSubprogram();
+    NodeId parseArguments();
+    NodeId parseIdentifierList();
+    NodeId parseCompoundStatement();
+    NodeId parseStatement();
+    NodeId parseStatementBody();
+    NodeId parseExpressionList();
+    NodeId parseExpression(int minPrecedence);
+    NodeId parsePrefix();
+
+    Lexer& lexer;
+    ErrorHandler& errors;
+    Token token;
+    size_t errorsReported;
+    size_t sinceError; // tokens consumed since the last syntax error
+    bool recovering; // a syntax error occurred and we have not resynchronized yet
+    bool stopped;    // error cap reached: every further token reads as end of input
+};
+
+#endif // PARSER_H
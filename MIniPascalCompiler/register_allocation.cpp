@@ -0,0 +1,330 @@
+#include "register_allocation.h"
+
+#include <algorithm>
+
+static const uint32_t NO_INTERVAL = 0xFFFFFFFFu;
+
+namespace {
+
+// An if or while statement, with the positions of its arms.
+struct Construct {
+    bool loop;
+    uint32_t start;
+    uint32_t end;
+    uint32_t thenStart, thenEnd;
+    uint32_t elseStart, elseEnd;
+};
+
+struct Reference {
+    uint32_t interval;
+    bool write;
+};
+
+// Numbers the statements and records which variables each one mentions.
+class IntervalBuilder {
+public:
+    IntervalBuilder(const AstArena& ast, const SemanticInfo& info, RegisterAllocation& out)
+        : ast(ast), info(info), out(out), position(0), depth(0), intervalOf(info.variables.size(), NO_INTERVAL) {}
+
+    void statement(NodeId node) {
+        if (!node) return;
+
+        uint32_t start = position++;
+        out.statementStart[node] = start;
+        std::vector<Reference> references;
+        bool calls = false;
+
+        const ASTNode& n = ast.node(node);
+        switch (n.type) {
+        case NODE_COMPOUND_STMT:
+            for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+                statement(child);
+            }
+            break;
+        case NODE_ASSIGNMENT: {
+            NodeId target = ast.child(node, 0);
+            if (ast.node(target).type == NODE_ARRAY_ACCESS) expression(ast.child(target, 0), references, calls);
+            else if (info.ref(target).kind == RefKind::VARIABLE) reference(target, true, references);
+            expression(ast.child(node, 1), references, calls);
+            break;
+        }
+        case NODE_IF: {
+            expression(ast.child(node, 0), references, calls);
+            NodeId thenStmt = ast.child(node, 1);
+            NodeId elseStmt = ast.child(node, 2);
+            statement(thenStmt);
+            statement(elseStmt);
+            Construct construct = { false, start, 0, 0, 0, 0, 0 };
+            if (thenStmt) {
+                construct.thenStart = out.statementStart[thenStmt];
+                construct.thenEnd = out.statementEnd[thenStmt];
+            }
+            if (elseStmt) {
+                construct.elseStart = out.statementStart[elseStmt];
+                construct.elseEnd = out.statementEnd[elseStmt];
+            }
+            constructs.push_back(construct);
+            break;
+        }
+        case NODE_WHILE:
+            ++depth;
+            expression(ast.child(node, 0), references, calls);
+            statement(ast.child(node, 1));
+            --depth;
+            constructs.push_back(Construct{ true, start, 0, 0, 0, 0, 0 });
+            break;
+        case NODE_PROCEDURE_CALL:
+        case NODE_FUNCTION_CALL:
+            calls = true;
+            for (NodeId arg = ast.firstChild(node); arg; arg = ast.nextSibling(arg)) {
+                expression(arg, references, calls);
+            }
+            break;
+        default:
+            break;
+        }
+
+        uint32_t end = position++;
+        out.statementEnd[node] = end;
+        if (n.type == NODE_IF || n.type == NODE_WHILE) constructs.back().end = end;
+        if (calls) callPositions.push_back(start);
+
+        for (const Reference& ref : references) {
+            LiveInterval& interval = out.intervals[ref.interval];
+            if (firstStart[ref.interval] == NO_INTERVAL) {
+                firstStart[ref.interval] = start;
+                definedFirst[ref.interval] = n.type == NODE_ASSIGNMENT && !calls &&
+                    std::all_of(references.begin(), references.end(), [&](const Reference& other) {
+                        return other.interval != ref.interval || other.write;
+                    });
+            }
+            interval.start = std::min(interval.start, start);
+            interval.end = std::max(interval.end, end);
+            interval.written = interval.written || ref.write;
+        }
+    }
+
+    void widen();
+
+    // A variable assigned before it is read needs no load from its home. A
+    // call in the assigning statement stores it there first, so it still does.
+    void markLoads() {
+        for (uint32_t i = 0; i < out.intervals.size(); ++i) {
+            out.intervals[i].needsLoad = !definedFirst[i] || out.intervals[i].start != firstStart[i];
+        }
+    }
+
+    std::vector<uint32_t> callPositions;
+
+private:
+    // Scalars only: arrays always live in memory
+    void reference(NodeId node, bool write, std::vector<Reference>& references) {
+        uint32_t variable = info.ref(node).index;
+        const VariableInfo& v = info.variables[variable];
+        if (v.type.baseType == DataType::ARRAY) return;
+
+        uint32_t& index = intervalOf[variable];
+        if (index == NO_INTERVAL) {
+            index = static_cast<uint32_t>(out.intervals.size());
+            out.intervals.push_back(LiveInterval{ variable, 0xFFFFFFFFu, 0, 0.0f, v.type.baseType == DataType::REAL,
+                                                  false, true, false, NO_REGISTER });
+            firstStart.push_back(NO_INTERVAL);
+            definedFirst.push_back(false);
+        }
+        float weight = 1.0f;
+        for (int i = 0; i < depth && i < 6; ++i) weight *= 8.0f;
+        out.intervals[index].weight += weight;
+        references.push_back(Reference{ index, write });
+    }
+
+    void expression(NodeId node, std::vector<Reference>& references, bool& calls) {
+        const ASTNode& n = ast.node(node);
+        switch (n.type) {
+        case NODE_VARIABLE:
+            if (info.ref(node).kind == RefKind::CALL) calls = true;
+            else if (info.ref(node).kind == RefKind::VARIABLE) reference(node, false, references);
+            break;
+        case NODE_FUNCTION_CALL:
+            calls = true;
+            for (NodeId arg = ast.firstChild(node); arg; arg = ast.nextSibling(arg)) {
+                expression(arg, references, calls);
+            }
+            break;
+        case NODE_ARRAY_ACCESS:
+        case NODE_UNARY_OP:
+        case NODE_BINARY_OP:
+            for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+                expression(child, references, calls);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    const AstArena& ast;
+    const SemanticInfo& info;
+    RegisterAllocation& out;
+    uint32_t position;
+    int depth;
+    std::vector<uint32_t> intervalOf;
+    std::vector<uint32_t> firstStart;   // by interval: first statement mentioning it
+    std::vector<bool> definedFirst;     // ... and that statement only assigns it, with no call
+    std::vector<Construct> constructs;
+};
+
+static bool within(const LiveInterval& interval, uint32_t start, uint32_t end) {
+    return start <= interval.start && interval.end <= end;
+}
+
+// Grows intervals until each one either contains every loop and if statement
+// it touches, or (for an if) sits inside one arm.
+void IntervalBuilder::widen() {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (LiveInterval& interval : out.intervals) {
+            for (const Construct& construct : constructs) {
+                if (interval.end < construct.start || interval.start > construct.end) continue;
+                if (interval.start <= construct.start && interval.end >= construct.end) continue;
+                if (!construct.loop && ((construct.thenEnd && within(interval, construct.thenStart, construct.thenEnd)) ||
+                                        (construct.elseEnd && within(interval, construct.elseStart, construct.elseEnd))))
+                    continue;
+                interval.start = std::min(interval.start, construct.start);
+                interval.end = std::max(interval.end, construct.end);
+                changed = true;
+            }
+        }
+    }
+}
+
+}
+
+void allocateRegisters(const AstArena& ast, const SemanticInfo& info, NodeId body,
+                       RegisterAllocation& out, RegisterAllocationStats& stats) {
+    out.intervals.clear();
+    out.location.assign(info.variables.size(), NO_REGISTER);
+    out.calleeSaved = 0;
+    if (out.statementStart.size() < info.refs.size()) {
+        out.statementStart.resize(info.refs.size());
+        out.statementEnd.resize(info.refs.size());
+    }
+
+    IntervalBuilder builder(ast, info, out);
+    builder.statement(body);
+    builder.widen();
+    builder.markLoads();
+
+    std::vector<uint32_t>& calls = builder.callPositions;
+    std::sort(calls.begin(), calls.end());
+    for (LiveInterval& interval : out.intervals) {
+        auto call = std::lower_bound(calls.begin(), calls.end(), interval.start);
+        interval.crossesCall = call != calls.end() && *call <= interval.end;
+    }
+    std::sort(out.intervals.begin(), out.intervals.end(), [](const LiveInterval& a, const LiveInterval& b) {
+        return a.start < b.start || (a.start == b.start && a.variable < b.variable);
+    });
+
+    // Caller-saved registers first, keeping the callee-saved ones (which
+    // cost a save and restore) for intervals that span a call
+    static const uint8_t gprOrder[] = { REG_R10, REG_R11, REG_RBX, REG_R12, REG_R13, REG_R14, REG_R15 };
+    static const uint8_t gprAcrossCalls[] = { REG_RBX, REG_R12, REG_R13, REG_R14, REG_R15 };
+    static const uint8_t xmmOrder[] = { REG_XMM8, REG_XMM9, REG_XMM10, REG_XMM11,
+                                        REG_XMM12, REG_XMM13, REG_XMM14, REG_XMM15 };
+
+    bool inUse[REG_COUNT] = {};
+    std::vector<uint32_t> active;   // indices into intervals
+    for (uint32_t current = 0; current < out.intervals.size(); ++current) {
+        LiveInterval& interval = out.intervals[current];
+
+        // Expire intervals that ended before this one starts
+        for (size_t i = 0; i < active.size();) {
+            LiveInterval& old = out.intervals[active[i]];
+            if (old.end < interval.start) {
+                inUse[old.reg] = false;
+                active[i] = active.back();
+                active.pop_back();
+            }
+            else {
+                ++i;
+            }
+        }
+
+        const uint8_t* candidates;
+        size_t count;
+        if (interval.real) {
+            // No XMM register survives a call
+            candidates = xmmOrder;
+            count = interval.crossesCall ? 0 : sizeof xmmOrder;
+        }
+        else if (interval.crossesCall) {
+            candidates = gprAcrossCalls;
+            count = sizeof gprAcrossCalls;
+        }
+        else {
+            candidates = gprOrder;
+            count = sizeof gprOrder;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (!inUse[candidates[i]]) {
+                interval.reg = candidates[i];
+                break;
+            }
+        }
+
+        // Under pressure the lightest interval goes to memory, whichever it is
+        if (interval.reg == NO_REGISTER && count) {
+            uint32_t victim = NO_INTERVAL;
+            for (uint32_t index : active) {
+                const LiveInterval& other = out.intervals[index];
+                if (std::find(candidates, candidates + count, other.reg) == candidates + count) continue;
+                if (victim == NO_INTERVAL || other.weight < out.intervals[victim].weight) victim = index;
+            }
+            if (victim != NO_INTERVAL && out.intervals[victim].weight < interval.weight) {
+                interval.reg = out.intervals[victim].reg;
+                out.intervals[victim].reg = NO_REGISTER;
+                active.erase(std::find(active.begin(), active.end(), victim));
+            }
+        }
+
+        if (interval.reg != NO_REGISTER) {
+            inUse[interval.reg] = true;
+            active.push_back(current);
+        }
+    }
+
+    for (const LiveInterval& interval : out.intervals) {
+        ++stats.intervals;
+        if (interval.reg == NO_REGISTER) {
+            ++stats.spilled;
+            continue;
+        }
+        ++stats.allocated;
+        out.location[interval.variable] = interval.reg;
+        if (interval.reg < CALLEE_SAVED_REGISTERS) out.calleeSaved = std::max<uint32_t>(out.calleeSaved, interval.reg + 1);
+    }
+}
+
+static void markGlobals(const AstArena& ast, const SemanticInfo& info, NodeId node, std::vector<bool>& shared) {
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        markGlobals(ast, info, child, shared);
+    }
+    NodeType type = ast.node(node).type;
+    if ((type == NODE_VARIABLE || type == NODE_ARRAY_ACCESS) && info.ref(node).kind == RefKind::VARIABLE) {
+        uint32_t variable = info.ref(node).index;
+        if (info.variables[variable].storage == Storage::GLOBAL) shared[variable] = true;
+    }
+}
+
+void findSharedGlobals(const AstArena& ast, const SemanticInfo& info, std::vector<bool>& shared) {
+    shared.assign(info.variables.size(), false);
+    for (const SubprogramInfo& subprogram : info.subprograms) {
+        markGlobals(ast, info, ast.child(subprogram.node, 2), shared);
+    }
+}
+
+void printAllocationStats(const RegisterAllocationStats& stats, std::ostream& out) {
+    out << "Register allocation: " << stats.intervals << " intervals, " << stats.allocated << " in registers, "
+        << stats.spilled << " spilled to memory, " << stats.loads << " loads, " << stats.stores << " stores" << std::endl;
+}
@@ -0,0 +1,73 @@
+#ifndef REGISTER_ALLOCATION_H
+#define REGISTER_ALLOCATION_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "ast.h"
+#include "ast_arena.h"
+#include "semantic_info.h"
+
+// Linear-scan allocation of scalar variables to machine registers for the
+// native backend, one routine at a time.
+//
+// The linear IR is the routine's statements in emission order, each with a
+// start and an end position. A variable is live over every statement that
+// mentions it, widened to cover whole while loops it is used in (its value
+// goes around the back edge) and whole if statements it enters or leaves
+// partway, so its load at the start and store at the end run on every path.
+// Variables that lose out stay in memory.
+
+enum PhysicalRegister : uint8_t {
+    REG_RBX, REG_R12, REG_R13, REG_R14, REG_R15,    // callee-saved
+    REG_R10, REG_R11,                               // caller-saved, never used by the generator
+    REG_XMM8, REG_XMM9, REG_XMM10, REG_XMM11, REG_XMM12, REG_XMM13, REG_XMM14, REG_XMM15,
+    REG_COUNT,
+    NO_REGISTER = 0xFF
+};
+
+const unsigned CALLEE_SAVED_REGISTERS = 5;
+
+struct LiveInterval {
+    uint32_t variable;
+    uint32_t start;
+    uint32_t end;
+    float weight;       // references, each weighted by 8^loop depth
+    bool real;
+    bool written;
+    bool needsLoad;     // false when it starts by assigning the variable without a call
+    bool crossesCall;   // only callee-saved registers survive it
+    uint8_t reg;
+};
+
+struct RegisterAllocationStats {
+    uint32_t intervals = 0;
+    uint32_t allocated = 0;
+    uint32_t spilled = 0;
+    uint32_t loads = 0;     // counted by the code generator
+    uint32_t stores = 0;
+};
+
+struct RegisterAllocation {
+    std::vector<LiveInterval> intervals;    // by start position
+    std::vector<uint32_t> statementStart;   // by NodeId
+    std::vector<uint32_t> statementEnd;
+    std::vector<uint8_t> location;          // by variable: register or NO_REGISTER
+    uint32_t calleeSaved = 0;               // how many of REG_RBX..REG_R15 are in use
+
+    bool inRegister(uint32_t variable) const { return location[variable] != NO_REGISTER; }
+};
+
+// Allocates the scalar variables used by `body`, the statement part of a
+// subprogram or of the main program.
+void allocateRegisters(const AstArena& ast, const SemanticInfo& info, NodeId body,
+                       RegisterAllocation& out, RegisterAllocationStats& stats);
+
+// Marks the globals some subprogram reads or writes: a caller keeping one in
+// a register has to store it before a call and reload it after.
+void findSharedGlobals(const AstArena& ast, const SemanticInfo& info, std::vector<bool>& shared);
+
+// One line: intervals, how many got a register, spills, loads and stores.
+void printAllocationStats(const RegisterAllocationStats& stats, std::ostream& out);
+
+#endif // REGISTER_ALLOCATION_H
@@ -0,0 +1,531 @@
+#include "register_bytecode.h"
+
+#include <initializer_list>
+#include <iomanip>
+
+static const char* const registerOpcodeNames[R_OPCODE_COUNT] = {
+#define REGISTER_NAME(name) #name,
+    REGISTER_OPS(REGISTER_NAME)
+#undef REGISTER_NAME
+};
+
+const char* registerOpcodeName(RegisterOpcode op) {
+    return op < R_OPCODE_COUNT ? registerOpcodeNames[op] : "?";
+}
+
+unsigned registerOperandCount(RegisterOpcode op) {
+    switch (op) {
+    case R_RETURN:
+    case R_HALT:
+        return 0;
+    case R_JUMP:
+    case R_RETURN_VALUE:
+        return 1;
+    case R_MOVE:
+    case R_LOADK_I:
+    case R_LOADK_R:
+    case R_GET_GLOBAL:
+    case R_SET_GLOBAL:
+    case R_INC_LOCAL:
+    case R_NEG_I:
+    case R_NEG_R:
+    case R_INT_TO_REAL:
+    case R_NOT:
+    case R_JUMP_IF:
+    case R_JUMP_IF_NOT:
+        return 2;
+    case R_LOAD_ELEM:
+    case R_LOAD_ELEM_GLOBAL:
+    case R_STORE_ELEM:
+    case R_STORE_ELEM_GLOBAL:
+    case R_STORE_ELEM_K:
+        return 5;
+    case R_ADD_ELEM_I:
+        return 6;
+    default:
+        return 3;
+    }
+}
+
+namespace {
+
+const uint32_t NO_REGISTER = 0xFFFFFFFFu;
+
+// EQ, NE, LT, LE, GT, GE are consecutive in OpKind and in every opcode group
+RegisterOpcode comparison(RegisterOpcode first, OpKind op) {
+    return static_cast<RegisterOpcode>(first + (op - OP_EQ));
+}
+
+OpKind negated(OpKind op) {
+    switch (op) {
+    case OP_EQ: return OP_NEQ;
+    case OP_NEQ: return OP_EQ;
+    case OP_LT: return OP_GE;
+    case OP_LE: return OP_GT;
+    case OP_GT: return OP_LE;
+    default: return OP_LT;
+    }
+}
+
+bool isRelational(OpKind op) {
+    return op >= OP_EQ && op <= OP_GE;
+}
+
+class RegisterCompiler {
+public:
+    RegisterCompiler(const AstArena& ast, const SemanticInfo& info, RegisterProgram& out)
+        : ast(ast), info(info), out(out), inMain(true), tempBase(0), tempTop(0), tempMax(0) {}
+
+    void compileProgram(NodeId root);
+
+private:
+    void beginBody(bool main, uint32_t variableCells);
+    bool inRegisters(const VariableInfo& variable) const {
+        return variable.storage == Storage::FRAME || inMain;
+    }
+    uint32_t temp(uint32_t cells = 1);
+    uint32_t target(uint32_t dest) { return dest != NO_REGISTER ? dest : temp(); }
+    uint32_t stable(uint32_t reg, NodeId later);
+    bool constant(NodeId id, int32_t& value) const;
+    bool containsCall(NodeId id) const;
+
+    void emit(RegisterOpcode op, std::initializer_list<uint32_t> operands);
+    size_t emitJump(RegisterOpcode op, std::initializer_list<uint32_t> operands);
+    void patchHere(const std::vector<size_t>& jumps);
+
+    uint32_t expression(NodeId id, uint32_t dest = NO_REGISTER);
+    uint32_t binary(NodeId id, uint32_t dest);
+    uint32_t call(NodeId id, uint32_t index, uint32_t dest);
+    void branch(NodeId condition, bool when, std::vector<size_t>& jumps);
+    void statement(NodeId id);
+
+    const AstArena& ast;
+    const SemanticInfo& info;
+    RegisterProgram& out;
+    bool inMain;
+    uint32_t tempBase;  // first register past the variables
+    uint32_t tempTop;   // temporaries are released at every statement
+    uint32_t tempMax;
+};
+
+void RegisterCompiler::beginBody(bool main, uint32_t variableCells) {
+    inMain = main;
+    tempBase = tempTop = tempMax = variableCells;
+}
+
+uint32_t RegisterCompiler::temp(uint32_t cells) {
+    uint32_t reg = tempTop;
+    tempTop += cells;
+    if (tempTop > tempMax) tempMax = tempTop;
+    return reg;
+}
+
+// A variable read straight from its register would see a later call's
+// side effects; snapshot it when `later` contains a call.
+uint32_t RegisterCompiler::stable(uint32_t reg, NodeId later) {
+    if (reg >= tempBase || !containsCall(later)) return reg;
+    uint32_t copy = temp();
+    emit(R_MOVE, { copy, reg });
+    return copy;
+}
+
+bool RegisterCompiler::constant(NodeId id, int32_t& value) const {
+    const ASTNode& node = ast.node(id);
+    if (node.type == NODE_INT_NUM) value = node.intVal;
+    else if (node.type == NODE_BOOLEAN) value = node.boolVal ? 1 : 0;
+    else return false;
+    return true;
+}
+
+bool RegisterCompiler::containsCall(NodeId id) const {
+    const ASTNode& node = ast.node(id);
+    if (node.type == NODE_FUNCTION_CALL) return true;
+    if (node.type == NODE_VARIABLE) return info.ref(id).kind == RefKind::CALL;
+    for (NodeId child = node.firstChild; child; child = ast.nextSibling(child)) {
+        if (containsCall(child)) return true;
+    }
+    return false;
+}
+
+void RegisterCompiler::emit(RegisterOpcode op, std::initializer_list<uint32_t> operands) {
+    out.code.push_back(op);
+    out.code.insert(out.code.end(), operands.begin(), operands.end());
+}
+
+// The jump target is the last operand; returns its position for patching.
+size_t RegisterCompiler::emitJump(RegisterOpcode op, std::initializer_list<uint32_t> operands) {
+    emit(op, operands);
+    return out.code.size() - 1;
+}
+
+void RegisterCompiler::patchHere(const std::vector<size_t>& jumps) {
+    for (size_t at : jumps) out.code[at] = static_cast<uint32_t>(out.code.size());
+}
+
+void RegisterCompiler::compileProgram(NodeId root) {
+    out.code.clear();
+    out.reals.clear();
+    out.functions.clear();
+    out.globalCells = info.globalCells;
+
+    beginBody(true, info.globalCells);
+    out.mainEntry = 0;
+    statement(ast.child(root, 2));
+    emit(R_HALT, {});
+    out.mainFrameSize = tempMax;
+
+    for (const SubprogramInfo& subprogram : info.subprograms) {
+        RegisterFunction function;
+        function.name = subprogram.name;
+        function.entry = static_cast<uint32_t>(out.code.size());
+        function.paramCells = subprogram.paramCells;
+        function.frameCells = subprogram.frameCells;
+        function.isFunction = subprogram.isFunction;
+
+        beginBody(false, subprogram.frameCells);
+        statement(ast.child(subprogram.node, 2));
+        if (subprogram.isFunction) emit(R_RETURN_VALUE, { subprogram.resultSlot });
+        else emit(R_RETURN, {});
+        function.frameSize = tempMax;
+        out.functions.push_back(function);
+    }
+}
+
+// Arguments are evaluated straight into the registers that become the
+// callee's parameters, at the top of the caller's frame.
+uint32_t RegisterCompiler::call(NodeId id, uint32_t index, uint32_t dest) {
+    const SubprogramInfo& subprogram = info.subprograms[index];
+    uint32_t result = subprogram.isFunction ? target(dest) : NO_REGISTER;
+    uint32_t args = temp(subprogram.paramCells);
+
+    uint32_t slot = args;
+    uint32_t param = subprogram.firstParam;
+    for (NodeId arg = ast.firstChild(id); arg; arg = ast.nextSibling(arg), ++param) {
+        expression(arg, slot);
+        slot += info.variables[param].cells;
+    }
+    emit(R_CALL, { index, args, result });
+    return result;
+}
+
+uint32_t RegisterCompiler::expression(NodeId id, uint32_t dest) {
+    const ASTNode& node = ast.node(id);
+    switch (node.type) {
+    case NODE_INT_NUM:
+    case NODE_BOOLEAN: {
+        int32_t value = 0;
+        constant(id, value);
+        uint32_t d = target(dest);
+        emit(R_LOADK_I, { d, static_cast<uint32_t>(value) });
+        return d;
+    }
+    case NODE_REAL_NUM: {
+        uint32_t d = target(dest);
+        emit(R_LOADK_R, { d, static_cast<uint32_t>(out.reals.size()) });
+        out.reals.push_back(node.realVal);
+        return d;
+    }
+    case NODE_VARIABLE: {
+        if (info.ref(id).kind == RefKind::CALL) return call(id, info.ref(id).index, dest);
+
+        const VariableInfo& variable = info.variable(id);
+        bool array = variable.type.baseType == DataType::ARRAY;
+        if (inRegisters(variable)) {
+            if (dest == NO_REGISTER || dest == variable.slot) return variable.slot;
+            if (array) emit(R_COPY, { dest, variable.slot, variable.cells });
+            else emit(R_MOVE, { dest, variable.slot });
+            return dest;
+        }
+        if (array) {
+            uint32_t d = dest != NO_REGISTER ? dest : temp(variable.cells);
+            emit(R_COPY_FROM_GLOBAL, { d, variable.slot, variable.cells });
+            return d;
+        }
+        uint32_t d = target(dest);
+        emit(R_GET_GLOBAL, { d, variable.slot });
+        return d;
+    }
+    case NODE_ARRAY_ACCESS: {
+        const VariableInfo& array = info.variable(id);
+        uint32_t index = expression(ast.child(id, 0));
+        uint32_t d = target(dest);
+        emit(inRegisters(array) ? R_LOAD_ELEM : R_LOAD_ELEM_GLOBAL,
+             { d, array.slot, index, static_cast<uint32_t>(array.type.arrayStart), array.cells });
+        return d;
+    }
+    case NODE_FUNCTION_CALL:
+        return call(id, info.ref(id).index, dest);
+    case NODE_UNARY_OP: {
+        NodeId operand = ast.child(id, 0);
+        uint32_t a = expression(operand);
+        uint32_t d = target(dest);
+        if (node.op == OP_NOT) emit(R_NOT, { d, a });
+        else emit(info.typeOf(operand) == DataType::REAL ? R_NEG_R : R_NEG_I, { d, a });
+        return d;
+    }
+    case NODE_BINARY_OP:
+        return binary(id, dest);
+    default:
+        return target(dest);
+    }
+}
+
+uint32_t RegisterCompiler::binary(NodeId id, uint32_t dest) {
+    const ASTNode& node = ast.node(id);
+    NodeId left = ast.child(id, 0);
+    NodeId right = ast.child(id, 1);
+    bool real = info.typeOf(left) == DataType::REAL;
+
+    // and / or only exist as control flow; materialize the outcome
+    if (node.op == OP_AND || node.op == OP_OR) {
+        uint32_t t = temp();
+        std::vector<size_t> toFalse;
+        branch(id, false, toFalse);
+        emit(R_LOADK_I, { t, 1 });
+        size_t end = emitJump(R_JUMP, { 0 });
+        patchHere(toFalse);
+        emit(R_LOADK_I, { t, 0 });
+        patchHere({ end });
+        if (dest == NO_REGISTER) return t;
+        emit(R_MOVE, { dest, t });
+        return dest;
+    }
+
+    if (node.op == OP_DIVIDE) {
+        uint32_t a = stable(expression(left), right);
+        if (!real) {
+            uint32_t t = temp();
+            emit(R_INT_TO_REAL, { t, a });
+            a = t;
+        }
+        uint32_t b = expression(right);
+        if (!real) {
+            uint32_t t = temp();
+            emit(R_INT_TO_REAL, { t, b });
+            b = t;
+        }
+        uint32_t d = target(dest);
+        emit(R_DIV_R, { d, a, b });
+        return d;
+    }
+
+    if (!real && (node.op == OP_ADD || node.op == OP_SUB)) {
+        // x + k, x - k, k + x
+        int32_t k;
+        NodeId other = NULL_NODE;
+        uint32_t addend = 0;
+        if (constant(right, k)) {
+            other = left;
+            addend = node.op == OP_SUB ? 0u - static_cast<uint32_t>(k) : static_cast<uint32_t>(k);
+        }
+        else if (node.op == OP_ADD && constant(left, k)) {
+            other = right;
+            addend = static_cast<uint32_t>(k);
+        }
+        if (other) {
+            uint32_t a = expression(other);
+            uint32_t d = target(dest);
+            if (d == a) emit(R_INC_LOCAL, { d, addend });
+            else emit(R_ADDK_I, { d, a, addend });
+            return d;
+        }
+
+        // x + a[i] and a[i] + x
+        if (node.op == OP_ADD) {
+            NodeId access = NULL_NODE;
+            if (ast.node(right).type == NODE_ARRAY_ACCESS && inRegisters(info.variable(right))) {
+                access = right;
+                other = left;
+            }
+            else if (ast.node(left).type == NODE_ARRAY_ACCESS && inRegisters(info.variable(left))) {
+                access = left;
+                other = right;
+            }
+            if (access) {
+                const VariableInfo& array = info.variable(access);
+                uint32_t a = stable(expression(other), access);
+                uint32_t index = expression(ast.child(access, 0));
+                uint32_t d = target(dest);
+                emit(R_ADD_ELEM_I, { d, a, array.slot, index,
+                                     static_cast<uint32_t>(array.type.arrayStart), array.cells });
+                return d;
+            }
+        }
+    }
+
+    uint32_t a = stable(expression(left), right);
+    uint32_t b = expression(right);
+    uint32_t d = target(dest);
+    switch (node.op) {
+    case OP_ADD: emit(real ? R_ADD_R : R_ADD_I, { d, a, b }); break;
+    case OP_SUB: emit(real ? R_SUB_R : R_SUB_I, { d, a, b }); break;
+    case OP_MUL: emit(real ? R_MUL_R : R_MUL_I, { d, a, b }); break;
+    case OP_DIV: emit(R_DIV_I, { d, a, b }); break;
+    default:
+        if (isRelational(node.op)) emit(comparison(real ? R_EQ_R : R_EQ_I, node.op), { d, a, b });
+        break;
+    }
+    return d;
+}
+
+// Emits a jump taken when `condition` evaluates to `when`; the positions to
+// patch with the target are added to `jumps`. Relational operators become
+// compare-and-branch instructions, and / or become jump chains.
+void RegisterCompiler::branch(NodeId condition, bool when, std::vector<size_t>& jumps) {
+    const ASTNode& node = ast.node(condition);
+    if (node.type == NODE_UNARY_OP && node.op == OP_NOT) {
+        branch(ast.child(condition, 0), !when, jumps);
+        return;
+    }
+    if (node.type == NODE_BOOLEAN) {
+        if (node.boolVal == when) jumps.push_back(emitJump(R_JUMP, { 0 }));
+        return;
+    }
+    if (node.type == NODE_BINARY_OP) {
+        NodeId left = ast.child(condition, 0);
+        NodeId right = ast.child(condition, 1);
+        if (node.op == OP_AND || node.op == OP_OR) {
+            if ((node.op == OP_AND) != when) {
+                branch(left, when, jumps);
+                branch(right, when, jumps);
+            }
+            else {
+                std::vector<size_t> skip;
+                branch(left, !when, skip);
+                branch(right, when, jumps);
+                patchHere(skip);
+            }
+            return;
+        }
+        if (isRelational(node.op)) {
+            OpKind op = when ? node.op : negated(node.op);
+            bool real = info.typeOf(left) == DataType::REAL;
+            int32_t k;
+            uint32_t a = stable(expression(left), right);
+            if (!real && constant(right, k)) {
+                jumps.push_back(emitJump(comparison(R_JEQ_K, op), { a, static_cast<uint32_t>(k), 0 }));
+            }
+            else {
+                uint32_t b = expression(right);
+                jumps.push_back(emitJump(comparison(real ? R_JEQ_R : R_JEQ_I, op), { a, b, 0 }));
+            }
+            return;
+        }
+    }
+
+    uint32_t a = expression(condition);
+    jumps.push_back(emitJump(when ? R_JUMP_IF : R_JUMP_IF_NOT, { a, 0 }));
+}
+
+void RegisterCompiler::statement(NodeId id) {
+    if (!id) return;
+
+    tempTop = tempBase;
+    const ASTNode& node = ast.node(id);
+    switch (node.type) {
+    case NODE_COMPOUND_STMT:
+        for (NodeId child = ast.firstChild(id); child; child = ast.nextSibling(child)) {
+            statement(child);
+        }
+        break;
+    case NODE_ASSIGNMENT: {
+        NodeId lhs = ast.child(id, 0);
+        NodeId value = ast.child(id, 1);
+        if (ast.node(lhs).type == NODE_ARRAY_ACCESS) {
+            const VariableInfo& array = info.variable(lhs);
+            uint32_t index = stable(expression(ast.child(lhs, 0)), value);
+            uint32_t low = static_cast<uint32_t>(array.type.arrayStart);
+            int32_t k;
+            if (inRegisters(array) && constant(value, k)) {
+                emit(R_STORE_ELEM_K, { array.slot, index, static_cast<uint32_t>(k), low, array.cells });
+            }
+            else {
+                uint32_t a = expression(value);
+                emit(inRegisters(array) ? R_STORE_ELEM : R_STORE_ELEM_GLOBAL,
+                     { array.slot, index, a, low, array.cells });
+            }
+        }
+        else if (info.ref(lhs).kind == RefKind::RESULT) {
+            expression(value, info.subprogram(lhs).resultSlot);
+        }
+        else {
+            const VariableInfo& variable = info.variable(lhs);
+            if (inRegisters(variable)) {
+                expression(value, variable.slot);
+            }
+            else {
+                uint32_t a = expression(value);
+                if (variable.type.baseType == DataType::ARRAY)
+                    emit(R_COPY_TO_GLOBAL, { variable.slot, a, variable.cells });
+                else
+                    emit(R_SET_GLOBAL, { variable.slot, a });
+            }
+        }
+        break;
+    }
+    case NODE_IF: {
+        std::vector<size_t> toElse;
+        branch(ast.child(id, 0), false, toElse);
+        statement(ast.child(id, 1));
+        NodeId elseStmt = ast.child(id, 2);
+        if (elseStmt) {
+            size_t skipElse = emitJump(R_JUMP, { 0 });
+            patchHere(toElse);
+            statement(elseStmt);
+            patchHere({ skipElse });
+        }
+        else {
+            patchHere(toElse);
+        }
+        break;
+    }
+    case NODE_WHILE: {
+        // Condition at the bottom: one compare-and-branch per iteration
+        size_t toCondition = emitJump(R_JUMP, { 0 });
+        uint32_t body = static_cast<uint32_t>(out.code.size());
+        statement(ast.child(id, 1));
+        patchHere({ toCondition });
+        tempTop = tempBase;
+        std::vector<size_t> toBody;
+        branch(ast.child(id, 0), true, toBody);
+        for (size_t at : toBody) out.code[at] = body;
+        break;
+    }
+    case NODE_PROCEDURE_CALL:
+    case NODE_FUNCTION_CALL:
+        call(id, info.ref(id).index, NO_REGISTER);
+        break;
+    default:
+        break;
+    }
+}
+
+} // namespace
+
+void compileRegisterBytecode(const AstArena& ast, NodeId root, const SemanticInfo& info, RegisterProgram& out) {
+    RegisterCompiler compiler(ast, info, out);
+    compiler.compileProgram(root);
+}
+
+void disassemble(const RegisterProgram& program, std::ostream& out) {
+    const std::vector<uint32_t>& code = program.code;
+    size_t function = 0;
+    out << "main:\n";
+    for (size_t pc = 0; pc < code.size();) {
+        while (function < program.functions.size() && program.functions[function].entry == pc) {
+            out << nameOf(program.functions[function].name) << ":\n";
+            ++function;
+        }
+
+        RegisterOpcode opcode = static_cast<RegisterOpcode>(code[pc]);
+        unsigned operands = registerOperandCount(opcode);
+        out << std::setw(6) << pc << "  " << registerOpcodeName(opcode);
+        for (unsigned i = 1; i <= operands; ++i) {
+            out << ' ' << static_cast<int32_t>(code[pc + i]);
+        }
+        if (opcode == R_LOADK_R) out << "  ; " << program.reals[code[pc + 2]];
+        else if (opcode == R_CALL) out << "  ; " << nameOf(program.functions[code[pc + 1]].name);
+        out << '\n';
+        pc += 1 + operands;
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef REGISTER_BYTECODE_H
+#define REGISTER_BYTECODE_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "ast.h"
+#include "ast_arena.h"
+#include "bytecode.h"
+#include "semantic_info.h"
+
+// Register bytecode. Registers are cells of the current frame: the
+// variables at the slots SemanticInfo assigned them, then temporaries.
+// The main program's frame is the global area itself, so in main every
+// variable is a register; subprograms reach globals with GET/SET_GLOBAL.
+//
+// Code is a stream of 32-bit words, an opcode followed by its operands:
+//
+//   d a b     destination and source registers
+//   k         i32 immediate
+//   g         global cell
+//   base idx low count   array at register `base`, index register, range
+//   target    absolute word offset of a jump target
+//
+// The *_K compare-and-branch, INC_LOCAL, ADD_ELEM_I and STORE_ELEM_K
+// instructions are superinstructions for the shapes that dominate loops:
+// `while i < n`, `i := i + 1`, `s := s + a[i]` and `a[i] := 0`.
+#define REGISTER_OPS(X) \
+    X(MOVE)             /* d a */ \
+    X(LOADK_I)          /* d k */ \
+    X(LOADK_R)          /* d constant */ \
+    X(GET_GLOBAL)       /* d g */ \
+    X(SET_GLOBAL)       /* g a */ \
+    X(COPY)             /* d a count */ \
+    X(COPY_FROM_GLOBAL) /* d g count */ \
+    X(COPY_TO_GLOBAL)   /* g a count */ \
+    X(LOAD_ELEM)        /* d base idx low count */ \
+    X(LOAD_ELEM_GLOBAL) /* d g idx low count */ \
+    X(STORE_ELEM)       /* base idx a low count */ \
+    X(STORE_ELEM_GLOBAL)/* g idx a low count */ \
+    X(STORE_ELEM_K)     /* base idx k low count */ \
+    X(ADD_ELEM_I)       /* d a base idx low count:  d = a + base[idx] */ \
+    X(ADD_I) X(SUB_I) X(MUL_I) X(DIV_I) /* d a b */ \
+    X(ADDK_I)           /* d a k */ \
+    X(INC_LOCAL)        /* d k:  d = d + k */ \
+    X(NEG_I)            /* d a */ \
+    X(ADD_R) X(SUB_R) X(MUL_R) X(DIV_R) /* d a b */ \
+    X(NEG_R) X(INT_TO_REAL) X(NOT) /* d a */ \
+    X(EQ_I) X(NE_I) X(LT_I) X(LE_I) X(GT_I) X(GE_I) /* d a b */ \
+    X(EQ_R) X(NE_R) X(LT_R) X(LE_R) X(GT_R) X(GE_R) /* d a b */ \
+    X(JEQ_I) X(JNE_I) X(JLT_I) X(JLE_I) X(JGT_I) X(JGE_I) /* a b target */ \
+    X(JEQ_K) X(JNE_K) X(JLT_K) X(JLE_K) X(JGT_K) X(JGE_K) /* a k target */ \
+    X(JEQ_R) X(JNE_R) X(JLT_R) X(JLE_R) X(JGT_R) X(JGE_R) /* a b target */ \
+    X(JUMP)             /* target */ \
+    X(JUMP_IF)          /* a target */ \
+    X(JUMP_IF_NOT)      /* a target */ \
+    X(CALL)             /* function args d:  callee frame starts at register args */ \
+    X(RETURN) \
+    X(RETURN_VALUE)     /* a */ \
+    X(HALT)
+
+enum RegisterOpcode : uint32_t {
+#define REGISTER_ENUM(name) R_##name,
+    REGISTER_OPS(REGISTER_ENUM)
+#undef REGISTER_ENUM
+    R_OPCODE_COUNT
+};
+
+const char* registerOpcodeName(RegisterOpcode op);
+
+// Number of operand words that follow the opcode.
+unsigned registerOperandCount(RegisterOpcode op);
+
+struct RegisterFunction {
+    NameId name;
+    uint32_t entry;         // word offset of the first instruction
+    uint32_t paramCells;
+    uint32_t frameCells;    // variables, zeroed on entry past the parameters
+    uint32_t frameSize;     // variables + temporaries
+    bool isFunction;
+};
+
+struct RegisterProgram {
+    std::vector<uint32_t> code;
+    std::vector<double> reals;
+    std::vector<RegisterFunction> functions;   // same order as SemanticInfo::subprograms
+    uint32_t mainEntry = 0;
+    uint32_t globalCells = 0;
+    uint32_t mainFrameSize = 0;                // globals + main's temporaries
+};
+
+void compileRegisterBytecode(const AstArena& ast, NodeId root, const SemanticInfo& info, RegisterProgram& out);
+
+void disassemble(const RegisterProgram& program, std::ostream& out);
+
+#endif // REGISTER_BYTECODE_H
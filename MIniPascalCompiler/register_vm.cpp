@@ -0,0 +1,327 @@
+#include "register_vm.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+static const size_t MAX_CALL_DEPTH = 1u << 16;
+
+// Integers wrap around on overflow
+static inline int32_t wrap(uint32_t value) {
+    return static_cast<int32_t>(value);
+}
+
+RegisterVM::RegisterVM(const RegisterProgram& program, size_t stackCells)
+    : program(program), stack(std::max<size_t>(stackCells, program.mainFrameSize)), dispatches(0) {}
+
+bool RegisterVM::run() {
+    std::fill(stack.begin(), stack.begin() + program.mainFrameSize, Value{});
+    frames.clear();
+    frames.reserve(64);
+    errorMessage.clear();
+    dispatches = 0;
+
+    const uint32_t* const code = program.code.data();
+    const double* const reals = program.reals.data();
+    const RegisterFunction* const functions = program.functions.data();
+    Value* const globals = stack.data();
+    Value* const stackEnd = stack.data() + stack.size();
+    const uint32_t* pc = code + program.mainEntry;
+    Value* fp = globals;
+    uint64_t count = 0;
+
+#ifdef VM_COMPUTED_GOTO
+    static const void* const dispatchTable[R_OPCODE_COUNT] = {
+#define REGISTER_LABEL(name) &&op_##name,
+        REGISTER_OPS(REGISTER_LABEL)
+#undef REGISTER_LABEL
+    };
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() do { ++count; goto *dispatchTable[*pc]; } while (0)
+    VM_NEXT();
+    {
+#else
+#define VM_CASE(name) case R_##name:
+#define VM_NEXT() continue
+    for (;;) {
+        ++count;
+        switch (*pc) {
+#endif
+
+    VM_CASE(MOVE) {
+        fp[pc[1]] = fp[pc[2]];
+        pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(LOADK_I) {
+        fp[pc[1]].i = static_cast<int32_t>(pc[2]);
+        pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(LOADK_R) {
+        fp[pc[1]].r = reals[pc[2]];
+        pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(GET_GLOBAL) {
+        fp[pc[1]] = globals[pc[2]];
+        pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(SET_GLOBAL) {
+        globals[pc[1]] = fp[pc[2]];
+        pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(COPY) {
+        std::memmove(fp + pc[1], fp + pc[2], pc[3] * sizeof(Value));
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(COPY_FROM_GLOBAL) {
+        std::memmove(fp + pc[1], globals + pc[2], pc[3] * sizeof(Value));
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(COPY_TO_GLOBAL) {
+        std::memmove(globals + pc[1], fp + pc[2], pc[3] * sizeof(Value));
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_ELEM) {
+        uint32_t index = static_cast<uint32_t>(fp[pc[3]].i) - pc[4];
+        if (index >= pc[5]) goto outOfBounds;
+        fp[pc[1]] = fp[pc[2] + index];
+        pc += 6;
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_ELEM_GLOBAL) {
+        uint32_t index = static_cast<uint32_t>(fp[pc[3]].i) - pc[4];
+        if (index >= pc[5]) goto outOfBounds;
+        fp[pc[1]] = globals[pc[2] + index];
+        pc += 6;
+        VM_NEXT();
+    }
+    VM_CASE(STORE_ELEM) {
+        uint32_t index = static_cast<uint32_t>(fp[pc[2]].i) - pc[4];
+        if (index >= pc[5]) goto outOfBounds;
+        fp[pc[1] + index] = fp[pc[3]];
+        pc += 6;
+        VM_NEXT();
+    }
+    VM_CASE(STORE_ELEM_GLOBAL) {
+        uint32_t index = static_cast<uint32_t>(fp[pc[2]].i) - pc[4];
+        if (index >= pc[5]) goto outOfBounds;
+        globals[pc[1] + index] = fp[pc[3]];
+        pc += 6;
+        VM_NEXT();
+    }
+    VM_CASE(STORE_ELEM_K) {
+        uint32_t index = static_cast<uint32_t>(fp[pc[2]].i) - pc[4];
+        if (index >= pc[5]) goto outOfBounds;
+        fp[pc[1] + index].r = 0.0;
+        fp[pc[1] + index].i = static_cast<int32_t>(pc[3]);
+        pc += 6;
+        VM_NEXT();
+    }
+    VM_CASE(ADD_ELEM_I) {
+        uint32_t index = static_cast<uint32_t>(fp[pc[4]].i) - pc[5];
+        if (index >= pc[6]) goto outOfBounds;
+        fp[pc[1]].i = wrap(static_cast<uint32_t>(fp[pc[2]].i) + static_cast<uint32_t>(fp[pc[3] + index].i));
+        pc += 7;
+        VM_NEXT();
+    }
+
+    VM_CASE(ADD_I) {
+        fp[pc[1]].i = wrap(static_cast<uint32_t>(fp[pc[2]].i) + static_cast<uint32_t>(fp[pc[3]].i));
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(SUB_I) {
+        fp[pc[1]].i = wrap(static_cast<uint32_t>(fp[pc[2]].i) - static_cast<uint32_t>(fp[pc[3]].i));
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(MUL_I) {
+        fp[pc[1]].i = wrap(static_cast<uint32_t>(fp[pc[2]].i) * static_cast<uint32_t>(fp[pc[3]].i));
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(DIV_I) {
+        int32_t divisor = fp[pc[3]].i;
+        if (divisor == 0) goto divisionByZero;
+        if (divisor == -1) fp[pc[1]].i = wrap(0u - static_cast<uint32_t>(fp[pc[2]].i));
+        else fp[pc[1]].i = fp[pc[2]].i / divisor;
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(ADDK_I) {
+        fp[pc[1]].i = wrap(static_cast<uint32_t>(fp[pc[2]].i) + pc[3]);
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(INC_LOCAL) {
+        fp[pc[1]].i = wrap(static_cast<uint32_t>(fp[pc[1]].i) + pc[2]);
+        pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(NEG_I) {
+        fp[pc[1]].i = wrap(0u - static_cast<uint32_t>(fp[pc[2]].i));
+        pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(ADD_R) {
+        fp[pc[1]].r = fp[pc[2]].r + fp[pc[3]].r;
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(SUB_R) {
+        fp[pc[1]].r = fp[pc[2]].r - fp[pc[3]].r;
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(MUL_R) {
+        fp[pc[1]].r = fp[pc[2]].r * fp[pc[3]].r;
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(DIV_R) {
+        fp[pc[1]].r = fp[pc[2]].r / fp[pc[3]].r;
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(NEG_R) {
+        fp[pc[1]].r = -fp[pc[2]].r;
+        pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(INT_TO_REAL) {
+        fp[pc[1]].r = static_cast<double>(fp[pc[2]].i);
+        pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(NOT) {
+        fp[pc[1]].i = !fp[pc[2]].i;
+        pc += 3;
+        VM_NEXT();
+    }
+
+#define VM_COMPARE(name, field, cmp) \
+    VM_CASE(name) { \
+        fp[pc[1]].i = fp[pc[2]].field cmp fp[pc[3]].field; \
+        pc += 4; \
+        VM_NEXT(); \
+    }
+    VM_COMPARE(EQ_I, i, ==)
+    VM_COMPARE(NE_I, i, !=)
+    VM_COMPARE(LT_I, i, <)
+    VM_COMPARE(LE_I, i, <=)
+    VM_COMPARE(GT_I, i, >)
+    VM_COMPARE(GE_I, i, >=)
+    VM_COMPARE(EQ_R, r, ==)
+    VM_COMPARE(NE_R, r, !=)
+    VM_COMPARE(LT_R, r, <)
+    VM_COMPARE(LE_R, r, <=)
+    VM_COMPARE(GT_R, r, >)
+    VM_COMPARE(GE_R, r, >=)
+#undef VM_COMPARE
+
+#define VM_BRANCH(name, lhs, rhs, cmp) \
+    VM_CASE(name) { \
+        if (lhs cmp rhs) pc = code + pc[3]; \
+        else pc += 4; \
+        VM_NEXT(); \
+    }
+    VM_BRANCH(JEQ_I, fp[pc[1]].i, fp[pc[2]].i, ==)
+    VM_BRANCH(JNE_I, fp[pc[1]].i, fp[pc[2]].i, !=)
+    VM_BRANCH(JLT_I, fp[pc[1]].i, fp[pc[2]].i, <)
+    VM_BRANCH(JLE_I, fp[pc[1]].i, fp[pc[2]].i, <=)
+    VM_BRANCH(JGT_I, fp[pc[1]].i, fp[pc[2]].i, >)
+    VM_BRANCH(JGE_I, fp[pc[1]].i, fp[pc[2]].i, >=)
+    VM_BRANCH(JEQ_K, fp[pc[1]].i, static_cast<int32_t>(pc[2]), ==)
+    VM_BRANCH(JNE_K, fp[pc[1]].i, static_cast<int32_t>(pc[2]), !=)
+    VM_BRANCH(JLT_K, fp[pc[1]].i, static_cast<int32_t>(pc[2]), <)
+    VM_BRANCH(JLE_K, fp[pc[1]].i, static_cast<int32_t>(pc[2]), <=)
+    VM_BRANCH(JGT_K, fp[pc[1]].i, static_cast<int32_t>(pc[2]), >)
+    VM_BRANCH(JGE_K, fp[pc[1]].i, static_cast<int32_t>(pc[2]), >=)
+    VM_BRANCH(JEQ_R, fp[pc[1]].r, fp[pc[2]].r, ==)
+    VM_BRANCH(JNE_R, fp[pc[1]].r, fp[pc[2]].r, !=)
+    VM_BRANCH(JLT_R, fp[pc[1]].r, fp[pc[2]].r, <)
+    VM_BRANCH(JLE_R, fp[pc[1]].r, fp[pc[2]].r, <=)
+    VM_BRANCH(JGT_R, fp[pc[1]].r, fp[pc[2]].r, >)
+    VM_BRANCH(JGE_R, fp[pc[1]].r, fp[pc[2]].r, >=)
+#undef VM_BRANCH
+
+    VM_CASE(JUMP) {
+        pc = code + pc[1];
+        VM_NEXT();
+    }
+    VM_CASE(JUMP_IF) {
+        if (fp[pc[1]].i) pc = code + pc[2];
+        else pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(JUMP_IF_NOT) {
+        if (!fp[pc[1]].i) pc = code + pc[2];
+        else pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(CALL) {
+        const RegisterFunction& function = functions[pc[1]];
+        Value* base = fp + pc[2];
+        if (base + function.frameSize > stackEnd || frames.size() >= MAX_CALL_DEPTH) goto stackOverflow;
+        for (Value* cell = base + function.paramCells; cell < base + function.frameCells; ++cell) cell->r = 0.0;
+        frames.push_back(CallFrame{ pc + 4, fp, pc[3] });
+        fp = base;
+        pc = code + function.entry;
+        VM_NEXT();
+    }
+    VM_CASE(RETURN) {
+        pc = frames.back().returnPc;
+        fp = frames.back().fp;
+        frames.pop_back();
+        VM_NEXT();
+    }
+    VM_CASE(RETURN_VALUE) {
+        Value result = fp[pc[1]];
+        const CallFrame& frame = frames.back();
+        fp = frame.fp;
+        fp[frame.result] = result;
+        pc = frame.returnPc;
+        frames.pop_back();
+        VM_NEXT();
+    }
+    VM_CASE(HALT) {
+        dispatches = count;
+        return true;
+    }
+
+#ifdef VM_COMPUTED_GOTO
+    }
+#else
+        default:
+            errorMessage = "invalid opcode";
+            dispatches = count;
+            return false;
+        }
+    }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+
+divisionByZero:
+    errorMessage = "division by zero";
+    dispatches = count;
+    return false;
+outOfBounds:
+    errorMessage = "array index out of range";
+    dispatches = count;
+    return false;
+stackOverflow:
+    errorMessage = "stack overflow";
+    dispatches = count;
+    return false;
+}
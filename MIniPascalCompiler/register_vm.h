@@ -0,0 +1,39 @@
+#ifndef REGISTER_VM_H
+#define REGISTER_VM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "register_bytecode.h"
+
+// Interpreter for the register bytecode in register_bytecode.h, dispatched
+// the same way as StackVM. Frames are windows onto one register stack whose
+// bottom is the global area, which doubles as main's frame.
+class RegisterVM {
+public:
+    explicit RegisterVM(const RegisterProgram& program, size_t stackCells = 1u << 20);
+
+    // Runs the program from main. Returns false on a runtime error
+    // (division by zero, index out of range, stack overflow).
+    bool run();
+
+    const std::string& error() const { return errorMessage; }
+    const Value* globals() const { return stack.data(); }
+    uint64_t dispatchCount() const { return dispatches; }
+
+private:
+    struct CallFrame {
+        const uint32_t* returnPc;
+        Value* fp;
+        uint32_t result;    // caller register receiving a function's value
+    };
+
+    const RegisterProgram& program;
+    std::vector<Value> stack;
+    std::vector<CallFrame> frames;
+    std::string errorMessage;
+    uint64_t dispatches;
+};
+
+#endif // REGISTER_VM_H
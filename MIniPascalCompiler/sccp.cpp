@@ -0,0 +1,310 @@
+#include "optimizer.h"
+#include "ast_rewrite.h"
+#include "ir.h"
+#include "ir_interpreter.h"
+
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+
+namespace {
+
+// Runs calls to functions that read and write nothing but their own frame.
+// Results, failures included, are remembered per argument list.
+class CompileTimeCalls {
+public:
+    CompileTimeCalls(const IrModule& module, uint64_t budget);
+
+    bool call(uint32_t function, const Value* args, uint32_t count, Value& result);
+
+private:
+    const IrModule& module;
+    uint64_t budget;
+    std::vector<bool> pure;
+    IrInterpreter interpreter;
+    std::map<std::vector<uint64_t>, std::pair<bool, Value>> results;
+};
+
+CompileTimeCalls::CompileTimeCalls(const IrModule& module, uint64_t budget)
+    : module(module), budget(budget), pure(module.functions.size(), false),
+      interpreter(module, 1u << 16, 1u << 18) {
+    const SemanticInfo& info = *module.info;
+    for (uint32_t f = 0; f < module.functions.size(); ++f) {
+        const IrFunction& function = module.functions[f];
+        if (function.subprogram == NO_SUBPROGRAM) continue;
+        bool candidate = true;
+        for (IrType type : function.paramTypes) {
+            if (type == IR_ARRAY) candidate = false;
+        }
+        for (ValueId v = 1; candidate && v < function.values.size(); ++v) {
+            const IrInst& inst = function.values[v];
+            if (inst.op == IR_LOAD_GLOBAL || inst.op == IR_STORE_GLOBAL) candidate = false;
+            if (inst.op == IR_ADDR && info.variables[inst.index].owner != function.subprogram) candidate = false;
+        }
+        pure[f] = candidate;
+    }
+
+    // A call to anything impure spoils the caller
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t f = 0; f < module.functions.size(); ++f) {
+            if (!pure[f]) continue;
+            const IrFunction& function = module.functions[f];
+            for (ValueId v = 1; v < function.values.size(); ++v) {
+                if (function.values[v].op == IR_CALL && !pure[function.values[v].index]) {
+                    pure[f] = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+bool CompileTimeCalls::call(uint32_t function, const Value* args, uint32_t count, Value& result) {
+    if (!pure[function] || module.functions[function].returnType == IR_VOID) return false;
+
+    std::vector<uint64_t> key(count + 1);
+    key[0] = function;
+    for (uint32_t i = 0; i < count; ++i) std::memcpy(&key[i + 1], &args[i], sizeof(Value));
+    auto found = results.find(key);
+    if (found == results.end()) {
+        Value value{};
+        bool ok = interpreter.evaluate(function, args, count, budget, value);
+        found = results.emplace(key, std::make_pair(ok, value)).first;
+    }
+    result = found->second.second;
+    return found->second.first;
+}
+
+enum Lattice : uint8_t {
+    UNDEFINED,  // not reached yet
+    CONSTANT,
+    VARYING
+};
+
+struct Cell {
+    Lattice state;
+    Value value;
+};
+
+// Wegman and Zadeck's algorithm: values only move down the lattice, and
+// blocks are visited only once an edge into them is known to be taken.
+class ConstantPropagation {
+public:
+    ConstantPropagation(const IrFunction& function, CompileTimeCalls& calls);
+
+    void run();
+    const Cell& cell(ValueId value) const { return cells[value]; }
+    bool executed(BlockId block) const { return reachable[block]; }
+
+private:
+    void markEdge(BlockId from, BlockId to);
+    void visit(ValueId value);
+    Cell evaluate(ValueId value);
+    bool same(IrType type, const Value& a, const Value& b) const;
+
+    const IrFunction& function;
+    CompileTimeCalls& calls;
+    std::vector<Cell> cells;
+    std::vector<bool> reachable;
+    std::vector<std::vector<bool>> edges;   // by block, by predecessor position
+    std::vector<std::vector<ValueId>> users;
+    std::vector<BlockId> blockWork;
+    std::vector<ValueId> valueWork;
+};
+
+ConstantPropagation::ConstantPropagation(const IrFunction& function, CompileTimeCalls& calls)
+    : function(function), calls(calls), cells(function.values.size(), Cell{ UNDEFINED, Value{} }),
+      reachable(function.blocks.size(), false), edges(function.blocks.size()), users(function.values.size()) {
+    for (BlockId b = 0; b < function.blocks.size(); ++b) {
+        edges[b].assign(function.blocks[b].predecessors.size(), false);
+        for (ValueId v : function.blocks[b].instructions) {
+            const ValueId* operands = function.operandsOf(v);
+            for (uint32_t i = 0; i < function.values[v].operandCount; ++i) users[operands[i]].push_back(v);
+        }
+    }
+}
+
+bool ConstantPropagation::same(IrType type, const Value& a, const Value& b) const {
+    if (type == IR_REAL) return std::memcmp(&a.r, &b.r, sizeof(double)) == 0;
+    return a.i == b.i;
+}
+
+void ConstantPropagation::run() {
+    reachable[0] = true;
+    blockWork.push_back(0);
+    while (!blockWork.empty() || !valueWork.empty()) {
+        if (!blockWork.empty()) {
+            BlockId block = blockWork.back();
+            blockWork.pop_back();
+            for (ValueId v : function.blocks[block].instructions) visit(v);
+            continue;
+        }
+        ValueId value = valueWork.back();
+        valueWork.pop_back();
+        for (ValueId user : users[value]) {
+            if (reachable[function.values[user].block]) visit(user);
+        }
+    }
+}
+
+void ConstantPropagation::markEdge(BlockId from, BlockId to) {
+    const std::vector<BlockId>& preds = function.blocks[to].predecessors;
+    bool added = false;
+    for (size_t i = 0; i < preds.size(); ++i) {
+        if (preds[i] == from && !edges[to][i]) {
+            edges[to][i] = true;
+            added = true;
+        }
+    }
+    if (!added) return;
+    if (!reachable[to]) {
+        reachable[to] = true;
+        blockWork.push_back(to);
+        return;
+    }
+    // Already visited: only its phis see the new edge
+    for (ValueId v : function.blocks[to].instructions) {
+        if (function.values[v].op != IR_PHI) break;
+        visit(v);
+    }
+}
+
+void ConstantPropagation::visit(ValueId value) {
+    const IrInst& inst = function.values[value];
+    if (inst.op == IR_JUMP) {
+        markEdge(inst.block, inst.targets[0]);
+        return;
+    }
+    if (inst.op == IR_BRANCH) {
+        const Cell& condition = cells[function.operand(value, 0)];
+        if (condition.state == UNDEFINED) return;
+        if (condition.state == VARYING || condition.value.i) markEdge(inst.block, inst.targets[0]);
+        if (condition.state == VARYING || !condition.value.i) markEdge(inst.block, inst.targets[1]);
+        return;
+    }
+
+    Cell& current = cells[value];
+    if (current.state == VARYING) return;
+    Cell next = evaluate(value);
+    if (next.state == current.state) return;
+    current = next;
+    valueWork.push_back(value);
+}
+
+Cell ConstantPropagation::evaluate(ValueId value) {
+    const IrInst& inst = function.values[value];
+    const ValueId* operands = function.operandsOf(value);
+    Cell varying = { VARYING, Value{} };
+    Cell result = { CONSTANT, Value{} };
+
+    switch (inst.op) {
+    case IR_CONST:
+        if (inst.type == IR_REAL) result.value.r = inst.realValue;
+        else result.value.i = inst.intValue;
+        return result;
+    case IR_PHI: {
+        Cell merged = { UNDEFINED, Value{} };
+        for (uint32_t i = 0; i < inst.operandCount; ++i) {
+            if (!edges[inst.block][i]) continue;
+            const Cell& incoming = cells[operands[i]];
+            if (incoming.state == UNDEFINED) continue;
+            if (incoming.state == VARYING) return varying;
+            if (merged.state == CONSTANT && !same(inst.type, merged.value, incoming.value)) return varying;
+            merged = incoming;
+        }
+        return merged;
+    }
+    default:
+        break;
+    }
+
+    // Everything else needs all its operands, and only the ops below fold
+    Value args[8];
+    std::vector<Value> spilled;
+    Value* values = inst.operandCount <= 8 ? args : (spilled.resize(inst.operandCount), spilled.data());
+    for (uint32_t i = 0; i < inst.operandCount; ++i) {
+        const Cell& operand = cells[operands[i]];
+        if (operand.state == UNDEFINED) return Cell{ UNDEFINED, Value{} };
+        if (operand.state == VARYING) return varying;
+        values[i] = operand.value;
+    }
+
+    switch (inst.op) {
+    case IR_BOUNDS: {
+        uint32_t offset = static_cast<uint32_t>(values[0].i) - static_cast<uint32_t>(inst.bounds.low);
+        if (offset >= inst.bounds.count) return varying;
+        result.value.i = static_cast<int32_t>(offset);
+        return result;
+    }
+    case IR_CALL:
+        if (!calls.call(inst.index, values, inst.operandCount, result.value)) return varying;
+        return result;
+    default:
+        if (!isPure(inst.op) || !foldIrOp(inst.op, values, result.value)) return varying;
+        return result;
+    }
+}
+
+DataType dataType(IrType type) {
+    switch (type) {
+    case IR_INT: return DataType::INTEGER;
+    case IR_REAL: return DataType::REAL;
+    case IR_BOOL: return DataType::BOOLEAN;
+    default: return DataType::UNKNOWN;
+    }
+}
+
+// Whether replacing `node` by its value drops nothing that runs and could
+// call out or trap: every call, element read and div in it either sits in
+// a block that never runs or was worked out here.
+bool settled(const AstArena& ast, const SemanticInfo& info, const IrFunction& function,
+             const ConstantPropagation& propagation, const std::unordered_map<NodeId, ValueId>& valueOf,
+             NodeId node) {
+    const ASTNode& n = ast.node(node);
+    bool effect = n.type == NODE_FUNCTION_CALL || n.type == NODE_ARRAY_ACCESS ||
+                  (n.type == NODE_VARIABLE && info.ref(node).kind == RefKind::CALL) ||
+                  (n.type == NODE_BINARY_OP && n.op == OP_DIV);
+    if (effect) {
+        auto found = valueOf.find(node);
+        if (found == valueOf.end()) return false;
+        if (!propagation.executed(function.values[found->second].block)) return true;
+        if (propagation.cell(found->second).state != CONSTANT) return false;
+    }
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        if (!settled(ast, info, function, propagation, valueOf, child)) return false;
+    }
+    return true;
+}
+
+}
+
+void propagateConstants(AstArena& ast, NodeId root, SemanticInfo& info, const OptimizationOptions& options,
+                        PassReport& report) {
+    IrModule module;
+    buildIr(ast, root, info, module);
+    CompileTimeCalls calls(module, options.evaluationBudget);
+
+    for (const IrFunction& function : module.functions) {
+        ConstantPropagation propagation(function, calls);
+        propagation.run();
+        std::unordered_map<NodeId, ValueId> valueOf(function.nodeValues.begin(), function.nodeValues.end());
+
+        // Inner expressions come first, so an outer one replaced later cuts
+        // off literals rather than counting them twice
+        for (const std::pair<NodeId, ValueId>& source : function.nodeValues) {
+            const Cell& cell = propagation.cell(source.second);
+            if (cell.state != CONSTANT || isLiteral(ast, source.first)) continue;
+            DataType type = dataType(function.values[source.second].type);
+            if (type == DataType::UNKNOWN) continue;
+            // The C++ backend has no spelling for inf or nan
+            if (type == DataType::REAL && !std::isfinite(cell.value.r)) continue;
+            if (!settled(ast, info, function, propagation, valueOf, source.first)) continue;
+            report.removed += replaceWithLiteral(ast, info, source.first, type, cell.value);
+            ++report.rewritten;
+        }
+    }
+}
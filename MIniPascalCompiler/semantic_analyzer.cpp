@@ -1,183 +1,426 @@
 #include "semantic_analyzer.h"
 #include "ast.h"
 #include "symbol_table.h"
+#include "thread_pool.h"
 
-#include <iostream>
-#include <sstream>
+#include <algorithm>
+#include <memory>
+#include <string>
 
-SemanticAnalyzer::SemanticAnalyzer() : hasErrors(false) {}
+SemanticAnalyzer::SemanticAnalyzer()
+    : ast(nullptr), hasErrors(false), diagnostics(nullptr), pool(nullptr), subprogramCount(0), bodyCache(nullptr),
+      checkedBodies(0), uses(nullptr), info(nullptr), currentSubprogram(NO_SUBPROGRAM), currentFunction(NO_NAME),
+      frameCells(0) {}
 
-bool SemanticAnalyzer::analyze(ASTNode* root) {
+bool SemanticAnalyzer::analyze(const AstArena& tree, NodeId root, SemanticInfo* resolved) {
     if (!root) return false;
 
-    symbolTable.enterScope("global");
+    ast = &tree;
+    info = resolved;
+    subprogramCount = 0;
+    checkedBodies = 0;
+    if (info) info->reset(tree.nodeCount() + 1);  // NodeIds run up to nodeCount()
+    symbolTable.enterScope();
     checkProgram(root);
     symbolTable.exitScope();
 
     return !hasErrors;
 }
 
-void SemanticAnalyzer::checkProgram(ASTNode* node) {
+void SemanticAnalyzer::checkProgram(NodeId node) {
     if (!node) return;
 
     //    
-    if (node->children.size() > 0 && node->children[0]) {
-        checkDeclarations(node->children[0]);
-    }
+    checkDeclarations(ast->child(node, 0));
 
     //     ( )
-    if (node->children.size() > 1 && node->children[1]) {
-        ASTNode* subprogs = node->children[1];
-        for (ASTNode* subprog : subprogs->children) {
+    NodeId subprogs = ast->child(node, 1);
+    if (subprogs && ((pool && pool->size() > 1) || bodyCache)) {
+        checkSubprogramBodies(subprogs);
+    }
+    else if (subprogs) {
+        for (NodeId subprog = ast->firstChild(subprogs); subprog; subprog = ast->nextSibling(subprog)) {
             checkSubprogram(subprog);
+            ++checkedBodies;
         }
     }
 
     //     
-    if (node->children.size() > 2 && node->children[2]) {
-        checkStatements(node->children[2]);
+    checkStatements(ast->child(node, 2));
+}
+
+// Gives the variable its cells, in the global area or in the frame of the
+// subprogram being analyzed.
+void SemanticAnalyzer::declareVariable(Symbol& symbol, bool isParameter) {
+    if (!info) return;
+
+    VariableInfo variable;
+    variable.name = symbol.name;
+    variable.type = symbol.typeInfo;
+    variable.cells = symbol.typeInfo.baseType == DataType::ARRAY
+        ? static_cast<uint32_t>(symbol.typeInfo.arrayEnd - symbol.typeInfo.arrayStart + 1)
+        : 1;
+    variable.owner = currentSubprogram;
+    variable.isParameter = isParameter;
+    if (currentSubprogram == NO_SUBPROGRAM) {
+        variable.storage = Storage::GLOBAL;
+        variable.slot = info->globalCells;
+        info->globalCells += variable.cells;
+    }
+    else {
+        variable.storage = Storage::FRAME;
+        variable.slot = frameCells;
+        frameCells += variable.cells;
+    }
+
+    symbol.infoIndex = static_cast<uint32_t>(info->variables.size());
+    info->variables.push_back(variable);
+}
+
+// A body only sees the subprograms declared before it, and itself.
+Symbol* SemanticAnalyzer::lookup(NameId name) {
+    Symbol* sym = symbolTable.findSymbol(name);
+    if (sym && (sym->kind == SymbolKind::FUNCTION || sym->kind == SymbolKind::PROCEDURE) &&
+        currentSubprogram != NO_SUBPROGRAM && sym->infoIndex > currentSubprogram)
+        sym = nullptr;
+
+    // Within one body a name always resolves the same way
+    if (uses && std::none_of(uses->begin(), uses->end(), [name](const BodyDependency& use) { return use.name == name; }))
+        uses->push_back(dependency(name, sym));
+    return sym;
+}
+
+BodyDependency SemanticAnalyzer::dependency(NameId name, const Symbol* sym) const {
+    BodyDependency use;
+    use.name = name;
+    use.found = sym != nullptr;
+    use.kind = sym ? sym->kind : SymbolKind::VARIABLE;
+    use.index = sym ? sym->infoIndex : 0;
+    if (sym) {
+        use.type = sym->typeInfo;
+        for (uint32_t i = 0; i < sym->paramCount; ++i) use.params.push_back(symbolTable.parameterType(*sym, i));
     }
+    return use;
+}
+
+void SemanticAnalyzer::recordRef(NodeId node, RefKind kind, uint32_t index) {
+    if (info) info->refs[node] = NodeRef{ kind, index };
+}
+
+void SemanticAnalyzer::error(NodeId node, DiagnosticCode code, std::initializer_list<std::string_view> args) {
+    hasErrors = true;
+    if (!diagnostics) return;
+    const ASTNode& at = ast->node(node);
+    diagnostics->report(code, at.line, at.column, args);
 }
 
-void SemanticAnalyzer::checkDeclarations(ASTNode* node) {
-    if (!node || node->type != NODE_DECLARATIONS) return;
+TypeInfo SemanticAnalyzer::resolveType(NodeId typeNode) const {
+    TypeInfo typeInfo;
+    if (!typeNode) return typeInfo;
+
+    const ASTNode& node = ast->node(typeNode);
+    if (node.type == NODE_ARRAY_TYPE) {
+        typeInfo.baseType = DataType::ARRAY;
+        typeInfo.arrayStart = node.range.start;
+        typeInfo.arrayEnd = node.range.end;
 
-    for (ASTNode* decl : node->children) {
-        if (decl->type == NODE_DECLARATIONS) {
+        NodeId baseTypeNode = ast->firstChild(typeNode);
+        if (baseTypeNode)
+            typeInfo.elementType = ast->node(baseTypeNode).dataType;
+    }
+    else if (node.type == NODE_TYPE) {
+        typeInfo.baseType = node.dataType;
+    }
+
+    return typeInfo;
+}
+
+void SemanticAnalyzer::checkDeclarations(NodeId node) {
+    if (!node || ast->node(node).type != NODE_DECLARATIONS) return;
+
+    for (NodeId decl = ast->firstChild(node); decl; decl = ast->nextSibling(decl)) {
+        if (ast->node(decl).type != NODE_VAR_DECL) continue;
+
+        NodeId ids = ast->child(decl, 0);       //  
+        NodeId typeNode = ast->child(decl, 1);   //  
+        TypeInfo typeInfo = resolveType(typeNode);
+
+        //     
+        for (NodeId idNode = ast->firstChild(ids); idNode; idNode = ast->nextSibling(idNode)) {
             Symbol symbol;
-            ASTNode* ids = decl->children[0];       //  
-            ASTNode* typeNode = decl->children[1];   //  
-
-            TypeInfo typeInfo;
-
-            if (typeNode->type == NODE_ARRAY_TYPE) {
-                typeInfo.baseType = DataType::ARRAY;
-                typeInfo.arrayStart = static_cast<int>(typeNode->int_val);
-                typeInfo.arrayEnd = static_cast<int>(typeNode->real_val);
-
-                ASTNode* baseTypeNode = typeNode->children[0];
-                if (baseTypeNode->name == "integer")
-                    typeInfo.elementType = DataType::INTEGER;
-                else if (baseTypeNode->name == "real")
-                    typeInfo.elementType = DataType::REAL;
-                else if (baseTypeNode->name == "boolean")
-                    typeInfo.elementType = DataType::BOOLEAN;
-            }
-            else if (typeNode->type == NODE_TYPE) {
-                if (typeNode->name == "integer")
-                    typeInfo.baseType = DataType::INTEGER;
-                else if (typeNode->name == "real")
-                    typeInfo.baseType = DataType::REAL;
-                else if (typeNode->name == "boolean")
-                    typeInfo.baseType = DataType::BOOLEAN;
-                else
-                    typeInfo.baseType = DataType::UNKNOWN;
-            }
+            symbol.name = ast->node(idNode).name;
+            symbol.kind = SymbolKind::VARIABLE;
+            symbol.typeInfo = typeInfo;
 
-            //     
-            for (ASTNode* idNode : ids->children) {
-                symbol.name = idNode->name;
-                symbol.kind = SymbolKind::VARIABLE;
-                symbol.typeInfo = typeInfo;
+            if (typeInfo.baseType == DataType::ARRAY && typeInfo.arrayEnd < typeInfo.arrayStart) {
+                error(idNode, DiagnosticCode::EMPTY_ARRAY_RANGE, { nameOf(symbol.name) });
+                continue;
+            }
 
-                if (!symbolTable.addSymbol(symbol)) {
-                    std::cerr << "Semantic error: Redeclaration of '" << symbol.name << "'\n";
-                    hasErrors = true;
-                }
+            declareVariable(symbol, false);
+            if (!symbolTable.addSymbol(symbol)) {
+                error(idNode, DiagnosticCode::REDECLARATION, { nameOf(symbol.name) });
             }
         }
     }
 }
 
-void SemanticAnalyzer::checkSubprogram(ASTNode* node) {
-    if (!node || node->type != NODE_SUBPROGRAM) return;
+void SemanticAnalyzer::checkSubprogram(NodeId node) {
+    if (!node || ast->node(node).type != NODE_SUBPROGRAM) return;
 
-    ASTNode* head = node->children[0]; //    
-    ASTNode* body = node->children[1]; //  
+    declareSubprogram(node);
+    checkStatements(ast->child(node, 2)); // 
+    leaveSubprogram();
+}
+
+// Declares the subprogram, its parameters and its locals, and leaves its
+// scope open for the body.
+void SemanticAnalyzer::declareSubprogram(NodeId node) {
+    NodeId head = ast->child(node, 0); //    
+    NodeId decls = ast->child(node, 1);
 
     Symbol subprogSymbol;
-    if (head->type == NODE_FUNCTION_HEAD) {
+    subprogSymbol.name = ast->node(head).name;
+    if (ast->node(head).type == NODE_FUNCTION_HEAD) {
         subprogSymbol.kind = SymbolKind::FUNCTION;
-        subprogSymbol.name = head->name;
 
         //    
-        if (head->children.size() >= 2) {
-            ASTNode* returnTypeNode = head->children[1];
-            if (returnTypeNode->type == NODE_TYPE) {
-                if (returnTypeNode->name == "integer")
-                    subprogSymbol.typeInfo.baseType = DataType::INTEGER;
-                else if (returnTypeNode->name == "real")
-                    subprogSymbol.typeInfo.baseType = DataType::REAL;
-                else if (returnTypeNode->name == "boolean")
-                    subprogSymbol.typeInfo.baseType = DataType::BOOLEAN;
-                else
-                    subprogSymbol.typeInfo.baseType = DataType::UNKNOWN;
-            }
-        }
+        subprogSymbol.typeInfo = resolveType(ast->child(head, 1));
     }
-    else if (head->type == NODE_PROCEDURE_HEAD) {
+    else {
         subprogSymbol.kind = SymbolKind::PROCEDURE;
-        subprogSymbol.name = head->name;
         subprogSymbol.typeInfo.baseType = DataType::UNKNOWN;
     }
 
+    NodeId params = ast->child(head, 0);
+    for (NodeId param = ast->firstChild(params); param; param = ast->nextSibling(param)) {
+        TypeInfo paramType = resolveType(ast->child(param, 1));
+        for (NodeId idNode = ast->firstChild(ast->child(param, 0)); idNode; idNode = ast->nextSibling(idNode)) {
+            symbolTable.addParameterType(subprogSymbol, paramType);
+        }
+    }
+
+    if (info) {
+        SubprogramInfo subprogram;
+        subprogram.name = subprogSymbol.name;
+        subprogram.node = node;
+        subprogram.isFunction = subprogSymbol.kind == SymbolKind::FUNCTION;
+        subprogram.returnType = subprogSymbol.typeInfo.baseType;
+        subprogram.firstParam = static_cast<uint32_t>(info->variables.size());
+        subprogram.paramCount = subprogSymbol.paramCount;
+        subprogram.paramCells = 0;
+        subprogram.resultSlot = 0;
+        subprogram.frameCells = 0;
+        info->subprograms.push_back(subprogram);
+    }
+    subprogSymbol.infoIndex = subprogramCount++;
+
     //     
     if (!symbolTable.addSymbol(subprogSymbol)) {
-        std::cerr << "Semantic error: Redeclaration of subprogram '" << subprogSymbol.name << "'\n";
-        hasErrors = true;
+        error(head, DiagnosticCode::SUBPROGRAM_REDECLARATION, { nameOf(subprogSymbol.name) });
     }
 
     //   
-    symbolTable.enterScope(subprogSymbol.name);
+    symbolTable.enterScope();
+    currentSubprogram = subprogSymbol.infoIndex;
+    currentFunction = subprogSymbol.kind == SymbolKind::FUNCTION ? subprogSymbol.name : NO_NAME;
+    frameCells = 0;
 
     //    
-    if (head->children.size() >= 1 && head->children[0]) {
-        ASTNode* params = head->children[0];
-        for (ASTNode* paramList : params->children) {
-            ASTNode* ids = paramList->children[0];
-            ASTNode* type = paramList->children[1];
-
-            TypeInfo paramType;
-            if (type->type == NODE_TYPE) {
-                if (type->name == "integer")
-                    paramType.baseType = DataType::INTEGER;
-                else if (type->name == "real")
-                    paramType.baseType = DataType::REAL;
-                else if (type->name == "boolean")
-                    paramType.baseType = DataType::BOOLEAN;
-                else
-                    paramType.baseType = DataType::UNKNOWN;
-            }
-
-            for (ASTNode* idNode : ids->children) {
-                Symbol paramSymbol;
-                paramSymbol.name = idNode->name;
-                paramSymbol.kind = SymbolKind::PARAMETER;
-                paramSymbol.typeInfo = paramType;
-                subprogSymbol.paramTypes.push_back(paramType);
-
-                if (!symbolTable.addSymbol(paramSymbol)) {
-                    std::cerr << "Semantic error: Duplicate parameter '" << paramSymbol.name
-                        << "' in subprogram '" << subprogSymbol.name << "'\n";
-                    hasErrors = true;
-                }
+    for (NodeId param = ast->firstChild(params); param; param = ast->nextSibling(param)) {
+        TypeInfo paramType = resolveType(ast->child(param, 1));
+        for (NodeId idNode = ast->firstChild(ast->child(param, 0)); idNode; idNode = ast->nextSibling(idNode)) {
+            Symbol paramSymbol;
+            paramSymbol.name = ast->node(idNode).name;
+            paramSymbol.kind = SymbolKind::PARAMETER;
+            paramSymbol.typeInfo = paramType;
+
+            declareVariable(paramSymbol, true);
+            if (!symbolTable.addSymbol(paramSymbol)) {
+                error(idNode, DiagnosticCode::DUPLICATE_PARAMETER,
+                      { nameOf(paramSymbol.name), nameOf(subprogSymbol.name) });
             }
         }
     }
 
-    //     
-    if (body && body->children.size() >= 2) {
-        checkDeclarations(body->children[0]); //  
-        checkStatements(body->children[1]);   // 
+    if (info) {
+        SubprogramInfo& subprogram = info->subprograms[currentSubprogram];
+        subprogram.paramCells = frameCells;
+        if (subprogram.isFunction) subprogram.resultSlot = frameCells++;
     }
 
+    //     
+    checkDeclarations(decls); //  
+    if (info) info->subprograms[currentSubprogram].frameCells = frameCells;
+}
+
+void SemanticAnalyzer::leaveSubprogram() {
     symbolTable.exitScope();
+    currentSubprogram = NO_SUBPROGRAM;
+    currentFunction = NO_NAME;
+}
+
+// Phase one declares every subprogram in order and records its scope;
+// phase two checks the bodies, on the pool when there is one, with one
+// analyzer per worker. Bodies the cache still holds are replayed instead.
+void SemanticAnalyzer::checkSubprogramBodies(NodeId subprogs) {
+    std::vector<PendingBody> bodies;
+    for (NodeId subprog = ast->firstChild(subprogs); subprog; subprog = ast->nextSibling(subprog)) {
+        if (ast->node(subprog).type == NODE_SUBPROGRAM) bodies.push_back(PendingBody{ subprog, NO_NAME, 0, 0 });
+    }
+    // Per subprogram, what declaring it and then checking its body reported
+    std::vector<ErrorHandler> messages(bodies.size());
+    size_t limit = diagnostics ? diagnostics->max_error_count() : ErrorHandler().max_error_count();
+    for (ErrorHandler& message : messages) message.set_max_errors(limit);
+
+    // One list for every scope, rather than an allocation per subprogram
+    std::vector<Symbol> scopes;
+    ErrorHandler* output = diagnostics;
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        diagnostics = &messages[i];
+        declareSubprogram(bodies[i].node);
+        bodies[i].function = currentFunction;
+        bodies[i].scopeBegin = static_cast<uint32_t>(scopes.size());
+        symbolTable.currentScope(scopes);
+        bodies[i].scopeEnd = static_cast<uint32_t>(scopes.size());
+        leaveSubprogram();
+    }
+    diagnostics = output;
+
+    std::vector<std::unique_ptr<SemanticAnalyzer>> workers;
+    for (unsigned i = 0; i < (pool ? pool->size() : 1); ++i) workers.push_back(std::unique_ptr<SemanticAnalyzer>(new SemanticAnalyzer(*this)));
+    std::vector<CheckedBody> checked(bodyCache ? bodies.size() : 0);
+    for (CheckedBody& body : checked) body.messages.set_max_errors(limit);
+    StringInterner& names = globalInterner();
+    auto checkBody = [&](size_t index, unsigned worker) {
+        InternerScope scope(names);
+        SemanticAnalyzer& analyzer = *workers[worker];
+        const PendingBody& body = bodies[index];
+        analyzer.diagnostics = &messages[index];
+        analyzer.symbolTable.enterScope();
+        // Duplicates were reported when the scope was first built
+        for (uint32_t i = body.scopeBegin; i < body.scopeEnd; ++i) analyzer.symbolTable.addSymbol(scopes[i]);
+        analyzer.currentSubprogram = static_cast<uint32_t>(index);
+        analyzer.currentFunction = body.function;
+
+        if (!bodyCache) {
+            analyzer.checkStatements(ast->child(body.node, 2));
+            ++analyzer.checkedBodies;
+            analyzer.leaveSubprogram();
+            return;
+        }
+        // Each task owns the cache entry of its own node
+        BodyCache::iterator previous = bodyCache->find(body.node);
+        if (previous != bodyCache->end() && analyzer.replayBody(body.node, previous->second)) {
+            checked[index] = std::move(previous->second);
+        }
+        else {
+            bool earlier = analyzer.hasErrors;
+            analyzer.hasErrors = false;
+            analyzer.uses = &checked[index].uses;
+            analyzer.diagnostics = &checked[index].messages;
+            analyzer.checkStatements(ast->child(body.node, 2));
+            analyzer.uses = nullptr;
+            ++analyzer.checkedBodies;
+            checked[index].hasErrors = analyzer.hasErrors;
+            checked[index].line = ast->node(body.node).line;
+            checked[index].column = ast->node(body.node).column;
+            analyzer.recordBody(ast->child(body.node, 2), checked[index]);
+            analyzer.hasErrors = analyzer.hasErrors || earlier;
+        }
+        analyzer.leaveSubprogram();
+    };
+    if (pool) pool->run(bodies.size(), checkBody);
+    else for (size_t i = 0; i < bodies.size(); ++i) checkBody(i, 0);
+
+    for (const std::unique_ptr<SemanticAnalyzer>& worker : workers) {
+        if (worker->hasErrors) hasErrors = true;
+        checkedBodies += worker->checkedBodies;
+    }
+    if (diagnostics) {
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            diagnostics->append(messages[i]);
+            if (bodyCache) diagnostics->append(checked[i].messages);
+        }
+    }
+
+    // Bodies that are no longer in the tree are dropped
+    if (bodyCache) {
+        bodyCache->clear();
+        for (size_t i = 0; i < bodies.size(); ++i) (*bodyCache)[bodies[i].node] = std::move(checked[i]);
+    }
+}
+
+// Writes what `checked` recorded as this body's result, if every name it
+// looked up still resolves to a symbol of the same kind and type. The
+// variables and subprograms it refers to may have moved, so each ref is
+// renumbered by the symbol that the name finds now, and the messages are
+// moved with `subprog` if the text above it changed.
+bool SemanticAnalyzer::replayBody(NodeId subprog, CheckedBody& checked) {
+    if (info && !checked.resolved) return false;
+
+    // Old index to new, for the few symbols one body uses
+    std::vector<std::pair<uint32_t, uint32_t>> variables, subprograms;
+    for (const BodyDependency& use : checked.uses) {
+        Symbol* sym = lookup(use.name);
+        BodyDependency now = dependency(use.name, sym);
+        if (now.found != use.found || now.kind != use.kind || now.type != use.type || now.params != use.params)
+            return false;
+        if (!sym) continue;
+        if (sym->kind == SymbolKind::FUNCTION || sym->kind == SymbolKind::PROCEDURE)
+            subprograms.push_back(std::make_pair(use.index, sym->infoIndex));
+        else
+            variables.push_back(std::make_pair(use.index, sym->infoIndex));
+    }
+
+    const ASTNode& now = ast->node(subprog);
+    checked.messages.move(0, checked.line, checked.column, now.line, now.column);
+    checked.line = now.line;
+    checked.column = now.column;
+    if (checked.hasErrors) hasErrors = true;
+    if (!info) return true;
+    for (const std::pair<NodeId, NodeRef>& ref : checked.refs) {
+        const std::vector<std::pair<uint32_t, uint32_t>>& renumber = ref.second.kind == RefKind::VARIABLE ? variables : subprograms;
+        NodeRef renumbered = ref.second;
+        for (const std::pair<uint32_t, uint32_t>& index : renumber) {
+            if (index.first == ref.second.index) renumbered.index = index.second;
+        }
+        info->refs[ref.first] = renumbered;
+    }
+    for (const std::pair<NodeId, DataType>& type : checked.types) info->exprTypes[type.first] = type.second;
+    return true;
 }
 
-TypeInfo SemanticAnalyzer::checkExpression(ASTNode* node) {
-    if (!node) return TypeInfo(DataType::UNKNOWN);
+// Keeps the resolution of every node under `body` for replayBody.
+void SemanticAnalyzer::recordBody(NodeId body, CheckedBody& checked) const {
+    checked.resolved = info != nullptr;
+    if (!info) return;
+
+    std::vector<NodeId> pending(1, body);
+    while (!pending.empty()) {
+        NodeId id = pending.back();
+        pending.pop_back();
+        if (info->refs[id].kind != RefKind::NONE) checked.refs.push_back(std::make_pair(id, info->refs[id]));
+        if (info->exprTypes[id] != DataType::UNKNOWN) checked.types.push_back(std::make_pair(id, info->exprTypes[id]));
+        for (NodeId child = ast->firstChild(id); child; child = ast->nextSibling(child)) pending.push_back(child);
+    }
+}
+
+TypeInfo SemanticAnalyzer::checkExpression(NodeId id) {
+    TypeInfo type = inferExpression(id);
+    if (info && id) info->exprTypes[id] = type.baseType;
+    return type;
+}
 
-    switch (node->type) {
+static bool isNumeric(DataType type) {
+    return type == DataType::INTEGER || type == DataType::REAL;
+}
+
+TypeInfo SemanticAnalyzer::inferExpression(NodeId id) {
+    if (!id) return TypeInfo(DataType::UNKNOWN);
+
+    const ASTNode& node = ast->node(id);
+    switch (node.type) {
     case NODE_INT_NUM:
         return TypeInfo(DataType::INTEGER);
     case NODE_REAL_NUM:
@@ -185,91 +428,101 @@ TypeInfo SemanticAnalyzer::checkExpression(ASTNode* node) {
     case NODE_BOOLEAN:
         return TypeInfo(DataType::BOOLEAN);
     case NODE_VARIABLE: {
-        Symbol* sym = symbolTable.findSymbol(node->name);
+        Symbol* sym = lookup(ast->node(id).name);
         if (!sym) {
-            std::cerr << "Semantic error: Undeclared identifier '" << node->name << "'\n";
-            hasErrors = true;
+            error(id, DiagnosticCode::UNDECLARED_IDENTIFIER, { ast->nodeName(id) });
+            return TypeInfo(DataType::UNKNOWN);
+        }
+
+        // A bare subprogram name is a call without arguments
+        if (sym->kind == SymbolKind::PROCEDURE) {
+            error(id, DiagnosticCode::PROCEDURE_AS_VALUE, { ast->nodeName(id) });
             return TypeInfo(DataType::UNKNOWN);
         }
+        if (sym->kind == SymbolKind::FUNCTION) {
+            if (sym->paramCount != 0) {
+                error(id, DiagnosticCode::FUNCTION_ARGUMENT_COUNT,
+                      { ast->nodeName(id), std::to_string(sym->paramCount), "0" });
+            }
+            recordRef(id, RefKind::CALL, sym->infoIndex);
+            return sym->typeInfo;
+        }
+
+        recordRef(id, RefKind::VARIABLE, sym->infoIndex);
         return sym->typeInfo;
     }
     case NODE_ARRAY_ACCESS: {
-        Symbol* sym = symbolTable.findSymbol(node->children[0]->name);
+        Symbol* sym = lookup(ast->node(id).name);
         if (!sym || sym->typeInfo.baseType != DataType::ARRAY) {
-            std::cerr << "Semantic error: Undeclared array '" << node->children[0]->name << "'\n";
-            hasErrors = true;
+            error(id, DiagnosticCode::UNDECLARED_ARRAY, { ast->nodeName(id) });
             return TypeInfo(DataType::UNKNOWN);
         }
+        DataType elementType = sym->typeInfo.elementType;
+        recordRef(id, RefKind::VARIABLE, sym->infoIndex);
 
-        TypeInfo indexType = checkExpression(node->children[1]);
-        if (indexType.baseType != DataType::INTEGER) {
-            std::cerr << "Semantic error: Array index must be integer\n";
-            hasErrors = true;
-        }
+        TypeInfo indexType = checkExpression(ast->child(id, 0));
+        if (indexType.baseType != DataType::INTEGER) error(id, DiagnosticCode::INDEX_NOT_INTEGER);
 
-        return TypeInfo(sym->typeInfo.elementType); //    
+        return TypeInfo(elementType); //    
     }
     case NODE_BINARY_OP: {
-        TypeInfo left = checkExpression(node->children[0]);
-        TypeInfo right = checkExpression(node->children[1]);
+        TypeInfo left = checkExpression(ast->child(id, 0));
+        TypeInfo right = checkExpression(ast->child(id, 1));
 
         if (left.baseType == DataType::UNKNOWN || right.baseType == DataType::UNKNOWN)
             return TypeInfo(DataType::UNKNOWN);
 
-        if (left != right) {
-            std::cerr << "Semantic error: Type mismatch in binary operation\n";
-            hasErrors = true;
+        if (left != right) error(id, DiagnosticCode::OPERAND_TYPE_MISMATCH);
+
+        switch (node.op) {
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_LE:
+        case OP_GT:
+        case OP_GE:
+            if (left.baseType == DataType::ARRAY) error(id, DiagnosticCode::ARRAY_COMPARISON);
+            return TypeInfo(DataType::BOOLEAN);
+        case OP_AND:
+        case OP_OR:
+            if (left.baseType != DataType::BOOLEAN) error(id, DiagnosticCode::BOOLEAN_OPERANDS, { opSpelling(node.op) });
+            return TypeInfo(DataType::BOOLEAN);
+        case OP_DIVIDE:
+            if (!isNumeric(left.baseType)) error(id, DiagnosticCode::NUMERIC_OPERANDS, { "/" });
+            return TypeInfo(DataType::REAL);
+        case OP_DIV:
+            if (left.baseType != DataType::INTEGER) error(id, DiagnosticCode::INTEGER_OPERANDS, { "div" });
+            return TypeInfo(DataType::INTEGER);
+        default:
+            if (!isNumeric(left.baseType)) error(id, DiagnosticCode::NUMERIC_OPERANDS, { opSpelling(node.op) });
+            return left;
         }
-
-        return left;
     }
     case NODE_UNARY_OP: {
-        TypeInfo expr = checkExpression(node->children[0]);
+        TypeInfo expr = checkExpression(ast->child(id, 0));
         if (expr.baseType == DataType::UNKNOWN)
             return TypeInfo(DataType::UNKNOWN);
 
-        if (node->op == "not" && expr.baseType != DataType::BOOLEAN) {
-            std::cerr << "Semantic error: NOT operator requires boolean operand\n";
-            hasErrors = true;
+        if (node.op == OP_NOT && expr.baseType != DataType::BOOLEAN) {
+            error(id, DiagnosticCode::NOT_OPERAND);
         }
-        else if ((node->op == "+" || node->op == "-") &&
+        else if (node.op == OP_NEG &&
             expr.baseType != DataType::INTEGER &&
             expr.baseType != DataType::REAL) {
-            std::cerr << "Semantic error: Unary minus/plus requires numeric operand\n";
-            hasErrors = true;
+            error(id, DiagnosticCode::SIGN_OPERAND);
         }
 
         return expr;
     }
     case NODE_FUNCTION_CALL: {
-        Symbol* sym = symbolTable.findSymbol(node->name);
+        Symbol* sym = lookup(ast->node(id).name);
         if (!sym || sym->kind != SymbolKind::FUNCTION) {
-            std::cerr << "Semantic error: Undeclared function '" << node->name << "'\n";
-            hasErrors = true;
+            error(id, DiagnosticCode::UNDECLARED_FUNCTION, { ast->nodeName(id) });
             return TypeInfo(DataType::UNKNOWN);
         }
 
-        if (node->children.size() > 0) {
-            ASTNode* args = node->children[0];
-            if (args->children.size() != sym->paramTypes.size()) {
-                std::cerr << "Semantic error: Function '" << sym->name << "' expects "
-                    << sym->paramTypes.size() << " arguments but got "
-                    << args->children.size() << "\n";
-                hasErrors = true;
-            }
-            else {
-                for (size_t i = 0; i < args->children.size(); ++i) {
-                    TypeInfo argType = checkExpression(args->children[i]);
-                    if (argType != sym->paramTypes[i]) {
-                        std::cerr << "Semantic error: Argument " << i + 1 << " of function '"
-                            << sym->name << "' expects type " << sym->paramTypes[i].toString()
-                            << ", got " << argType.toString() << "\n";
-                        hasErrors = true;
-                    }
-                }
-            }
-        }
-
+        recordRef(id, RefKind::CALL, sym->infoIndex);
+        checkArguments(id, *sym, true);
         return sym->typeInfo;
     }
     default:
@@ -277,95 +530,114 @@ TypeInfo SemanticAnalyzer::checkExpression(ASTNode* node) {
     }
 }
 
-void SemanticAnalyzer::checkStatements(ASTNode* node) {
-    if (!node) return;
+void SemanticAnalyzer::checkCondition(NodeId node) {
+    TypeInfo type = checkExpression(node);
+    if (type.baseType != DataType::BOOLEAN && type.baseType != DataType::UNKNOWN)
+        error(node, DiagnosticCode::CONDITION_NOT_BOOLEAN, { type.toString() });
+}
 
-    for (ASTNode* stmt : node->children) {
-        switch (stmt->type) {
-        case NODE_ASSIGNMENT: {
-            ASTNode* var = stmt->left;
-            ASTNode* expr = stmt->right;
+void SemanticAnalyzer::checkArguments(NodeId call, const Symbol& sym, bool isFunction) {
+    unsigned argCount = ast->childCount(call);
+    if (argCount != sym.paramCount) {
+        error(call, isFunction ? DiagnosticCode::FUNCTION_ARGUMENT_COUNT : DiagnosticCode::SUBPROGRAM_ARGUMENT_COUNT,
+              { nameOf(sym.name), std::to_string(sym.paramCount), std::to_string(argCount) });
+        return;
+    }
 
-            TypeInfo varType, exprType;
+    uint32_t i = 0;
+    for (NodeId arg = ast->firstChild(call); arg; arg = ast->nextSibling(arg), ++i) {
+        TypeInfo argType = checkExpression(arg);
+        const TypeInfo& paramType = symbolTable.parameterType(sym, i);
+        if (argType != paramType) {
+            error(arg, isFunction ? DiagnosticCode::FUNCTION_ARGUMENT_TYPE : DiagnosticCode::SUBPROGRAM_ARGUMENT_TYPE,
+                  { std::to_string(i + 1), nameOf(sym.name), paramType.toString(), argType.toString() });
+        }
+    }
+}
 
-            if (var->type == NODE_VARIABLE) {
-                Symbol* sym = symbolTable.findSymbol(var->name);
-                if (!sym) {
-                    std::cerr << "Semantic error: Undeclared variable '" << var->name << "'\n";
-                    hasErrors = true;
-                    break;
-                }
-                varType = sym->typeInfo;
+void SemanticAnalyzer::checkStatements(NodeId stmt) {
+    if (!stmt) return;
+
+    switch (ast->node(stmt).type) {
+    case NODE_COMPOUND_STMT: {
+        for (NodeId child = ast->firstChild(stmt); child; child = ast->nextSibling(child)) {
+            checkStatements(child);
+        }
+        break;
+    }
+    case NODE_ASSIGNMENT: {
+        NodeId var = ast->child(stmt, 0);
+        NodeId expr = ast->child(stmt, 1);
+
+        TypeInfo varType, exprType;
+
+        if (ast->node(var).type == NODE_VARIABLE) {
+            Symbol* sym = lookup(ast->node(var).name);
+            if (!sym) {
+                error(var, DiagnosticCode::UNDECLARED_VARIABLE, { ast->nodeName(var) });
+                break;
             }
-            else if (var->type == NODE_ARRAY_ACCESS) {
-                ASTNode* arrName = var->children[0];
-                Symbol* sym = symbolTable.findSymbol(arrName->name);
-                if (!sym || sym->typeInfo.baseType != DataType::ARRAY) {
-                    std::cerr << "Semantic error: Undeclared array '" << arrName->name << "'\n";
-                    hasErrors = true;
+
+            // Inside a function, assigning to its name sets the result
+            if (sym->kind == SymbolKind::FUNCTION || sym->kind == SymbolKind::PROCEDURE) {
+                if (sym->kind != SymbolKind::FUNCTION || sym->name != currentFunction) {
+                    error(var, DiagnosticCode::ASSIGNMENT_TO_SUBPROGRAM, { ast->nodeName(var) });
                     break;
                 }
-                varType = TypeInfo(sym->typeInfo.elementType);
+                recordRef(var, RefKind::RESULT, sym->infoIndex);
             }
-
-            exprType = checkExpression(expr);
-
-            if (varType != exprType) {
-                std::cerr << "Semantic error: Type mismatch in assignment\n";
-                hasErrors = true;
+            else {
+                recordRef(var, RefKind::VARIABLE, sym->infoIndex);
             }
-
-            break;
-        }
-        case NODE_IF: {
-            checkExpression(stmt->left); // 
-            checkStatements(stmt->right); //    
-            if (stmt->children.size() > 0)
-                checkStatements(stmt->children[0]->right); //    
-            break;
-        }
-        case NODE_WHILE: {
-            checkExpression(stmt->left); // 
-            checkStatements(stmt->right); //  
-            break;
+            varType = sym->typeInfo;
         }
-        case NODE_PROCEDURE_CALL:
-        case NODE_FUNCTION_CALL: {
-            Symbol* sym = symbolTable.findSymbol(stmt->name);
-            if (!sym || (sym->kind != SymbolKind::FUNCTION && sym->kind != SymbolKind::PROCEDURE)) {
-                std::cerr << "Semantic error: Undeclared subprogram '" << stmt->name << "'\n";
-                hasErrors = true;
+        else if (ast->node(var).type == NODE_ARRAY_ACCESS) {
+            Symbol* sym = lookup(ast->node(var).name);
+            if (!sym || sym->typeInfo.baseType != DataType::ARRAY) {
+                error(var, DiagnosticCode::UNDECLARED_ARRAY, { ast->nodeName(var) });
                 break;
             }
+            varType = TypeInfo(sym->typeInfo.elementType);
+            recordRef(var, RefKind::VARIABLE, sym->infoIndex);
 
-            if (stmt->children.size() > 0) {
-                ASTNode* args = stmt->children[0];
-                if (args->children.size() != sym->paramTypes.size()) {
-                    std::cerr << "Semantic error: Subprogram '" << sym->name << "' expects "
-                        << sym->paramTypes.size() << " arguments but got "
-                        << args->children.size() << "\n";
-                    hasErrors = true;
-                }
-                else {
-                    for (size_t i = 0; i < args->children.size(); ++i) {
-                        TypeInfo argType = checkExpression(args->children[i]);
-                        if (argType != sym->paramTypes[i]) {
-                            std::cerr << "Semantic error: Argument " << i + 1 << " of subprogram '"
-                                << sym->name << "' expects type " << sym->paramTypes[i].toString()
-                                << ", got " << argType.toString() << "\n";
-                            hasErrors = true;
-                        }
-                    }
-                }
-            }
-            break;
+            if (checkExpression(ast->child(var, 0)).baseType != DataType::INTEGER)
+                error(var, DiagnosticCode::INDEX_NOT_INTEGER);
         }
-        default:
+
+        exprType = checkExpression(expr);
+
+        if (varType != exprType) error(stmt, DiagnosticCode::ASSIGNMENT_TYPE_MISMATCH);
+
+        break;
+    }
+    case NODE_IF: {
+        checkCondition(ast->child(stmt, 0)); // 
+        checkStatements(ast->child(stmt, 1)); //    
+        checkStatements(ast->child(stmt, 2)); //    
+        break;
+    }
+    case NODE_WHILE: {
+        checkCondition(ast->child(stmt, 0)); // 
+        checkStatements(ast->child(stmt, 1)); //  
+        break;
+    }
+    case NODE_PROCEDURE_CALL:
+    case NODE_FUNCTION_CALL: {
+        Symbol* sym = lookup(ast->node(stmt).name);
+        if (!sym || (sym->kind != SymbolKind::FUNCTION && sym->kind != SymbolKind::PROCEDURE)) {
+            error(stmt, DiagnosticCode::UNDECLARED_SUBPROGRAM, { ast->nodeName(stmt) });
             break;
         }
+
+        recordRef(stmt, RefKind::CALL, sym->infoIndex);
+        checkArguments(stmt, *sym, false);
+        break;
+    }
+    default:
+        break;
     }
 }
 
 bool SemanticAnalyzer::hasSemanticErrors() const {
     return hasErrors;
-}
\ No newline at end of file
+}
@@ -1,30 +1,127 @@
 #ifndef SEMANTIC_ANALYZER_H
 #define SEMANTIC_ANALYZER_H
 
+#include <initializer_list>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "ast.h"
+#include "ast_arena.h"
+#include "error_handler.h"
+#include "semantic_info.h"
 #include "symbol_table.h"
 #include "semantic_types.h"  //   TypeInfo  DataType
 
+class ThreadPool;
+
+// One name a subprogram body looked up and what it resolved to.
+struct BodyDependency {
+    NameId name;
+    bool found;
+    SymbolKind kind;
+    TypeInfo type;
+    std::vector<TypeInfo> params;   // subprograms: parameter types
+    uint32_t index;                 // the symbol's infoIndex at the time
+};
+
+// What checking one subprogram body produced, kept between analyses of an
+// edited program: the lookups it made, its messages, and the resolution of
+// the nodes in the body. The messages are placed for the subprogram
+// starting at line:column; a replay moves them to where it starts now.
+struct CheckedBody {
+    std::vector<BodyDependency> uses;
+    ErrorHandler messages;
+    uint32_t line = 0;
+    uint32_t column = 0;
+    bool hasErrors = false;
+    bool resolved = false;          // refs and types below were recorded
+    std::vector<std::pair<NodeId, NodeRef>> refs;
+    std::vector<std::pair<NodeId, DataType>> types;
+};
+
+// Checked bodies by NODE_SUBPROGRAM. A body whose subtree is still in the
+// tree, and whose every lookup finds a symbol of the same kind and type as
+// before, is replayed from here instead of being checked again.
+typedef std::unordered_map<NodeId, CheckedBody> BodyCache;
+
+// Checks a program and, when asked, resolves it into SemanticInfo. With a
+// thread pool the subprogram bodies are checked in parallel: a serial pass
+// declares the globals and every subprogram's signature, parameters and
+// locals, then each worker checks bodies against its own copy of the symbol
+// table. A body only sees the subprograms declared before it, as in a
+// serial run, and diagnostics are recorded in an ErrorHandler per
+// subprogram, which only the worker checking it touches, then appended to
+// the caller's in declaration order, so the output does not depend on the
+// thread count.
+// Bodies go through the same two phases when a BodyCache is set.
 class SemanticAnalyzer {
 private:
+    // A subprogram scope recorded by the serial pass, for the worker that
+    // checks the body
+    struct PendingBody {
+        NodeId node;
+        NameId function;                // NO_NAME for procedures
+        uint32_t scopeBegin;            // its parameters and locals, in order, in the shared list
+        uint32_t scopeEnd;
+    };
+
     SymbolTable symbolTable;
+    const AstArena* ast;
     bool hasErrors;
+    ErrorHandler* diagnostics;
+    ThreadPool* pool;
+    uint32_t subprogramCount;
+    BodyCache* bodyCache;
+    size_t checkedBodies;
+    std::vector<BodyDependency>* uses;  // lookups of the body being checked, when recording
+
+    // Resolution results for the backends, only when the caller asks
+    SemanticInfo* info;
+    uint32_t currentSubprogram;
+    NameId currentFunction;
+    uint32_t frameCells;
+    void declareVariable(Symbol& symbol, bool isParameter);
+    void recordRef(NodeId node, RefKind kind, uint32_t index);
+    void error(NodeId node, DiagnosticCode code, std::initializer_list<std::string_view> args = {});
 
     //    
-    void checkProgram(ASTNode* node);
-    void checkDeclarations(ASTNode* node);
-    void checkSubprogram(ASTNode* node);
-    void checkStatements(ASTNode* node);
+    void checkProgram(NodeId node);
+    void checkDeclarations(NodeId node);
+    void checkSubprogram(NodeId node);
+    void declareSubprogram(NodeId node);
+    void leaveSubprogram();
+    void checkSubprogramBodies(NodeId subprogs);
+    BodyDependency dependency(NameId name, const Symbol* sym) const;
+    bool replayBody(NodeId subprog, CheckedBody& checked);
+    void recordBody(NodeId body, CheckedBody& checked) const;
+    Symbol* lookup(NameId name);
+    void checkStatements(NodeId node);
+    void checkArguments(NodeId call, const Symbol& sym, bool isFunction);
 
     //     
-    TypeInfo checkExpression(ASTNode* node);
+    TypeInfo checkExpression(NodeId node);
+    TypeInfo inferExpression(NodeId node);
+    void checkCondition(NodeId node);
+    TypeInfo resolveType(NodeId typeNode) const;
 
     //    
     void checkTypeCompatibility(const TypeInfo& type1, const TypeInfo& type2);
 
 public:
     SemanticAnalyzer();
-    bool analyze(ASTNode* root);
+
+    // Checks subprogram bodies on `threads` (null: serially, the default).
+    void setThreadPool(ThreadPool* threads) { pool = threads; }
+    // Where semantic errors are recorded, with the position of the node
+    // they are about (null: nowhere, the default; analyze() still says
+    // whether there were any).
+    void setErrorHandler(ErrorHandler* errors) { diagnostics = errors; }
+    // Reuses and updates checked bodies (null: checks every body, the default).
+    void setBodyCache(BodyCache* cache) { bodyCache = cache; }
+    // Bodies the last analysis checked rather than replayed.
+    size_t bodiesChecked() const { return checkedBodies; }
+    bool analyze(const AstArena& tree, NodeId root, SemanticInfo* resolved = nullptr);
     bool hasSemanticErrors() const;
 };
 
@@ -0,0 +1,87 @@
+#ifndef SEMANTIC_INFO_H
+#define SEMANTIC_INFO_H
+
+#include <cstdint>
+#include <vector>
+#include "ast.h"
+#include "semantic_types.h"
+
+// What a successful analysis resolved, for the backends. The analyzer leaves
+// the AST untouched; everything here lives in side tables indexed by NodeId,
+// which the passes in optimizer.h keep in step as they rewrite the tree.
+//
+// Storage is measured in cells, one per scalar value; an array takes one
+// cell per element. Globals live in one global area, everything declared in
+// a subprogram lives in that subprogram's frame: parameters first, then the
+// function result, then locals.
+
+enum class Storage : uint8_t {
+    GLOBAL,
+    FRAME
+};
+
+struct VariableInfo {
+    NameId name;
+    TypeInfo type;
+    Storage storage;
+    uint32_t slot;      // first cell in the global area or in the frame
+    uint32_t cells;     // 1, or the element count of an array
+    uint32_t owner;     // subprogram index, or NO_SUBPROGRAM for globals
+    bool isParameter;
+    bool isTemporary = false;   // made by an optimization pass; never printed
+    bool isUnused = false;      // an array or temporary no reachable code mentions; the native backends give it no storage
+};
+
+struct SubprogramInfo {
+    NameId name;
+    NodeId node;            // NODE_SUBPROGRAM
+    bool isFunction;
+    DataType returnType;    // UNKNOWN for procedures
+    uint32_t firstParam;    // parameters are variables[firstParam, firstParam + paramCount)
+    uint32_t paramCount;
+    uint32_t paramCells;    // cells the arguments occupy at the bottom of the frame
+    uint32_t resultSlot;    // functions: frame cell holding the result
+    uint32_t frameCells;    // parameters + result + locals
+    bool isReachable = true;    // false once the optimizer found no call from the main program
+};
+
+const uint32_t NO_SUBPROGRAM = 0xFFFFFFFFu;
+
+// How a named node was resolved.
+enum class RefKind : uint8_t {
+    NONE,
+    VARIABLE,   // index into variables
+    CALL,       // index into subprograms; also a bare function name used as a value
+    RESULT      // function name as an assignment target; index into subprograms
+};
+
+struct NodeRef {
+    RefKind kind;
+    uint32_t index;
+};
+
+struct SemanticInfo {
+    std::vector<VariableInfo> variables;
+    std::vector<SubprogramInfo> subprograms;
+    uint32_t globalCells = 0;
+
+    std::vector<NodeRef> refs;          // by NodeId: VARIABLE, ARRAY_ACCESS, calls
+    std::vector<DataType> exprTypes;    // by NodeId: value type of each expression
+    std::vector<bool> boundsProven;     // by NodeId: ARRAY_ACCESS whose index is known to be in range
+
+    void reset(size_t nodeCount) {
+        variables.clear();
+        subprograms.clear();
+        globalCells = 0;
+        refs.assign(nodeCount, NodeRef{ RefKind::NONE, 0 });
+        exprTypes.assign(nodeCount, DataType::UNKNOWN);
+        boundsProven.assign(nodeCount, false);
+    }
+
+    const NodeRef& ref(NodeId id) const { return refs[id]; }
+    DataType typeOf(NodeId id) const { return exprTypes[id]; }
+    const VariableInfo& variable(NodeId id) const { return variables[refs[id].index]; }
+    const SubprogramInfo& subprogram(NodeId id) const { return subprograms[refs[id].index]; }
+};
+
+#endif // SEMANTIC_INFO_H
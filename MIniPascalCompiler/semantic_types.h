@@ -41,6 +41,10 @@ struct TypeInfo {
         return true;
     }
 
+    bool operator!=(const TypeInfo& other) const {
+        return !(*this == other);
+    }
+
     std::string toString() const {
         switch (baseType) {
         case DataType::INTEGER:
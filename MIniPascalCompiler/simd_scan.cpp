@@ -0,0 +1,308 @@
+#include "simd_scan.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCAN_HAVE_SSE2 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(SCAN_HAVE_SSE2) && (defined(__GNUC__) || defined(_MSC_VER))
+#define SCAN_HAVE_AVX2 1
+#endif
+
+#if defined(__GNUC__)
+#define SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SCAN_TARGET_AVX2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static inline unsigned lowestBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline unsigned highestBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return index;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+static inline unsigned popCount(uint32_t mask) {
+#ifdef _MSC_VER
+    mask = mask - ((mask >> 1) & 0x55555555u);
+    mask = (mask & 0x33333333u) + ((mask >> 2) & 0x33333333u);
+    return (((mask + (mask >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+#else
+    return __builtin_popcount(mask);
+#endif
+}
+
+// Bits of `mask` below `count`; count may equal the full 32-bit width.
+static inline uint32_t bitsBelow(uint32_t mask, unsigned count) {
+    return count >= 32 ? mask : mask & ((1u << count) - 1);
+}
+
+static inline void countLines(LineCount& lines, const char* base, uint32_t newlineMask) {
+    if (!newlineMask) return;
+    lines.newlines += popCount(newlineMask);
+    lines.lastNewline = base + highestBit(newlineMask);
+}
+
+static inline bool isIdentByte(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// ---------------------------------------------------------------------------
+// Scalar
+
+static const char* skipWhitespaceScalar(const char* p, const char* end, LineCount& lines) {
+    for (; p < end; ++p) {
+        char c = *p;
+        if (c == '\n') {
+            lines.newlines++;
+            lines.lastNewline = p;
+        }
+        else if (c != ' ' && c != '\t' && c != '\r') {
+            break;
+        }
+    }
+    return p;
+}
+
+static const char* findCommentEndScalar(const char* p, const char* end, LineCount& lines) {
+    for (; p < end; ++p) {
+        if (*p == '}') return p;
+        if (*p == '\n') {
+            lines.newlines++;
+            lines.lastNewline = p;
+        }
+    }
+    return nullptr;
+}
+
+static const char* identifierEndScalar(const char* p, const char* end) {
+    while (p < end && isIdentByte(*p)) ++p;
+    return p;
+}
+
+// ---------------------------------------------------------------------------
+// SSE2: 16 bytes per step, scalar for the tail
+
+#ifdef SCAN_HAVE_SSE2
+
+static const char* skipWhitespaceSse2(const char* p, const char* end, LineCount& lines) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i newline = _mm_cmpeq_epi8(chunk, lf);
+        __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(chunk, cr), newline));
+        uint32_t blankMask = static_cast<uint32_t>(_mm_movemask_epi8(blank));
+        uint32_t newlineMask = static_cast<uint32_t>(_mm_movemask_epi8(newline));
+
+        if (blankMask != 0xFFFFu) {
+            unsigned stop = lowestBit(~blankMask);
+            countLines(lines, p, bitsBelow(newlineMask, stop));
+            return p + stop;
+        }
+        countLines(lines, p, newlineMask);
+        p += 16;
+    }
+    return skipWhitespaceScalar(p, end, lines);
+}
+
+static const char* findCommentEndSse2(const char* p, const char* end, LineCount& lines) {
+    const __m128i brace = _mm_set1_epi8('}');
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t closeMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, brace)));
+        uint32_t newlineMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, lf)));
+
+        if (closeMask) {
+            unsigned stop = lowestBit(closeMask);
+            countLines(lines, p, bitsBelow(newlineMask, stop));
+            return p + stop;
+        }
+        countLines(lines, p, newlineMask);
+        p += 16;
+    }
+    return findCommentEndScalar(p, end, lines);
+}
+
+// Signed byte compares are enough: bytes >= 0x80 compare negative and so
+// fall outside every ASCII range below.
+static inline __m128i identBytesSse2(__m128i chunk) {
+    __m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1)));
+    __m128i underscore = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), underscore);
+}
+
+static const char* identifierEndSse2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t identMask = static_cast<uint32_t>(_mm_movemask_epi8(identBytesSse2(chunk)));
+        if (identMask != 0xFFFFu) return p + lowestBit(~identMask);
+        p += 16;
+    }
+    return identifierEndScalar(p, end);
+}
+
+#endif // SCAN_HAVE_SSE2
+
+// ---------------------------------------------------------------------------
+// AVX2: 32 bytes per step, SSE2 for the tail
+
+#ifdef SCAN_HAVE_AVX2
+
+SCAN_TARGET_AVX2
+static const char* skipWhitespaceAvx2(const char* p, const char* end, LineCount& lines) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i newline = _mm256_cmpeq_epi8(chunk, lf);
+        __m256i blank = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, cr), newline));
+        uint32_t blankMask = static_cast<uint32_t>(_mm256_movemask_epi8(blank));
+        uint32_t newlineMask = static_cast<uint32_t>(_mm256_movemask_epi8(newline));
+
+        if (blankMask != 0xFFFFFFFFu) {
+            unsigned stop = lowestBit(~blankMask);
+            countLines(lines, p, bitsBelow(newlineMask, stop));
+            return p + stop;
+        }
+        countLines(lines, p, newlineMask);
+        p += 32;
+    }
+    return skipWhitespaceSse2(p, end, lines);
+}
+
+SCAN_TARGET_AVX2
+static const char* findCommentEndAvx2(const char* p, const char* end, LineCount& lines) {
+    const __m256i brace = _mm256_set1_epi8('}');
+    const __m256i lf = _mm256_set1_epi8('\n');
+
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t closeMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, brace)));
+        uint32_t newlineMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, lf)));
+
+        if (closeMask) {
+            unsigned stop = lowestBit(closeMask);
+            countLines(lines, p, bitsBelow(newlineMask, stop));
+            return p + stop;
+        }
+        countLines(lines, p, newlineMask);
+        p += 32;
+    }
+    return findCommentEndSse2(p, end, lines);
+}
+
+SCAN_TARGET_AVX2
+static const char* identifierEndAvx2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i lower = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+        __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('0' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chunk));
+        __m256i underscore = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('_'));
+        __m256i ident = _mm256_or_si256(_mm256_or_si256(alpha, digit), underscore);
+
+        uint32_t identMask = static_cast<uint32_t>(_mm256_movemask_epi8(ident));
+        if (identMask != 0xFFFFFFFFu) return p + lowestBit(~identMask);
+        p += 32;
+    }
+    return identifierEndSse2(p, end);
+}
+
+static bool cpuHasAvx2() {
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    int info[4];
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    if (!osSavesYmm) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#endif
+}
+
+#endif // SCAN_HAVE_AVX2
+
+// ---------------------------------------------------------------------------
+
+static const ScanKernels scalarKernels = {
+    ScanKernel::SCALAR, skipWhitespaceScalar, findCommentEndScalar, identifierEndScalar
+};
+
+#ifdef SCAN_HAVE_SSE2
+static const ScanKernels sse2Kernels = {
+    ScanKernel::SSE2, skipWhitespaceSse2, findCommentEndSse2, identifierEndSse2
+};
+#endif
+
+#ifdef SCAN_HAVE_AVX2
+static const ScanKernels avx2Kernels = {
+    ScanKernel::AVX2, skipWhitespaceAvx2, findCommentEndAvx2, identifierEndAvx2
+};
+#endif
+
+ScanKernel bestScanKernel() {
+#ifdef SCAN_HAVE_AVX2
+    static const bool hasAvx2 = cpuHasAvx2();
+    if (hasAvx2) return ScanKernel::AVX2;
+#endif
+#ifdef SCAN_HAVE_SSE2
+    return ScanKernel::SSE2;
+#else
+    return ScanKernel::SCALAR;
+#endif
+}
+
+const ScanKernels& scanKernels(ScanKernel kind) {
+#ifdef SCAN_HAVE_AVX2
+    if (kind == ScanKernel::AVX2 && bestScanKernel() == ScanKernel::AVX2) return avx2Kernels;
+#endif
+#ifdef SCAN_HAVE_SSE2
+    if (kind != ScanKernel::SCALAR) return sse2Kernels;
+#endif
+    return scalarKernels;
+}
+
+const char* scanKernelName(ScanKernel kind) {
+    switch (kind) {
+    case ScanKernel::SSE2: return "sse2";
+    case ScanKernel::AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
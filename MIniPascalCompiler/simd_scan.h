@@ -0,0 +1,44 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Bulk scanning loops of the hand-written lexer. Each kernel has a scalar,
+// an SSE2 (16 bytes per step) and an AVX2 (32 bytes per step) version; all
+// three must return exactly the same results.
+enum class ScanKernel : uint8_t {
+    SCALAR,
+    SSE2,
+    AVX2
+};
+
+// Newlines crossed by a scan, so the lexer can keep line/column exact.
+struct LineCount {
+    uint32_t newlines;
+    const char* lastNewline; // position of the last '\n' seen, or nullptr
+};
+
+struct ScanKernels {
+    ScanKernel kind;
+
+    // First byte in [p, end) that is not ' ', '\t', '\r' or '\n'.
+    const char* (*skipWhitespace)(const char* p, const char* end, LineCount& lines);
+
+    // The '}' closing a block comment whose body starts at p, or nullptr.
+    const char* (*findCommentEnd)(const char* p, const char* end, LineCount& lines);
+
+    // First byte in [p, end) that is not [A-Za-z0-9_].
+    const char* (*identifierEnd)(const char* p, const char* end);
+};
+
+// Kernels for a given instruction set. Falls back to the next narrower set
+// when the requested one was not compiled in or the CPU lacks it.
+const ScanKernels& scanKernels(ScanKernel kind);
+
+// Widest kernel set this CPU supports.
+ScanKernel bestScanKernel();
+
+const char* scanKernelName(ScanKernel kind);
+
+#endif // SIMD_SCAN_H
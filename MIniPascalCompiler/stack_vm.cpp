@@ -0,0 +1,317 @@
+#include "stack_vm.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+static const size_t MAX_CALL_DEPTH = 1u << 16;
+
+static inline uint32_t readU32(const uint8_t* pc) {
+    uint32_t value;
+    std::memcpy(&value, pc, 4);
+    return value;
+}
+
+static inline int32_t readI32(const uint8_t* pc) {
+    int32_t value;
+    std::memcpy(&value, pc, 4);
+    return value;
+}
+
+// Integers wrap around on overflow
+static inline int32_t wrap(uint32_t value) {
+    return static_cast<int32_t>(value);
+}
+
+StackVM::StackVM(const BytecodeProgram& program, size_t stackCells)
+    : program(program), stack(stackCells), dispatches(0) {}
+
+bool StackVM::run() {
+    globalCells.assign(program.globalCells, Value{});
+    frames.clear();
+    frames.reserve(64);
+    errorMessage.clear();
+    dispatches = 0;
+
+    if (program.mainMaxStack > stack.size()) {
+        errorMessage = "stack overflow";
+        return false;
+    }
+
+    const uint8_t* const code = program.code.data();
+    const double* const reals = program.reals.data();
+    const BytecodeFunction* const functions = program.functions.data();
+    Value* const globals = globalCells.data();
+    Value* const stackEnd = stack.data() + stack.size();
+    const uint8_t* pc = code + program.mainEntry;
+    Value* fp = stack.data();
+    Value* sp = fp;
+    uint64_t count = 0;
+
+#ifdef VM_COMPUTED_GOTO
+    static const void* const dispatchTable[BC_OPCODE_COUNT] = {
+#define BYTECODE_LABEL(name) &&op_##name,
+        BYTECODE_OPS(BYTECODE_LABEL)
+#undef BYTECODE_LABEL
+    };
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() do { ++count; goto *dispatchTable[*pc++]; } while (0)
+    VM_NEXT();
+    {
+#else
+#define VM_CASE(name) case BC_##name:
+#define VM_NEXT() continue
+    for (;;) {
+        ++count;
+        switch (*pc++) {
+#endif
+
+    VM_CASE(PUSH_INT) {
+        (sp++)->i = readI32(pc);
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(PUSH_REAL) {
+        (sp++)->r = reals[readU32(pc)];
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_GLOBAL) {
+        *sp++ = globals[readU32(pc)];
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(STORE_GLOBAL) {
+        globals[readU32(pc)] = *--sp;
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_LOCAL) {
+        *sp++ = fp[readU32(pc)];
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(STORE_LOCAL) {
+        fp[readU32(pc)] = *--sp;
+        pc += 4;
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_ELEM_GLOBAL) {
+        uint32_t index = static_cast<uint32_t>(sp[-1].i) - static_cast<uint32_t>(readI32(pc + 4));
+        if (index >= readU32(pc + 8)) goto outOfBounds;
+        sp[-1] = globals[readU32(pc) + index];
+        pc += 12;
+        VM_NEXT();
+    }
+    VM_CASE(STORE_ELEM_GLOBAL) {
+        uint32_t index = static_cast<uint32_t>(sp[-2].i) - static_cast<uint32_t>(readI32(pc + 4));
+        if (index >= readU32(pc + 8)) goto outOfBounds;
+        globals[readU32(pc) + index] = sp[-1];
+        sp -= 2;
+        pc += 12;
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_ELEM_LOCAL) {
+        uint32_t index = static_cast<uint32_t>(sp[-1].i) - static_cast<uint32_t>(readI32(pc + 4));
+        if (index >= readU32(pc + 8)) goto outOfBounds;
+        sp[-1] = fp[readU32(pc) + index];
+        pc += 12;
+        VM_NEXT();
+    }
+    VM_CASE(STORE_ELEM_LOCAL) {
+        uint32_t index = static_cast<uint32_t>(sp[-2].i) - static_cast<uint32_t>(readI32(pc + 4));
+        if (index >= readU32(pc + 8)) goto outOfBounds;
+        fp[readU32(pc) + index] = sp[-1];
+        sp -= 2;
+        pc += 12;
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_ARRAY_GLOBAL) {
+        uint32_t cells = readU32(pc + 4);
+        std::memcpy(sp, globals + readU32(pc), cells * sizeof(Value));
+        sp += cells;
+        pc += 8;
+        VM_NEXT();
+    }
+    VM_CASE(STORE_ARRAY_GLOBAL) {
+        uint32_t cells = readU32(pc + 4);
+        sp -= cells;
+        std::memcpy(globals + readU32(pc), sp, cells * sizeof(Value));
+        pc += 8;
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_ARRAY_LOCAL) {
+        uint32_t cells = readU32(pc + 4);
+        std::memmove(sp, fp + readU32(pc), cells * sizeof(Value));
+        sp += cells;
+        pc += 8;
+        VM_NEXT();
+    }
+    VM_CASE(STORE_ARRAY_LOCAL) {
+        uint32_t cells = readU32(pc + 4);
+        sp -= cells;
+        std::memmove(fp + readU32(pc), sp, cells * sizeof(Value));
+        pc += 8;
+        VM_NEXT();
+    }
+
+    VM_CASE(ADD_I) {
+        --sp;
+        sp[-1].i = wrap(static_cast<uint32_t>(sp[-1].i) + static_cast<uint32_t>(sp[0].i));
+        VM_NEXT();
+    }
+    VM_CASE(SUB_I) {
+        --sp;
+        sp[-1].i = wrap(static_cast<uint32_t>(sp[-1].i) - static_cast<uint32_t>(sp[0].i));
+        VM_NEXT();
+    }
+    VM_CASE(MUL_I) {
+        --sp;
+        sp[-1].i = wrap(static_cast<uint32_t>(sp[-1].i) * static_cast<uint32_t>(sp[0].i));
+        VM_NEXT();
+    }
+    VM_CASE(DIV_I) {
+        --sp;
+        if (sp[0].i == 0) goto divisionByZero;
+        if (sp[0].i == -1) sp[-1].i = wrap(0u - static_cast<uint32_t>(sp[-1].i));
+        else sp[-1].i /= sp[0].i;
+        VM_NEXT();
+    }
+    VM_CASE(NEG_I) {
+        sp[-1].i = wrap(0u - static_cast<uint32_t>(sp[-1].i));
+        VM_NEXT();
+    }
+    VM_CASE(ADD_R) {
+        --sp;
+        sp[-1].r += sp[0].r;
+        VM_NEXT();
+    }
+    VM_CASE(SUB_R) {
+        --sp;
+        sp[-1].r -= sp[0].r;
+        VM_NEXT();
+    }
+    VM_CASE(MUL_R) {
+        --sp;
+        sp[-1].r *= sp[0].r;
+        VM_NEXT();
+    }
+    VM_CASE(DIV_R) {
+        --sp;
+        sp[-1].r /= sp[0].r;
+        VM_NEXT();
+    }
+    VM_CASE(NEG_R) {
+        sp[-1].r = -sp[-1].r;
+        VM_NEXT();
+    }
+    VM_CASE(INT_TO_REAL) {
+        sp[-1].r = static_cast<double>(sp[-1].i);
+        VM_NEXT();
+    }
+
+#define VM_COMPARE(name, field, cmp) \
+    VM_CASE(name) { \
+        --sp; \
+        sp[-1].i = sp[-1].field cmp sp[0].field; \
+        VM_NEXT(); \
+    }
+    VM_COMPARE(EQ_I, i, ==)
+    VM_COMPARE(NE_I, i, !=)
+    VM_COMPARE(LT_I, i, <)
+    VM_COMPARE(LE_I, i, <=)
+    VM_COMPARE(GT_I, i, >)
+    VM_COMPARE(GE_I, i, >=)
+    VM_COMPARE(EQ_R, r, ==)
+    VM_COMPARE(NE_R, r, !=)
+    VM_COMPARE(LT_R, r, <)
+    VM_COMPARE(LE_R, r, <=)
+    VM_COMPARE(GT_R, r, >)
+    VM_COMPARE(GE_R, r, >=)
+#undef VM_COMPARE
+
+    VM_CASE(NOT) {
+        sp[-1].i = !sp[-1].i;
+        VM_NEXT();
+    }
+    VM_CASE(JUMP) {
+        pc += 4 + readI32(pc);
+        VM_NEXT();
+    }
+    VM_CASE(JUMP_IF_FALSE) {
+        int32_t rel = readI32(pc);
+        pc += 4;
+        if (!(--sp)->i) pc += rel;
+        VM_NEXT();
+    }
+    VM_CASE(JUMP_IF_TRUE) {
+        int32_t rel = readI32(pc);
+        pc += 4;
+        if ((--sp)->i) pc += rel;
+        VM_NEXT();
+    }
+    VM_CASE(CALL) {
+        const BytecodeFunction& function = functions[readU32(pc)];
+        pc += 4;
+        Value* base = sp - function.paramCells;
+        Value* frameEnd = base + function.frameCells;
+        if (frameEnd + function.maxStack > stackEnd || frames.size() >= MAX_CALL_DEPTH) goto stackOverflow;
+        for (; sp < frameEnd; ++sp) sp->r = 0.0;
+        frames.push_back(CallFrame{ pc, fp });
+        fp = base;
+        pc = code + function.entry;
+        VM_NEXT();
+    }
+    VM_CASE(RETURN) {
+        sp = fp;
+        pc = frames.back().returnPc;
+        fp = frames.back().fp;
+        frames.pop_back();
+        VM_NEXT();
+    }
+    VM_CASE(RETURN_VALUE) {
+        Value result = fp[readU32(pc)];
+        sp = fp;
+        *sp++ = result;
+        pc = frames.back().returnPc;
+        fp = frames.back().fp;
+        frames.pop_back();
+        VM_NEXT();
+    }
+    VM_CASE(POP) {
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(HALT) {
+        dispatches = count;
+        return true;
+    }
+
+#ifdef VM_COMPUTED_GOTO
+    }
+#else
+        default:
+            errorMessage = "invalid opcode";
+            dispatches = count;
+            return false;
+        }
+    }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+
+divisionByZero:
+    errorMessage = "division by zero";
+    dispatches = count;
+    return false;
+outOfBounds:
+    errorMessage = "array index out of range";
+    dispatches = count;
+    return false;
+stackOverflow:
+    errorMessage = "stack overflow";
+    dispatches = count;
+    return false;
+}
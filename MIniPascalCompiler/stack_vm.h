@@ -0,0 +1,42 @@
+#ifndef STACK_VM_H
+#define STACK_VM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bytecode.h"
+
+// Interpreter for the stack bytecode in bytecode.h. Dispatch is a computed
+// goto through a label table on GCC and Clang, and a switch elsewhere.
+//
+// One value stack holds every frame: a call leaves its arguments in place
+// as the callee's first cells, zeroes the rest of the frame, and works on
+// the operand stack above it.
+class StackVM {
+public:
+    explicit StackVM(const BytecodeProgram& program, size_t stackCells = 1u << 20);
+
+    // Runs the program from main. Returns false on a runtime error
+    // (division by zero, index out of range, stack overflow).
+    bool run();
+
+    const std::string& error() const { return errorMessage; }
+    const Value* globals() const { return globalCells.data(); }
+    uint64_t dispatchCount() const { return dispatches; }
+
+private:
+    struct CallFrame {
+        const uint8_t* returnPc;
+        Value* fp;
+    };
+
+    const BytecodeProgram& program;
+    std::vector<Value> globalCells;
+    std::vector<Value> stack;
+    std::vector<CallFrame> frames;
+    std::string errorMessage;
+    uint64_t dispatches;
+};
+
+#endif // STACK_VM_H
@@ -0,0 +1,135 @@
+#include "string_interner.h"
+#include <cstdlib>
+#include <new>
+
+static const size_t BLOCK_SIZE = 64 * 1024;
+static const size_t INITIAL_SLOTS = 1024;
+
+StringInterner::StringInterner() : cursor(nullptr), limit(nullptr), textBytes(0) {
+    clear();
+}
+
+StringInterner::~StringInterner() {
+    for (char* block : blocks) {
+        std::free(block);
+    }
+}
+
+// 64-bit multiply-xorshift over 8-byte words; identifiers are short, so this
+// is mostly one or two rounds.
+uint32_t StringInterner::hash(const char* text, size_t length) {
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ length;
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, text, 8);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+        text += 8;
+        length -= 8;
+    }
+    if (length > 0) {
+        uint64_t word = 0;
+        std::memcpy(&word, text, length);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    h *= 0xC4CEB9FE1A85EC53ull;
+    return static_cast<uint32_t>(h ^ (h >> 29));
+}
+
+char* StringInterner::store(const char* text, size_t length) {
+    if (!cursor || cursor + length + 1 > limit) {
+        size_t size = length + 1 > BLOCK_SIZE ? length + 1 : BLOCK_SIZE;
+        char* block = static_cast<char*>(std::malloc(size));
+        if (!block) throw std::bad_alloc();
+        blocks.push_back(block);
+        cursor = block;
+        limit = block + size;
+    }
+
+    char* copy = cursor;
+    std::memcpy(copy, text, length);
+    copy[length] = '\0';
+    cursor += length + 1;
+    textBytes += length + 1;
+    return copy;
+}
+
+void StringInterner::grow() {
+    std::vector<NameId> bigger(slots.size() * 2, NO_NAME);
+    size_t mask = bigger.size() - 1;
+    for (NameId id = 1; id < entries.size(); ++id) {
+        size_t i = entries[id].hash & mask;
+        while (bigger[i] != NO_NAME) i = (i + 1) & mask;
+        bigger[i] = id;
+    }
+    slots.swap(bigger);
+}
+
+NameId StringInterner::find(const char* text, size_t length) const {
+    uint32_t h = hash(text, length);
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask; slots[i] != NO_NAME; i = (i + 1) & mask) {
+        const Entry& e = entries[slots[i]];
+        if (e.hash == h && e.length == length && std::memcmp(e.text, text, length) == 0)
+            return slots[i];
+    }
+    return NO_NAME;
+}
+
+NameId StringInterner::intern(const char* text, size_t length) {
+    uint32_t h = hash(text, length);
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    for (; slots[i] != NO_NAME; i = (i + 1) & mask) {
+        const Entry& e = entries[slots[i]];
+        if (e.hash == h && e.length == length && std::memcmp(e.text, text, length) == 0)
+            return slots[i];
+    }
+
+    NameId id = static_cast<NameId>(entries.size());
+    entries.push_back({ store(text, length), static_cast<uint32_t>(length), h });
+    slots[i] = id;
+
+    // Keep the load factor at or below one half.
+    if (entries.size() * 2 > slots.size())
+        grow();
+    return id;
+}
+
+size_t StringInterner::bytesUsed() const {
+    return textBytes + entries.capacity() * sizeof(Entry) + slots.capacity() * sizeof(NameId);
+}
+
+void StringInterner::clear() {
+    for (char* block : blocks) {
+        std::free(block);
+    }
+    blocks.clear();
+    cursor = nullptr;
+    limit = nullptr;
+    textBytes = 0;
+
+    entries.clear();
+    slots.assign(INITIAL_SLOTS, NO_NAME);
+    entries.push_back({ "", 0, 0 });
+}
+
+static StringInterner& processInterner() {
+    static StringInterner interner;
+    return interner;
+}
+
+static thread_local StringInterner* threadInterner = nullptr;
+
+StringInterner& globalInterner() {
+    return threadInterner ? *threadInterner : processInterner();
+}
+
+InternerScope::InternerScope(StringInterner& interner) : previous(threadInterner) {
+    threadInterner = &interner;
+}
+
+InternerScope::~InternerScope() {
+    threadInterner = previous;
+}
@@ -0,0 +1,79 @@
+#ifndef STRING_INTERNER_H
+#define STRING_INTERNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Dense identifier handle. 0 is the empty name and never refers to a real
+// identifier, so it can double as "no name".
+typedef uint32_t NameId;
+const NameId NO_NAME = 0;
+
+// Maps every distinct identifier spelling to a small integer once, so the
+// rest of the pipeline compares and hashes names as integers. Spellings are
+// copied into large blocks owned by the interner and stay valid until clear().
+class StringInterner {
+public:
+    StringInterner();
+    ~StringInterner();
+
+    StringInterner(const StringInterner&) = delete;
+    StringInterner& operator=(const StringInterner&) = delete;
+
+    NameId intern(const char* text, size_t length);
+    NameId intern(const char* text) { return intern(text, std::strlen(text)); }
+    NameId find(const char* text, size_t length) const;
+
+    const char* spelling(NameId id) const { return entries[id].text; }
+    uint32_t length(NameId id) const { return entries[id].length; }
+    size_t size() const { return entries.size() - 1; }
+    size_t bytesUsed() const;
+
+    void clear();
+
+private:
+    struct Entry {
+        const char* text;
+        uint32_t length;
+        uint32_t hash;
+    };
+
+    static uint32_t hash(const char* text, size_t length);
+    char* store(const char* text, size_t length);
+    void grow();
+
+    std::vector<Entry> entries;
+    std::vector<NameId> slots;     // open addressing, NO_NAME marks an empty slot
+    std::vector<char*> blocks;
+    char* cursor;
+    char* limit;
+    size_t textBytes;
+};
+
+// Interner shared by the lexer, AST and symbol tables: a process-wide one,
+// unless the calling thread has installed another with InternerScope.
+StringInterner& globalInterner();
+
+// Makes `interner` the calling thread's globalInterner() for the scope's
+// lifetime. A compilation installs its own so that files compiled on
+// different threads never touch the same table; threads helping with one
+// compilation install the interner of the thread that started it.
+class InternerScope {
+public:
+    explicit InternerScope(StringInterner& interner);
+    ~InternerScope();
+
+    InternerScope(const InternerScope&) = delete;
+    InternerScope& operator=(const InternerScope&) = delete;
+
+private:
+    StringInterner* previous;
+};
+
+inline const char* nameOf(NameId id) {
+    return globalInterner().spelling(id);
+}
+
+#endif // STRING_INTERNER_H
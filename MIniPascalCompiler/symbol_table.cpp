@@ -2,18 +2,31 @@
 #include <iostream>
 
 SymbolTable::SymbolTable() {
+    // Reserve up front so entering and leaving scopes does not allocate.
+    symbols.reserve(256);
+    scopes.reserve(64);
+    paramPool.reserve(64);
+
     // Start with global scope
-    enterScope("global");
+    enterScope();
 }
 
-void SymbolTable::enterScope(const std::string& scopeName) {
-    scopes.push_back(std::unordered_map<std::string, Symbol>());
+void SymbolTable::enterScope() {
+    scopes.push_back({ static_cast<uint32_t>(symbols.size()), static_cast<uint32_t>(paramPool.size()) });
 }
 
 void SymbolTable::exitScope() {
-    if (!scopes.empty()) {
-        scopes.pop_back();
+    if (scopes.empty()) return;
+
+    ScopeMark mark = scopes.back();
+    scopes.pop_back();
+
+    while (symbols.size() > mark.symbolCount) {
+        const Symbol& symbol = symbols.back();
+        bindings[symbol.name] = symbol.shadowed;
+        symbols.pop_back();
     }
+    paramPool.resize(mark.paramCount);
 }
 
 bool SymbolTable::addSymbol(const Symbol& symbol) {
@@ -21,29 +34,45 @@ bool SymbolTable::addSymbol(const Symbol& symbol) {
         return false;
     }
 
-    scopes.back()[symbol.name] = symbol;
+    if (symbol.name >= bindings.size()) {
+        size_t size = globalInterner().size() + 1;
+        bindings.resize(size > symbol.name ? size : symbol.name + 1, 0);
+    }
+
+    symbols.push_back(symbol);
+    Symbol& added = symbols.back();
+    added.depth = static_cast<uint32_t>(scopes.size());
+    added.shadowed = bindings[symbol.name];
+    bindings[symbol.name] = static_cast<uint32_t>(symbols.size());
     return true;
 }
 
-Symbol* SymbolTable::findSymbol(const std::string& name) {
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-        auto found = it->find(name);
-        if (found != it->end()) {
-            return &found->second;
-        }
-    }
-    return nullptr;
+Symbol* SymbolTable::findSymbol(NameId name) {
+    if (name >= bindings.size() || bindings[name] == 0) return nullptr;
+    return &symbols[bindings[name] - 1];
 }
 
-bool SymbolTable::isInCurrentScope(const std::string& name) {
-    if (scopes.empty()) return false;
-    return scopes.back().find(name) != scopes.back().end();
+bool SymbolTable::isInCurrentScope(NameId name) {
+    Symbol* symbol = findSymbol(name);
+    return symbol && symbol->depth == scopes.size();
+}
+
+void SymbolTable::addParameterType(Symbol& subprogram, const TypeInfo& type) {
+    if (subprogram.paramCount == 0)
+        subprogram.paramBegin = static_cast<uint32_t>(paramPool.size());
+    paramPool.push_back(type);
+    subprogram.paramCount++;
 }
 
 void SymbolTable::printCurrentScope() const {
     if (scopes.empty()) return;
 
-    for (const auto& pair : scopes.back()) {
-        std::cout << pair.first << " : " << pair.second.dataType << std::endl;
+    for (size_t i = scopes.back().symbolCount; i < symbols.size(); ++i) {
+        std::cout << nameOf(symbols[i].name) << " : " << symbols[i].typeInfo.toString() << std::endl;
     }
-}
\ No newline at end of file
+}
+
+void SymbolTable::currentScope(std::vector<Symbol>& out) const {
+    if (scopes.empty()) return;
+    out.insert(out.end(), symbols.begin() + scopes.back().symbolCount, symbols.end());
+}
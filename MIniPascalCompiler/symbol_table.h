@@ -1,39 +1,68 @@
 #ifndef SYMBOL_TABLE_H
 #define SYMBOL_TABLE_H
 
-#include <string>
+#include <cstdint>
 #include <vector>
-#include <unordered_map>
-
-enum SymbolType {
-    SYM_VARIABLE,
-    SYM_FUNCTION,
-    SYM_PROCEDURE,
-    SYM_ARRAY,
-    SYM_PARAMETER
+#include "semantic_types.h"
+#include "string_interner.h"
+
+enum class SymbolKind {
+    VARIABLE,
+    FUNCTION,
+    PROCEDURE,
+    PARAMETER
 };
 
 struct Symbol {
-    std::string name;
-    SymbolType type;
-    std::string dataType;
-    int arrayStart;
-    int arrayEnd;
-    std::vector<std::string> parameters;
+    NameId name;
+    SymbolKind kind;
+    TypeInfo typeInfo;      // variable type, or function return type
+    uint32_t paramBegin;    // FUNCTION / PROCEDURE: slice of the table's parameter pool
+    uint32_t paramCount;
+    uint32_t depth;         // scope depth the symbol was declared at
+    uint32_t shadowed;      // binding hidden by this symbol, restored on exitScope
+    uint32_t infoIndex;     // entry in SemanticInfo::variables or ::subprograms
+
+    Symbol() : name(NO_NAME), kind(SymbolKind::VARIABLE), paramBegin(0), paramCount(0), depth(0), shadowed(0), infoIndex(0) {}
 };
 
+// Single flat table for all scopes. Every visible name maps straight to its
+// innermost declaration through `bindings`, indexed by NameId, so a lookup is
+// one probe regardless of nesting. Declarations are pushed onto `symbols`,
+// which doubles as the undo log: exitScope pops back to the scope's mark and
+// restores whatever each popped symbol was shadowing.
+//
+// Symbol pointers returned by findSymbol stay valid until the next addSymbol.
 class SymbolTable {
 private:
-    std::vector<std::unordered_map<std::string, Symbol>> scopes;
+    struct ScopeMark {
+        uint32_t symbolCount;
+        uint32_t paramCount;
+    };
+
+    std::vector<Symbol> symbols;
+    std::vector<uint32_t> bindings;     // NameId -> index + 1 into symbols, 0 if unbound
+    std::vector<ScopeMark> scopes;
+    std::vector<TypeInfo> paramPool;
 
 public:
     SymbolTable();
-    void enterScope(const std::string& scopeName);
+    void enterScope();
     void exitScope();
     bool addSymbol(const Symbol& symbol);
-    Symbol* findSymbol(const std::string& name);
-    bool isInCurrentScope(const std::string& name);
+    Symbol* findSymbol(NameId name);
+    bool isInCurrentScope(NameId name);
     void printCurrentScope() const;
+    void currentScope(std::vector<Symbol>& out) const;    // appends the innermost scope's symbols, in order
+
+    // Appends a parameter type to a subprogram symbol that has not been added
+    // yet; all of one subprogram's parameters must be added back to back.
+    void addParameterType(Symbol& subprogram, const TypeInfo& type);
+    const TypeInfo& parameterType(const Symbol& subprogram, uint32_t index) const {
+        return paramPool[subprogram.paramBegin + index];
+    }
+
+    size_t depth() const { return scopes.size(); }
 };
 
-#endif // SYMBOL_TABLE_H
\ No newline at end of file
+#endif // SYMBOL_TABLE_H
@@ -0,0 +1,83 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned count) : current(nullptr), generation(0), active(0), stopping(false) {
+    if (count == 0) count = std::thread::hardware_concurrency();
+    workerCount = count ? count : 1;
+    for (unsigned i = 0; i < workerCount; ++i) queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    if (workerCount == 1) return;
+    for (unsigned i = 0; i < workerCount; ++i) threads.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) thread.join();
+}
+
+void ThreadPool::run(size_t count, const Task& task) {
+    if (threads.empty()) {
+        for (size_t i = 0; i < count; ++i) task(i, 0);
+        return;
+    }
+
+    for (unsigned worker = 0; worker < workerCount; ++worker) {
+        std::lock_guard<std::mutex> guard(queues[worker]->lock);
+        for (size_t i = count * worker / workerCount; i < count * (worker + 1) / workerCount; ++i) {
+            queues[worker]->tasks.push_back(i);
+        }
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    current = &task;
+    active = workerCount;
+    ++generation;
+    wake.notify_all();
+    // Every worker has to be back waiting before the queues can be refilled
+    idle.wait(guard, [this] { return active == 0; });
+    current = nullptr;
+}
+
+bool ThreadPool::next(unsigned worker, size_t& index) {
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            index = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (unsigned i = 1; i < workerCount; ++i) {
+        Queue& victim = *queues[(worker + i) % workerCount];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            index = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::work(unsigned worker) {
+    uint64_t seen = 0;
+    for (;;) {
+        const Task* task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this, seen] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            task = current;
+        }
+
+        size_t index;
+        while (next(worker, index)) (*task)(index, worker);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--active == 0) idle.notify_all();
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops. run() deals the
+// indices out to the workers in contiguous blocks; a worker walks its own
+// block forward, through the AST in source order, and once it is done
+// steals from the far end of the others', so uneven task sizes even out. A
+// pool of one thread runs everything on the caller.
+class ThreadPool {
+public:
+    typedef std::function<void(size_t index, unsigned worker)> Task;
+
+    explicit ThreadPool(unsigned count);       // 0: one per hardware thread
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return workerCount; }
+
+    // Calls task(index, worker) for every index in [0, count), worker being
+    // below size(), and returns once all calls have returned.
+    void run(size_t count, const Task& task);
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    bool next(unsigned worker, size_t& index);
+    void work(unsigned worker);
+
+    unsigned workerCount;
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    const Task* current;
+    uint64_t generation;
+    unsigned active;
+    bool stopping;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,231 @@
+#include "tree_walker.h"
+
+#include <algorithm>
+
+static const size_t MAX_CALL_DEPTH = 1u << 16;
+
+static inline int32_t wrap(uint32_t value) {
+    return static_cast<int32_t>(value);
+}
+
+TreeWalker::TreeWalker(const AstArena& ast, NodeId root, const SemanticInfo& info, size_t stackCells)
+    : ast(ast), root(root), info(info), stack(stackCells), fp(nullptr), top(0), depth(0),
+      failed(false), visits(0) {}
+
+bool TreeWalker::run() {
+    globalCells.assign(info.globalCells, Value{});
+    fp = stack.data();
+    top = 0;
+    depth = 0;
+    failed = false;
+    errorMessage.clear();
+    visits = 0;
+
+    execute(ast.child(root, 2));
+    return !failed;
+}
+
+void TreeWalker::fail(const char* message) {
+    if (!failed) errorMessage = message;
+    failed = true;
+}
+
+Value* TreeWalker::storage(const VariableInfo& variable) {
+    return (variable.storage == Storage::GLOBAL ? globalCells.data() : fp) + variable.slot;
+}
+
+Value* TreeWalker::element(NodeId access) {
+    const VariableInfo& array = info.variable(access);
+    int32_t index = evaluate(ast.child(access, 0)).i;
+    uint32_t offset = static_cast<uint32_t>(index) - static_cast<uint32_t>(array.type.arrayStart);
+    if (offset >= array.cells) {
+        fail("array index out of range");
+        return nullptr;
+    }
+    return storage(array) + offset;
+}
+
+// The callee's frame sits above everything in use; arguments are evaluated
+// straight into it before it becomes the current frame.
+Value TreeWalker::call(NodeId id, uint32_t index) {
+    const SubprogramInfo& subprogram = info.subprograms[index];
+    if (top + subprogram.frameCells > stack.size() || depth >= MAX_CALL_DEPTH) {
+        fail("stack overflow");
+        return Value{};
+    }
+
+    Value* frame = stack.data() + top;
+    std::fill(frame, frame + subprogram.frameCells, Value{});
+    top += subprogram.frameCells;
+
+    uint32_t param = subprogram.firstParam;
+    for (NodeId arg = ast.firstChild(id); arg; arg = ast.nextSibling(arg), ++param) {
+        const VariableInfo& target = info.variables[param];
+        if (target.type.baseType == DataType::ARRAY) {
+            const Value* source = storage(info.variable(arg));
+            std::copy(source, source + target.cells, frame + target.slot);
+        }
+        else {
+            frame[target.slot] = evaluate(arg);
+        }
+    }
+
+    Value* callerFp = fp;
+    fp = frame;
+    ++depth;
+    if (!failed) execute(ast.child(subprogram.node, 2));
+    --depth;
+    Value result = subprogram.isFunction ? frame[subprogram.resultSlot] : Value{};
+    fp = callerFp;
+    top -= subprogram.frameCells;
+    return result;
+}
+
+Value TreeWalker::evaluate(NodeId id) {
+    ++visits;
+    Value value{};
+    if (failed) return value;
+
+    const ASTNode& node = ast.node(id);
+    switch (node.type) {
+    case NODE_INT_NUM:
+        value.i = node.intVal;
+        break;
+    case NODE_REAL_NUM:
+        value.r = node.realVal;
+        break;
+    case NODE_BOOLEAN:
+        value.i = node.boolVal ? 1 : 0;
+        break;
+    case NODE_VARIABLE:
+        if (info.ref(id).kind == RefKind::CALL) value = call(id, info.ref(id).index);
+        else value = *storage(info.variable(id));
+        break;
+    case NODE_ARRAY_ACCESS: {
+        Value* cell = element(id);
+        if (cell) value = *cell;
+        break;
+    }
+    case NODE_FUNCTION_CALL:
+        value = call(id, info.ref(id).index);
+        break;
+    case NODE_UNARY_OP: {
+        NodeId operand = ast.child(id, 0);
+        Value a = evaluate(operand);
+        if (node.op == OP_NOT) value.i = !a.i;
+        else if (info.typeOf(operand) == DataType::REAL) value.r = -a.r;
+        else value.i = wrap(0u - static_cast<uint32_t>(a.i));
+        break;
+    }
+    case NODE_BINARY_OP: {
+        NodeId left = ast.child(id, 0);
+        NodeId right = ast.child(id, 1);
+        Value a = evaluate(left);
+        if (node.op == OP_AND) {
+            value.i = a.i ? evaluate(right).i : 0;
+            break;
+        }
+        if (node.op == OP_OR) {
+            value.i = a.i ? 1 : evaluate(right).i;
+            break;
+        }
+
+        Value b = evaluate(right);
+        if (info.typeOf(left) == DataType::REAL) {
+            switch (node.op) {
+            case OP_ADD: value.r = a.r + b.r; break;
+            case OP_SUB: value.r = a.r - b.r; break;
+            case OP_MUL: value.r = a.r * b.r; break;
+            case OP_DIVIDE: value.r = a.r / b.r; break;
+            case OP_EQ: value.i = a.r == b.r; break;
+            case OP_NEQ: value.i = a.r != b.r; break;
+            case OP_LT: value.i = a.r < b.r; break;
+            case OP_LE: value.i = a.r <= b.r; break;
+            case OP_GT: value.i = a.r > b.r; break;
+            case OP_GE: value.i = a.r >= b.r; break;
+            default: break;
+            }
+            break;
+        }
+
+        uint32_t ua = static_cast<uint32_t>(a.i);
+        uint32_t ub = static_cast<uint32_t>(b.i);
+        switch (node.op) {
+        case OP_ADD: value.i = wrap(ua + ub); break;
+        case OP_SUB: value.i = wrap(ua - ub); break;
+        case OP_MUL: value.i = wrap(ua * ub); break;
+        case OP_DIVIDE: value.r = static_cast<double>(a.i) / static_cast<double>(b.i); break;
+        case OP_DIV:
+            if (b.i == 0) fail("division by zero");
+            else if (b.i == -1) value.i = wrap(0u - ua);
+            else value.i = a.i / b.i;
+            break;
+        case OP_EQ: value.i = a.i == b.i; break;
+        case OP_NEQ: value.i = a.i != b.i; break;
+        case OP_LT: value.i = a.i < b.i; break;
+        case OP_LE: value.i = a.i <= b.i; break;
+        case OP_GT: value.i = a.i > b.i; break;
+        case OP_GE: value.i = a.i >= b.i; break;
+        default: break;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return value;
+}
+
+void TreeWalker::execute(NodeId id) {
+    ++visits;
+    if (!id || failed) return;
+
+    const ASTNode& node = ast.node(id);
+    switch (node.type) {
+    case NODE_COMPOUND_STMT:
+        for (NodeId child = ast.firstChild(id); child && !failed; child = ast.nextSibling(child)) {
+            execute(child);
+        }
+        break;
+    case NODE_ASSIGNMENT: {
+        NodeId target = ast.child(id, 0);
+        NodeId value = ast.child(id, 1);
+        if (ast.node(target).type == NODE_ARRAY_ACCESS) {
+            Value* cell = element(target);
+            Value result = evaluate(value);
+            if (cell && !failed) *cell = result;
+        }
+        else if (info.ref(target).kind == RefKind::RESULT) {
+            Value result = evaluate(value);
+            fp[info.subprogram(target).resultSlot] = result;
+        }
+        else {
+            const VariableInfo& variable = info.variable(target);
+            if (variable.type.baseType == DataType::ARRAY) {
+                const Value* source = storage(info.variable(value));
+                std::copy(source, source + variable.cells, storage(variable));
+            }
+            else {
+                Value result = evaluate(value);
+                *storage(variable) = result;
+            }
+        }
+        break;
+    }
+    case NODE_IF:
+        if (evaluate(ast.child(id, 0)).i) execute(ast.child(id, 1));
+        else execute(ast.child(id, 2));
+        break;
+    case NODE_WHILE:
+        while (!failed && evaluate(ast.child(id, 0)).i) {
+            execute(ast.child(id, 1));
+        }
+        break;
+    case NODE_PROCEDURE_CALL:
+    case NODE_FUNCTION_CALL:
+        call(id, info.ref(id).index);
+        break;
+    default:
+        break;
+    }
+}
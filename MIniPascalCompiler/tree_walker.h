@@ -0,0 +1,47 @@
+#ifndef TREE_WALKER_H
+#define TREE_WALKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ast.h"
+#include "ast_arena.h"
+#include "bytecode.h"
+#include "semantic_info.h"
+
+// Evaluates the analyzed AST directly, one recursive call per node. It is
+// the baseline the bytecode VMs are measured against, and a third opinion
+// when their results differ.
+class TreeWalker {
+public:
+    TreeWalker(const AstArena& ast, NodeId root, const SemanticInfo& info, size_t stackCells = 1u << 20);
+
+    bool run();
+
+    const std::string& error() const { return errorMessage; }
+    const Value* globals() const { return globalCells.data(); }
+    uint64_t dispatchCount() const { return visits; }  // nodes evaluated
+
+private:
+    void execute(NodeId id);
+    Value evaluate(NodeId id);
+    Value call(NodeId id, uint32_t index);
+    Value* storage(const VariableInfo& variable);
+    Value* element(NodeId access);
+    void fail(const char* message);
+
+    const AstArena& ast;
+    NodeId root;
+    const SemanticInfo& info;
+    std::vector<Value> globalCells;
+    std::vector<Value> stack;
+    Value* fp;
+    size_t top;         // first free cell of stack
+    size_t depth;
+    bool failed;
+    std::string errorMessage;
+    uint64_t visits;
+};
+
+#endif // TREE_WALKER_H
@@ -0,0 +1,191 @@
+#include "vectorization.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+class LoopMatcher {
+public:
+    LoopMatcher(const AstArena& ast, const SemanticInfo& info) : ast(ast), info(info) {}
+
+    bool match(NodeId node, VectorLoop& loop);
+
+private:
+    bool condition(NodeId node, VectorLoop& loop);
+    bool increment(NodeId node, uint32_t counter) const;
+    bool value(NodeId node, const VectorLoop& loop, uint32_t depth);
+    bool access(NodeId node, const VectorLoop& loop);
+    bool scalarVariable(NodeId node) const;
+
+    const AstArena& ast;
+    const SemanticInfo& info;
+    std::vector<std::pair<uint32_t, int64_t>> accesses;    // array and offset
+    std::vector<uint32_t> stored;                           // arrays the loop stores to
+};
+
+bool LoopMatcher::scalarVariable(NodeId node) const {
+    return ast.node(node).type == NODE_VARIABLE && info.ref(node).kind == RefKind::VARIABLE &&
+           info.variable(node).type.baseType != DataType::ARRAY;
+}
+
+// i < n, i <= n, n > i or n >= i
+bool LoopMatcher::condition(NodeId node, VectorLoop& loop) {
+    const ASTNode& n = ast.node(node);
+    if (n.type != NODE_BINARY_OP) return false;
+    NodeId left = ast.child(node, 0);
+    NodeId right = ast.child(node, 1);
+    OpKind op = n.op;
+    if (op == OP_GT || op == OP_GE) {
+        std::swap(left, right);
+        op = op == OP_GT ? OP_LT : OP_LE;
+    }
+    if (op != OP_LT && op != OP_LE) return false;
+    if (!scalarVariable(left) || info.variable(left).type.baseType != DataType::INTEGER) return false;
+    if (ast.node(right).type != NODE_INT_NUM &&
+        (!scalarVariable(right) || info.ref(right).index == info.ref(left).index))
+        return false;
+
+    loop.counter = info.ref(left).index;
+    loop.bound = right;
+    loop.inclusive = op == OP_LE;
+    return true;
+}
+
+// i := i + 1 or i := 1 + i
+bool LoopMatcher::increment(NodeId node, uint32_t counter) const {
+    if (ast.node(node).type != NODE_ASSIGNMENT) return false;
+    NodeId target = ast.child(node, 0);
+    NodeId sum = ast.child(node, 1);
+    if (!scalarVariable(target) || info.ref(target).index != counter) return false;
+    const ASTNode& n = ast.node(sum);
+    if (n.type != NODE_BINARY_OP || n.op != OP_ADD) return false;
+    NodeId left = ast.child(sum, 0);
+    NodeId right = ast.child(sum, 1);
+    if (ast.node(left).type == NODE_INT_NUM) std::swap(left, right);
+    return scalarVariable(left) && info.ref(left).index == counter && ast.node(right).type == NODE_INT_NUM &&
+           ast.node(right).intVal == 1;
+}
+
+bool LoopMatcher::access(NodeId node, const VectorLoop& loop) {
+    int64_t offset = 0;
+    if (!counterOffset(ast, info, ast.child(node, 0), loop.counter, offset)) return false;
+    accesses.push_back(std::make_pair(info.ref(node).index, offset));
+    return true;
+}
+
+bool LoopMatcher::value(NodeId node, const VectorLoop& loop, uint32_t depth) {
+    if (depth > MAX_VECTOR_DEPTH || info.typeOf(node) != loop.elementType) return false;
+    const ASTNode& n = ast.node(node);
+    switch (n.type) {
+    case NODE_INT_NUM:
+    case NODE_REAL_NUM:
+        return true;
+    case NODE_VARIABLE:
+        // The stores and the increment are the only writes in the loop
+        if (!scalarVariable(node)) return false;
+        return info.ref(node).index != loop.counter || loop.elementType == DataType::INTEGER;
+    case NODE_ARRAY_ACCESS:
+        return access(node, loop);
+    case NODE_UNARY_OP:
+        return n.op == OP_NEG && value(ast.child(node, 0), loop, depth + 1);
+    case NODE_BINARY_OP:
+        if (n.op != OP_ADD && n.op != OP_SUB && n.op != OP_MUL && (n.op != OP_DIVIDE || loop.elementType != DataType::REAL))
+            return false;
+        // A real / has integer operands only when both are integers
+        if (info.typeOf(ast.child(node, 0)) != loop.elementType) return false;
+        return value(ast.child(node, 0), loop, depth + 1) && value(ast.child(node, 1), loop, depth + 1);
+    default:
+        return false;
+    }
+}
+
+bool LoopMatcher::match(NodeId node, VectorLoop& loop) {
+    loop.loop = node;
+    loop.stores.clear();
+    accesses.clear();
+    stored.clear();
+
+    NodeId body = ast.child(node, 1);
+    if (!condition(ast.child(node, 0), loop) || ast.node(body).type != NODE_COMPOUND_STMT) return false;
+
+    NodeId last = NULL_NODE;
+    for (NodeId statement = ast.firstChild(body); statement; statement = ast.nextSibling(statement)) {
+        last = statement;
+    }
+    if (!last || !increment(last, loop.counter)) return false;
+
+    loop.elementType = DataType::UNKNOWN;
+    for (NodeId statement = ast.firstChild(body); statement != last; statement = ast.nextSibling(statement)) {
+        const ASTNode& s = ast.node(statement);
+        if (s.type == NODE_COMPOUND_STMT && !s.firstChild) continue;
+        if (s.type != NODE_ASSIGNMENT) return false;
+        NodeId target = ast.child(statement, 0);
+        if (ast.node(target).type != NODE_ARRAY_ACCESS) return false;
+        DataType type = info.variable(target).type.elementType;
+        if (type != DataType::INTEGER && type != DataType::REAL) return false;
+        if (loop.elementType == DataType::UNKNOWN) loop.elementType = type;
+        if (type != loop.elementType) return false;
+
+        if (!access(target, loop) || !value(ast.child(statement, 1), loop, 0)) return false;
+        stored.push_back(info.ref(target).index);
+        loop.stores.push_back(statement);
+    }
+    if (loop.stores.empty()) return false;
+
+    loop.lowest = INT32_MIN;
+    loop.highest = INT32_MAX;
+    for (const std::pair<uint32_t, int64_t>& indexed : accesses) {
+        for (const std::pair<uint32_t, int64_t>& other : accesses) {
+            if (other.first == indexed.first && other.second != indexed.second &&
+                std::find(stored.begin(), stored.end(), indexed.first) != stored.end())
+                return false;
+        }
+        const TypeInfo& type = info.variables[indexed.first].type;
+        loop.lowest = std::max<int64_t>(loop.lowest, type.arrayStart - indexed.second);
+        loop.highest = std::min<int64_t>(loop.highest, type.arrayEnd - indexed.second);
+    }
+    return true;
+}
+
+void collect(const AstArena& ast, NodeId node, LoopMatcher& matcher, std::vector<VectorLoop>& loops) {
+    for (NodeId child = ast.firstChild(node); child; child = ast.nextSibling(child)) {
+        collect(ast, child, matcher, loops);
+    }
+    if (ast.node(node).type != NODE_WHILE) return;
+    VectorLoop loop;
+    if (matcher.match(node, loop)) loops.push_back(loop);
+}
+
+}
+
+bool counterOffset(const AstArena& ast, const SemanticInfo& info, NodeId index, uint32_t counter, int64_t& offset) {
+    const ASTNode& n = ast.node(index);
+    NodeId base = index;
+    offset = 0;
+    if (n.type == NODE_BINARY_OP && (n.op == OP_ADD || n.op == OP_SUB)) {
+        NodeId left = ast.child(index, 0);
+        NodeId right = ast.child(index, 1);
+        if (ast.node(right).type == NODE_INT_NUM) {
+            base = left;
+            offset = n.op == OP_ADD ? ast.node(right).intVal : -static_cast<int64_t>(ast.node(right).intVal);
+        }
+        else if (n.op == OP_ADD && ast.node(left).type == NODE_INT_NUM) {
+            base = right;
+            offset = ast.node(left).intVal;
+        }
+    }
+    return ast.node(base).type == NODE_VARIABLE && info.ref(base).kind == RefKind::VARIABLE &&
+           info.ref(base).index == counter;
+}
+
+bool matchVectorLoop(const AstArena& ast, const SemanticInfo& info, NodeId node, VectorLoop& loop) {
+    LoopMatcher matcher(ast, info);
+    return matcher.match(node, loop);
+}
+
+void findVectorLoops(const AstArena& ast, NodeId root, const SemanticInfo& info, std::vector<VectorLoop>& loops) {
+    loops.clear();
+    LoopMatcher matcher(ast, info);
+    collect(ast, root, matcher, loops);
+}
@@ -0,0 +1,55 @@
+#ifndef VECTORIZATION_H
+#define VECTORIZATION_H
+
+#include <cstdint>
+#include <vector>
+#include "ast.h"
+#include "ast_arena.h"
+#include "semantic_info.h"
+
+// Finds while loops the native backends can run several elements at a time:
+//
+//     while i < n do          (or i <= n; n a literal or a variable the
+//     begin                    loop leaves alone)
+//         c[i] := a[i] + b[i - 1] * x;
+//         ...
+//         i := i + 1
+//     end
+//
+// Every statement but the last stores to an array element indexed by the
+// counter plus a literal offset, and all of them have the same element
+// type, integer or real. The values use + - * (and / for reals), unary
+// minus, literals, scalars the loop does not write, the counter itself in
+// integer loops, and array elements indexed like the stores. An array the
+// loop stores to is only ever indexed with one offset, so no iteration
+// reads what another writes.
+//
+// The backends run a vector loop over whole groups of lanes first, while
+// the counter is within [lowest, highest] and every access therefore in
+// bounds, and then the original loop for what is left; that remainder also
+// reports an out-of-range index at the element the scalar code would.
+
+const uint32_t MAX_VECTOR_DEPTH = 6;    // deeper expressions would spill vector registers
+
+struct VectorLoop {
+    NodeId loop;
+    uint32_t counter;               // the variable stepped by one
+    NodeId bound;                   // literal or variable
+    bool inclusive;                 // i <= bound rather than i < bound
+    DataType elementType;
+    std::vector<NodeId> stores;     // the body's element assignments, in order
+    int64_t lowest;                 // counter values with every access in bounds
+    int64_t highest;
+};
+
+// Whether the while loop `node` has the shape above.
+bool matchVectorLoop(const AstArena& ast, const SemanticInfo& info, NodeId node, VectorLoop& loop);
+
+// Collects every vectorizable loop of the program, in no particular order.
+void findVectorLoops(const AstArena& ast, NodeId root, const SemanticInfo& info, std::vector<VectorLoop>& loops);
+
+// The literal k when `index` is the counter, counter + k, k + counter or
+// counter - k.
+bool counterOffset(const AstArena& ast, const SemanticInfo& info, NodeId index, uint32_t counter, int64_t& offset);
+
+#endif // VECTORIZATION_H